@@ -0,0 +1,433 @@
+// device_cache.c : implementation of the persistent page cache wrapper device.
+//                  pages read from a slow non-volatile inner device (such as a
+//                  remote dump or a dump on network storage) are stored in a
+//                  local sparse cache file which survives across sessions.
+//
+// Syntax: cache://<inner-device>[,cachefile=<file>]
+//         example: cache://file://file=\\server\share\memory.dmp
+//
+// (c) Ulf Frisk, 2020-2023
+// Author: Ulf Frisk, pcileech@frizk.net
+//
+#include "leechcore.h"
+#include "leechcore_device.h"
+#include "leechcore_internal.h"
+#include "util.h"
+#ifdef _WIN32
+#include <io.h>
+#endif /* _WIN32 */
+
+#define CACHE_MAGIC                     0x4143434c      // 'LCCA'
+#define CACHE_VERSION                   1
+#define CACHE_BITMAP_OFFSET             0x1000
+#define CACHE_FLUSH_PAGES               0x4000          // flush bitmap after this many new pages
+#define CACHE_PARAMETER_FILE            "cachefile"
+
+/*
+* Header of the cache file. The page presence bitmap follows the header. Page
+* data is stored sparsely at oData + physical address. The bitmap is written
+* only after the page data it refers to has been flushed to the cache file.
+*/
+typedef struct tdDEVICE_CACHE_HEADER {
+    DWORD dwMagic;
+    DWORD dwVersion;
+    QWORD qwDeviceId;               // hash of the inner device configuration and dump file identity
+    QWORD cPage;                    // number of pages covered by bitmap
+    QWORD oBitmap;
+    QWORD oData;
+    CHAR szDevice[MAX_PATH];        // inner device (information only)
+} DEVICE_CACHE_HEADER, *PDEVICE_CACHE_HEADER;
+
+typedef struct tdDEVICE_CONTEXT_CACHE {
+    HANDLE hLC;                     // inner device
+    FILE *hFile;
+    BOOL fPassthrough;              // volatile inner device - no caching
+    BOOL fBitmapDirty;
+    QWORD cPageNew;                 // new pages since last bitmap flush
+    QWORD cbBitmap;
+    PBYTE pbBitmap;
+    DEVICE_CACHE_HEADER Hdr;
+    struct {
+        QWORD cHit;
+        QWORD cMiss;
+        QWORD cPage;                // pages present in cache
+    } Stat;
+    CHAR szFileName[MAX_PATH];
+} DEVICE_CONTEXT_CACHE, *PDEVICE_CONTEXT_CACHE;
+
+//-----------------------------------------------------------------------------
+// CACHE FILE FUNCTIONALITY BELOW:
+//-----------------------------------------------------------------------------
+
+#define CACHE_BIT_TEST(ctx, pfn)        ((ctx)->pbBitmap[(pfn) >> 3] & (1 << ((pfn) & 7)))
+#define CACHE_BIT_SET(ctx, pfn)         ((ctx)->pbBitmap[(pfn) >> 3] |= (1 << ((pfn) & 7)))
+#define CACHE_BIT_CLEAR(ctx, pfn)       ((ctx)->pbBitmap[(pfn) >> 3] &= ~(1 << ((pfn) & 7)))
+
+/*
+* Read or write at a given offset of the cache file. The file is opened for
+* both reading and writing so a seek is always required between accesses.
+* -- ctx
+* -- qwOffset
+* -- cb
+* -- pb
+* -- fWrite
+* -- return
+*/
+_Success_(return)
+BOOL DeviceCache_FileIo(_In_ PDEVICE_CONTEXT_CACHE ctx, _In_ QWORD qwOffset, _In_ DWORD cb, _Inout_updates_bytes_(cb) PBYTE pb, _In_ BOOL fWrite)
+{
+    if(_fseeki64(ctx->hFile, qwOffset, SEEK_SET)) { return FALSE; }
+    return cb == (DWORD)(fWrite ? fwrite(pb, 1, cb, ctx->hFile) : fread(pb, 1, cb, ctx->hFile));
+}
+
+/*
+* Flush the page presence bitmap to the cache file. Page data is flushed
+* before the bitmap so that a set bit always refers to valid page data.
+* -- ctx
+*/
+VOID DeviceCache_FlushBitmap(_In_ PDEVICE_CONTEXT_CACHE ctx)
+{
+    if(!ctx->fBitmapDirty) { return; }
+    fflush(ctx->hFile);
+    if(DeviceCache_FileIo(ctx, ctx->Hdr.oBitmap, (DWORD)ctx->cbBitmap, ctx->pbBitmap, TRUE)) {
+        fflush(ctx->hFile);
+        ctx->fBitmapDirty = FALSE;
+        ctx->cPageNew = 0;
+    }
+}
+
+/*
+* Retrieve the dump file name of a local file inner device - i.e. 'file=' of
+* 'file://file=<file>[,...]', 'file://<file>' or a plain file name.
+* -- szDevice
+* -- szFileName
+* -- return
+*/
+_Success_(return)
+BOOL DeviceCache_DeviceFileName(_In_ LPSTR szDevice, _Out_writes_(MAX_PATH) LPSTR szFileName)
+{
+    LPSTR sz;
+    DWORD i;
+    szFileName[0] = 0;
+    if(0 == _strnicmp("file://", szDevice, 7)) {
+        szDevice += 7;
+        for(sz = szDevice; sz; sz = strchr(sz, ',') ? strchr(sz, ',') + 1 : NULL) {
+            if(0 == _strnicmp("file=", sz, 5)) {
+                szDevice = sz + 5;
+                break;
+            }
+        }
+        for(i = 0; (i < MAX_PATH - 1) && szDevice[i] && (szDevice[i] != ','); i++) {
+            szFileName[i] = szDevice[i];
+        }
+        szFileName[i] = 0;
+    } else if(!strstr(szDevice, "://")) {
+        strncpy_s(szFileName, MAX_PATH, szDevice, _TRUNCATE);
+    }
+    return szFileName[0] ? TRUE : FALSE;
+}
+
+/*
+* Calculate an identifier of the inner device configuration (FNV-1a) used to
+* verify that an existing cache file belongs to the inner device. The size
+* and modification time of a local inner dump file are included so that a
+* dump file replaced under the same name doesn't reuse a stale cache file.
+* -- szRemote
+* -- szDevice
+* -- return
+*/
+QWORD DeviceCache_DeviceId(_In_ LPSTR szRemote, _In_ LPSTR szDevice)
+{
+    QWORD i, qwHash = 0xcbf29ce484222325, qwFileId[2];
+    CHAR szFileName[MAX_PATH];
+    struct _stat64 st;
+    LPSTR sz;
+    for(sz = szRemote; *sz; sz++) {
+        qwHash = (qwHash ^ (BYTE)*sz) * 0x100000001b3;
+    }
+    qwHash = (qwHash ^ '|') * 0x100000001b3;
+    for(sz = szDevice; *sz; sz++) {
+        qwHash = (qwHash ^ (BYTE)*sz) * 0x100000001b3;
+    }
+    if(!szRemote[0] && DeviceCache_DeviceFileName(szDevice, szFileName) && !_stat64(szFileName, &st)) {
+        qwFileId[0] = (QWORD)st.st_size;
+        qwFileId[1] = (QWORD)st.st_mtime;
+        for(i = 0; i < sizeof(qwFileId); i++) {
+            qwHash = (qwHash ^ ((PBYTE)qwFileId)[i]) * 0x100000001b3;
+        }
+    }
+    return qwHash;
+}
+
+/*
+* Open an existing cache file belonging to the inner device, or create a new
+* cache file if it does not exist or does not match the inner device.
+* -- ctxLC
+* -- ctx
+* -- return
+*/
+_Success_(return)
+BOOL DeviceCache_FileOpen(_In_ PLC_CONTEXT ctxLC, _In_ PDEVICE_CONTEXT_CACHE ctx)
+{
+    QWORD pfn;
+    DEVICE_CACHE_HEADER Hdr = { 0 };
+#ifdef _WIN32
+    DWORD cbRet;
+#endif /* _WIN32 */
+    ctx->cbBitmap = ((ctx->Hdr.cPage + 7) / 8 + 0xfff) & ~0xfff;
+    ctx->Hdr.oBitmap = CACHE_BITMAP_OFFSET;
+    ctx->Hdr.oData = CACHE_BITMAP_OFFSET + ctx->cbBitmap;
+    if(!(ctx->pbBitmap = LocalAlloc(LMEM_ZEROINIT, ctx->cbBitmap))) { return FALSE; }
+    // 1: try open existing cache file:
+    if(!fopen_s(&ctx->hFile, ctx->szFileName, "r+b") && ctx->hFile) {
+        if(DeviceCache_FileIo(ctx, 0, sizeof(DEVICE_CACHE_HEADER), (PBYTE)&Hdr, FALSE) &&
+            (Hdr.dwMagic == CACHE_MAGIC) && (Hdr.dwVersion == CACHE_VERSION) &&
+            (Hdr.qwDeviceId == ctx->Hdr.qwDeviceId) && (Hdr.cPage == ctx->Hdr.cPage) &&
+            (Hdr.oBitmap == ctx->Hdr.oBitmap) && (Hdr.oData == ctx->Hdr.oData) &&
+            DeviceCache_FileIo(ctx, ctx->Hdr.oBitmap, (DWORD)ctx->cbBitmap, ctx->pbBitmap, FALSE))
+        {
+            for(pfn = 0; pfn < ctx->Hdr.cPage; pfn++) {
+                if(CACHE_BIT_TEST(ctx, pfn)) { ctx->Stat.cPage++; }
+            }
+            lcprintfv(ctxLC, "DEVICE: CACHE: Opened cache file '%s' (%lli cached pages).\n", ctx->szFileName, ctx->Stat.cPage);
+            return TRUE;
+        }
+        lcprintf(ctxLC, "DEVICE: CACHE: WARNING: cache file '%s' does not match device - reinitializing.\n", ctx->szFileName);
+        fclose(ctx->hFile);
+        ctx->hFile = NULL;
+        ZeroMemory(ctx->pbBitmap, ctx->cbBitmap);
+    }
+    // 2: create new cache file:
+    if(fopen_s(&ctx->hFile, ctx->szFileName, "w+b") || !ctx->hFile) {
+        lcprintf(ctxLC, "DEVICE: CACHE: FAIL: unable to create cache file '%s'.\n", ctx->szFileName);
+        return FALSE;
+    }
+#ifdef _WIN32
+    DeviceIoControl((HANDLE)_get_osfhandle(_fileno(ctx->hFile)), FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &cbRet, NULL);
+#endif /* _WIN32 */
+    if(!DeviceCache_FileIo(ctx, 0, sizeof(DEVICE_CACHE_HEADER), (PBYTE)&ctx->Hdr, TRUE) ||
+        !DeviceCache_FileIo(ctx, ctx->Hdr.oBitmap, (DWORD)ctx->cbBitmap, ctx->pbBitmap, TRUE))
+    {
+        lcprintf(ctxLC, "DEVICE: CACHE: FAIL: unable to write cache file '%s'.\n", ctx->szFileName);
+        return FALSE;
+    }
+    fflush(ctx->hFile);
+    lcprintfv(ctxLC, "DEVICE: CACHE: Created cache file '%s'.\n", ctx->szFileName);
+    return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// GENERAL FUNCTIONALITY BELOW:
+//-----------------------------------------------------------------------------
+
+/*
+* Read from the cache. Pages present in the cache file are served from it, all
+* other reads are forwarded to the inner device in one scatter read. Missing
+* pages are fetched in full from the inner device and added to the cache.
+* -- ctxLC
+* -- cpMEMs
+* -- ppMEMs
+*/
+VOID DeviceCache_ReadScatter(_In_ PLC_CONTEXT ctxLC, _In_ DWORD cpMEMs, _Inout_ PPMEM_SCATTER ppMEMs)
+{
+    PDEVICE_CONTEXT_CACHE ctx = (PDEVICE_CONTEXT_CACHE)ctxLC->hDevice;
+    DWORD i, iInner, cInner = 0, cPartial = 0, iPartial = 0;
+    QWORD pfn;
+    PMEM_SCATTER pMEM, pMEMInner;
+    PPMEM_SCATTER ppMEMsInner = NULL, ppMEMsPartial = NULL;
+    PDWORD piInner;
+    if(ctx->fPassthrough) {
+        LcReadScatter(ctx->hLC, cpMEMs, ppMEMs);
+        return;
+    }
+    if(!(ppMEMsInner = LocalAlloc(0, cpMEMs * (sizeof(PMEM_SCATTER) + sizeof(DWORD))))) { return; }
+    piInner = (PDWORD)(ppMEMsInner + cpMEMs);
+    // 1: serve hits from cache file and collect misses:
+    for(i = 0; i < cpMEMs; i++) {
+        pMEM = ppMEMs[i];
+        if(pMEM->f || MEM_SCATTER_ADDR_ISINVALID(pMEM)) { continue; }
+        pfn = pMEM->qwA >> 12;
+        if(((pMEM->qwA & 0xfff) + pMEM->cb > 0x1000) || (pfn >= ctx->Hdr.cPage)) {
+            // not cacheable - forward as-is to inner device
+            piInner[cInner] = (DWORD)-1;
+            ppMEMsInner[cInner++] = pMEM;
+            continue;
+        }
+        if(CACHE_BIT_TEST(ctx, pfn) && DeviceCache_FileIo(ctx, ctx->Hdr.oData + pMEM->qwA, pMEM->cb, pMEM->pb, FALSE)) {
+            pMEM->f = TRUE;
+            ctx->Stat.cHit++;
+            continue;
+        }
+        ctx->Stat.cMiss++;
+        if(pMEM->cb != 0x1000) { cPartial++; }
+        piInner[cInner] = i;
+        ppMEMsInner[cInner++] = pMEM;
+    }
+    if(!cInner) { goto finish; }
+    // 2: partial page misses are fetched as full pages into temporary MEMs:
+    if(cPartial) {
+        if(!LcAllocScatter1(cPartial, &ppMEMsPartial)) { goto finish; }
+        for(iInner = 0; iInner < cInner; iInner++) {
+            if((piInner[iInner] != (DWORD)-1) && (ppMEMsInner[iInner]->cb != 0x1000)) {
+                pMEMInner = ppMEMsPartial[iPartial++];
+                pMEMInner->qwA = ppMEMsInner[iInner]->qwA & ~0xfff;
+                ppMEMsInner[iInner] = pMEMInner;
+            }
+        }
+    }
+    // 3: read from inner device and add fetched pages to cache:
+    LcReadScatter(ctx->hLC, cInner, ppMEMsInner);
+    for(iInner = 0; iInner < cInner; iInner++) {
+        if(piInner[iInner] == (DWORD)-1) { continue; }
+        pMEMInner = ppMEMsInner[iInner];
+        if(!pMEMInner->f) { continue; }
+        pfn = pMEMInner->qwA >> 12;
+        if(!CACHE_BIT_TEST(ctx, pfn) && DeviceCache_FileIo(ctx, ctx->Hdr.oData + (pfn << 12), 0x1000, pMEMInner->pb, TRUE)) {
+            CACHE_BIT_SET(ctx, pfn);
+            ctx->fBitmapDirty = TRUE;
+            ctx->cPageNew++;
+            ctx->Stat.cPage++;
+        }
+        pMEM = ppMEMs[piInner[iInner]];
+        if(pMEM != pMEMInner) {
+            memcpy(pMEM->pb, pMEMInner->pb + (pMEM->qwA & 0xfff), pMEM->cb);
+            pMEM->f = TRUE;
+        }
+    }
+    if(ctx->cPageNew >= CACHE_FLUSH_PAGES) {
+        DeviceCache_FlushBitmap(ctx);
+    }
+finish:
+    LcMemFree(ppMEMsPartial);
+    LocalFree(ppMEMsInner);
+}
+
+/*
+* Write to the inner device. Cached pages touched by the write are removed
+* from the cache since their contents may have changed.
+* -- ctxLC
+* -- cpMEMs
+* -- ppMEMs
+*/
+VOID DeviceCache_WriteScatter(_In_ PLC_CONTEXT ctxLC, _In_ DWORD cpMEMs, _Inout_ PPMEM_SCATTER ppMEMs)
+{
+    PDEVICE_CONTEXT_CACHE ctx = (PDEVICE_CONTEXT_CACHE)ctxLC->hDevice;
+    DWORD i;
+    QWORD pfn, pfnLast;
+    PMEM_SCATTER pMEM;
+    LcWriteScatter(ctx->hLC, cpMEMs, ppMEMs);
+    if(ctx->fPassthrough) { return; }
+    for(i = 0; i < cpMEMs; i++) {
+        pMEM = ppMEMs[i];
+        if(MEM_SCATTER_ADDR_ISINVALID(pMEM) || !pMEM->cb) { continue; }
+        pfnLast = min((pMEM->qwA + pMEM->cb - 1) >> 12, ctx->Hdr.cPage - 1);
+        for(pfn = pMEM->qwA >> 12; pfn <= pfnLast; pfn++) {
+            if(CACHE_BIT_TEST(ctx, pfn)) {
+                CACHE_BIT_CLEAR(ctx, pfn);
+                ctx->fBitmapDirty = TRUE;
+                ctx->Stat.cPage--;
+            }
+        }
+    }
+    DeviceCache_FlushBitmap(ctx);
+}
+
+_Success_(return)
+BOOL DeviceCache_GetOption(_In_ PLC_CONTEXT ctxLC, _In_ QWORD fOption, _Out_ PQWORD pqwValue)
+{
+    PDEVICE_CONTEXT_CACHE ctx = (PDEVICE_CONTEXT_CACHE)ctxLC->hDevice;
+    switch(fOption) {
+        case LC_OPT_CACHE_STATISTICS_HIT:
+            *pqwValue = ctx->Stat.cHit;
+            return TRUE;
+        case LC_OPT_CACHE_STATISTICS_MISS:
+            *pqwValue = ctx->Stat.cMiss;
+            return TRUE;
+        case LC_OPT_CACHE_STATISTICS_PAGES:
+            *pqwValue = ctx->Stat.cPage;
+            return TRUE;
+    }
+    return LcGetOption(ctx->hLC, fOption, pqwValue);
+}
+
+_Success_(return)
+BOOL DeviceCache_SetOption(_In_ PLC_CONTEXT ctxLC, _In_ QWORD fOption, _In_ QWORD qwValue)
+{
+    PDEVICE_CONTEXT_CACHE ctx = (PDEVICE_CONTEXT_CACHE)ctxLC->hDevice;
+    return LcSetOption(ctx->hLC, fOption, qwValue);
+}
+
+_Success_(return)
+BOOL DeviceCache_Command(_In_ PLC_CONTEXT ctxLC, _In_ QWORD fOption, _In_ DWORD cbDataIn, _In_reads_opt_(cbDataIn) PBYTE pbDataIn, _Out_opt_ PBYTE *ppbDataOut, _Out_opt_ PDWORD pcbDataOut)
+{
+    PDEVICE_CONTEXT_CACHE ctx = (PDEVICE_CONTEXT_CACHE)ctxLC->hDevice;
+    return LcCommand(ctx->hLC, fOption, cbDataIn, pbDataIn, ppbDataOut, pcbDataOut);
+}
+
+VOID DeviceCache_Close(_Inout_ PLC_CONTEXT ctxLC)
+{
+    PDEVICE_CONTEXT_CACHE ctx = (PDEVICE_CONTEXT_CACHE)ctxLC->hDevice;
+    if(ctx) {
+        ctxLC->hDevice = 0;
+        if(ctx->hFile) {
+            DeviceCache_FlushBitmap(ctx);
+            fclose(ctx->hFile);
+        }
+        if(ctx->Stat.cHit || ctx->Stat.cMiss) {
+            lcprintfv(ctxLC, "DEVICE: CACHE: hits: %lli misses: %lli (hit ratio: %lli%%) cached pages: %lli\n",
+                ctx->Stat.cHit, ctx->Stat.cMiss, (ctx->Stat.cHit * 100) / (ctx->Stat.cHit + ctx->Stat.cMiss), ctx->Stat.cPage);
+        }
+        LcClose(ctx->hLC);
+        LocalFree(ctx->pbBitmap);
+        LocalFree(ctx);
+    }
+}
+
+_Success_(return)
+BOOL DeviceCache_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO ppLcCreateErrorInfo)
+{
+    PDEVICE_CONTEXT_CACHE ctx;
+    PLC_DEVICE_PARAMETER_ENTRY pParam;
+    LC_CONFIG LcConfig;
+    LPSTR szParameters[] = { CACHE_PARAMETER_FILE };
+    QWORD qwVolatile = 0, qwReadOnly = 1, paMax = 0;
+    if(ppLcCreateErrorInfo) { *ppLcCreateErrorInfo = NULL; }
+    if(!(ctx = (PDEVICE_CONTEXT_CACHE)LocalAlloc(LMEM_ZEROINIT, sizeof(DEVICE_CONTEXT_CACHE)))) { return FALSE; }
+    ctxLC->hDevice = (HANDLE)ctx;
+    // 1: open inner device (memory map is mirrored from inner device):
+    if(!(ctx->hLC = LcCreate_WrapperInnerDevice(ctxLC, _countof(szParameters), szParameters, &LcConfig, ppLcCreateErrorInfo))) {
+        goto fail;
+    }
+    LcGetOption(ctx->hLC, LC_OPT_CORE_VOLATILE, &qwVolatile);
+    LcGetOption(ctx->hLC, LC_OPT_CORE_READONLY, &qwReadOnly);
+    LcGetOption(ctx->hLC, LC_OPT_CORE_ADDR_MAX, &paMax);
+    // 2: open cache file (volatile devices are not cached):
+    if(qwVolatile) {
+        ctx->fPassthrough = TRUE;
+        lcprintf(ctxLC, "DEVICE: CACHE: WARNING: inner device '%s' is volatile - caching disabled.\n", LcConfig.szDevice);
+    } else {
+        ctx->Hdr.dwMagic = CACHE_MAGIC;
+        ctx->Hdr.dwVersion = CACHE_VERSION;
+        ctx->Hdr.qwDeviceId = DeviceCache_DeviceId(LcConfig.szRemote, LcConfig.szDevice);
+        ctx->Hdr.cPage = (paMax + 0xfff) >> 12;
+        strncpy_s(ctx->Hdr.szDevice, _countof(ctx->Hdr.szDevice), LcConfig.szDevice, _TRUNCATE);
+        if((pParam = LcDeviceParameterGet(ctxLC, CACHE_PARAMETER_FILE)) && pParam->szValue[0]) {
+            strncpy_s(ctx->szFileName, _countof(ctx->szFileName), pParam->szValue, _TRUNCATE);
+        } else {
+            _snprintf_s(ctx->szFileName, _countof(ctx->szFileName), _TRUNCATE, "leechcore_%016llx.lccache", ctx->Hdr.qwDeviceId);
+        }
+        if(!ctx->Hdr.cPage || !DeviceCache_FileOpen(ctxLC, ctx)) { goto fail; }
+    }
+    // 3: set callback functions and fix up config:
+    ctxLC->Config.fVolatile = qwVolatile ? TRUE : FALSE;
+    ctxLC->pfnClose = DeviceCache_Close;
+    ctxLC->pfnReadScatter = DeviceCache_ReadScatter;
+    ctxLC->pfnWriteScatter = qwReadOnly ? NULL : DeviceCache_WriteScatter;
+    ctxLC->pfnGetOption = DeviceCache_GetOption;
+    ctxLC->pfnSetOption = DeviceCache_SetOption;
+    ctxLC->pfnCommand = DeviceCache_Command;
+    return TRUE;
+fail:
+    DeviceCache_Close(ctxLC);
+    return FALSE;
+}
@@ -60,77 +60,6 @@ typedef struct tdDUMP_HEADER_BITMAP_FULL64 {
 #define CDMP_QWORD(o)                               (*(PQWORD)(ctx->CrashOrCoreDump.pbHdr + o))
 #define VMM_PTR_OFFSET_DUAL(f32, pb, o32, o64)      ((f32) ? *(PDWORD)((o32) + (PBYTE)(pb)) : *(PQWORD)((o64) + (PBYTE)(pb)))
 
-//-----------------------------------------------------------------------------
-// DEFINES: ELF HEADER DEFINES BELOW (USED FOR VIRTUALBOX .core DUMP FILES)
-//-----------------------------------------------------------------------------
-
-#define ELF_EI_MAGIC            0x464c457f
-#define ELF_EI_CLASSDATA_32     0x0101
-#define ELF_EI_CLASSDATA_64     0x0102
-#define ELF_ET_CORE             0x04
-#define ELF_ET_VERSION          0x01
-#define ELF_PHDR_OFFSET_32      0x34
-#define ELF_PHDR_OFFSET_64      0x40
-#define ELF_PT_LOAD             0x00000001
-
-typedef struct tdElf32_Phdr {
-    DWORD p_type;
-    DWORD p_offset;
-    DWORD p_vaddr;
-    DWORD p_paddr;
-    DWORD p_filesz;
-    DWORD p_memsz;
-    DWORD p_flags;
-    DWORD p_align;
-} Elf32_Phdr, *PElf32_Phdr;
-
-typedef struct tdElf64_Phdr {
-    DWORD p_type;
-    DWORD p_flags;
-    QWORD p_offset;
-    QWORD p_vaddr;
-    QWORD p_paddr;
-    QWORD p_filesz;
-    QWORD p_memsz;
-    QWORD p_align;
-} Elf64_Phdr, *PElf64_Phdr;
-
-typedef struct tdElf32_Ehdr {
-    unsigned char e_ident[16];
-    WORD e_type;
-    WORD e_machine;
-    DWORD e_version;
-    DWORD e_entry;
-    DWORD e_phoff;
-    DWORD e_shoff;
-    DWORD e_flags;
-    WORD e_ehsize;
-    WORD e_phentsize;
-    WORD e_phnum;
-    WORD e_shentsize;
-    WORD e_shnum;
-    WORD e_shstrndx;
-    Elf32_Phdr Phdr[];
-} Elf32_Ehdr, *PElf32_Ehdr;
-
-typedef struct tdElf64_Ehdr {
-    unsigned char e_ident[16];
-    WORD e_type;
-    WORD e_machine;
-    DWORD e_version;
-    QWORD e_entry;
-    QWORD e_phoff;
-    QWORD e_shoff;
-    DWORD e_flags;
-    WORD e_ehsize;
-    WORD e_phentsize;
-    WORD e_phnum;
-    WORD e_shentsize;
-    WORD e_shnum;
-    WORD e_shstrndx;
-    Elf64_Phdr Phdr[];
-} Elf64_Ehdr, *PElf64_Ehdr;
-
 //-----------------------------------------------------------------------------
 // DEFINES: LiME DUMP DEFINES
 //-----------------------------------------------------------------------------
@@ -146,12 +75,313 @@ typedef struct tdLIME_MEM_RANGE_HEADER {
     unsigned char reserved[8];
 } LIME_MEM_RANGE_HEADER, *PLIME_MEM_RANGE_HEADER;
 
+//-----------------------------------------------------------------------------
+// DEFINES: KDUMP COMPRESSED (DISKDUMP) DEFINES
+// (makedumpfile -c/-l/-p/-z and QEMU dump-guest-memory -z/-l/-s)
+//-----------------------------------------------------------------------------
+
+#define KDUMP_SIGNATURE                     "KDUMP   "
+#define KDUMP_SIGNATURE_DISKDUMP            "DISKDUMP"
+#define KDUMP_DH_COMPRESSED_ZLIB            0x01
+#define KDUMP_DH_COMPRESSED_LZO             0x02
+#define KDUMP_DH_COMPRESSED_SNAPPY          0x04
+#define KDUMP_DH_COMPRESSED_INCOMPLETE      0x08
+#define KDUMP_DH_COMPRESSED_ZSTD            0x20
+#define KDUMP_PAGE_CACHE_SIZE               0x00800000  // 8MB decompressed page cache
+
+typedef struct tdKDUMP_DISK_DUMP_HEADER64 {
+    CHAR signature[8];          // + 0x000
+    DWORD header_version;       // + 0x008
+    CHAR utsname_sysname[65];   // + 0x00c
+    CHAR utsname_nodename[65];  // + 0x04d
+    CHAR utsname_release[65];   // + 0x08e
+    CHAR utsname_version[65];   // + 0x0cf
+    CHAR utsname_machine[65];   // + 0x110
+    CHAR utsname_domainname[65];// + 0x151
+    BYTE _Filler[6];            // + 0x192
+    QWORD timestamp_sec;        // + 0x198
+    QWORD timestamp_usec;       // + 0x1a0
+    DWORD status;               // + 0x1a8
+    DWORD block_size;           // + 0x1ac
+    DWORD sub_hdr_size;         // + 0x1b0
+    DWORD bitmap_blocks;        // + 0x1b4
+    DWORD max_mapnr;            // + 0x1b8
+    DWORD total_ram_blocks;     // + 0x1bc
+    DWORD device_blocks;        // + 0x1c0
+    DWORD written_blocks;       // + 0x1c4
+    DWORD current_cpu;          // + 0x1c8
+    DWORD nr_cpus;              // + 0x1cc
+} KDUMP_DISK_DUMP_HEADER64, *PKDUMP_DISK_DUMP_HEADER64;
+
+typedef struct tdKDUMP_SUB_HEADER64 {
+    QWORD phys_base;            // + 0x00
+    DWORD dump_level;           // + 0x08
+    DWORD split;                // + 0x0c
+    QWORD start_pfn;            // + 0x10
+    QWORD end_pfn;              // + 0x18
+    QWORD offset_vmcoreinfo;    // + 0x20 (header_version >= 3)
+    QWORD size_vmcoreinfo;      // + 0x28
+    QWORD offset_note;          // + 0x30 (header_version >= 4)
+    QWORD size_note;            // + 0x38
+    QWORD offset_eraseinfo;     // + 0x40 (header_version >= 5)
+    QWORD size_eraseinfo;       // + 0x48
+    QWORD start_pfn_64;         // + 0x50 (header_version >= 6)
+    QWORD end_pfn_64;           // + 0x58
+    QWORD max_mapnr_64;         // + 0x60
+} KDUMP_SUB_HEADER64, *PKDUMP_SUB_HEADER64;
+
+typedef struct tdKDUMP_PAGE_DESC {
+    QWORD offset;               // + 0x00 file offset of page data
+    DWORD size;                 // + 0x08 size of (compressed) page data
+    DWORD flags;                // + 0x0c KDUMP_DH_COMPRESSED_*
+    QWORD page_flags;           // + 0x10
+} KDUMP_PAGE_DESC, *PKDUMP_PAGE_DESC;
+
+typedef int(*PFN_KDUMP_ZLIB_UNCOMPRESS)(PBYTE dest, unsigned long *destLen, const BYTE *source, unsigned long sourceLen);
+typedef int(*PFN_KDUMP_LZO1X_DECOMPRESS_SAFE)(const BYTE *src, SIZE_T src_len, PBYTE dst, SIZE_T *dst_len, PVOID wrkmem);
+typedef int(*PFN_KDUMP_SNAPPY_UNCOMPRESS)(const CHAR *compressed, SIZE_T compressed_length, CHAR *uncompressed, SIZE_T *uncompressed_length);
+typedef SIZE_T(*PFN_KDUMP_ZSTD_DECOMPRESS)(PVOID dst, SIZE_T dstCapacity, const VOID *src, SIZE_T compressedSize);
+
+#ifdef _WIN32
+#define KDUMP_LIBRARY_ZLIB                  "zlib1.dll"
+#define KDUMP_LIBRARY_LZO                   "lzo2.dll"
+#define KDUMP_LIBRARY_SNAPPY                "snappy.dll"
+#define KDUMP_LIBRARY_ZSTD                  "libzstd.dll"
+#endif /* _WIN32 */
+#ifdef LINUX
+#define KDUMP_LIBRARY_ZLIB                  "libz.so.1"
+#define KDUMP_LIBRARY_LZO                   "liblzo2.so.2"
+#define KDUMP_LIBRARY_SNAPPY                "libsnappy.so.1"
+#define KDUMP_LIBRARY_ZSTD                  "libzstd.so.1"
+#endif /* LINUX */
+
+typedef struct tdKDUMP_PAGE_CACHE_ENTRY {
+    QWORD iDesc;                // page descriptor index + 1 (0 = empty entry)
+    BYTE pb[0];                 // decompressed page (cbBlock bytes)
+} KDUMP_PAGE_CACHE_ENTRY, *PKDUMP_PAGE_CACHE_ENTRY;
+
+//-----------------------------------------------------------------------------
+// DEFINES: WINDOWS HIBERNATION FILE (HIBERFIL.SYS) DEFINES
+// (Windows XP - Windows 7 hibernation files with Xpress compressed pages and
+//  Windows 8 - Windows 11 hibernation files with compression sets)
+//-----------------------------------------------------------------------------
+
+#define HIBR_SIGNATURE_HIBR_LOWER           0x72626968      // 'hibr'
+#define HIBR_SIGNATURE_HIBR                 0x52424948      // 'HIBR'
+#define HIBR_SIGNATURE_WAKE_LOWER           0x656b6177      // 'wake'
+#define HIBR_SIGNATURE_WAKE                 0x454b4157      // 'WAKE'
+#define HIBR_SIGNATURE_RSTR                 0x52545352      // 'RSTR'
+#define HIBR_XPRESS_SIGNATURE               "\x81\x81xpress"
+#define HIBR_XPRESS_HEADER_SIZE             0x20
+#define HIBR_TABLE_SCAN_PAGES               0x100           // first restore table must be within the first 1MB
+#define HIBR_TABLE_MAX                      0x01000000
+#define HIBR_BLOCK_CACHE_SIZE               0x02000000      // 32MB decompressed block cache
+#define HIBR_SET_DESCRIPTORS_MAX            0x10            // max page descriptors in a compression set
+#define HIBR_SET_HUFFMAN                    0x80000000      // compression set flag: xpress huffman compressed
+#define HIBR_HUFFMAN_CHUNK                  0x00010000      // xpress huffman: output bytes per huffman table
+#define HIBR_HUFFMAN_TABLE_BITS             15
+
+/*
+* Layout of the restore table page (PO_MEMORY_RANGE_ARRAY) which differs
+* between Windows versions and bitness.
+*/
+typedef struct tdHIBR_TABLE_LAYOUT {
+    LPSTR szName;
+    BOOL f32;                   // 32-bit page number fields
+    LC_ARCH_TP tpArch;
+    DWORD cbLink;               // sizeof(PO_MEMORY_RANGE_ARRAY_LINK)
+    DWORD oNextTable;
+    DWORD oEntryCount;
+    DWORD cbRange;              // sizeof(PO_MEMORY_RANGE_ARRAY_RANGE)
+    DWORD oStartPage;
+    DWORD oEndPage;
+} HIBR_TABLE_LAYOUT, *PHIBR_TABLE_LAYOUT;
+
+static const HIBR_TABLE_LAYOUT HIBR_TABLE_LAYOUTS[] = {
+    { "Windows 7 x64",        FALSE, LC_ARCH_X64, 0x10, 0x00, 0x08, 0x10, 0x00, 0x08 },
+    { "Windows XP/Vista x64", FALSE, LC_ARCH_X64, 0x20, 0x08, 0x14, 0x20, 0x08, 0x10 },
+    { "Windows 7 x86",        TRUE,  LC_ARCH_NA,  0x08, 0x00, 0x04, 0x08, 0x00, 0x04 },
+    { "Windows XP/Vista x86", TRUE,  LC_ARCH_NA,  0x10, 0x04, 0x0c, 0x10, 0x04, 0x08 },
+};
+
+/*
+* Location of the restore set fields in the PO_MEMORY_IMAGE header of Windows 8
+* and later hibernation files. The fields move between Windows versions.
+*/
+typedef struct tdHIBR_SET_LAYOUT {
+    LPSTR szName;
+    DWORD oNumPagesForLoader;
+    DWORD oFirstBootRestorePage;
+    DWORD oFirstKernelRestorePage;
+    DWORD oKernelPagesProcessed;
+} HIBR_SET_LAYOUT, *PHIBR_SET_LAYOUT;
+
+static const HIBR_SET_LAYOUT HIBR_SET_LAYOUTS[] = {
+    { "Windows 10 1703 - Windows 11 x64", 0x58, 0x68, 0x70, 0x230 },
+    { "Windows 10 1607 x64",              0x58, 0x68, 0x70, 0x220 },
+    { "Windows 10 1507 - 1511 x64",       0x58, 0x68, 0x70, 0x218 },
+    { "Windows 8 - 8.1 x64",              0x58, 0x60, 0x68, 0x1c8 },
+};
+
+typedef struct tdHIBR_RANGE {
+    QWORD pfn;
+    QWORD cPage;
+    QWORD iPage;                // page stream index of the first page in range
+} HIBR_RANGE, *PHIBR_RANGE;
+
+typedef struct tdHIBR_BLOCK {
+    QWORD o;                    // file offset of (compressed) block data
+    QWORD iPage;                // page stream index of the first page in block
+    DWORD cb;                   // size of (compressed) block data
+    WORD cPage;
+    WORD fHuffman;              // xpress huffman (otherwise plain xpress) compressed
+} HIBR_BLOCK, *PHIBR_BLOCK;
+
+typedef struct tdHIBR_BLOCK_CACHE_ENTRY {
+    QWORD iBlock;               // block index + 1 (0 = empty entry)
+    BYTE pb[0];                 // decompressed block
+} HIBR_BLOCK_CACHE_ENTRY, *PHIBR_BLOCK_CACHE_ENTRY;
+
+//-----------------------------------------------------------------------------
+// DEFINES: QEMU MIGRATION STREAM DEFINES
+// (savevm / 'migrate exec:cat > file' streams and the mapped-ram file format)
+//-----------------------------------------------------------------------------
+
+#define QEMU_VM_FILE_MAGIC                  0x5145564d      // 'QEVM' (big-endian)
+#define QEMU_VM_FILE_VERSION_COMPAT         0x00000002
+#define QEMU_VM_FILE_VERSION                0x00000003
+#define QEMU_VM_EOF                         0x00
+#define QEMU_VM_SECTION_START               0x01
+#define QEMU_VM_SECTION_PART                0x02
+#define QEMU_VM_SECTION_END                 0x03
+#define QEMU_VM_SECTION_FULL                0x04
+#define QEMU_VM_SUBSECTION                  0x05
+#define QEMU_VM_CONFIGURATION               0x07
+#define QEMU_VM_COMMAND                     0x08
+#define QEMU_VM_SECTION_FOOTER              0x7e
+#define QEMU_RAM_FLAG_ZERO                  0x0002
+#define QEMU_RAM_FLAG_MEM_SIZE              0x0004
+#define QEMU_RAM_FLAG_PAGE                  0x0008
+#define QEMU_RAM_FLAG_EOS                   0x0010
+#define QEMU_RAM_FLAG_CONTINUE              0x0020
+#define QEMU_RAM_FLAG_XBZRLE                0x0040
+#define QEMU_RAM_FLAG_HOOK                  0x0080
+#define QEMU_RAM_FLAG_COMPRESS_PAGE         0x0100
+#define QEMU_RAM_FLAG_MULTIFD_FLUSH         0x0200
+#define QEMU_XBZRLE_ENCODING                0x01
+#define QEMU_MAPPED_RAM_VERSION             1
+#define QEMU_MAPPED_RAM_HEADER_SIZE         28
+#define QEMU_RAMBLOCKS_MAX                  0x40
+#define QEMU_REGIONS_MAX                    2
+#define QEMU_READER_BUFFER                  0x00400000      // stream reader buffer: 4MB
+#define QEMU_PAGE_ZERO                      0x8000000000000000  // page entry: zero page (low byte = fill byte)
+#define QEMU_PAGE_XBZRLE                    0x4000000000000000  // page entry: xbzrle record index
+#define QEMU_PAGE_MASK                      0x3fffffffffffffff
+#define QEMU_X86_LOWMEM_PC                  0xc0000000      // i440fx: ram below 4GB if ram >= 0xe0000000
+#define QEMU_X86_LOWMEM_Q35                 0x80000000      // q35: ram below 4GB if ram >= 0xb0000000
+#define QEMU_ARM64_VIRT_RAM_BASE            0x40000000
+
+typedef struct tdQEMU_RAMBLOCK {
+    CHAR szName[0x100];
+    QWORD cb;                   // used length
+    QWORD cPage;
+    PQWORD pqwPage;             // per page: file offset, QEMU_PAGE_ZERO or QEMU_PAGE_XBZRLE entry (0 = not present)
+} QEMU_RAMBLOCK, *PQEMU_RAMBLOCK;
+
+typedef struct tdQEMU_REGION {
+    QWORD pa;
+    QWORD cb;
+    QWORD oBlock;               // offset of region in ram block
+    DWORD iBlock;
+} QEMU_REGION, *PQEMU_REGION;
+
+typedef struct tdQEMU_XBZRLE {
+    QWORD o;                    // file offset of xbzrle encoded data
+    QWORD qwPrev;               // page entry the xbzrle data is applied to
+    DWORD cb;
+} QEMU_XBZRLE, *PQEMU_XBZRLE;
+
 //-----------------------------------------------------------------------------
 // DEFINES: GENERAL
 //-----------------------------------------------------------------------------
 
 #define FILE_MAX_THREADS        4
 
+#define FILE_READAHEAD_STREAMS              8
+#define FILE_READAHEAD_HINT_MAX             32
+#define FILE_READAHEAD_WINDOW_MIN           0x00040000      // 256kB
+#define FILE_READAHEAD_WINDOW_MAX           0x04000000      // 64MB
+#define FILE_READAHEAD_GAP_MAX              0x00010000      // max forward gap in sequential stream
+#define FILE_READAHEAD_STRIDE_MAX           0x01000000      // max stride in strided stream
+#define FILE_READAHEAD_SWEEP_LAG            0x04000000      // sweep mode: drop cache 64MB behind consumer
+
+typedef struct tdFILE_READAHEAD_STREAM {
+    QWORD qwTick;                   // last use (0 = unused stream)
+    DWORD cHit;
+    DWORD cbWindow;
+    QWORD cbStride;                 // 0 = sequential stream
+    QWORD oLast;                    // file offset of last access
+    QWORD oNext;                    // file offset following last access
+    QWORD oAhead;                   // file offset up to which readahead is issued
+    QWORD oSweep;                   // file offset up to which cache is dropped
+} FILE_READAHEAD_STREAM, *PFILE_READAHEAD_STREAM;
+
+#define FILE_PART_MAX                       0x40
+
+typedef struct tdFILE_PART {
+    struct tdDEVICE_CONTEXT_FILE *ctx;
+    QWORD oBase;                    // logical file offset of part
+    QWORD cb;                       // size of part
+    QWORD paBase;                   // union device: physical address of region file
+    FILE *h[FILE_MAX_THREADS];      // handle per file handle slot (part 0: ctx->File[].h)
+    struct {
+        FILE *h;                    // dedicated file handle of part worker
+        CRITICAL_SECTION Lock;      // held by reader dispatching to worker
+        HANDLE hEventWakeup;
+        HANDLE hEventFinish;
+        HANDLE hThread;
+        DWORD cMEMs;
+        PPMEM_SCATTER ppMEMs;
+    } Worker;
+    CHAR szFileName[MAX_PATH];
+} FILE_PART, *PFILE_PART;
+
+#define FILE_ZERO_SCAN_CHUNK                0x00100000      // zero page scan: 1MB read chunks
+
+typedef struct tdFILE_ZERO_RANGE {
+    QWORD o;                        // logical file offset of known-zero range
+    QWORD cb;
+} FILE_ZERO_RANGE, *PFILE_ZERO_RANGE;
+
+#define FILE_OVERLAY_MAGIC                  0x564f434c      // 'LCOV'
+#define FILE_OVERLAY_VERSION                1
+#define FILE_OVERLAY_DATA_OFFSET            0x1000          // on-disk overlay: file offset of page slots
+#define FILE_OVERLAY_BLOCK_PAGES            0x200           // in-memory overlay: page slots per 2MB block
+#define FILE_OVERLAY_RESERVE_SLOTS          0x400           // on-disk overlay: slot area growth (4MB) before the slot index
+
+typedef struct tdFILE_OVERLAY_HEADER {
+    DWORD dwMagic;
+    DWORD dwVersion;
+    QWORD cbFile;                   // size of the underlying dump file
+    QWORD cSlot;                    // number of overlay pages
+    QWORD oIndex;                   // file offset of slot index (QWORD[cSlot] page number of each slot)
+} FILE_OVERLAY_HEADER, *PFILE_OVERLAY_HEADER;
+
+#define FILE_DELTA_LAYERS_MAX               0x20
+#define FILE_DELTA_LAYER_NONE               0xff
+#define FILE_DELTA_HASH_BATCH               0x00010000      // hash table read batch (pfns)
+
+typedef struct tdFILE_DELTA_LAYER {
+    FILE *h;                        // parent delta snapshot (NULL for top layer and non-delta base)
+    HANDLE hLC;                     // non-delta base snapshot opened as a separate file device
+    QWORD cPfn;
+    QWORD oPageData;
+    QWORD oHash;
+    PQWORD pqwBitmap;               // stored page bitmap
+    PQWORD pqwRank;                 // number of stored pages prior to each 512-pfn chunk
+    CHAR szFileName[MAX_PATH];
+} FILE_DELTA_LAYER, *PFILE_DELTA_LAYER;
+
 typedef struct tdDEVICE_CONTEXT_FILE {
     struct {
         FILE *h;
@@ -159,427 +389,4510 @@ typedef struct tdDEVICE_CONTEXT_FILE {
     } File[FILE_MAX_THREADS];
     BOOL fMultiThreaded;
     DWORD iFileNext;                // next file handle to use for a read (in multi-threaded mode)
-    QWORD cbFile;
+    QWORD cbFile;                   // logical file size (sum of all parts in multi-part file)
     CHAR szFileName[MAX_PATH];
+    DWORD cPart;                    // multi-part file: number of parts (0 = single file)
+    BOOL fUnion;                    // union device: parts are region files at declared physical addresses
+    BOOL fPartWorkerActive;
+    PFILE_PART pPart;               // multi-part file: parts
     struct {
         BOOL fValidCoreDump;
         BOOL fValidCrashDump;
         BOOL fValidLimeDump;
         BOOL fValidVMwareDump;
+        BOOL fValidKdumpDump;
+        BOOL fValidHibrDump;
+        BOOL fValidQemuDump;
+        BOOL fValidDedupDump;
         BOOL f32;
         union {
             BYTE pbHdr[0x2000];
             Elf64_Ehdr Elf64;
             Elf32_Ehdr Elf32;
             LIME_MEM_RANGE_HEADER LiME;
+            KDUMP_DISK_DUMP_HEADER64 Kdump;
+            LC_DELTA_HEADER Delta;
+            LC_DEDUP_HEADER Dedup;
         };
     } CrashOrCoreDump;
+    struct {
+        DWORD cbBlock;              // page size of dumped system
+        DWORD dwBlockShift;
+        QWORD oPageDesc;            // file offset of page descriptor table
+        QWORD cPfn;                 // number of pfns covered by bitmap
+        PQWORD pqwBitmap;           // bitmap of dumped pfns (bitmap2)
+        PQWORD pqwRank;             // number of dumped pfns prior to each 512-pfn chunk
+        DWORD cCacheEntry;
+        DWORD cbCacheEntry;
+        PBYTE pbCache;              // decompressed page cache (direct mapped)
+        CRITICAL_SECTION LockCache;
+        struct {
+            HMODULE hModuleZlib;
+            HMODULE hModuleLzo;
+            HMODULE hModuleSnappy;
+            HMODULE hModuleZstd;
+            PFN_KDUMP_ZLIB_UNCOMPRESS pfnZlibUncompress;
+            PFN_KDUMP_LZO1X_DECOMPRESS_SAFE pfnLzo1xDecompressSafe;
+            PFN_KDUMP_SNAPPY_UNCOMPRESS pfnSnappyUncompress;
+            PFN_KDUMP_ZSTD_DECOMPRESS pfnZstdDecompress;
+        } fn;
+    } Kdump;
+    struct {
+        const HIBR_TABLE_LAYOUT *pLayout;
+        const HIBR_SET_LAYOUT *pSetLayout;
+        QWORD cPage;                // number of pages in page stream
+        DWORD cRange;
+        DWORD cRangeMax;
+        PHIBR_RANGE pRange;         // restored page ranges sorted by pfn
+        QWORD cBlock;
+        QWORD cBlockMax;
+        PHIBR_BLOCK pBlock;         // xpress blocks / compression sets in page stream order
+        DWORD cbBlockMax;           // max size of (compressed) block data
+        DWORD cPageBlockMax;        // max pages in a block
+        DWORD cCacheEntry;
+        DWORD cbCacheEntry;
+        PBYTE pbCache;              // decompressed block cache (direct mapped)
+        CRITICAL_SECTION LockCache;
+    } Hibr;
+    struct {
+        DWORD cbPage;               // target page size
+        DWORD dwPageShift;
+        QWORD cbLowMem;             // x86: size of ram below 4GB (0 = machine type default)
+        CHAR szMachine[0x100];      // machine type from configuration section
+        BOOL fMappedRam;            // capability: pages at fixed file offsets
+        BOOL fIgnoreShared;         // capability: ram block list holds block addresses
+        DWORD cBlock;
+        QEMU_RAMBLOCK Block[QEMU_RAMBLOCKS_MAX];
+        DWORD cRegion;
+        QEMU_REGION Region[QEMU_REGIONS_MAX];
+        QWORD cXbzrle;
+        QWORD cXbzrleMax;
+        PQEMU_XBZRLE pXbzrle;       // xbzrle records in stream order
+    } Qemu;
+    struct {
+        BOOL fEnabled;
+        BOOL fSweep;                // one-pass sweep: drop consumed regions from cache
+        QWORD qwTick;
+        CRITICAL_SECTION Lock;
+        FILE_READAHEAD_STREAM Stream[FILE_READAHEAD_STREAMS];
+    } ReadAhead;
+    struct {
+        BOOL fEnabled;
+        DWORD cRange;
+        DWORD cRangeMax;
+        PFILE_ZERO_RANGE pRange;    // known-zero file ranges (sparse file holes), sorted
+        QWORD cPage;
+        PQWORD pqwBitmap;           // zero page scan: bitmap of all-zero 4kB file pages
+    } Zero;
+    struct {
+        DWORD cLayer;               // number of layers, 0 = not a delta snapshot (0 = top, cLayer-1 = base)
+        QWORD cPfn;
+        PBYTE pbLayer;              // per-pfn index of the newest layer holding the page
+        CRITICAL_SECTION Lock;      // protects parent layer file handles
+        FILE_DELTA_LAYER Layer[FILE_DELTA_LAYERS_MAX];
+    } Delta;
+    struct {
+        QWORD cPfn;
+        PDWORD pdwMap;              // page map: page id of each pfn
+        QWORD cPageStore;
+        FILE *hStore[FILE_MAX_THREADS]; // page store handle per file handle slot
+        CHAR szStore[MAX_PATH];
+    } Dedup;
+    struct {
+        BOOL fEnabled;
+        CRITICAL_SECTION Lock;
+        QWORD cPage;                // number of pages in the overlay address space
+        PQWORD pqwBitmap;           // pages present in overlay
+        PDWORD *ppdwDir;            // per 512 pages: slot index table (allocated on demand)
+        DWORD cSlot;
+        DWORD cSlotMax;
+        PQWORD pqwSlotPage;         // page number of each slot
+        PBYTE *ppbBlock;            // in-memory overlay: blocks of FILE_OVERLAY_BLOCK_PAGES slots
+        DWORD cSlotReserve;         // on-disk overlay: slots reserved in front of the slot index
+        DWORD cSlotIndex;           // on-disk overlay: slot index entries written at the current index offset
+        FILE *hFile;                // on-disk overlay: overlay file
+        CHAR szFileName[MAX_PATH];
+        VOID(*pfnReadScatter)(_In_ PLC_CONTEXT ctxLC, _In_ DWORD cpMEMs, _Inout_ PPMEM_SCATTER ppMEMs);
+    } Overlay;
     LC_ARCH_TP tpArch;              // LC_ARCH_TP
     QWORD paDtbHint;
 } DEVICE_CONTEXT_FILE, *PDEVICE_CONTEXT_FILE;
 
 //-----------------------------------------------------------------------------
-// GENERAL 'DEVICE' FUNCTIONALITY BELOW:
+// FILE I/O AND MULTI-PART FILE FUNCTIONALITY BELOW:
+// Dump files split into numbered parts (image.001, image.002 .. or
+// image_part1, image_part2 ..) are accessed as one logical file. All file
+// offsets used by the device are logical offsets which are mapped onto the
+// parts by the functions below.
 //-----------------------------------------------------------------------------
 
 /*
-* Contigious file read. This is used by LiveKD since it is otherwise very slow
-* to read scattered memory using LiveKD.
-* -- ctxRC
+* Retrieve the file handle of a part for a given file handle slot.
+* -- ctx
+* -- iPart
+* -- iFile
+* -- return
 */
-VOID DeviceFile_ReadContigious(_Inout_ PLC_READ_CONTIGIOUS_CONTEXT ctxRC)
+FILE* DeviceFile_PartHandle(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ DWORD iPart, _In_ DWORD iFile)
 {
-    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxRC->ctxLC->hDevice;
-    EnterCriticalSection(&ctx->File[0].Lock);
-    if(0 == _fseeki64(ctx->File[0].h, ctxRC->paBase, SEEK_SET)) {
-        ctxRC->cbRead = (DWORD)fread(ctxRC->pb, 1, ctxRC->cb, ctx->File[0].h);
+    return iPart ? ctx->pPart[iPart].h[iFile] : ctx->File[iFile].h;
+}
+
+/*
+* Locate the part containing a logical file offset (binary search).
+* -- ctx
+* -- qwOffset
+* -- return = part index, or (DWORD)-1 if outside of file.
+*/
+DWORD DeviceFile_PartFind(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ QWORD qwOffset)
+{
+    DWORD iLo = 0, iHi = ctx->cPart, iMid;
+    if(qwOffset >= ctx->cbFile) { return (DWORD)-1; }
+    while(iHi - iLo > 1) {
+        iMid = (iLo + iHi) >> 1;
+        if(ctx->pPart[iMid].oBase <= qwOffset) {
+            iLo = iMid;
+        } else {
+            iHi = iMid;
+        }
     }
-    LeaveCriticalSection(&ctx->File[0].Lock);
+    return iLo;
 }
 
 /*
-* Default scatter read function - to be called by LeechCore. This function may
-* be called in multi-threaded mode if the ctx->fMultiThreaded flag is set. In
-* that case load-balance accesses amongst the file handles in the ctx->File[].
-* -- ctxLC
+* Read or write at a given offset of a single file handle.
+* -- h
+* -- qwOffset
+* -- cb
+* -- pb
+* -- fWrite
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_FileIo(_In_ FILE *h, _In_ QWORD qwOffset, _In_ DWORD cb, _Inout_updates_bytes_(cb) PBYTE pb, _In_ BOOL fWrite)
+{
+    if(qwOffset != (QWORD)_ftelli64(h)) {
+        if(_fseeki64(h, qwOffset, SEEK_SET)) { return FALSE; }
+    }
+    return cb == (DWORD)(fWrite ? fwrite(pb, 1, cb, h) : fread(pb, 1, cb, h));
+}
+
+/*
+* Read or write at a logical file offset. Accesses crossing part boundaries
+* are split over the parts. The caller must hold the file handle slot iFile.
+* -- ctx
+* -- iFile
+* -- qwOffset
+* -- cb
+* -- pb
+* -- fWrite
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_LogicalIo(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ DWORD iFile, _In_ QWORD qwOffset, _In_ DWORD cb, _Inout_updates_bytes_(cb) PBYTE pb, _In_ BOOL fWrite)
+{
+    DWORD iPart, cbPart;
+    PFILE_PART pPart;
+    if(!ctx->pPart) {
+        return DeviceFile_FileIo(ctx->File[iFile].h, qwOffset, cb, pb, fWrite);
+    }
+    while(cb) {
+        if((iPart = DeviceFile_PartFind(ctx, qwOffset)) == (DWORD)-1) { return FALSE; }
+        pPart = &ctx->pPart[iPart];
+        cbPart = (DWORD)min(cb, pPart->oBase + pPart->cb - qwOffset);
+        if(!DeviceFile_FileIo(DeviceFile_PartHandle(ctx, iPart, iFile), qwOffset - pPart->oBase, cbPart, pb, fWrite)) { return FALSE; }
+        qwOffset += cbPart;
+        pb += cbPart;
+        cb -= cbPart;
+    }
+    return TRUE;
+}
+
+/*
+* Read from the backing file at a given logical file offset. The caller must
+* hold the file handle iFile (i.e. from DeviceFile_LockAcquire() or at init).
+* -- ctx
+* -- iFile
+* -- qwOffset
+* -- cb
+* -- pb
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_ReadFile(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ DWORD iFile, _In_ QWORD qwOffset, _In_ DWORD cb, _Out_writes_(cb) PBYTE pb)
+{
+    return DeviceFile_LogicalIo(ctx, iFile, qwOffset, cb, pb, FALSE);
+}
+
+/*
+* Write to the backing file at a given logical file offset.
+* -- ctx
+* -- iFile
+* -- qwOffset
+* -- cb
+* -- pb
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_WriteFile(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ DWORD iFile, _In_ QWORD qwOffset, _In_ DWORD cb, _In_reads_(cb) PBYTE pb)
+{
+    return DeviceFile_LogicalIo(ctx, iFile, qwOffset, cb, pb, TRUE);
+}
+
+/*
+* Part worker thread: reads the MEMs of a scatter read that belong to a part
+* using the dedicated file handle of the worker.
+* -- pPart
+*/
+DWORD DeviceFile_PartWorker_ThreadProc(_In_ PFILE_PART pPart)
+{
+    DWORD i;
+    PMEM_SCATTER pMEM;
+    while(pPart->ctx->fPartWorkerActive) {
+        WaitForSingleObject(pPart->Worker.hEventWakeup, INFINITE);
+        if(!pPart->ctx->fPartWorkerActive) { break; }
+        for(i = 0; i < pPart->Worker.cMEMs; i++) {
+            pMEM = pPart->Worker.ppMEMs[i];
+            pMEM->f = DeviceFile_FileIo(pPart->Worker.h, pMEM->qwA - pPart->oBase, pMEM->cb, pMEM->pb, FALSE);
+        }
+        SetEvent(pPart->Worker.hEventFinish);
+    }
+    SetEvent(pPart->Worker.hEventFinish);
+    return 0;
+}
+
+/*
+* Scatter read spread over multiple parts. The MEMs are grouped per part and
+* each part is read in parallel by its worker thread. Part workers are locked
+* in ascending order to avoid deadlocks between concurrent readers.
+* -- ctx
 * -- cpMEMs
 * -- ppMEMs
+* -- return = FALSE if the read touches less than two parts (nothing done).
 */
-VOID DeviceFile_ReadScatter(_In_ PLC_CONTEXT ctxLC, _In_ DWORD cpMEMs, _Inout_ PPMEM_SCATTER ppMEMs)
+_Success_(return)
+BOOL DeviceFile_PartWorker_ReadScatter(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ DWORD cpMEMs, _Inout_ PPMEM_SCATTER ppMEMs)
 {
-    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
-    DWORD iMEM, iFile = 0, cTryLock = 0;
+    PBYTE pbBuffer = NULL;
+    PDWORD pcPartMEMs, piPartMEMs;
+    PPMEM_SCATTER ppPartMEMs;
     PMEM_SCATTER pMEM;
-    if(ctx->fMultiThreaded) {
-        // in a multi-threaded environment:
-        // load-balance file access amongst available file handles
-        iFile = InterlockedIncrement(&ctx->iFileNext) % FILE_MAX_THREADS;
-        while(!TryEnterCriticalSection(&ctx->File[iFile].Lock)) {
-            iFile = InterlockedIncrement(&ctx->iFileNext) % FILE_MAX_THREADS;
-            if(++cTryLock == FILE_MAX_THREADS) {
-                EnterCriticalSection(&ctx->File[iFile].Lock);
-                break;
-            }
-        }
+    DWORD iMEM, iPart, cPartTouch = 0;
+    // 1: count MEMs per part (MEMs crossing part boundaries are left to the caller):
+    if(!(pbBuffer = LocalAlloc(LMEM_ZEROINIT, 2ULL * ctx->cPart * sizeof(DWORD) + (SIZE_T)cpMEMs * sizeof(PMEM_SCATTER)))) { return FALSE; }
+    pcPartMEMs = (PDWORD)pbBuffer;
+    piPartMEMs = pcPartMEMs + ctx->cPart;
+    ppPartMEMs = (PPMEM_SCATTER)(piPartMEMs + ctx->cPart);
+    for(iMEM = 0; iMEM < cpMEMs; iMEM++) {
+        pMEM = ppMEMs[iMEM];
+        if(pMEM->f || (pMEM->qwA == (QWORD)-1)) { continue; }
+        if((iPart = DeviceFile_PartFind(ctx, pMEM->qwA)) == (DWORD)-1) { continue; }
+        if(pMEM->qwA + pMEM->cb > ctx->pPart[iPart].oBase + ctx->pPart[iPart].cb) { continue; }
+        if(!pcPartMEMs[iPart]++) { cPartTouch++; }
+    }
+    if(cPartTouch < 2) {
+        LocalFree(pbBuffer);
+        return FALSE;
+    }
+    for(iMEM = 0, iPart = 0; iPart < ctx->cPart; iPart++) {
+        piPartMEMs[iPart] = iMEM;
+        iMEM += pcPartMEMs[iPart];
     }
     for(iMEM = 0; iMEM < cpMEMs; iMEM++) {
         pMEM = ppMEMs[iMEM];
         if(pMEM->f || (pMEM->qwA == (QWORD)-1)) { continue; }
-        if(pMEM->qwA != (QWORD)_ftelli64(ctx->File[iFile].h)) {
-            if(_fseeki64(ctx->File[iFile].h, pMEM->qwA, SEEK_SET)) { continue; }
+        if((iPart = DeviceFile_PartFind(ctx, pMEM->qwA)) == (DWORD)-1) { continue; }
+        if(pMEM->qwA + pMEM->cb > ctx->pPart[iPart].oBase + ctx->pPart[iPart].cb) { continue; }
+        ppPartMEMs[piPartMEMs[iPart]++] = pMEM;
+    }
+    // 2: dispatch to part workers and wait for completion:
+    for(iMEM = 0, iPart = 0; iPart < ctx->cPart; iPart++) {
+        if(!pcPartMEMs[iPart]) { continue; }
+        EnterCriticalSection(&ctx->pPart[iPart].Worker.Lock);
+        ctx->pPart[iPart].Worker.cMEMs = pcPartMEMs[iPart];
+        ctx->pPart[iPart].Worker.ppMEMs = ppPartMEMs + iMEM;
+        SetEvent(ctx->pPart[iPart].Worker.hEventWakeup);
+        iMEM += pcPartMEMs[iPart];
+    }
+    for(iPart = 0; iPart < ctx->cPart; iPart++) {
+        if(!pcPartMEMs[iPart]) { continue; }
+        WaitForSingleObject(ctx->pPart[iPart].Worker.hEventFinish, INFINITE);
+        LeaveCriticalSection(&ctx->pPart[iPart].Worker.Lock);
+    }
+    LocalFree(pbBuffer);
+    return TRUE;
+}
+
+/*
+* Locate the part number in the file name of a multi-part dump file.
+* Supported conventions are numeric extensions (image.001) and _partN
+* suffixes (image_part1.raw).
+* -- szPart
+* -- poDigit = offset of the part number in szPart.
+* -- pcchDigit = number of digits in the part number.
+* -- return = FALSE if the file name is not on a multi-part file name format.
+*/
+_Success_(return)
+BOOL DeviceFile_PartNameDigits(_In_ LPSTR szPart, _Out_ PDWORD poDigit, _Out_ PDWORD pcchDigit)
+{
+    LPSTR sz, szDot;
+    DWORD i;
+    *poDigit = 0;
+    *pcchDigit = 0;
+    // 1: numeric extension (at least three digits):
+    if((szDot = strrchr(szPart, '.')) && (strlen(szDot + 1) >= 3)) {
+        for(sz = szDot + 1; *sz && isdigit((unsigned char)*sz); sz++);
+        if(!*sz) {
+            *poDigit = (DWORD)(szDot + 1 - szPart);
+            *pcchDigit = (DWORD)strlen(szDot + 1);
+            return TRUE;
         }
-        pMEM->f = pMEM->cb == (DWORD)fread(pMEM->pb, 1, pMEM->cb, ctx->File[iFile].h);
-        if(pMEM->f) {
-            if(ctxLC->fPrintf[LC_PRINTF_VVV]) {
-                lcprintf_fn(
-                    ctxLC,
-                    "READ:\n        offset=%016llx req_len=%08x\n",
-                    pMEM->qwA,
-                    pMEM->cb
-                );
-                Util_PrintHexAscii(ctxLC, pMEM->pb, pMEM->cb, 0);
-            }
-        } else {
-            lcprintfvvv_fn(ctxLC, "READ FAILED:\n        offset=%016llx req_len=%08x\n", pMEM->qwA, pMEM->cb);
+    }
+    // 2: _partN suffix (last occurrence):
+    for(sz = szPart; (sz = strstr(sz, "_part")); sz++) {
+        for(i = 0; isdigit((unsigned char)sz[5 + i]); i++);
+        if(i) {
+            *poDigit = (DWORD)(sz + 5 - szPart);
+            *pcchDigit = i;
         }
     }
-    if(ctx->fMultiThreaded) {
-        LeaveCriticalSection(&ctx->File[iFile].Lock);
+    return *pcchDigit ? TRUE : FALSE;
+}
+
+/*
+* Check whether a file name is the name of the first part of a multi-part dump
+* file, i.e. has a part number of zero or one (image.000, image.001 or
+* image_part1.raw).
+* -- szPart
+* -- return
+*/
+BOOL DeviceFile_PartIsFirstName(_In_ LPSTR szPart)
+{
+    DWORD i, oDigit, cchDigit;
+    if(!DeviceFile_PartNameDigits(szPart, &oDigit, &cchDigit)) { return FALSE; }
+    for(i = 0; i < cchDigit - 1; i++) {
+        if(szPart[oDigit + i] != '0') { return FALSE; }
     }
+    return (szPart[oDigit + cchDigit - 1] == '0') || (szPart[oDigit + cchDigit - 1] == '1');
 }
 
 /*
-* Scatter write function - to be called by LeechCore. This function may
-* be called in multi-threaded mode if the ctx->fMultiThreaded flag is set. In
-* that case load-balance accesses amongst the file handles in the ctx->File[].
-* Writes are only supported by special devices and must be set in the write=1
-* parameter in the device string.
-* Do not use for normal file access - it may corrupt files!
+* Retrieve the file name of the next part of a multi-part dump file.
+* Supported conventions are numeric extensions (image.001 -> image.002) and
+* _partN suffixes (image_part1.raw -> image_part2.raw). Zero padding is kept.
+* -- szPart
+* -- szPartNext
+* -- return = FALSE if the file name is not on a multi-part file name format.
+*/
+_Success_(return)
+BOOL DeviceFile_PartNextName(_In_ LPSTR szPart, _Out_writes_(MAX_PATH) LPSTR szPartNext)
+{
+    DWORD i, oDigit, cchDigit, cch = (DWORD)strlen(szPart);
+    if(!cch || (cch >= MAX_PATH - 2)) { return FALSE; }
+    if(!DeviceFile_PartNameDigits(szPart, &oDigit, &cchDigit)) { return FALSE; }
+    // increment number (carry may require an additional digit):
+    strcpy_s(szPartNext, MAX_PATH, szPart);
+    for(i = oDigit + cchDigit; i > oDigit; i--) {
+        if(szPartNext[i - 1] != '9') {
+            szPartNext[i - 1]++;
+            return TRUE;
+        }
+        szPartNext[i - 1] = '0';
+    }
+    memmove(szPartNext + oDigit + 1, szPartNext + oDigit, cch - oDigit + 1);
+    szPartNext[oDigit] = '1';
+    return TRUE;
+}
+
+/*
+* Close all parts of a multi-part dump file (except part 0 which is
+* represented by ctx->File[]).
+* -- ctx
+*/
+VOID DeviceFile_PartClose(_In_ PDEVICE_CONTEXT_FILE ctx)
+{
+    DWORD iPart, iFile;
+    PFILE_PART pPart;
+    if(!ctx->pPart) { return; }
+    ctx->fPartWorkerActive = FALSE;
+    for(iPart = 0; iPart < ctx->cPart; iPart++) {
+        pPart = &ctx->pPart[iPart];
+        if(pPart->Worker.hThread) {
+            SetEvent(pPart->Worker.hEventWakeup);
+            WaitForSingleObject(pPart->Worker.hEventFinish, INFINITE);
+            CloseHandle(pPart->Worker.hThread);
+            DeleteCriticalSection(&pPart->Worker.Lock);
+        }
+        if(pPart->Worker.hEventWakeup) { CloseHandle(pPart->Worker.hEventWakeup); }
+        if(pPart->Worker.hEventFinish) { CloseHandle(pPart->Worker.hEventFinish); }
+        if(pPart->Worker.h) { fclose(pPart->Worker.h); }
+        for(iFile = 0; iPart && (iFile < FILE_MAX_THREADS); iFile++) {
+            if(pPart->h[iFile]) { fclose(pPart->h[iFile]); }
+        }
+    }
+    LocalFree(ctx->pPart);
+    ctx->pPart = NULL;
+    ctx->cPart = 0;
+}
+
+/*
+* Open the parts of a multi-part dump file for a given file handle slot.
+* -- ctx
+* -- iFile
+* -- szMode
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_PartOpenHandles(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ DWORD iFile, _In_ LPSTR szMode)
+{
+    DWORD iPart;
+    for(iPart = 1; iPart < ctx->cPart; iPart++) {
+        if(fopen_s(&ctx->pPart[iPart].h[iFile], ctx->pPart[iPart].szFileName, szMode) || !ctx->pPart[iPart].h[iFile]) {
+            ctx->pPart[iPart].h[iFile] = NULL;
+            for(iPart = 1; iPart < ctx->cPart; iPart++) {
+                if(ctx->pPart[iPart].h[iFile]) { fclose(ctx->pPart[iPart].h[iFile]); }
+                ctx->pPart[iPart].h[iFile] = NULL;
+            }
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/*
+* Try to initialize a multi-part dump file. Part 0 must already be opened as
+* ctx->File[0].h. On success ctx->cbFile is set to the total size of all parts
+* and a part worker thread is started for each part. The parts of a union
+* device are the region files already declared by DeviceFile_UnionParse().
 * -- ctxLC
-* -- cpMEMs
-* -- ppMEMs
+* -- szMode
+* -- fAuto = auto-detect: only join parts if the opened file is the first part.
+* -- return = FALSE on fatal error, otherwise TRUE (also if not multi-part).
 */
-VOID DeviceFile_WriteScatter(_In_ PLC_CONTEXT ctxLC, _In_ DWORD cpMEMs, _Inout_ PPMEM_SCATTER ppMEMs)
+_Success_(return)
+BOOL DeviceFile_PartInitialize(_In_ PLC_CONTEXT ctxLC, _In_ LPSTR szMode, _In_ BOOL fAuto)
 {
     PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
-    DWORD iMEM, iFile = 0, cTryLock = 0;
-    PMEM_SCATTER pMEM;
-    if(ctx->fMultiThreaded) {
-        // in a multi-threaded environment:
-        // load-balance file access amongst available file handles
-        iFile = InterlockedIncrement(&ctx->iFileNext) % FILE_MAX_THREADS;
-        while(!TryEnterCriticalSection(&ctx->File[iFile].Lock)) {
-            iFile = InterlockedIncrement(&ctx->iFileNext) % FILE_MAX_THREADS;
-            if(++cTryLock == FILE_MAX_THREADS) {
-                EnterCriticalSection(&ctx->File[iFile].Lock);
+    CHAR szPartNext[MAX_PATH];
+    PFILE_PART pPart;
+    FILE *hFile = NULL;
+    DWORD iPart;
+    // 1: verify multi-part naming and that the 2nd part exists:
+    if(!ctx->fUnion) {
+        if(fAuto && !DeviceFile_PartIsFirstName(ctx->szFileName)) { return TRUE; }
+        if(!DeviceFile_PartNextName(ctx->szFileName, szPartNext)) { return TRUE; }
+        if(fopen_s(&hFile, szPartNext, szMode) || !hFile) { return TRUE; }
+        fclose(hFile);
+        if(!(ctx->pPart = LocalAlloc(LMEM_ZEROINIT, FILE_PART_MAX * sizeof(FILE_PART)))) { return FALSE; }
+        strcpy_s(ctx->pPart[0].szFileName, MAX_PATH, ctx->szFileName);
+    }
+    // 2: open parts (part 0 is ctx->File[0].h) and calculate logical offsets:
+    for(iPart = 0; iPart < FILE_PART_MAX; iPart++) {
+        pPart = &ctx->pPart[iPart];
+        pPart->ctx = ctx;
+        if(iPart) {
+            if(ctx->fUnion && !pPart->szFileName[0]) { break; }
+            if(!ctx->fUnion && !DeviceFile_PartNextName(ctx->pPart[iPart - 1].szFileName, pPart->szFileName)) { break; }
+            if(fopen_s(&pPart->h[0], pPart->szFileName, szMode) || !pPart->h[0]) {
+                pPart->h[0] = NULL;
+                if(ctx->fUnion) {
+                    lcprintf(ctxLC, "DEVICE: FAIL: Unable to open region file '%s'.\n", pPart->szFileName);
+                    goto fail;
+                }
                 break;
             }
         }
-    }
-    for(iMEM = 0; iMEM < cpMEMs; iMEM++) {
-        pMEM = ppMEMs[iMEM];
-        if(pMEM->f || (pMEM->qwA == (QWORD)-1)) { continue; }
-        if(pMEM->qwA != (QWORD)_ftelli64(ctx->File[iFile].h)) {
-            if(_fseeki64(ctx->File[iFile].h, pMEM->qwA, SEEK_SET)) { continue; }
-        }
-        pMEM->f = pMEM->cb == (DWORD)fwrite(pMEM->pb, 1, pMEM->cb, ctx->File[iFile].h);
-        if(pMEM->f) {
-            if(ctxLC->fPrintf[LC_PRINTF_VVV]) {
-                lcprintf_fn(
-                    ctxLC,
-                    "WRITE:\n        offset=%016llx req_len=%08x\n",
-                    pMEM->qwA,
-                    pMEM->cb
-                );
-                Util_PrintHexAscii(ctxLC, pMEM->pb, pMEM->cb, 0);
+        hFile = DeviceFile_PartHandle(ctx, iPart, 0);
+        if(_fseeki64(hFile, 0, SEEK_END)) { goto fail; }
+        pPart->oBase = iPart ? (ctx->pPart[iPart - 1].oBase + ctx->pPart[iPart - 1].cb) : 0;
+        pPart->cb = _ftelli64(hFile);
+        ctx->cPart++;
+        if(!pPart->cb) {
+            if(ctx->fUnion) {
+                lcprintf(ctxLC, "DEVICE: FAIL: Empty region file '%s'.\n", pPart->szFileName);
+                goto fail;
             }
-        } else {
-            lcprintfvvv_fn(ctxLC, "WRITE FAILED:\n        offset=%016llx req_len=%08x\n", pMEM->qwA, pMEM->cb);
+            break;
         }
     }
-    if(ctx->fMultiThreaded) {
-        LeaveCriticalSection(&ctx->File[iFile].Lock);
+    if(!ctx->fUnion && (ctx->cPart == FILE_PART_MAX)) {
+        lcprintf(ctxLC, "DEVICE: WARN: Multi-part dump file - only first %i parts used.\n", FILE_PART_MAX);
+    }
+    ctx->cbFile = ctx->pPart[ctx->cPart - 1].oBase + ctx->pPart[ctx->cPart - 1].cb;
+    lcprintfv(ctxLC, "DEVICE: %s: %i parts, total size: 0x%llx.\n", (ctx->fUnion ? "Union of region files" : "Multi-part dump file"), ctx->cPart, ctx->cbFile);
+    for(iPart = 0; iPart < ctx->cPart; iPart++) {
+        lcprintfv(ctxLC, "DEVICE:   part %i: 0x%016llx-0x%016llx '%s'\n", iPart, ctx->pPart[iPart].oBase, ctx->pPart[iPart].oBase + ctx->pPart[iPart].cb, ctx->pPart[iPart].szFileName);
+    }
+    // 3: start part worker threads used for parallel scatter reads:
+    ctx->fPartWorkerActive = TRUE;
+    for(iPart = 0; iPart < ctx->cPart; iPart++) {
+        pPart = &ctx->pPart[iPart];
+        if(fopen_s(&pPart->Worker.h, pPart->szFileName, "rb") || !pPart->Worker.h) { goto fail; }
+        if(!(pPart->Worker.hEventWakeup = CreateEvent(NULL, FALSE, FALSE, NULL))) { goto fail; }
+        if(!(pPart->Worker.hEventFinish = CreateEvent(NULL, FALSE, FALSE, NULL))) { goto fail; }
+        InitializeCriticalSection(&pPart->Worker.Lock);
+        if(!(pPart->Worker.hThread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)DeviceFile_PartWorker_ThreadProc, pPart, 0, NULL))) {
+            DeleteCriticalSection(&pPart->Worker.Lock);
+            goto fail;
+        }
     }
+    return TRUE;
+fail:
+    lcprintf(ctxLC, "DEVICE: FAIL: Unable to initialize multi-part dump file.\n");
+    DeviceFile_PartClose(ctx);
+    return FALSE;
 }
 
 //-----------------------------------------------------------------------------
-// PARSING OF DUMP FILE FORMATS BELOW:
-// - VMware .vmem + vmss/vmsn Dump Files.
-// - Full Microsoft Crash Dumps (DumpIt).
-// - VirtualBox ELF CORE Dumps.
+// UNION DEVICE FUNCTIONALITY BELOW:
+// A union device (union://<file>@<address>,<file>@<address>,..) maps several
+// raw region files onto declared physical addresses. The region files are the
+// parts of a multi-part file - i.e. scatter reads touching multiple regions are
+// dispatched to the per-part workers and read in parallel.
 //-----------------------------------------------------------------------------
 
-typedef struct tdFILE_VMWARE_HEADER {
-    DWORD magic;
-    DWORD _Filler;
-    DWORD cGroups;
-} FILE_VMWARE_HEADER;
-
-typedef struct tdFILE_VMWARE_GROUP {
-    CHAR szName[64];
-    QWORD cbOffset;
-    QWORD cbSize;
-} FILE_VMWARE_GROUP;
+/*
+* Parse the region files of a union device string on the format:
+* union://<file>@<address>,<file>@<address>[,<parameter>=<value>]
+* Region addresses must be page aligned and are given as hex (0x prefix).
+* -- ctxLC
+* -- ctx
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_UnionParse(_In_ PLC_CONTEXT ctxLC, _In_ PDEVICE_CONTEXT_FILE ctx)
+{
+    CHAR szDevice[MAX_PATH] = { 0 };
+    LPSTR szAt, szRegions, szToken, szTokenContext = NULL;
+    PFILE_PART pPart;
+    DWORD cPart = 0;
+    memcpy(szDevice, ctxLC->Config.szDevice, _countof(szDevice));
+    if(!(szRegions = strstr(szDevice, "://"))) { return FALSE; }
+    szRegions += 3;
+    if(!(ctx->pPart = LocalAlloc(LMEM_ZEROINIT, FILE_PART_MAX * sizeof(FILE_PART)))) { return FALSE; }
+    while((szToken = strtok_s(szRegions, ",;", &szTokenContext))) {
+        szRegions = NULL;
+        if(strchr(szToken, '=')) { continue; }          // device parameter
+        if(!(szAt = strrchr(szToken, '@')) || (szAt == szToken) || (cPart == FILE_PART_MAX)) {
+            lcprintf(ctxLC, "DEVICE: FAIL: union: bad region '%s' (expected <file>@<address>, max %i regions).\n", szToken, FILE_PART_MAX);
+            goto fail;
+        }
+        *szAt = 0;
+        pPart = &ctx->pPart[cPart++];
+        strncpy_s(pPart->szFileName, _countof(pPart->szFileName), szToken, _TRUNCATE);
+        pPart->paBase = Util_GetNumericA(szAt + 1);
+        if(pPart->paBase & 0xfff) {
+            lcprintf(ctxLC, "DEVICE: FAIL: union: region '%s' address %llx not page aligned.\n", pPart->szFileName, pPart->paBase);
+            goto fail;
+        }
+    }
+    if(!cPart) { goto fail; }
+    strcpy_s(ctx->szFileName, _countof(ctx->szFileName), ctx->pPart[0].szFileName);
+    ctx->fUnion = TRUE;
+    return TRUE;
+fail:
+    LocalFree(ctx->pPart);
+    ctx->pPart = NULL;
+    return FALSE;
+}
+
+/*
+* Populate the memory map of a union device. Each region file is mapped at its
+* declared physical address onto its logical offset in the multi-part file.
+* Regions are added in ascending address order and may not overlap.
+* -- ctxLC
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_UnionMemMap(_In_ PLC_CONTEXT ctxLC)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    DWORD i, j, piPart[FILE_PART_MAX];
+    PFILE_PART pPart;
+    QWORD cb;
+    for(i = 0; i < ctx->cPart; i++) {
+        for(j = i; j && (ctx->pPart[piPart[j - 1]].paBase > ctx->pPart[i].paBase); j--) {
+            piPart[j] = piPart[j - 1];
+        }
+        piPart[j] = i;
+    }
+    for(i = 0; i < ctx->cPart; i++) {
+        pPart = &ctx->pPart[piPart[i]];
+        cb = pPart->cb & ~0xfffULL;
+        if(cb != pPart->cb) {
+            lcprintfv(ctxLC, "DEVICE: WARN: union: region '%s' size not page aligned - last 0x%llx bytes not mapped.\n", pPart->szFileName, pPart->cb - cb);
+        }
+        if(!cb) { continue; }
+        if(!LcMemMap_AddRange(ctxLC, pPart->paBase, cb, LC_MEMMAP_FORCE_OFFSET | pPart->oBase)) {
+            lcprintf(ctxLC, "DEVICE: FAIL: union: region '%s' at %llx overlaps another region.\n", pPart->szFileName, pPart->paBase);
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// READAHEAD FUNCTIONALITY BELOW:
+// Scatter reads translated through the memory map look random to the kernel
+// even if the logical access is linear. Sequential and strided streams of
+// file accesses are detected here and the kernel is hinted to read ahead of
+// the consumer (posix_fadvise WILLNEED). In sweep mode regions well behind a
+// sequential consumer are dropped from the page cache (DONTNEED).
+// Readahead hints are currently only issued on Linux.
+//-----------------------------------------------------------------------------
+
+typedef struct tdFILE_READAHEAD_HINT {
+    QWORD o;
+    QWORD cb;
+    BOOL fDontNeed;
+} FILE_READAHEAD_HINT, *PFILE_READAHEAD_HINT;
+
+/*
+* Issue a readahead hint to the operating system.
+* -- ctx
+* -- pHint
+*/
+VOID DeviceFile_ReadAhead_Hint(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ PFILE_READAHEAD_HINT pHint)
+{
+#ifdef LINUX
+    DWORD iPart;
+    QWORD o = pHint->o, cb = pHint->cb, cbPart;
+    int iAdvice = pHint->fDontNeed ? POSIX_FADV_DONTNEED : POSIX_FADV_WILLNEED;
+    if(!ctx->pPart) {
+        posix_fadvise(fileno(ctx->File[0].h), o, cb, iAdvice);
+        return;
+    }
+    while(cb && ((iPart = DeviceFile_PartFind(ctx, o)) != (DWORD)-1)) {
+        cbPart = min(cb, ctx->pPart[iPart].oBase + ctx->pPart[iPart].cb - o);
+        posix_fadvise(fileno(DeviceFile_PartHandle(ctx, iPart, 0)), o - ctx->pPart[iPart].oBase, cbPart, iAdvice);
+        o += cbPart;
+        cb -= cbPart;
+    }
+#endif /* LINUX */
+}
+
+/*
+* Append a readahead hint to the hint buffer (if space exists).
+* -- pHints
+* -- pcHint
+* -- o
+* -- cb
+* -- fDontNeed
+*/
+VOID DeviceFile_ReadAhead_HintAdd(_Inout_ PFILE_READAHEAD_HINT pHints, _Inout_ PDWORD pcHint, _In_ QWORD o, _In_ QWORD cb, _In_ BOOL fDontNeed)
+{
+    if(*pcHint >= FILE_READAHEAD_HINT_MAX) { return; }
+    pHints[*pcHint].o = o;
+    pHints[*pcHint].cb = cb;
+    pHints[*pcHint].fDontNeed = fDontNeed;
+    (*pcHint)++;
+}
+
+/*
+* Feed a single contiguous file access into the stream detector and collect
+* readahead hints for the matching stream.
+* NB! must be called with ctx->ReadAhead.Lock held.
+* -- ctx
+* -- o = file offset of access.
+* -- cb = size of access.
+* -- pHints = hint buffer of FILE_READAHEAD_HINT_MAX entries.
+* -- pcHint = number of hints in pHints (updated).
+*/
+VOID DeviceFile_ReadAhead_Stream(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ QWORD o, _In_ QWORD cb, _Inout_ PFILE_READAHEAD_HINT pHints, _Inout_ PDWORD pcHint)
+{
+    DWORD i;
+    QWORD oTarget;
+    PFILE_READAHEAD_STREAM ps = NULL, psLRU = NULL;
+    // 1: locate matching stream (sequential, strided or tentative strided):
+    for(i = 0; i < FILE_READAHEAD_STREAMS; i++) {
+        ps = &ctx->ReadAhead.Stream[i];
+        if(!ps->qwTick) {
+            psLRU = ps;
+            continue;
+        }
+        if(!ps->cbStride && (o >= ps->oNext) && (o <= ps->oNext + FILE_READAHEAD_GAP_MAX)) { break; }
+        if(ps->cbStride && (o == ps->oLast + ps->cbStride)) { break; }
+        if((ps->cHit == 1) && (o > ps->oNext) && (o - ps->oLast <= FILE_READAHEAD_STRIDE_MAX)) {
+            ps->cbStride = o - ps->oLast;
+            break;
+        }
+        if(!psLRU || (psLRU->qwTick && (ps->qwTick < psLRU->qwTick))) { psLRU = ps; }
+    }
+    if(i == FILE_READAHEAD_STREAMS) {
+        // new stream - replace unused or least recently used stream:
+        ps = psLRU;
+        ZeroMemory(ps, sizeof(FILE_READAHEAD_STREAM));
+        ps->oSweep = o;
+        ps->cbWindow = FILE_READAHEAD_WINDOW_MIN;
+    }
+    ps->qwTick = ++ctx->ReadAhead.qwTick;
+    ps->cHit++;
+    ps->oLast = o;
+    ps->oNext = o + cb;
+    if(ps->cHit < 3) { return; }
+    // 2: sequential stream - read ahead with a growing window:
+    if(!ps->cbStride) {
+        oTarget = ps->oNext + ps->cbWindow;
+        if(ps->oAhead < ps->oNext) { ps->oAhead = ps->oNext; }
+        if(oTarget > ps->oAhead + (ps->cbWindow >> 1)) {
+            DeviceFile_ReadAhead_HintAdd(pHints, pcHint, ps->oAhead, oTarget - ps->oAhead, FALSE);
+            ps->oAhead = oTarget;
+            ps->cbWindow = min(FILE_READAHEAD_WINDOW_MAX, ps->cbWindow << 1);
+        }
+        if(ctx->ReadAhead.fSweep && (ps->oNext > ps->oSweep + 2 * FILE_READAHEAD_SWEEP_LAG)) {
+            DeviceFile_ReadAhead_HintAdd(pHints, pcHint, ps->oSweep, ps->oNext - FILE_READAHEAD_SWEEP_LAG - ps->oSweep, TRUE);
+            ps->oSweep = ps->oNext - FILE_READAHEAD_SWEEP_LAG;
+        }
+        return;
+    }
+    // 3: strided stream - read ahead the next accesses in the stride:
+    if(ps->oAhead < ps->oLast) { ps->oAhead = ps->oLast; }
+    while((*pcHint < FILE_READAHEAD_HINT_MAX) && (ps->oAhead + ps->cbStride <= ps->oLast + ps->cbWindow)) {
+        ps->oAhead += ps->cbStride;
+        DeviceFile_ReadAhead_HintAdd(pHints, pcHint, ps->oAhead, cb, FALSE);
+    }
+    ps->cbWindow = min(FILE_READAHEAD_WINDOW_MAX, ps->cbWindow << 1);
+}
+
+/*
+* Feed a scatter read into the readahead stream detector. Contiguous MEMs are
+* merged into a single access before they are fed to the stream detector.
+* -- ctx
+* -- cpMEMs
+* -- ppMEMs
+*/
+VOID DeviceFile_ReadAhead(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ DWORD cpMEMs, _In_ PPMEM_SCATTER ppMEMs)
+{
+    FILE_READAHEAD_HINT Hints[FILE_READAHEAD_HINT_MAX];
+    DWORD i, iMEM, cHint = 0;
+    QWORD oRun = 0, cbRun = 0;
+    PMEM_SCATTER pMEM;
+    EnterCriticalSection(&ctx->ReadAhead.Lock);
+    for(iMEM = 0; iMEM <= cpMEMs; iMEM++) {
+        pMEM = (iMEM < cpMEMs) ? ppMEMs[iMEM] : NULL;
+        if(pMEM && (pMEM->f || (pMEM->qwA == (QWORD)-1))) { continue; }
+        if(pMEM && cbRun && (oRun + cbRun == pMEM->qwA)) {
+            cbRun += pMEM->cb;
+            continue;
+        }
+        if(cbRun) {
+            DeviceFile_ReadAhead_Stream(ctx, oRun, cbRun, Hints, &cHint);
+        }
+        if(pMEM) {
+            oRun = pMEM->qwA;
+            cbRun = pMEM->cb;
+        }
+    }
+    LeaveCriticalSection(&ctx->ReadAhead.Lock);
+    for(i = 0; i < cHint; i++) {
+        DeviceFile_ReadAhead_Hint(ctx, &Hints[i]);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// SPARSE FILE AND ZERO PAGE FUNCTIONALITY BELOW:
+// Raw dumps of virtual machines are often stored as sparse files. Filesystem
+// holes are located with SEEK_DATA/SEEK_HOLE (Linux) when the file is opened
+// and are registered as known-zero file ranges. Optionally (zeroscan=1) the
+// whole file is scanned for all-zero 4kB pages. Reads of known-zero data are
+// served by memset without file i/o.
+//-----------------------------------------------------------------------------
+
+/*
+* Add a known-zero range to the zero range table. Ranges must be added in
+* ascending order; adjacent ranges are merged.
+* -- ctx
+* -- o
+* -- cb
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Zero_AddRange(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ QWORD o, _In_ QWORD cb)
+{
+    PFILE_ZERO_RANGE pRangeNew, pRangeLast;
+    if(!cb) { return TRUE; }
+    pRangeLast = ctx->Zero.cRange ? &ctx->Zero.pRange[ctx->Zero.cRange - 1] : NULL;
+    if(pRangeLast && (pRangeLast->o + pRangeLast->cb == o)) {
+        pRangeLast->cb += cb;
+        return TRUE;
+    }
+    if(ctx->Zero.cRange == ctx->Zero.cRangeMax) {
+        if(!(pRangeNew = LocalAlloc(0, (ctx->Zero.cRangeMax ? 2ULL * ctx->Zero.cRangeMax : 0x100) * sizeof(FILE_ZERO_RANGE)))) { return FALSE; }
+        if(ctx->Zero.pRange) {
+            memcpy(pRangeNew, ctx->Zero.pRange, ctx->Zero.cRange * sizeof(FILE_ZERO_RANGE));
+            LocalFree(ctx->Zero.pRange);
+        }
+        ctx->Zero.pRange = pRangeNew;
+        ctx->Zero.cRangeMax = ctx->Zero.cRangeMax ? 2 * ctx->Zero.cRangeMax : 0x100;
+    }
+    ctx->Zero.pRange[ctx->Zero.cRange].o = o;
+    ctx->Zero.pRange[ctx->Zero.cRange].cb = cb;
+    ctx->Zero.cRange++;
+    return TRUE;
+}
+
+/*
+* Check whether a file range is known to be all-zero, i.e. fully contained in
+* a filesystem hole or fully covered by all-zero pages from a zero page scan.
+* -- ctx
+* -- o
+* -- cb
+* -- return
+*/
+BOOL DeviceFile_Zero_IsZero(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ QWORD o, _In_ QWORD cb)
+{
+    DWORD iLo = 0, iHi = ctx->Zero.cRange, iMid;
+    QWORD iPage, iPageEnd;
+    // 1: filesystem holes (binary search):
+    while(iLo < iHi) {
+        iMid = (iLo + iHi) >> 1;
+        if(o < ctx->Zero.pRange[iMid].o) {
+            iHi = iMid;
+        } else if(o >= ctx->Zero.pRange[iMid].o + ctx->Zero.pRange[iMid].cb) {
+            iLo = iMid + 1;
+        } else {
+            return o + cb <= ctx->Zero.pRange[iMid].o + ctx->Zero.pRange[iMid].cb;
+        }
+    }
+    // 2: zero page bitmap:
+    if(!ctx->Zero.pqwBitmap || !cb) { return FALSE; }
+    iPageEnd = (o + cb + 0xfff) >> 12;
+    if(iPageEnd > ctx->Zero.cPage) { return FALSE; }
+    for(iPage = o >> 12; iPage < iPageEnd; iPage++) {
+        if(!(ctx->Zero.pqwBitmap[iPage >> 6] & (1ULL << (iPage & 0x3f)))) { return FALSE; }
+    }
+    return TRUE;
+}
+
+/*
+* Locate filesystem holes in the backing file(s) with SEEK_DATA/SEEK_HOLE and
+* register them as known-zero ranges. Only supported on Linux.
+* -- ctxLC
+*/
+VOID DeviceFile_Zero_ScanHoles(_In_ PLC_CONTEXT ctxLC)
+{
+#ifdef LINUX
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    DWORD iPart, cPart = ctx->cPart ? ctx->cPart : 1;
+    QWORD oBase, cbPart, cbHole = 0;
+    off64_t oData, oHole;
+    FILE *h;
+    int fd;
+    for(iPart = 0; iPart < cPart; iPart++) {
+        oBase = ctx->pPart ? ctx->pPart[iPart].oBase : 0;
+        cbPart = ctx->pPart ? ctx->pPart[iPart].cb : ctx->cbFile;
+        h = DeviceFile_PartHandle(ctx, iPart, 0);
+        fd = fileno(h);
+        for(oHole = 0; (QWORD)oHole < cbPart; oHole = oData) {
+            if((oHole = lseek64(fd, oHole, SEEK_HOLE)) < 0) { break; }
+            if((QWORD)oHole >= cbPart) { break; }
+            if((oData = lseek64(fd, oHole, SEEK_DATA)) < 0) {
+                oData = cbPart;     // ENXIO: hole extends to end of file
+            }
+            if(!DeviceFile_Zero_AddRange(ctx, oBase + oHole, oData - oHole)) { break; }
+            cbHole += oData - oHole;
+        }
+        // re-sync stdio file position with the underlying file descriptor:
+        _fseeki64(h, 0, SEEK_SET);
+    }
+    if(ctx->Zero.cRange) {
+        lcprintfv(ctxLC, "DEVICE: Sparse file: %i holes, 0x%llx bytes not read from file.\n", ctx->Zero.cRange, cbHole);
+    }
+#endif /* LINUX */
+}
+
+/*
+* Scan the whole backing file for all-zero 4kB pages and build the zero page
+* bitmap. Known filesystem holes are skipped. This may take a long time on
+* large files and is therefore only done if the zeroscan=1 option is given.
+* -- ctxLC
+*/
+VOID DeviceFile_Zero_ScanPages(_In_ PLC_CONTEXT ctxLC)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    QWORD o, oPage, cbChunk, cPageZero = 0;
+    PBYTE pb = NULL;
+    DWORD i;
+    ctx->Zero.cPage = ctx->cbFile >> 12;
+    if(!(ctx->Zero.pqwBitmap = LocalAlloc(LMEM_ZEROINIT, ((ctx->Zero.cPage + 63) >> 6) * sizeof(QWORD)))) { goto fail; }
+    if(!(pb = LocalAlloc(0, FILE_ZERO_SCAN_CHUNK))) { goto fail; }
+    for(o = 0; o < (ctx->Zero.cPage << 12); o += cbChunk) {
+        cbChunk = min(FILE_ZERO_SCAN_CHUNK, (ctx->Zero.cPage << 12) - o);
+        if(DeviceFile_Zero_IsZero(ctx, o, cbChunk)) { continue; }
+        if(!DeviceFile_ReadFile(ctx, 0, o, (DWORD)cbChunk, pb)) { goto fail; }
+        for(oPage = 0; oPage < cbChunk; oPage += 0x1000) {
+            for(i = 0; (i < 0x1000) && !*(PQWORD)(pb + oPage + i); i += sizeof(QWORD));
+            if(i == 0x1000) {
+                ctx->Zero.pqwBitmap[(o + oPage) >> 18] |= 1ULL << (((o + oPage) >> 12) & 0x3f);
+                cPageZero++;
+            }
+        }
+    }
+    LocalFree(pb);
+    lcprintfv(ctxLC, "DEVICE: Zero page scan: %lli of %lli pages are all-zero.\n", cPageZero, ctx->Zero.cPage);
+    return;
+fail:
+    lcprintf(ctxLC, "DEVICE: WARN: Zero page scan failed.\n");
+    LocalFree(ctx->Zero.pqwBitmap);
+    LocalFree(pb);
+    ctx->Zero.pqwBitmap = NULL;
+    ctx->Zero.cPage = 0;
+}
+
+/*
+* Initialize sparse file hole detection and/or the zero page scan.
+* -- ctxLC
+* -- fScanHoles
+* -- fScanPages
+*/
+VOID DeviceFile_Zero_Initialize(_In_ PLC_CONTEXT ctxLC, _In_ BOOL fScanHoles, _In_ BOOL fScanPages)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    if(fScanHoles) {
+        DeviceFile_Zero_ScanHoles(ctxLC);
+    }
+    if(fScanPages) {
+        DeviceFile_Zero_ScanPages(ctxLC);
+    }
+    ctx->Zero.fEnabled = ctx->Zero.cRange || ctx->Zero.pqwBitmap;
+}
+
+/*
+* Serve MEMs which are known to be all-zero by memset without file i/o.
+* -- ctx
+* -- cpMEMs
+* -- ppMEMs
+*/
+VOID DeviceFile_Zero_ReadScatter(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ DWORD cpMEMs, _Inout_ PPMEM_SCATTER ppMEMs)
+{
+    DWORD iMEM;
+    PMEM_SCATTER pMEM;
+    for(iMEM = 0; iMEM < cpMEMs; iMEM++) {
+        pMEM = ppMEMs[iMEM];
+        if(pMEM->f || (pMEM->qwA == (QWORD)-1)) { continue; }
+        if(DeviceFile_Zero_IsZero(ctx, pMEM->qwA, pMEM->cb)) {
+            ZeroMemory(pMEM->pb, pMEM->cb);
+            pMEM->f = TRUE;
+        }
+    }
+}
+
+/*
+* Free the zero range table and the zero page bitmap.
+* -- ctx
+*/
+VOID DeviceFile_Zero_Close(_In_ PDEVICE_CONTEXT_FILE ctx)
+{
+    LocalFree(ctx->Zero.pRange);
+    LocalFree(ctx->Zero.pqwBitmap);
+    ctx->Zero.pRange = NULL;
+    ctx->Zero.pqwBitmap = NULL;
+    ctx->Zero.cRange = 0;
+    ctx->Zero.fEnabled = FALSE;
+}
+
+//-----------------------------------------------------------------------------
+// COPY-ON-WRITE OVERLAY FUNCTIONALITY BELOW:
+// With cow=1 or overlay=<file> the dump file is opened read-only and writes
+// are redirected to a sparse page overlay. A page is copied from the dump file
+// into the overlay on its first write. Reads are served from the overlay for
+// pages present in the overlay page bitmap and from the dump file otherwise.
+// The overlay is addressed by device address (after memory map translation).
+// The in-memory overlay (cow=1) is discarded on close unless saved with the
+// LC_CMD_FILE_OVERLAY_SAVE command. The on-disk overlay (overlay=<file>) is
+// stored in the overlay file and re-applied when the dump file is re-opened.
+// The on-disk slot index is kept behind a reserved slot area and is updated
+// after each write batch, so the header always points at a valid index.
+//-----------------------------------------------------------------------------
+
+/*
+* Retrieve the overlay slot of a page. The caller must hold ctx->Overlay.Lock.
+* -- ctx
+* -- iPage
+* -- return = slot index, or (DWORD)-1 if the page is not in the overlay.
+*/
+DWORD DeviceFile_Overlay_SlotGet(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ QWORD iPage)
+{
+    if((iPage >= ctx->Overlay.cPage) || !((ctx->Overlay.pqwBitmap[iPage >> 6] >> (iPage & 63)) & 1)) { return (DWORD)-1; }
+    return ctx->Overlay.ppdwDir[iPage >> 9][iPage & 0x1ff];
+}
+
+/*
+* Read or write (a part of) an overlay page slot. The caller must hold
+* ctx->Overlay.Lock.
+* -- ctx
+* -- iSlot
+* -- o = offset within page.
+* -- cb
+* -- pb
+* -- fWrite
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Overlay_SlotIo(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ DWORD iSlot, _In_ DWORD o, _In_ DWORD cb, _Inout_updates_bytes_(cb) PBYTE pb, _In_ BOOL fWrite)
+{
+    PBYTE pbSlot;
+    if(ctx->Overlay.hFile) {
+        return DeviceFile_FileIo(ctx->Overlay.hFile, FILE_OVERLAY_DATA_OFFSET + ((QWORD)iSlot << 12) + o, cb, pb, fWrite);
+    }
+    pbSlot = ctx->Overlay.ppbBlock[iSlot / FILE_OVERLAY_BLOCK_PAGES] + (iSlot % FILE_OVERLAY_BLOCK_PAGES) * 0x1000ULL + o;
+    memcpy(fWrite ? pbSlot : pb, fWrite ? pb : pbSlot, cb);
+    return TRUE;
+}
+
+/*
+* Register a slot as holding a page. The caller must hold ctx->Overlay.Lock.
+* -- ctx
+* -- iPage
+* -- iSlot
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Overlay_SlotMap(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ QWORD iPage, _In_ DWORD iSlot)
+{
+    PQWORD pqwSlotPage;
+    if(iPage >= ctx->Overlay.cPage) { return FALSE; }
+    if(!ctx->Overlay.ppdwDir[iPage >> 9] && !(ctx->Overlay.ppdwDir[iPage >> 9] = LocalAlloc(0, 0x200 * sizeof(DWORD)))) { return FALSE; }
+    if(iSlot >= ctx->Overlay.cSlotMax) {
+        if(!(pqwSlotPage = LocalAlloc(0, max(0x1000, 2ULL * ctx->Overlay.cSlotMax) * sizeof(QWORD)))) { return FALSE; }
+        if(ctx->Overlay.pqwSlotPage) {
+            memcpy(pqwSlotPage, ctx->Overlay.pqwSlotPage, ctx->Overlay.cSlotMax * sizeof(QWORD));
+            LocalFree(ctx->Overlay.pqwSlotPage);
+        }
+        ctx->Overlay.pqwSlotPage = pqwSlotPage;
+        ctx->Overlay.cSlotMax = max(0x1000, 2 * ctx->Overlay.cSlotMax);
+    }
+    ctx->Overlay.ppdwDir[iPage >> 9][iPage & 0x1ff] = iSlot;
+    ctx->Overlay.pqwBitmap[iPage >> 6] |= 1ULL << (iPage & 63);
+    ctx->Overlay.pqwSlotPage[iSlot] = iPage;
+    return TRUE;
+}
+
+/*
+* Write the slot index and header of the on-disk overlay file. The slot index
+* is located behind the cSlotReserve reserved slots where slot writes cannot
+* reach it. Page data is flushed before the index and the index before the
+* header so that the header on disk never points at an incomplete index.
+* The caller must hold ctx->Overlay.Lock.
+* -- ctx
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Overlay_SaveIndex(_In_ PDEVICE_CONTEXT_FILE ctx)
+{
+    FILE *hFile = ctx->Overlay.hFile;
+    FILE_OVERLAY_HEADER Hdr = { 0 };
+    Hdr.dwMagic = FILE_OVERLAY_MAGIC;
+    Hdr.dwVersion = FILE_OVERLAY_VERSION;
+    Hdr.cbFile = ctx->cbFile;
+    Hdr.cSlot = ctx->Overlay.cSlot;
+    Hdr.oIndex = FILE_OVERLAY_DATA_OFFSET + ((QWORD)ctx->Overlay.cSlotReserve << 12);
+    if(fflush(hFile)) { return FALSE; }
+    if(ctx->Overlay.cSlot > ctx->Overlay.cSlotIndex) {
+        if(!DeviceFile_FileIo(hFile, Hdr.oIndex + ctx->Overlay.cSlotIndex * sizeof(QWORD), (DWORD)((ctx->Overlay.cSlot - ctx->Overlay.cSlotIndex) * sizeof(QWORD)), (PBYTE)(ctx->Overlay.pqwSlotPage + ctx->Overlay.cSlotIndex), TRUE)) { return FALSE; }
+        if(fflush(hFile)) { return FALSE; }
+        ctx->Overlay.cSlotIndex = ctx->Overlay.cSlot;
+    }
+    if(!DeviceFile_FileIo(hFile, 0, sizeof(FILE_OVERLAY_HEADER), (PBYTE)&Hdr, TRUE)) { return FALSE; }
+    return !fflush(hFile);
+}
+
+/*
+* Write to the overlay. Pages not yet in the overlay are first copied from the
+* dump file (copy-on-write); pages unreadable in the dump file start zeroed.
+* The caller must hold ctx->Overlay.Lock.
+* -- ctxLC
+* -- qwA
+* -- cb
+* -- pb
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Overlay_Write(_In_ PLC_CONTEXT ctxLC, _In_ QWORD qwA, _In_ DWORD cb, _In_reads_(cb) PBYTE pb)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    BYTE pbPage[0x1000];
+    MEM_SCATTER MEM = { 0 };
+    PMEM_SCATTER pMEM = &MEM;
+    DWORD iSlot, cbPage, cSlotReserveOld;
+    while(cb) {
+        cbPage = (DWORD)min(cb, 0x1000 - (qwA & 0xfff));
+        if((iSlot = DeviceFile_Overlay_SlotGet(ctx, qwA >> 12)) == (DWORD)-1) {
+            // copy-on-write: fetch initial page contents from the dump file.
+            MEM.version = MEM_SCATTER_VERSION;
+            MEM.qwA = qwA & ~0xfff;
+            MEM.pb = pbPage;
+            MEM.cb = 0x1000;
+            MEM.f = FALSE;
+            ctx->Overlay.pfnReadScatter(ctxLC, 1, &pMEM);
+            if(!MEM.f) { ZeroMemory(pbPage, 0x1000); }
+            iSlot = ctx->Overlay.cSlot;
+            if(ctx->Overlay.hFile && (iSlot >= ctx->Overlay.cSlotReserve)) {
+                // grow the slot area - move the slot index out of the way first.
+                cSlotReserveOld = ctx->Overlay.cSlotReserve;
+                ctx->Overlay.cSlotReserve = (iSlot + FILE_OVERLAY_RESERVE_SLOTS) & ~(FILE_OVERLAY_RESERVE_SLOTS - 1);
+                ctx->Overlay.cSlotIndex = 0;
+                if(!DeviceFile_Overlay_SaveIndex(ctx)) {
+                    ctx->Overlay.cSlotReserve = cSlotReserveOld;
+                    return FALSE;
+                }
+            }
+            if(!ctx->Overlay.hFile && !ctx->Overlay.ppbBlock[iSlot / FILE_OVERLAY_BLOCK_PAGES]) {
+                if(!(ctx->Overlay.ppbBlock[iSlot / FILE_OVERLAY_BLOCK_PAGES] = LocalAlloc(0, FILE_OVERLAY_BLOCK_PAGES * 0x1000))) { return FALSE; }
+            }
+            if(!DeviceFile_Overlay_SlotIo(ctx, iSlot, 0, 0x1000, pbPage, TRUE)) { return FALSE; }
+            if(!DeviceFile_Overlay_SlotMap(ctx, qwA >> 12, iSlot)) { return FALSE; }
+            ctx->Overlay.cSlot++;
+        }
+        if(!DeviceFile_Overlay_SlotIo(ctx, iSlot, (DWORD)(qwA & 0xfff), cbPage, pb, TRUE)) { return FALSE; }
+        qwA += cbPage;
+        pb += cbPage;
+        cb -= cbPage;
+    }
+    return TRUE;
+}
+
+/*
+* Read (a part of) the overlay into a MEM. Only pages present in the overlay
+* are read. The caller must hold ctx->Overlay.Lock.
+* -- ctx
+* -- pMEM
+* -- fCheck = only check if the MEM is fully covered by the overlay.
+* -- return = TRUE if all pages of the MEM are present in the overlay.
+*/
+BOOL DeviceFile_Overlay_ReadMEM(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ PMEM_SCATTER pMEM, _In_ BOOL fCheck)
+{
+    BOOL fAll = TRUE;
+    DWORD iSlot;
+    QWORD qwA, qwNext, qwEnd = pMEM->qwA + pMEM->cb;
+    for(qwA = pMEM->qwA; qwA < qwEnd; qwA = qwNext) {
+        qwNext = min(qwEnd, (qwA + 0x1000) & ~0xfff);
+        if((iSlot = DeviceFile_Overlay_SlotGet(ctx, qwA >> 12)) == (DWORD)-1) {
+            fAll = FALSE;
+            continue;
+        }
+        if(!fCheck) {
+            DeviceFile_Overlay_SlotIo(ctx, iSlot, (DWORD)(qwA & 0xfff), (DWORD)(qwNext - qwA), pMEM->pb + (qwA - pMEM->qwA), FALSE);
+        }
+    }
+    return fAll;
+}
+
+/*
+* Scatter read function for copy-on-write mode - to be called by LeechCore.
+* MEMs fully covered by the overlay are read from the overlay. MEMs partially
+* covered (unaligned file offsets) are read from the dump file and patched.
+* -- ctxLC
+* -- cpMEMs
+* -- ppMEMs
+*/
+VOID DeviceFile_Overlay_ReadScatter(_In_ PLC_CONTEXT ctxLC, _In_ DWORD cpMEMs, _Inout_ PPMEM_SCATTER ppMEMs)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    DWORD iMEM, cPatch = 0;
+    QWORD iPage, iPageLast;
+    PPMEM_SCATTER ppPatch = NULL;
+    PMEM_SCATTER pMEM;
+    if(ctx->Overlay.cSlot) {
+        EnterCriticalSection(&ctx->Overlay.Lock);
+        for(iMEM = 0; iMEM < cpMEMs; iMEM++) {
+            pMEM = ppMEMs[iMEM];
+            if(pMEM->f || (pMEM->qwA == (QWORD)-1) || !pMEM->cb) { continue; }
+            iPageLast = (pMEM->qwA + pMEM->cb - 1) >> 12;
+            for(iPage = pMEM->qwA >> 12; iPage <= iPageLast; iPage++) {
+                if(DeviceFile_Overlay_SlotGet(ctx, iPage) != (DWORD)-1) { break; }
+            }
+            if(iPage > iPageLast) { continue; }
+            if(DeviceFile_Overlay_ReadMEM(ctx, pMEM, TRUE)) {
+                pMEM->f = DeviceFile_Overlay_ReadMEM(ctx, pMEM, FALSE);
+            } else if(ppPatch || (ppPatch = LocalAlloc(0, cpMEMs * sizeof(PMEM_SCATTER)))) {
+                ppPatch[cPatch++] = pMEM;
+            }
+        }
+        LeaveCriticalSection(&ctx->Overlay.Lock);
+    }
+    ctx->Overlay.pfnReadScatter(ctxLC, cpMEMs, ppMEMs);
+    if(cPatch) {
+        EnterCriticalSection(&ctx->Overlay.Lock);
+        for(iMEM = 0; iMEM < cPatch; iMEM++) {
+            if(ppPatch[iMEM]->f) {
+                DeviceFile_Overlay_ReadMEM(ctx, ppPatch[iMEM], FALSE);
+            }
+        }
+        LeaveCriticalSection(&ctx->Overlay.Lock);
+    }
+    LocalFree(ppPatch);
+}
+
+/*
+* Scatter write function for copy-on-write mode - to be called by LeechCore.
+* The dump file is never written.
+* -- ctxLC
+* -- cpMEMs
+* -- ppMEMs
+*/
+VOID DeviceFile_Overlay_WriteScatter(_In_ PLC_CONTEXT ctxLC, _In_ DWORD cpMEMs, _Inout_ PPMEM_SCATTER ppMEMs)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    DWORD iMEM;
+    PMEM_SCATTER pMEM;
+    EnterCriticalSection(&ctx->Overlay.Lock);
+    for(iMEM = 0; iMEM < cpMEMs; iMEM++) {
+        pMEM = ppMEMs[iMEM];
+        if(pMEM->f || (pMEM->qwA == (QWORD)-1)) { continue; }
+        pMEM->f = DeviceFile_Overlay_Write(ctxLC, pMEM->qwA, pMEM->cb, pMEM->pb);
+        if(pMEM->f) {
+            if(ctxLC->fPrintf[LC_PRINTF_VVV]) {
+                lcprintf_fn(
+                    ctxLC,
+                    "WRITE (OVERLAY):\n        offset=%016llx req_len=%08x\n",
+                    pMEM->qwA,
+                    pMEM->cb
+                );
+                Util_PrintHexAscii(ctxLC, pMEM->pb, pMEM->cb, 0);
+            }
+        } else {
+            lcprintfvvv_fn(ctxLC, "WRITE FAILED (OVERLAY):\n        offset=%016llx req_len=%08x\n", pMEM->qwA, pMEM->cb);
+        }
+    }
+    if(ctx->Overlay.hFile) {
+        if(ctx->Overlay.cSlot != ctx->Overlay.cSlotIndex) {
+            if(!DeviceFile_Overlay_SaveIndex(ctx)) {
+                lcprintf(ctxLC, "DEVICE: WARN: unable to update overlay file '%s'.\n", ctx->Overlay.szFileName);
+            }
+        } else {
+            fflush(ctx->Overlay.hFile);
+        }
+    }
+    LeaveCriticalSection(&ctx->Overlay.Lock);
+}
+
+/*
+* Save the overlay to file. If the file is the on-disk overlay file only the
+* slot index and header are written, otherwise all overlay pages are copied.
+* The caller must hold ctx->Overlay.Lock.
+* -- ctx
+* -- szFileName = file name, or NULL for the on-disk overlay file.
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Overlay_SaveFile(_In_ PDEVICE_CONTEXT_FILE ctx, _In_opt_ LPSTR szFileName)
+{
+    BOOL fResult = FALSE;
+    FILE *hFile = NULL;
+    DWORD iSlot;
+    BYTE pbPage[0x1000];
+    FILE_OVERLAY_HEADER Hdr = { 0 };
+    if(szFileName && ctx->Overlay.hFile && !strcmp(szFileName, ctx->Overlay.szFileName)) { szFileName = NULL; }
+    if(!szFileName) {
+        return ctx->Overlay.hFile && DeviceFile_Overlay_SaveIndex(ctx);
+    }
+    if(fopen_s(&hFile, szFileName, "wb") || !hFile) { return FALSE; }
+    for(iSlot = 0; iSlot < ctx->Overlay.cSlot; iSlot++) {
+        if(!DeviceFile_Overlay_SlotIo(ctx, iSlot, 0, 0x1000, pbPage, FALSE)) { goto fail; }
+        if(!DeviceFile_FileIo(hFile, FILE_OVERLAY_DATA_OFFSET + ((QWORD)iSlot << 12), 0x1000, pbPage, TRUE)) { goto fail; }
+    }
+    Hdr.dwMagic = FILE_OVERLAY_MAGIC;
+    Hdr.dwVersion = FILE_OVERLAY_VERSION;
+    Hdr.cbFile = ctx->cbFile;
+    Hdr.cSlot = ctx->Overlay.cSlot;
+    Hdr.oIndex = FILE_OVERLAY_DATA_OFFSET + ((QWORD)ctx->Overlay.cSlot << 12);
+    if(Hdr.cSlot && !DeviceFile_FileIo(hFile, Hdr.oIndex, (DWORD)(Hdr.cSlot * sizeof(QWORD)), (PBYTE)ctx->Overlay.pqwSlotPage, TRUE)) { goto fail; }
+    if(!DeviceFile_FileIo(hFile, 0, sizeof(FILE_OVERLAY_HEADER), (PBYTE)&Hdr, TRUE)) { goto fail; }
+    fResult = !fflush(hFile);
+fail:
+    if(hFile) { fclose(hFile); }
+    return fResult;
+}
+
+/*
+* Discard all pages in the overlay. The caller must hold ctx->Overlay.Lock.
+* -- ctx
+*/
+VOID DeviceFile_Overlay_Discard(_In_ PDEVICE_CONTEXT_FILE ctx)
+{
+    QWORD i;
+    for(i = 0; i < (ctx->Overlay.cPage + 0x1ff) >> 9; i++) {
+        LocalFree(ctx->Overlay.ppdwDir[i]);
+        LocalFree(ctx->Overlay.ppbBlock[i]);
+        ctx->Overlay.ppdwDir[i] = NULL;
+        ctx->Overlay.ppbBlock[i] = NULL;
+    }
+    ZeroMemory(ctx->Overlay.pqwBitmap, ((ctx->Overlay.cPage + 63) >> 6) * sizeof(QWORD));
+    ctx->Overlay.cSlot = 0;
+    ctx->Overlay.cSlotIndex = 0;
+    if(ctx->Overlay.hFile) {
+        DeviceFile_Overlay_SaveFile(ctx, NULL);
+    }
+}
+
+/*
+* Load the pages of an existing on-disk overlay file.
+* -- ctxLC
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Overlay_Load(_In_ PLC_CONTEXT ctxLC)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    BOOL fResult = FALSE;
+    FILE_OVERLAY_HEADER Hdr = { 0 };
+    PQWORD pqwIndex = NULL;
+    QWORD i;
+    if(!DeviceFile_FileIo(ctx->Overlay.hFile, 0, sizeof(FILE_OVERLAY_HEADER), (PBYTE)&Hdr, FALSE)) { goto fail; }
+    if((Hdr.dwMagic != FILE_OVERLAY_MAGIC) || (Hdr.dwVersion != FILE_OVERLAY_VERSION)) { goto fail; }
+    if(Hdr.cbFile != ctx->cbFile) {
+        lcprintf(ctxLC, "DEVICE: FAIL: overlay '%s' does not belong to this dump file.\n", ctx->Overlay.szFileName);
+        goto fail;
+    }
+    if((Hdr.cSlot > ctx->Overlay.cPage) || (Hdr.oIndex & 0xfff) || (Hdr.oIndex < FILE_OVERLAY_DATA_OFFSET + (Hdr.cSlot << 12))) { goto fail; }
+    if(((Hdr.oIndex - FILE_OVERLAY_DATA_OFFSET) >> 12) > ctx->Overlay.cPage + FILE_OVERLAY_RESERVE_SLOTS) { goto fail; }
+    if(Hdr.cSlot) {
+        if(!(pqwIndex = LocalAlloc(0, (SIZE_T)(Hdr.cSlot * sizeof(QWORD))))) { goto fail; }
+        if(!DeviceFile_FileIo(ctx->Overlay.hFile, Hdr.oIndex, (DWORD)(Hdr.cSlot * sizeof(QWORD)), (PBYTE)pqwIndex, FALSE)) { goto fail; }
+    }
+    for(i = 0; i < Hdr.cSlot; i++) {
+        if(!DeviceFile_Overlay_SlotMap(ctx, pqwIndex[i], (DWORD)i)) { goto fail; }
+    }
+    ctx->Overlay.cSlot = (DWORD)Hdr.cSlot;
+    ctx->Overlay.cSlotIndex = (DWORD)Hdr.cSlot;
+    ctx->Overlay.cSlotReserve = (DWORD)((Hdr.oIndex - FILE_OVERLAY_DATA_OFFSET) >> 12);
+    lcprintfv(ctxLC, "DEVICE: overlay: %i modified pages loaded from '%s'.\n", ctx->Overlay.cSlot, ctx->Overlay.szFileName);
+    fResult = TRUE;
+fail:
+    LocalFree(pqwIndex);
+    return fResult;
+}
+
+/*
+* Clean up the overlay. An on-disk overlay is saved to its overlay file.
+* -- ctx
+*/
+VOID DeviceFile_Overlay_Close(_In_ PDEVICE_CONTEXT_FILE ctx)
+{
+    if(!ctx->Overlay.fEnabled) { return; }
+    if(ctx->Overlay.hFile) {
+        DeviceFile_Overlay_SaveFile(ctx, NULL);
+        fclose(ctx->Overlay.hFile);
+        ctx->Overlay.hFile = NULL;
+    }
+    if(ctx->Overlay.ppdwDir) {
+        DeviceFile_Overlay_Discard(ctx);
+    }
+    LocalFree(ctx->Overlay.pqwBitmap);
+    LocalFree(ctx->Overlay.ppdwDir);
+    LocalFree(ctx->Overlay.ppbBlock);
+    LocalFree(ctx->Overlay.pqwSlotPage);
+    DeleteCriticalSection(&ctx->Overlay.Lock);
+    ZeroMemory(&ctx->Overlay, sizeof(ctx->Overlay));
+}
+
+/*
+* Initialize copy-on-write mode. Must be called once the dump file has been
+* parsed and the memory map has been populated.
+* -- ctxLC
+* -- szFileName = on-disk overlay file (created if not existing), or NULL for
+*                 an in-memory overlay.
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Overlay_Initialize(_In_ PLC_CONTEXT ctxLC, _In_opt_ LPSTR szFileName)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    QWORD cDir;
+    if(!ctxLC->pfnReadScatter) {
+        lcprintf(ctxLC, "DEVICE: FAIL: copy-on-write overlay not supported by this file type.\n");
+        return FALSE;
+    }
+    ctx->Overlay.fEnabled = TRUE;
+    InitializeCriticalSection(&ctx->Overlay.Lock);
+    ctx->Overlay.cPage = (max(ctx->cbFile, LcMemMap_GetMaxAddress(ctxLC)) + 0xfff) >> 12;
+    cDir = (ctx->Overlay.cPage + 0x1ff) >> 9;
+    if(!(ctx->Overlay.pqwBitmap = LocalAlloc(LMEM_ZEROINIT, (SIZE_T)(cDir * 8 * sizeof(QWORD))))) { goto fail; }
+    if(!(ctx->Overlay.ppdwDir = LocalAlloc(LMEM_ZEROINIT, (SIZE_T)(cDir * sizeof(PDWORD))))) { goto fail; }
+    if(!(ctx->Overlay.ppbBlock = LocalAlloc(LMEM_ZEROINIT, (SIZE_T)(cDir * sizeof(PBYTE))))) { goto fail; }
+    if(szFileName) {
+        strncpy_s(ctx->Overlay.szFileName, _countof(ctx->Overlay.szFileName), szFileName, _TRUNCATE);
+        if(!fopen_s(&ctx->Overlay.hFile, szFileName, "r+b") && ctx->Overlay.hFile) {
+            if(!DeviceFile_Overlay_Load(ctxLC)) {
+                lcprintf(ctxLC, "DEVICE: FAIL: unable to load overlay file '%s'.\n", szFileName);
+                fclose(ctx->Overlay.hFile);
+                ctx->Overlay.hFile = NULL;
+                goto fail;
+            }
+        } else if(fopen_s(&ctx->Overlay.hFile, szFileName, "w+b") || !ctx->Overlay.hFile || !DeviceFile_Overlay_SaveFile(ctx, NULL)) {
+            lcprintf(ctxLC, "DEVICE: FAIL: unable to create overlay file '%s'.\n", szFileName);
+            goto fail;
+        }
+    }
+    ctx->Overlay.pfnReadScatter = ctxLC->pfnReadScatter;
+    ctxLC->pfnReadScatter = DeviceFile_Overlay_ReadScatter;
+    ctxLC->pfnWriteScatter = DeviceFile_Overlay_WriteScatter;
+    ctxLC->Config.fWritable = TRUE;
+    lcprintfv(ctxLC, "DEVICE: copy-on-write overlay enabled (%s).\n", szFileName ? szFileName : "memory");
+    return TRUE;
+fail:
+    DeviceFile_Overlay_Close(ctx);
+    return FALSE;
+}
+
+//-----------------------------------------------------------------------------
+// GENERAL 'DEVICE' FUNCTIONALITY BELOW:
+//-----------------------------------------------------------------------------
+
+/*
+* Contigious file read. This is used by LiveKD since it is otherwise very slow
+* to read scattered memory using LiveKD. Reads go through the logical file so
+* that reads spanning the parts of a multi-part file are split over the parts.
+* -- ctxRC
+*/
+VOID DeviceFile_ReadContigious(_Inout_ PLC_READ_CONTIGIOUS_CONTEXT ctxRC)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxRC->ctxLC->hDevice;
+    DWORD cb;
+    if(ctxRC->paBase >= ctx->cbFile) { return; }
+    cb = (DWORD)min(ctxRC->cb, ctx->cbFile - ctxRC->paBase);
+    EnterCriticalSection(&ctx->File[0].Lock);
+    if(DeviceFile_LogicalIo(ctx, 0, ctxRC->paBase, cb, ctxRC->pb, FALSE)) {
+        ctxRC->cbRead = cb;
+    }
+    LeaveCriticalSection(&ctx->File[0].Lock);
+}
+
+/*
+* Acquire a file handle for exclusive use by the caller. In a multi-threaded
+* environment file access is load-balanced amongst the available handles.
+* In single-threaded mode the handle is protected by the LeechCore lock.
+* -- ctx
+* -- return = index of the acquired file handle in ctx->File[].
+*/
+DWORD DeviceFile_LockAcquire(_In_ PDEVICE_CONTEXT_FILE ctx)
+{
+    DWORD iFile, cTryLock = 0;
+    if(!ctx->fMultiThreaded) { return 0; }
+    iFile = InterlockedIncrement(&ctx->iFileNext) % FILE_MAX_THREADS;
+    while(!TryEnterCriticalSection(&ctx->File[iFile].Lock)) {
+        iFile = InterlockedIncrement(&ctx->iFileNext) % FILE_MAX_THREADS;
+        if(++cTryLock == FILE_MAX_THREADS) {
+            EnterCriticalSection(&ctx->File[iFile].Lock);
+            break;
+        }
+    }
+    return iFile;
+}
+
+/*
+* Release a file handle previously acquired by DeviceFile_LockAcquire().
+* -- ctx
+* -- iFile
+*/
+VOID DeviceFile_LockRelease(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ DWORD iFile)
+{
+    if(ctx->fMultiThreaded) {
+        LeaveCriticalSection(&ctx->File[iFile].Lock);
+    }
+}
+
+/*
+* Default scatter read function - to be called by LeechCore. This function may
+* be called in multi-threaded mode if the ctx->fMultiThreaded flag is set. In
+* that case load-balance accesses amongst the file handles in the ctx->File[].
+* -- ctxLC
+* -- cpMEMs
+* -- ppMEMs
+*/
+VOID DeviceFile_ReadScatter(_In_ PLC_CONTEXT ctxLC, _In_ DWORD cpMEMs, _Inout_ PPMEM_SCATTER ppMEMs)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    DWORD iMEM, iFile;
+    PMEM_SCATTER pMEM;
+    if(ctx->Zero.fEnabled) {
+        // known-zero data (sparse file holes / zero pages) - no file i/o required.
+        DeviceFile_Zero_ReadScatter(ctx, cpMEMs, ppMEMs);
+    }
+    if(ctx->ReadAhead.fEnabled) {
+        DeviceFile_ReadAhead(ctx, cpMEMs, ppMEMs);
+    }
+    if(ctx->fPartWorkerActive) {
+        // multi-part file: read parts in parallel (remaining MEMs are read below).
+        DeviceFile_PartWorker_ReadScatter(ctx, cpMEMs, ppMEMs);
+    }
+    iFile = DeviceFile_LockAcquire(ctx);
+    for(iMEM = 0; iMEM < cpMEMs; iMEM++) {
+        pMEM = ppMEMs[iMEM];
+        if(pMEM->f || (pMEM->qwA == (QWORD)-1)) { continue; }
+        pMEM->f = DeviceFile_ReadFile(ctx, iFile, pMEM->qwA, pMEM->cb, pMEM->pb);
+        if(pMEM->f) {
+            if(ctxLC->fPrintf[LC_PRINTF_VVV]) {
+                lcprintf_fn(
+                    ctxLC,
+                    "READ:\n        offset=%016llx req_len=%08x\n",
+                    pMEM->qwA,
+                    pMEM->cb
+                );
+                Util_PrintHexAscii(ctxLC, pMEM->pb, pMEM->cb, 0);
+            }
+        } else {
+            lcprintfvvv_fn(ctxLC, "READ FAILED:\n        offset=%016llx req_len=%08x\n", pMEM->qwA, pMEM->cb);
+        }
+    }
+    DeviceFile_LockRelease(ctx, iFile);
+}
+
+/*
+* Scatter write function - to be called by LeechCore. This function may
+* be called in multi-threaded mode if the ctx->fMultiThreaded flag is set. In
+* that case load-balance accesses amongst the file handles in the ctx->File[].
+* Writes are only supported by special devices and must be set in the write=1
+* parameter in the device string.
+* Do not use for normal file access - it may corrupt files!
+* -- ctxLC
+* -- cpMEMs
+* -- ppMEMs
+*/
+VOID DeviceFile_WriteScatter(_In_ PLC_CONTEXT ctxLC, _In_ DWORD cpMEMs, _Inout_ PPMEM_SCATTER ppMEMs)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    DWORD iMEM, iFile;
+    PMEM_SCATTER pMEM;
+    iFile = DeviceFile_LockAcquire(ctx);
+    for(iMEM = 0; iMEM < cpMEMs; iMEM++) {
+        pMEM = ppMEMs[iMEM];
+        if(pMEM->f || (pMEM->qwA == (QWORD)-1)) { continue; }
+        pMEM->f = DeviceFile_WriteFile(ctx, iFile, pMEM->qwA, pMEM->cb, pMEM->pb);
+        if(pMEM->f) {
+            if(ctxLC->fPrintf[LC_PRINTF_VVV]) {
+                lcprintf_fn(
+                    ctxLC,
+                    "WRITE:\n        offset=%016llx req_len=%08x\n",
+                    pMEM->qwA,
+                    pMEM->cb
+                );
+                Util_PrintHexAscii(ctxLC, pMEM->pb, pMEM->cb, 0);
+            }
+        } else {
+            lcprintfvvv_fn(ctxLC, "WRITE FAILED:\n        offset=%016llx req_len=%08x\n", pMEM->qwA, pMEM->cb);
+        }
+    }
+    DeviceFile_LockRelease(ctx, iFile);
+}
+
+//-----------------------------------------------------------------------------
+// PARSING OF DUMP FILE FORMATS BELOW:
+// - VMware .vmem + vmss/vmsn Dump Files.
+// - Full Microsoft Crash Dumps (DumpIt).
+// - VirtualBox ELF CORE Dumps.
+//-----------------------------------------------------------------------------
+
+#define FILE_VMWARE_MAGIC_V0                0xbad1bad1
+#define FILE_VMWARE_MAGIC_V1                0xbed2bed2
+#define FILE_VMWARE_MAGIC_V2                0xbed3bed3
+#define FILE_VMWARE_GROUPS_MAX              0x100
+#define FILE_VMWARE_TAG_BUFFER              0x00010000      // tag reader buffer: 64kB
+#define FILE_VMWARE_MEMORY_REGIONS_MAX      0x400
+
+typedef struct tdFILE_VMWARE_HEADER {
+    DWORD magic;
+    DWORD _Filler;
+    DWORD cGroups;
+} FILE_VMWARE_HEADER;
+
+typedef struct tdFILE_VMWARE_GROUP {
+    CHAR szName[64];
+    QWORD cbOffset;
+    QWORD cbSize;
+} FILE_VMWARE_GROUP;
+
+typedef struct tdFILE_VMWARE_MEMORY_REGION {
+    BOOL fOffsetFile;
+    BOOL fOffsetMemory;
+    BOOL fSize;
+    QWORD cbOffsetFile;
+    QWORD cbOffsetMemory;
+    QWORD cbSize;
+} FILE_VMWARE_MEMORY_REGION, *PFILE_VMWARE_MEMORY_REGION;
+
+/*
+* A checkpoint tag is: flags (BYTE), name length (BYTE), name, 0-3 DWORD
+* indices (flags bits 6-7) and data. The data size is given by flags bits
+* 0-5 - except for sizes 62 and 63 which denote big data (i.e. inline memory)
+* where the data size, the in-memory data size (64-bit in all of the V0, V1
+* and V2 formats) and a padding length (WORD) follow the indices. A zero flags
+* byte ends the group.
+*/
+typedef struct tdFILE_VMWARE_TAG {
+    CHAR szName[0x100];
+    DWORD cIndex;
+    DWORD dwIndex[3];
+    QWORD oData;                    // file offset of tag data
+    QWORD cbData;
+    PBYTE pbData;                   // small tag data - valid until next tag is read (NULL for big data)
+} FILE_VMWARE_TAG, *PFILE_VMWARE_TAG;
+
+typedef struct tdFILE_VMWARE_TAG_READER {
+    FILE *hFile;
+    QWORD o;                        // file offset of next tag
+    QWORD oEnd;                     // file offset of group end
+    QWORD oBuffer;                  // file offset of buffered data
+    DWORD cbBuffer;
+    BYTE pbBuffer[FILE_VMWARE_TAG_BUFFER];
+} FILE_VMWARE_TAG_READER, *PFILE_VMWARE_TAG_READER;
+
+/*
+* Ensure the file range [o, o+cb) is in the tag reader buffer. Data is read
+* in chunks of up to 64kB so that a group is typically parsed with one read.
+* -- pr
+* -- o
+* -- cb
+* -- return = pointer to buffered data at o, or NULL on failure.
+*/
+PBYTE DeviceFile_VMware_TagBuffer(_In_ PFILE_VMWARE_TAG_READER pr, _In_ QWORD o, _In_ DWORD cb)
+{
+    if((o < pr->oBuffer) || (o + cb > pr->oBuffer + pr->cbBuffer)) {
+        if((cb > FILE_VMWARE_TAG_BUFFER) || (o + cb > pr->oEnd)) { return NULL; }
+        pr->oBuffer = o;
+        pr->cbBuffer = 0;
+        if(_fseeki64(pr->hFile, o, SEEK_SET)) { return NULL; }
+        pr->cbBuffer = (DWORD)fread(pr->pbBuffer, 1, (SIZE_T)min(FILE_VMWARE_TAG_BUFFER, pr->oEnd - o), pr->hFile);
+        if(cb > pr->cbBuffer) { return NULL; }
+    }
+    return pr->pbBuffer + (o - pr->oBuffer);
+}
+
+/*
+* Read the next tag of a checkpoint group. Big tag data is skipped over
+* without being read.
+* -- pr
+* -- pTag
+* -- return = FALSE on end of group or error.
+*/
+_Success_(return)
+BOOL DeviceFile_VMware_TagNext(_In_ PFILE_VMWARE_TAG_READER pr, _Out_ PFILE_VMWARE_TAG pTag)
+{
+    PBYTE pb;
+    BYTE bFlags, cchName;
+    DWORD i, cbHdr;
+    BOOL fBig;
+    if(!(pb = DeviceFile_VMware_TagBuffer(pr, pr->o, 2)) || !(bFlags = pb[0])) { return FALSE; }
+    cchName = pb[1];
+    pTag->cIndex = (bFlags >> 6) & 3;
+    pTag->cbData = bFlags & 0x3f;
+    fBig = (pTag->cbData == 62) || (pTag->cbData == 63);
+    cbHdr = 2 + cchName + 4 * pTag->cIndex + (fBig ? 16 + 2 : 0);
+    if(!cchName || !(pb = DeviceFile_VMware_TagBuffer(pr, pr->o, cbHdr))) { return FALSE; }
+    if(fBig) {
+        // big data is aligned by padding - the padding length precedes it.
+        cbHdr += *(PWORD)(pb + cbHdr - 2);
+    }
+    memcpy(pTag->szName, pb + 2, cchName);
+    pTag->szName[cchName] = 0;
+    for(i = 0; i < pTag->cIndex; i++) {
+        pTag->dwIndex[i] = *(PDWORD)(pb + 2 + cchName + 4 * i);
+    }
+    if(fBig) {
+        pb += 2 + cchName + 4 * pTag->cIndex;
+        pTag->cbData = *(PQWORD)pb;
+    }
+    pTag->oData = pr->o + cbHdr;
+    if((pTag->oData > pr->oEnd) || (pTag->cbData > pr->oEnd - pTag->oData)) { return FALSE; }
+    pTag->pbData = NULL;
+    if(!fBig && pTag->cbData) {
+        if(!(pb = DeviceFile_VMware_TagBuffer(pr, pTag->oData, (DWORD)pTag->cbData))) { return FALSE; }
+        pTag->pbData = pb;
+    }
+    if(pTag->oData + pTag->cbData <= pr->o) { return FALSE; }
+    pr->o = pTag->oData + pTag->cbData;
+    return TRUE;
+}
+
+/*
+* Try to initialize a VMWare Dump/Save File (.vmem + vmss/vmsn).
+* Also, older VMWare versions may have memory in-lined inside the vmsn file.
+* The checkpoint groups are parsed tag by tag; the memory regions are built
+* from the region tags of the memory group.
+*/
+VOID DeviceFile_VMwareDumpInitialize(_In_ PLC_CONTEXT ctxLC, _In_ BOOL fInlineMemory)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    FILE_VMWARE_HEADER hdr = { 0 };
+    FILE_VMWARE_GROUP *pGroups = NULL, *pGrp;
+    FILE_VMWARE_TAG tag;
+    PFILE_VMWARE_TAG_READER pr = NULL;
+    PFILE_VMWARE_MEMORY_REGION pRegions = NULL, pRegion;
+    CHAR szFileName[MAX_PATH];
+    FILE *pFile = NULL;
+    QWORD cbMetaFile, paDtbHint = 0, qwMemorySizeMB = 0, oInlineMemory = 0, cbInlineMemory = 0;
+    DWORD iGroup, iMemoryRegion, cMemoryRegion = 0, dwPlatform = 0;
+    strcpy_s(szFileName, _countof(szFileName), ctx->szFileName);
+    // 1: open and verify metadata file
+    memcpy(szFileName + strlen(szFileName) - 5, ".vmss", 5);
+    fopen_s(&pFile, szFileName, "rb");
+    if(!pFile) {
+        memcpy(szFileName + strlen(szFileName) - 5, ".vmsn", 5);
+        fopen_s(&pFile, szFileName, "rb");
+    }
+    if(!pFile) {
+        lcprintf(ctxLC, "DEVICE: WARN: Unable to open VMware .vmss or .vmsn file - assuming 1:1 memory space.\n");
+        goto fail;
+    }
+    if(_fseeki64(pFile, 0, SEEK_END)) { goto fail; }
+    cbMetaFile = _ftelli64(pFile);
+    _fseeki64(pFile, 0, SEEK_SET);
+    fread(&hdr, 1, sizeof(FILE_VMWARE_HEADER), pFile);
+    if((hdr.magic != FILE_VMWARE_MAGIC_V2) && (hdr.magic != FILE_VMWARE_MAGIC_V1) && (hdr.magic != FILE_VMWARE_MAGIC_V0) /* && (hdr.magic != 0xbed2bed0) */) {
+        lcprintf(ctxLC, "DEVICE: WARN: Unable to verify file '%s'.\n", szFileName);
+        goto fail;
+    }
+    // 2: read the group table in one read:
+    hdr.cGroups = min(hdr.cGroups, FILE_VMWARE_GROUPS_MAX);
+    if(!(pGroups = LocalAlloc(LMEM_ZEROINIT, hdr.cGroups * sizeof(FILE_VMWARE_GROUP)))) { goto fail; }
+    if(!(pRegions = LocalAlloc(LMEM_ZEROINIT, FILE_VMWARE_MEMORY_REGIONS_MAX * sizeof(FILE_VMWARE_MEMORY_REGION)))) { goto fail; }
+    if(!(pr = LocalAlloc(0, sizeof(FILE_VMWARE_TAG_READER)))) { goto fail; }
+    hdr.cGroups = (DWORD)fread(pGroups, sizeof(FILE_VMWARE_GROUP), hdr.cGroups, pFile);
+    // 3: walk the tags of the groups of interest:
+    for(iGroup = 0; iGroup < hdr.cGroups; iGroup++) {
+        pGrp = pGroups + iGroup;
+        pGrp->szName[sizeof(pGrp->szName) - 1] = 0;
+        if(strcmp("Checkpoint", pGrp->szName) && strcmp("cpu", pGrp->szName) && strcmp("memory", pGrp->szName)) { continue; }
+        if(pGrp->cbOffset >= cbMetaFile) { continue; }
+        pr->hFile = pFile;
+        pr->o = pGrp->cbOffset;
+        pr->oEnd = (pGrp->cbSize && (pGrp->cbSize <= cbMetaFile - pGrp->cbOffset)) ? (pGrp->cbOffset + pGrp->cbSize) : cbMetaFile;
+        pr->oBuffer = 0;
+        pr->cbBuffer = 0;
+        while(DeviceFile_VMware_TagNext(pr, &tag)) {
+            if(!tag.pbData) {
+                // big data - the only big data of interest is in-lined memory:
+                if(!strcmp("Memory", tag.szName) && !oInlineMemory) {
+                    oInlineMemory = tag.oData;
+                    cbInlineMemory = tag.cbData;
+                }
+                continue;
+            }
+            if(!dwPlatform && (tag.cbData >= 4) && !strcmp("Platform", tag.szName)) {
+                dwPlatform = *(PDWORD)tag.pbData;
+            }
+            if(!qwMemorySizeMB && (tag.cbData >= 4) && !strcmp("memSize", tag.szName)) {
+                qwMemorySizeMB = *(PDWORD)tag.pbData;
+            }
+            if(!paDtbHint && (tag.cbData >= 8) && !strcmp("hv:ttbrEL1[0]", tag.szName)) {
+                if(*(PDWORD)(tag.pbData + 4) >= 0x80000000) {
+                    paDtbHint = *(PDWORD)(tag.pbData + 4);
+                }
+            }
+            if((tag.cIndex == 1) && (tag.dwIndex[0] < FILE_VMWARE_MEMORY_REGIONS_MAX) && (tag.cbData >= 4)) {
+                pRegion = pRegions + tag.dwIndex[0];
+                if(!strcmp("regionSize", tag.szName)) {
+                    pRegion->fSize = TRUE;
+                    pRegion->cbSize = *(PDWORD)tag.pbData * 0x1000ULL;
+                } else if(!strcmp("regionPPN", tag.szName)) {
+                    pRegion->fOffsetMemory = TRUE;
+                    pRegion->cbOffsetMemory = *(PDWORD)tag.pbData * 0x1000ULL;
+                } else if(!strcmp("regionPageNum", tag.szName)) {
+                    pRegion->fOffsetFile = TRUE;
+                    pRegion->cbOffsetFile = *(PDWORD)tag.pbData * 0x1000ULL;
+                }
+                cMemoryRegion = max(cMemoryRegion, tag.dwIndex[0] + 1);
+            }
+        }
+    }
+    // 4: populate the memory map from the region table (file offsets are
+    //    relative to the in-lined memory if memory is in-lined in the vmsn).
+    if(!fInlineMemory) {
+        oInlineMemory = 0;
+        cbInlineMemory = 0;
+    }
+    for(iMemoryRegion = 0; iMemoryRegion < cMemoryRegion; iMemoryRegion++) {
+        pRegion = pRegions + iMemoryRegion;
+        if(pRegion->fSize && pRegion->fOffsetMemory && pRegion->fOffsetFile) {
+            LcMemMap_AddRange(ctxLC, pRegion->cbOffsetMemory, pRegion->cbSize, LC_MEMMAP_FORCE_OFFSET | (oInlineMemory + pRegion->cbOffsetFile));
+            ctx->CrashOrCoreDump.fValidVMwareDump = TRUE;
+        }
+    }
+    if(!LcMemMap_IsInitialized(ctxLC) && cbInlineMemory) {
+        // in-lined memory without region tags - single region at physical address zero.
+        LcMemMap_AddRange(ctxLC, 0, cbInlineMemory & ~0xfffULL, LC_MEMMAP_FORCE_OFFSET | oInlineMemory);
+        ctx->CrashOrCoreDump.fValidVMwareDump = TRUE;
+    }
+    ctx->paDtbHint = paDtbHint;
+    if(!LcMemMap_IsInitialized(ctxLC) && (dwPlatform == 3) && (qwMemorySizeMB > 16)) {
+        // ARM64 - initialize with default physical memory offset of 0x80000000 at zero file offset.
+        ctx->tpArch = LC_ARCH_ARM64;
+        LcMemMap_AddRange(ctxLC, 0x80000000, qwMemorySizeMB * 0x00100000ULL, LC_MEMMAP_FORCE_OFFSET | 0);
+    }
+    if(!LcMemMap_IsInitialized(ctxLC)) {
+        lcprintf(ctxLC, "DEVICE: WARN: No VMware memory regions located - file will be treated as single-region.\n");
+    }
+fail:
+    LocalFree(pr);
+    LocalFree(pRegions);
+    LocalFree(pGroups);
+    if(pFile) { fclose(pFile); }
+}
+
+/*
+* Parsing of the Full Bitmap Microsoft Crashdump file (currently only 64-bits).
+* -- ctxLC
+* -- return
+*/
+BOOL DeviceFile_MsCrashCoreDumpInitialize_BitmapFullOrActiveMemory(_In_ PLC_CONTEXT ctxLC)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    _DUMP_HEADER_BITMAP_FULL64 hdr = { 0 };
+    PBYTE pb = NULL;
+    BOOL fResult = FALSE, fPageValid = FALSE;
+    QWORD cb, cbFileBase, iPageBase, iPage, cMaxBits, iPageEx, b;
+    // 1: fetch header:
+    DeviceFile_ReadFile(ctx, 0, 0x2000, sizeof(_DUMP_HEADER_BITMAP_FULL64), (PBYTE)&hdr);
+    if((hdr.Signature != 0x504d5544504d4446) && (hdr.Signature != 0x504d5544504d4453)) { goto fail; }   // !'FDMPDUMP' && !'SDMPDUMP' && 
+    if((hdr.cPages > hdr.cBits) || (hdr.cBits > 0x7fffffff) || (hdr.cbFileBase & 0xfff) || (hdr.cbFileBase > 0x01000000)) { goto fail; }
+    cbFileBase = hdr.cbFileBase;
+    // 2: fetch bits:
+    cb = hdr.cBits / 8;
+    if(!(pb = LocalAlloc(LMEM_ZEROINIT, (SIZE_T)cb))) { goto fail; }
+    if(!DeviceFile_ReadFile(ctx, 0, 0x2000 + sizeof(_DUMP_HEADER_BITMAP_FULL64), (DWORD)cb, pb)) { goto fail; }
+    // 3: walk bitmap - add ranges!
+    cMaxBits = hdr.cBits & 0xffffffc0;
+    for(iPage = 0; iPage < cMaxBits; iPage += 64) {
+        b = *(PQWORD)(pb + (iPage >> 3));
+        // all pages valid!
+        if(b == (QWORD)-1) {
+            if(!fPageValid) {
+                fPageValid = TRUE;
+                iPageBase = iPage;
+            }
+            continue;
+        }
+        // no pages valid!
+        if(!b && !fPageValid) { continue; }
+        // some valid pages
+        for(iPageEx = 0; iPageEx < 64; iPageEx++) {
+            if((b >> iPageEx) & 1) {
+                // valid
+                if(!fPageValid) {
+                    fPageValid = TRUE;
+                    iPageBase = iPage + iPageEx;
+                }
+            } else {
+                // invalid
+                if(fPageValid) {
+                    cb = (iPage + iPageEx - iPageBase) << 12;
+                    if(!LcMemMap_AddRange(ctxLC, iPageBase << 12, cb, cbFileBase)) {
+                        lcprintf(ctxLC, "DEVICE: FAIL: unable to add range to memory map. (%016llx %016llx %016llx)\n", iPageBase << 12, cb, cbFileBase);
+                        return FALSE;
+                    }
+                    cbFileBase += cb;
+                    fPageValid = FALSE;
+                }
+            }
+        }
+    }
+    // 4: finalize remaining
+    if(fPageValid) {
+        cb = (iPage - iPageBase) << 12;
+        if(!LcMemMap_AddRange(ctxLC, iPageBase << 12, cb, cbFileBase)) {
+            lcprintf(ctxLC, "DEVICE: FAIL: unable to add range to memory map. (%016llx %016llx %016llx)\n", iPageBase << 12, cb, cbFileBase);
+            return FALSE;
+        }
+    }
+    ctx->CrashOrCoreDump.fValidCrashDump = TRUE;
+    fResult = TRUE;
+fail:
+    if(!fResult) {
+        lcprintf(ctxLC, "DEVICE: FAIL: error parsing 64-bit full bitmap dump.\n");
+    }
+    return fResult;
+}
+
+#define FILE_LIME_SERIAL_HEADERS        4       // headers walked serially before predicting
+#define FILE_LIME_PREDICT_MAX           64      // max predicted headers verified per batch
+
+typedef struct tdFILE_LIME_PARALLEL_WORKER {
+    struct tdFILE_LIME_PARALLEL_CONTEXT *pp;
+    DWORD iWorker;                  // worker index = file handle index
+    HANDLE hEventWakeup;
+    HANDLE hEventFinish;
+    HANDLE hThread;
+} FILE_LIME_PARALLEL_WORKER, *PFILE_LIME_PARALLEL_WORKER;
+
+typedef struct tdFILE_LIME_PARALLEL_CONTEXT {
+    PDEVICE_CONTEXT_FILE ctx;
+    BOOL fActive;
+    DWORD cWorker;                  // worker 0 = calling thread
+    DWORD cPredict;
+    QWORD poPredict[FILE_LIME_PREDICT_MAX];
+    LIME_MEM_RANGE_HEADER Header[FILE_LIME_PREDICT_MAX];
+    FILE_LIME_PARALLEL_WORKER Worker[FILE_MAX_THREADS];
+} FILE_LIME_PARALLEL_CONTEXT, *PFILE_LIME_PARALLEL_CONTEXT;
+
+/*
+* Read the predicted LiME headers assigned to a worker. Each worker reads from
+* its own file handle so that reads are issued concurrently.
+* -- pp
+* -- iWorker
+*/
+VOID DeviceFile_DumpInitialize_LiME_ParallelRead(_In_ PFILE_LIME_PARALLEL_CONTEXT pp, _In_ DWORD iWorker)
+{
+    DWORD i;
+    for(i = iWorker; i < pp->cPredict; i += pp->cWorker) {
+        if(!DeviceFile_ReadFile(pp->ctx, iWorker, pp->poPredict[i], sizeof(LIME_MEM_RANGE_HEADER), (PBYTE)&pp->Header[i])) {
+            ZeroMemory(&pp->Header[i], sizeof(LIME_MEM_RANGE_HEADER));
+        }
+    }
+}
+
+DWORD DeviceFile_DumpInitialize_LiME_ParallelThreadProc(_In_ PFILE_LIME_PARALLEL_WORKER pw)
+{
+    while(pw->pp->fActive) {
+        WaitForSingleObject(pw->hEventWakeup, INFINITE);
+        if(!pw->pp->fActive) { break; }
+        DeviceFile_DumpInitialize_LiME_ParallelRead(pw->pp, pw->iWorker);
+        SetEvent(pw->hEventFinish);
+    }
+    SetEvent(pw->hEventFinish);
+    return 0;
+}
+
+/*
+* Clean up the LiME parallel header discovery worker threads.
+* -- pp
+*/
+VOID DeviceFile_DumpInitialize_LiME_ParallelClose(_In_opt_ PFILE_LIME_PARALLEL_CONTEXT pp)
+{
+    DWORD i;
+    if(!pp) { return; }
+    pp->fActive = FALSE;
+    for(i = 1; i < FILE_MAX_THREADS; i++) {
+        if(pp->Worker[i].hThread) {
+            SetEvent(pp->Worker[i].hEventWakeup);
+            WaitForSingleObject(pp->Worker[i].hEventFinish, INFINITE);
+            CloseHandle(pp->Worker[i].hThread);
+        }
+        if(pp->Worker[i].hEventWakeup) { CloseHandle(pp->Worker[i].hEventWakeup); }
+        if(pp->Worker[i].hEventFinish) { CloseHandle(pp->Worker[i].hEventFinish); }
+    }
+    LocalFree(pp);
+}
+
+/*
+* Initialize the LiME parallel header discovery. One worker is used for each
+* open file handle; the calling thread acts as worker 0.
+* -- ctx
+* -- return = the parallel context or NULL if not possible (single file handle).
+*/
+PFILE_LIME_PARALLEL_CONTEXT DeviceFile_DumpInitialize_LiME_ParallelInitialize(_In_ PDEVICE_CONTEXT_FILE ctx)
+{
+    DWORD i;
+    PFILE_LIME_PARALLEL_CONTEXT pp;
+    if(!ctx->fMultiThreaded) { return NULL; }
+    if(!(pp = LocalAlloc(LMEM_ZEROINIT, sizeof(FILE_LIME_PARALLEL_CONTEXT)))) { return NULL; }
+    pp->ctx = ctx;
+    pp->fActive = TRUE;
+    pp->cWorker = 1;
+    for(i = 1; (i < FILE_MAX_THREADS) && ctx->File[i].h; i++) {
+        pp->Worker[i].pp = pp;
+        pp->Worker[i].iWorker = i;
+        if(!(pp->Worker[i].hEventWakeup = CreateEvent(NULL, FALSE, FALSE, NULL))) { break; }
+        if(!(pp->Worker[i].hEventFinish = CreateEvent(NULL, FALSE, FALSE, NULL))) { break; }
+        if(!(pp->Worker[i].hThread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)DeviceFile_DumpInitialize_LiME_ParallelThreadProc, &pp->Worker[i], 0, NULL))) { break; }
+        pp->cWorker++;
+    }
+    if(pp->cWorker < 2) {
+        DeviceFile_DumpInitialize_LiME_ParallelClose(pp);
+        return NULL;
+    }
+    return pp;
+}
+
+/*
+* Verify and add the memory range of a single LiME header.
+* -- ctxLC
+* -- oLimeHeader = file offset of the LiME header.
+* -- pLimeHeader
+* -- pcbPreviousRangeMax = end address of previous range (updated on success).
+* -- poLimeHeaderNext = file offset of next LiME header (updated on success).
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_DumpInitialize_LiME_AddRange(_In_ PLC_CONTEXT ctxLC, _In_ QWORD oLimeHeader, _In_ PLIME_MEM_RANGE_HEADER pLimeHeader, _Inout_ PQWORD pcbPreviousRangeMax, _Out_ PQWORD poLimeHeaderNext)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    QWORD cbRangeMax, cbRangeFileMax;
+    BOOL f;
+    f = (pLimeHeader->magic == LIME_MAGIC) && (pLimeHeader->version == LIME_VERSION) &&
+        ((pLimeHeader->_s_addr & 0xfff) == 0) && (pLimeHeader->_s_addr >= *pcbPreviousRangeMax) &&
+        (((pLimeHeader->_e_addr & 0xfff) == 0xfff) || ((pLimeHeader->_e_addr & 0xfff) == 0x000)) &&
+        (pLimeHeader->_s_addr < pLimeHeader->_e_addr);
+    if(!f) {
+        lcprintf(ctxLC, "DEVICE: FAIL: Parse LiME header at offset: 0x%llx\n", oLimeHeader);
+        return FALSE;
+    }
+    cbRangeMax = (pLimeHeader->_e_addr + 1) & ~0xfff;
+    cbRangeFileMax = (ctx->cbFile + pLimeHeader->_s_addr + oLimeHeader - sizeof(LIME_MEM_RANGE_HEADER)) & ~0xfff;
+    if(cbRangeMax > cbRangeFileMax) {
+        lcprintf(ctxLC, "DEVICE: WARN: memory range exceeds file size - adjusting...\n");
+        cbRangeMax = cbRangeFileMax;
+    }
+    if(!LcMemMap_AddRange(ctxLC, (QWORD)pLimeHeader->_s_addr, cbRangeMax - (QWORD)pLimeHeader->_s_addr, oLimeHeader + 0x20)) {
+        lcprintf(ctxLC, "DEVICE: FAIL: unable to add range to memory map. (%016llx %016llx %016llx)\n", pLimeHeader->_s_addr, cbRangeMax - pLimeHeader->_s_addr, oLimeHeader + 0x20);
+        return FALSE;
+    }
+    *poLimeHeaderNext = oLimeHeader + sizeof(LIME_MEM_RANGE_HEADER) + cbRangeMax - (QWORD)pLimeHeader->_s_addr;
+    *pcbPreviousRangeMax = cbRangeMax;
+    return TRUE;
+}
+
+/*
+* Initialize a LiME memory dump. In LiME memory dumps the headers are
+* spread out throughout the dump file (before each memory range).
+* Each header is located directly after the previous range which makes the
+* serial walk one dependent read per range. If multiple file handles exist
+* header locations are predicted from the size of the previous range and
+* verified by concurrent reads; a wrong prediction is simply discarded and
+* the walk continues from the last verified header.
+* -- ctxLC
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_DumpInitialize_LiME(_In_ PLC_CONTEXT ctxLC)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    PFILE_LIME_PARALLEL_CONTEXT pp = NULL;
+    QWORD cbStride, cbPreviousRangeMax = 0, oLimeHeader = 0;
+    DWORD i, cHeader = 0, cPredict = 0, cPredictHit = 0;
+    LIME_MEM_RANGE_HEADER LimeHeader;
+    BOOL fResult = FALSE, fParallelInit = FALSE;
+    while((oLimeHeader + sizeof(LIME_MEM_RANGE_HEADER) + 0x1000) <= ctx->cbFile) {
+        // 1: predicted (parallel) header discovery - predict that the next
+        //    ranges are of the same size as the previous range:
+        if((cHeader >= FILE_LIME_SERIAL_HEADERS) && !fParallelInit) {
+            fParallelInit = TRUE;
+            if((pp = DeviceFile_DumpInitialize_LiME_ParallelInitialize(ctx))) {
+                cPredict = pp->cWorker;
+            }
+        }
+        if(pp) {
+            cbStride = sizeof(LIME_MEM_RANGE_HEADER) + cbPreviousRangeMax - LimeHeader._s_addr;
+            for(i = 0; (i < cPredict) && (oLimeHeader + i * cbStride + sizeof(LIME_MEM_RANGE_HEADER) + 0x1000 <= ctx->cbFile); i++) {
+                pp->poPredict[i] = oLimeHeader + i * cbStride;
+            }
+            pp->cPredict = i;
+            for(i = 1; i < pp->cWorker; i++) {
+                SetEvent(pp->Worker[i].hEventWakeup);
+            }
+            DeviceFile_DumpInitialize_LiME_ParallelRead(pp, 0);
+            for(i = 1; i < pp->cWorker; i++) {
+                WaitForSingleObject(pp->Worker[i].hEventFinish, INFINITE);
+            }
+            // verify predictions in order - stop at the first mismatch:
+            for(i = 0; (i < pp->cPredict) && (pp->poPredict[i] == oLimeHeader); i++) {
+                LimeHeader = pp->Header[i];
+                if(!LimeHeader.magic && !LimeHeader.version) {
+                    fResult = TRUE;
+                    goto finish;
+                }
+                if(!DeviceFile_DumpInitialize_LiME_AddRange(ctxLC, oLimeHeader, &LimeHeader, &cbPreviousRangeMax, &oLimeHeader)) { goto finish; }
+                cHeader++;
+            }
+            cPredictHit += i ? i - 1 : 0;
+            cPredict = (i == pp->cPredict) ? min(FILE_LIME_PREDICT_MAX, 2 * cPredict) : pp->cWorker;
+            continue;
+        }
+        // 2: serial header discovery:
+        ZeroMemory(&LimeHeader, sizeof(LIME_MEM_RANGE_HEADER));
+        DeviceFile_ReadFile(ctx, 0, oLimeHeader, sizeof(LIME_MEM_RANGE_HEADER), (PBYTE)&LimeHeader);
+        if(oLimeHeader && !LimeHeader.magic && !LimeHeader.version) {
+            fResult = TRUE;
+            goto finish;
+        }
+        if(!DeviceFile_DumpInitialize_LiME_AddRange(ctxLC, oLimeHeader, &LimeHeader, &cbPreviousRangeMax, &oLimeHeader)) { goto finish; }
+        cHeader++;
+    }
+    fResult = cbPreviousRangeMax ? TRUE : FALSE;
+finish:
+    if(pp) {
+        lcprintfvv_fn(ctxLC, "LiME: %i headers, %i located by prediction.\n", cHeader, cPredictHit);
+    }
+    DeviceFile_DumpInitialize_LiME_ParallelClose(pp);
+    return fResult;
+}
+
+//-----------------------------------------------------------------------------
+// KDUMP COMPRESSED (DISKDUMP) FUNCTIONALITY BELOW:
+// Dump pages are located by their rank in the dumped page bitmap. Each page
+// descriptor points to a page which may be stored as-is or compressed with
+// zlib, lzo, snappy or zstd. The decompression libraries are loaded on demand.
+//-----------------------------------------------------------------------------
+
+/*
+* Count the number of set bits in a 64-bit word.
+* -- q
+* -- return
+*/
+DWORD DeviceFile_Kdump_BitCount(_In_ QWORD q)
+{
+    q = q - ((q >> 1) & 0x5555555555555555);
+    q = (q & 0x3333333333333333) + ((q >> 2) & 0x3333333333333333);
+    q = (q + (q >> 4)) & 0x0f0f0f0f0f0f0f0f;
+    return (DWORD)((q * 0x0101010101010101) >> 56);
+}
+
+/*
+* Retrieve the page descriptor index of a pfn. The index is the number of
+* dumped pfns preceding the pfn in the dumped page bitmap.
+* -- ctx
+* -- pfn
+* -- piDesc
+* -- return = FALSE if the pfn does not exist in the dump.
+*/
+_Success_(return)
+BOOL DeviceFile_Kdump_PfnToDescIndex(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ QWORD pfn, _Out_ PQWORD piDesc)
+{
+    QWORD i, iDesc;
+    PQWORD pqwBitmap = ctx->Kdump.pqwBitmap;
+    if(pfn >= ctx->Kdump.cPfn) { return FALSE; }
+    if(!((pqwBitmap[pfn >> 6] >> (pfn & 63)) & 1)) { return FALSE; }
+    iDesc = ctx->Kdump.pqwRank[pfn >> 9];
+    for(i = (pfn >> 9) << 3; i < (pfn >> 6); i++) {
+        iDesc += DeviceFile_Kdump_BitCount(pqwBitmap[i]);
+    }
+    iDesc += DeviceFile_Kdump_BitCount(pqwBitmap[pfn >> 6] & ((1ULL << (pfn & 63)) - 1));
+    *piDesc = iDesc;
+    return TRUE;
+}
+
+/*
+* Decompress a single kdump page into a page-sized buffer.
+* -- ctx
+* -- dwFlags = KDUMP_DH_COMPRESSED_* flags of the page descriptor.
+* -- pbSrc
+* -- cbSrc
+* -- pbDst = buffer of ctx->Kdump.cbBlock bytes.
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Kdump_Decompress(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ DWORD dwFlags, _In_reads_(cbSrc) PBYTE pbSrc, _In_ DWORD cbSrc, _Out_ PBYTE pbDst)
+{
+    DWORD cbBlock = ctx->Kdump.cbBlock;
+    unsigned long cbZlib = cbBlock;
+    SIZE_T cbDst = cbBlock;
+    if(dwFlags & KDUMP_DH_COMPRESSED_ZLIB) {
+        return ctx->Kdump.fn.pfnZlibUncompress && (0 == ctx->Kdump.fn.pfnZlibUncompress(pbDst, &cbZlib, pbSrc, cbSrc)) && (cbZlib == cbBlock);
+    }
+    if(dwFlags & KDUMP_DH_COMPRESSED_LZO) {
+        return ctx->Kdump.fn.pfnLzo1xDecompressSafe && (0 == ctx->Kdump.fn.pfnLzo1xDecompressSafe(pbSrc, cbSrc, pbDst, &cbDst, NULL)) && (cbDst == cbBlock);
+    }
+    if(dwFlags & KDUMP_DH_COMPRESSED_SNAPPY) {
+        return ctx->Kdump.fn.pfnSnappyUncompress && (0 == ctx->Kdump.fn.pfnSnappyUncompress((CHAR*)pbSrc, cbSrc, (CHAR*)pbDst, &cbDst)) && (cbDst == cbBlock);
+    }
+    if(dwFlags & KDUMP_DH_COMPRESSED_ZSTD) {
+        return ctx->Kdump.fn.pfnZstdDecompress && (cbBlock == ctx->Kdump.fn.pfnZstdDecompress(pbDst, cbBlock, pbSrc, cbSrc));
+    }
+    return FALSE;
+}
+
+/*
+* Read a full decompressed dump page by its page descriptor index. Compressed
+* pages are kept in a direct-mapped cache once decompressed since neighbouring
+* reads in the same page are common.
+* -- ctx
+* -- iFile = file handle held by caller.
+* -- iDesc
+* -- pbScratch = scratch buffer of ctx->Kdump.cbBlock bytes.
+* -- pbPage = buffer of ctx->Kdump.cbBlock bytes to receive the page.
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Kdump_ReadPage(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ DWORD iFile, _In_ QWORD iDesc, _In_ PBYTE pbScratch, _Out_ PBYTE pbPage)
+{
+    KDUMP_PAGE_DESC Desc;
+    PKDUMP_PAGE_CACHE_ENTRY pe = NULL;
+    DWORD cbBlock = ctx->Kdump.cbBlock;
+    // 1: try fetch from decompressed page cache:
+    if(ctx->Kdump.pbCache) {
+        pe = (PKDUMP_PAGE_CACHE_ENTRY)(ctx->Kdump.pbCache + (iDesc % ctx->Kdump.cCacheEntry) * ctx->Kdump.cbCacheEntry);
+        EnterCriticalSection(&ctx->Kdump.LockCache);
+        if(pe->iDesc == iDesc + 1) {
+            memcpy(pbPage, pe->pb, cbBlock);
+            LeaveCriticalSection(&ctx->Kdump.LockCache);
+            return TRUE;
+        }
+        LeaveCriticalSection(&ctx->Kdump.LockCache);
+    }
+    // 2: read page descriptor (offset zero = page not written in incomplete dump):
+    if(!DeviceFile_ReadFile(ctx, iFile, ctx->Kdump.oPageDesc + iDesc * sizeof(KDUMP_PAGE_DESC), sizeof(KDUMP_PAGE_DESC), (PBYTE)&Desc)) { return FALSE; }
+    if(!Desc.offset || !Desc.size || (Desc.size > cbBlock) || (Desc.offset + Desc.size > ctx->cbFile)) { return FALSE; }
+    // 3: read page - uncompressed pages are read directly into the page buffer:
+    if(!(Desc.flags & (KDUMP_DH_COMPRESSED_ZLIB | KDUMP_DH_COMPRESSED_LZO | KDUMP_DH_COMPRESSED_SNAPPY | KDUMP_DH_COMPRESSED_ZSTD))) {
+        return (Desc.size == cbBlock) && DeviceFile_ReadFile(ctx, iFile, Desc.offset, cbBlock, pbPage);
+    }
+    if(!DeviceFile_ReadFile(ctx, iFile, Desc.offset, Desc.size, pbScratch)) { return FALSE; }
+    if(!DeviceFile_Kdump_Decompress(ctx, Desc.flags, pbScratch, Desc.size, pbPage)) { return FALSE; }
+    // 4: store decompressed page in cache:
+    if(pe) {
+        EnterCriticalSection(&ctx->Kdump.LockCache);
+        memcpy(pe->pb, pbPage, cbBlock);
+        pe->iDesc = iDesc + 1;
+        LeaveCriticalSection(&ctx->Kdump.LockCache);
+    }
+    return TRUE;
+}
+
+/*
+* Scatter read function for kdump compressed dumps - to be called by LeechCore.
+* The memory map is identity mapped so the MEM address is the physical address.
+* -- ctxLC
+* -- cpMEMs
+* -- ppMEMs
+*/
+VOID DeviceFile_Kdump_ReadScatter(_In_ PLC_CONTEXT ctxLC, _In_ DWORD cpMEMs, _Inout_ PPMEM_SCATTER ppMEMs)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    DWORD iMEM, iFile, oPage, cbBlock = ctx->Kdump.cbBlock;
+    QWORD pfn, pfnBuffer = (QWORD)-1, iDesc;
+    PBYTE pbBuffer;
+    PMEM_SCATTER pMEM;
+    if(!(pbBuffer = LocalAlloc(0, 2ULL * cbBlock))) { return; }
+    iFile = DeviceFile_LockAcquire(ctx);
+    for(iMEM = 0; iMEM < cpMEMs; iMEM++) {
+        pMEM = ppMEMs[iMEM];
+        if(pMEM->f || (pMEM->qwA == (QWORD)-1)) { continue; }
+        pfn = pMEM->qwA >> ctx->Kdump.dwBlockShift;
+        oPage = (DWORD)(pMEM->qwA & (cbBlock - 1));
+        if(oPage + pMEM->cb > cbBlock) {
+            lcprintfvvv_fn(ctxLC, "READ FAILED (CROSS PAGE):\n        offset=%016llx req_len=%08x\n", pMEM->qwA, pMEM->cb);
+            continue;
+        }
+        if(pfn != pfnBuffer) {
+            pfnBuffer = (QWORD)-1;
+            if(!DeviceFile_Kdump_PfnToDescIndex(ctx, pfn, &iDesc) || !DeviceFile_Kdump_ReadPage(ctx, iFile, iDesc, pbBuffer + cbBlock, pbBuffer)) {
+                lcprintfvvv_fn(ctxLC, "READ FAILED:\n        offset=%016llx req_len=%08x\n", pMEM->qwA, pMEM->cb);
+                continue;
+            }
+            pfnBuffer = pfn;
+        }
+        memcpy(pMEM->pb, pbBuffer + oPage, pMEM->cb);
+        pMEM->f = TRUE;
+        if(ctxLC->fPrintf[LC_PRINTF_VVV]) {
+            lcprintf_fn(
+                ctxLC,
+                "READ:\n        offset=%016llx req_len=%08x\n",
+                pMEM->qwA,
+                pMEM->cb
+            );
+            Util_PrintHexAscii(ctxLC, pMEM->pb, pMEM->cb, 0);
+        }
+    }
+    DeviceFile_LockRelease(ctx, iFile);
+    LocalFree(pbBuffer);
+}
+
+/*
+* Walk the dumped page bitmap and either count or add memory map ranges. The
+* walk is done with a granularity of 2^dwUnitShift pfns - a unit is present if
+* any pfn within it is dumped. Non-dumped pfns within a present unit will fail
+* to read in DeviceFile_Kdump_ReadScatter.
+* -- ctxLC
+* -- dwUnitShift = 0 (single pfn) or 9 (512 pfns).
+* -- fAdd = add ranges to memory map (otherwise only count ranges).
+* -- return = number of ranges, or (QWORD)-1 on failure.
+*/
+QWORD DeviceFile_Kdump_MemMapWalk(_In_ PLC_CONTEXT ctxLC, _In_ DWORD dwUnitShift, _In_ BOOL fAdd)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    PQWORD pqwBitmap = ctx->Kdump.pqwBitmap;
+    QWORD iUnit, iUnitBase = 0, cUnit, cRange = 0, qw, pa, cb;
+    DWORD i, dwShift = dwUnitShift + ctx->Kdump.dwBlockShift;
+    BOOL f, fValid = FALSE;
+    cUnit = (ctx->Kdump.cPfn + (1ULL << dwUnitShift) - 1) >> dwUnitShift;
+    for(iUnit = 0; iUnit <= cUnit; iUnit++) {
+        if(iUnit == cUnit) {
+            f = FALSE;
+        } else if(dwUnitShift) {
+            for(qw = 0, i = 0; i < 8; i++) {
+                qw |= pqwBitmap[(iUnit << 3) + i];
+            }
+            f = qw ? TRUE : FALSE;
+        } else {
+            qw = pqwBitmap[iUnit >> 6];
+            if(!(iUnit & 63) && (iUnit + 64 <= cUnit) && ((!fValid && !qw) || (fValid && (qw == (QWORD)-1)))) {
+                iUnit += 63;
+                continue;
+            }
+            f = (qw >> (iUnit & 63)) & 1;
+        }
+        if(f && !fValid) {
+            fValid = TRUE;
+            iUnitBase = iUnit;
+        }
+        if(!f && fValid) {
+            fValid = FALSE;
+            cRange++;
+            if(fAdd) {
+                pa = iUnitBase << dwShift;
+                cb = (iUnit - iUnitBase) << dwShift;
+                if(!LcMemMap_AddRange(ctxLC, pa, cb, pa)) {
+                    lcprintf(ctxLC, "DEVICE: FAIL: unable to add range to memory map. (%016llx %016llx %016llx)\n", pa, cb, pa);
+                    return (QWORD)-1;
+                }
+            }
+        }
+    }
+    return cRange;
+}
+
+/*
+* Load the decompression libraries required by a kdump compressed dump. A
+* missing library is not fatal - pages compressed with it will fail to read.
+* -- ctxLC
+* -- dwStatus = KDUMP_DH_COMPRESSED_* flags from the dump header.
+*/
+VOID DeviceFile_Kdump_LoadLibraries(_In_ PLC_CONTEXT ctxLC, _In_ DWORD dwStatus)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    if((dwStatus & KDUMP_DH_COMPRESSED_ZLIB) && (ctx->Kdump.fn.hModuleZlib = LoadLibraryA(KDUMP_LIBRARY_ZLIB))) {
+        ctx->Kdump.fn.pfnZlibUncompress = (PFN_KDUMP_ZLIB_UNCOMPRESS)GetProcAddress(ctx->Kdump.fn.hModuleZlib, "uncompress");
+    }
+    if((dwStatus & KDUMP_DH_COMPRESSED_LZO) && (ctx->Kdump.fn.hModuleLzo = LoadLibraryA(KDUMP_LIBRARY_LZO))) {
+        ctx->Kdump.fn.pfnLzo1xDecompressSafe = (PFN_KDUMP_LZO1X_DECOMPRESS_SAFE)GetProcAddress(ctx->Kdump.fn.hModuleLzo, "lzo1x_decompress_safe");
+    }
+    if((dwStatus & KDUMP_DH_COMPRESSED_SNAPPY) && (ctx->Kdump.fn.hModuleSnappy = LoadLibraryA(KDUMP_LIBRARY_SNAPPY))) {
+        ctx->Kdump.fn.pfnSnappyUncompress = (PFN_KDUMP_SNAPPY_UNCOMPRESS)GetProcAddress(ctx->Kdump.fn.hModuleSnappy, "snappy_uncompress");
+    }
+    if((dwStatus & KDUMP_DH_COMPRESSED_ZSTD) && (ctx->Kdump.fn.hModuleZstd = LoadLibraryA(KDUMP_LIBRARY_ZSTD))) {
+        ctx->Kdump.fn.pfnZstdDecompress = (PFN_KDUMP_ZSTD_DECOMPRESS)GetProcAddress(ctx->Kdump.fn.hModuleZstd, "ZSTD_decompress");
+    }
+    if((dwStatus & KDUMP_DH_COMPRESSED_ZLIB) && !ctx->Kdump.fn.pfnZlibUncompress) {
+        lcprintf(ctxLC, "DEVICE: WARN: kdump: zlib compression - unable to load '%s'.\n", KDUMP_LIBRARY_ZLIB);
+    }
+    if((dwStatus & KDUMP_DH_COMPRESSED_LZO) && !ctx->Kdump.fn.pfnLzo1xDecompressSafe) {
+        lcprintf(ctxLC, "DEVICE: WARN: kdump: lzo compression - unable to load '%s'.\n", KDUMP_LIBRARY_LZO);
+    }
+    if((dwStatus & KDUMP_DH_COMPRESSED_SNAPPY) && !ctx->Kdump.fn.pfnSnappyUncompress) {
+        lcprintf(ctxLC, "DEVICE: WARN: kdump: snappy compression - unable to load '%s'.\n", KDUMP_LIBRARY_SNAPPY);
+    }
+    if((dwStatus & KDUMP_DH_COMPRESSED_ZSTD) && !ctx->Kdump.fn.pfnZstdDecompress) {
+        lcprintf(ctxLC, "DEVICE: WARN: kdump: zstd compression - unable to load '%s'.\n", KDUMP_LIBRARY_ZSTD);
+    }
+}
+
+/*
+* Clean up kdump compressed dump related resources.
+* -- ctx
+*/
+VOID DeviceFile_Kdump_Close(_In_ PDEVICE_CONTEXT_FILE ctx)
+{
+    if(ctx->Kdump.pbCache) {
+        DeleteCriticalSection(&ctx->Kdump.LockCache);
+        LocalFree(ctx->Kdump.pbCache);
+        ctx->Kdump.pbCache = NULL;
+    }
+    LocalFree(ctx->Kdump.pqwBitmap);
+    LocalFree(ctx->Kdump.pqwRank);
+    ctx->Kdump.pqwBitmap = NULL;
+    ctx->Kdump.pqwRank = NULL;
+    if(ctx->Kdump.fn.hModuleZlib) { FreeLibrary(ctx->Kdump.fn.hModuleZlib); }
+    if(ctx->Kdump.fn.hModuleLzo) { FreeLibrary(ctx->Kdump.fn.hModuleLzo); }
+    if(ctx->Kdump.fn.hModuleSnappy) { FreeLibrary(ctx->Kdump.fn.hModuleSnappy); }
+    if(ctx->Kdump.fn.hModuleZstd) { FreeLibrary(ctx->Kdump.fn.hModuleZstd); }
+    ZeroMemory(&ctx->Kdump.fn, sizeof(ctx->Kdump.fn));
+}
+
+/*
+* Initialize a kdump compressed dump (makedumpfile / QEMU dump-guest-memory).
+* Only the 64-bit header layout is supported. Split dumps are supported on a
+* per-file basis - only the pfn range of the opened file is readable.
+* -- ctxLC
+* -- fMemMap = populate the memory map (FALSE if restored from index file).
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_DumpInitialize_Kdump(_In_ PLC_CONTEXT ctxLC, _In_ BOOL fMemMap)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    PKDUMP_DISK_DUMP_HEADER64 pHdr = &ctx->CrashOrCoreDump.Kdump;
+    KDUMP_SUB_HEADER64 SubHdr = { 0 };
+    QWORD i, cqwBitmap, cbBitmap, oBitmap, cRank, cRange, pfnStart, pfnEnd;
+    DWORD dwUnitShift, cbBlock = pHdr->block_size;
+    // 1: verify header:
+    lcprintfvv_fn(ctxLC, "Kdump Compressed Dump identified.\n");
+    if((cbBlock < 0x1000) || (cbBlock > 0x10000) || (cbBlock & (cbBlock - 1)) || !pHdr->sub_hdr_size || !pHdr->bitmap_blocks || (pHdr->bitmap_blocks & 1)) {
+        lcprintf(ctxLC, "DEVICE: FAIL: kdump: unsupported header (32-bit dumps are not supported).\n");
+        return FALSE;
+    }
+    while((1UL << ctx->Kdump.dwBlockShift) < cbBlock) {
+        ctx->Kdump.dwBlockShift++;
+    }
+    ctx->Kdump.cbBlock = cbBlock;
+    if(!strncmp(pHdr->utsname_machine, "x86_64", 7)) { ctx->tpArch = LC_ARCH_X64; }
+    if(!strncmp(pHdr->utsname_machine, "aarch64", 8)) { ctx->tpArch = LC_ARCH_ARM64; }
+    if(pHdr->status & KDUMP_DH_COMPRESSED_INCOMPLETE) {
+        lcprintf(ctxLC, "DEVICE: WARN: kdump: incomplete dump - analysis will be degraded!\n");
+    }
+    // 2: fetch sub header and the pfn range:
+    if(!DeviceFile_ReadFile(ctx, 0, cbBlock, sizeof(KDUMP_SUB_HEADER64), (PBYTE)&SubHdr)) { goto fail; }
+    ctx->Kdump.cPfn = pHdr->max_mapnr;
+    pfnStart = SubHdr.start_pfn;
+    pfnEnd = SubHdr.end_pfn;
+    if(pHdr->header_version >= 6) {
+        if(SubHdr.max_mapnr_64) { ctx->Kdump.cPfn = SubHdr.max_mapnr_64; }
+        pfnStart = SubHdr.start_pfn_64;
+        pfnEnd = SubHdr.end_pfn_64;
+    }
+    // 3: fetch the dumped page bitmap (2nd bitmap) and calculate pfn ranks:
+    cbBitmap = (QWORD)pHdr->bitmap_blocks * cbBlock / 2;
+    oBitmap = (1ULL + pHdr->sub_hdr_size) * cbBlock;
+    if(!ctx->Kdump.cPfn || (ctx->Kdump.cPfn > cbBitmap * 8) || (cbBitmap > 0x40000000) || (oBitmap + 2 * cbBitmap > ctx->cbFile)) { goto fail; }
+    cqwBitmap = ((ctx->Kdump.cPfn + 511) >> 9) << 3;
+    if(!(ctx->Kdump.pqwBitmap = LocalAlloc(LMEM_ZEROINIT, (SIZE_T)(cqwBitmap * sizeof(QWORD))))) { goto fail; }
+    if(!(ctx->Kdump.pqwRank = LocalAlloc(0, (SIZE_T)((cqwBitmap >> 3) * sizeof(QWORD))))) { goto fail; }
+    if(!DeviceFile_ReadFile(ctx, 0, oBitmap + cbBitmap, (DWORD)((ctx->Kdump.cPfn + 7) >> 3), (PBYTE)ctx->Kdump.pqwBitmap)) { goto fail; }
+    for(i = ctx->Kdump.cPfn; i < (cqwBitmap << 6); i++) {
+        ctx->Kdump.pqwBitmap[i >> 6] &= ~(1ULL << (i & 63));
+    }
+    if(SubHdr.split) {
+        // split dump: page descriptors are relative to the start pfn of this file.
+        lcprintfv(ctxLC, "DEVICE: WARN: kdump: split dump - only pfn range %llx-%llx available.\n", pfnStart, pfnEnd);
+        for(i = 0; i < (cqwBitmap << 6); i++) {
+            if((i < pfnStart) || (i >= pfnEnd)) {
+                ctx->Kdump.pqwBitmap[i >> 6] &= ~(1ULL << (i & 63));
+            }
+        }
+    }
+    for(cRank = 0, i = 0; i < cqwBitmap; i++) {
+        if(!(i & 7)) { ctx->Kdump.pqwRank[i >> 3] = cRank; }
+        cRank += DeviceFile_Kdump_BitCount(ctx->Kdump.pqwBitmap[i]);
+    }
+    ctx->Kdump.oPageDesc = (1ULL + pHdr->sub_hdr_size + pHdr->bitmap_blocks) * cbBlock;
+    if(ctx->Kdump.oPageDesc + cRank * sizeof(KDUMP_PAGE_DESC) > ctx->cbFile) { goto fail; }
+    // 4: populate memory map - fall back to a coarser granularity if the dump
+    //    is too fragmented to fit in the memory map (i.e. free pages excluded).
+    if(fMemMap) {
+        dwUnitShift = 0;
+        if(DeviceFile_Kdump_MemMapWalk(ctxLC, 0, FALSE) > 0x00080000) {
+            lcprintfv(ctxLC, "DEVICE: kdump: fragmented dump - using coarse memory map.\n");
+            dwUnitShift = 9;
+        }
+        cRange = DeviceFile_Kdump_MemMapWalk(ctxLC, dwUnitShift, TRUE);
+        if(!cRange || (cRange == (QWORD)-1)) { goto fail; }
+    }
+    // 5: load decompression libraries and allocate decompressed page cache:
+    DeviceFile_Kdump_LoadLibraries(ctxLC, pHdr->status);
+    ctx->Kdump.cbCacheEntry = sizeof(KDUMP_PAGE_CACHE_ENTRY) + cbBlock;
+    ctx->Kdump.cCacheEntry = KDUMP_PAGE_CACHE_SIZE / cbBlock;
+    if((pHdr->status & (KDUMP_DH_COMPRESSED_ZLIB | KDUMP_DH_COMPRESSED_LZO | KDUMP_DH_COMPRESSED_SNAPPY | KDUMP_DH_COMPRESSED_ZSTD))) {
+        if((ctx->Kdump.pbCache = LocalAlloc(LMEM_ZEROINIT, (SIZE_T)ctx->Kdump.cCacheEntry * ctx->Kdump.cbCacheEntry))) {
+            InitializeCriticalSection(&ctx->Kdump.LockCache);
+        }
+    }
+    // 6: kdump dumps are read through the kdump scatter read function:
+    ctxLC->pfnReadScatter = DeviceFile_Kdump_ReadScatter;
+    ctxLC->pfnWriteScatter = NULL;
+    ctxLC->Config.fWritable = FALSE;
+    ctx->CrashOrCoreDump.fValidKdumpDump = TRUE;
+    return TRUE;
+fail:
+    lcprintf(ctxLC, "DEVICE: FAIL: error parsing kdump compressed dump.\n");
+    DeviceFile_Kdump_Close(ctx);
+    return FALSE;
+}
+
+//-----------------------------------------------------------------------------
+// DELTA SNAPSHOT FUNCTIONALITY BELOW:
+// A delta snapshot (LC_DUMP_FORMAT_DELTA) stores only the pages that changed
+// since its parent snapshot. The chain of delta snapshots down to the base
+// snapshot is opened as layers and a per-pfn byte index of the newest layer
+// holding each page is built once. Reads are resolved through the index - the
+// page is then located in its layer by its rank in the stored page bitmap.
+// A non-delta base snapshot (raw, crash or elf dump) is opened as a separate
+// file device.
+//-----------------------------------------------------------------------------
+
+/*
+* Retrieve the index of a stored page within the page data of a layer. The
+* index is the number of stored pfns preceding the pfn in the bitmap.
+* -- pLayer
+* -- pfn
+* -- return
+*/
+QWORD DeviceFile_Delta_PageIndex(_In_ PFILE_DELTA_LAYER pLayer, _In_ QWORD pfn)
+{
+    QWORD i, iPage = pLayer->pqwRank[pfn >> 9];
+    for(i = (pfn >> 9) << 3; i < (pfn >> 6); i++) {
+        iPage += DeviceFile_Kdump_BitCount(pLayer->pqwBitmap[i]);
+    }
+    return iPage + DeviceFile_Kdump_BitCount(pLayer->pqwBitmap[pfn >> 6] & ((1ULL << (pfn & 63)) - 1));
+}
+
+/*
+* Read from a delta snapshot layer at a given file offset. The caller must
+* hold the file handle iFile for the top layer and ctx->Delta.Lock for the
+* parent layers (not required at initialization time).
+* -- ctx
+* -- iFile
+* -- iLayer
+* -- qwOffset
+* -- cb
+* -- pb
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Delta_LayerRead(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ DWORD iFile, _In_ DWORD iLayer, _In_ QWORD qwOffset, _In_ DWORD cb, _Out_writes_(cb) PBYTE pb)
+{
+    if(!iLayer) {
+        return DeviceFile_ReadFile(ctx, iFile, qwOffset, cb, pb);
+    }
+    return DeviceFile_FileIo(ctx->Delta.Layer[iLayer].h, qwOffset, cb, pb, FALSE);
+}
+
+/*
+* Verify the header of a delta snapshot layer and load its stored page bitmap.
+* -- ctx
+* -- iLayer
+* -- pHdr
+* -- cbFile = size of the layer file.
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Delta_LayerInitialize(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ DWORD iLayer, _In_ PLC_DELTA_HEADER pHdr, _In_ QWORD cbFile)
+{
+    PFILE_DELTA_LAYER pLayer = &ctx->Delta.Layer[iLayer];
+    QWORD i, cRank, cqwBitmap = ((pHdr->cPfn + 511) >> 9) << 3;
+    if((pHdr->dwVersion != LC_DELTA_VERSION) || !pHdr->cPfn || (pHdr->cPfn > 0x0000000400000000)) { return FALSE; }
+    if((pHdr->oPageData < sizeof(LC_DELTA_HEADER)) || (pHdr->oPageData + (pHdr->cPageStored << 12) > pHdr->oBitmap)) { return FALSE; }
+    if((pHdr->oBitmap + cqwBitmap * sizeof(QWORD) > pHdr->oHash) || (pHdr->oHash + pHdr->cPfn * sizeof(QWORD) > cbFile)) { return FALSE; }
+    pLayer->cPfn = pHdr->cPfn;
+    pLayer->oPageData = pHdr->oPageData;
+    pLayer->oHash = pHdr->oHash;
+    if(!(pLayer->pqwBitmap = LocalAlloc(0, (SIZE_T)(cqwBitmap * sizeof(QWORD))))) { return FALSE; }
+    if(!(pLayer->pqwRank = LocalAlloc(0, (SIZE_T)((cqwBitmap >> 3) * sizeof(QWORD))))) { return FALSE; }
+    if(!DeviceFile_Delta_LayerRead(ctx, 0, iLayer, pHdr->oBitmap, (DWORD)(cqwBitmap * sizeof(QWORD)), (PBYTE)pLayer->pqwBitmap)) { return FALSE; }
+    for(cRank = 0, i = 0; i < cqwBitmap; i++) {
+        if(!(i & 7)) { pLayer->pqwRank[i >> 3] = cRank; }
+        cRank += DeviceFile_Kdump_BitCount(pLayer->pqwBitmap[i]);
+    }
+    return cRank == pHdr->cPageStored;
+}
+
+/*
+* Open the parent snapshot of a delta snapshot. A relative parent file name is
+* tried relative to the current directory and then to the directory of the
+* child snapshot.
+* -- szChild = file name of the child snapshot.
+* -- szParent = parent file name as recorded in the child snapshot.
+* -- szParentPath = buffer to receive the file name of the opened parent.
+* -- return = file handle or NULL on failure.
+*/
+FILE* DeviceFile_Delta_OpenParent(_In_ LPSTR szChild, _In_ LPSTR szParent, _Out_writes_(MAX_PATH) LPSTR szParentPath)
+{
+    FILE *h = NULL;
+    LPSTR sz;
+    _snprintf_s(szParentPath, MAX_PATH, _TRUNCATE, "%s", szParent);
+    if(!fopen_s(&h, szParentPath, "rb") && h) { return h; }
+    if(!(sz = strrchr(szChild, '/')) && !(sz = strrchr(szChild, '\\'))) { return NULL; }
+    _snprintf_s(szParentPath, MAX_PATH, _TRUNCATE, "%.*s%s", (int)(sz + 1 - szChild), szChild, szParent);
+    if(!fopen_s(&h, szParentPath, "rb") && h) { return h; }
+    return NULL;
+}
+
+/*
+* Walk the per-pfn layer index and either count or add memory map ranges. The
+* walk is done with a granularity of 2^dwUnitShift pfns - a unit is present if
+* any pfn within it is present in any layer.
+* -- ctxLC
+* -- dwUnitShift = 0 (single pfn) or 9 (512 pfns).
+* -- fAdd = add ranges to memory map (otherwise only count ranges).
+* -- return = number of ranges, or (QWORD)-1 on failure.
+*/
+QWORD DeviceFile_Delta_MemMapWalk(_In_ PLC_CONTEXT ctxLC, _In_ DWORD dwUnitShift, _In_ BOOL fAdd)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    QWORD iUnit, iUnitBase = 0, cUnit, cRange = 0, pfn, pfnMax, pa, cb;
+    BOOL f, fValid = FALSE;
+    cUnit = (ctx->Delta.cPfn + (1ULL << dwUnitShift) - 1) >> dwUnitShift;
+    for(iUnit = 0; iUnit <= cUnit; iUnit++) {
+        f = FALSE;
+        if(iUnit < cUnit) {
+            pfnMax = min(ctx->Delta.cPfn, (iUnit + 1) << dwUnitShift);
+            for(pfn = iUnit << dwUnitShift; !f && (pfn < pfnMax); pfn++) {
+                f = (ctx->Delta.pbLayer[pfn] != FILE_DELTA_LAYER_NONE);
+            }
+        }
+        if(f && !fValid) {
+            fValid = TRUE;
+            iUnitBase = iUnit;
+        }
+        if(!f && fValid) {
+            fValid = FALSE;
+            cRange++;
+            if(fAdd) {
+                pa = iUnitBase << (dwUnitShift + 12);
+                cb = (iUnit - iUnitBase) << (dwUnitShift + 12);
+                if(!LcMemMap_AddRange(ctxLC, pa, cb, pa)) {
+                    lcprintf(ctxLC, "DEVICE: FAIL: unable to add range to memory map. (%016llx %016llx %016llx)\n", pa, cb, pa);
+                    return (QWORD)-1;
+                }
+            }
+        }
+    }
+    return cRange;
+}
+
+/*
+* Build the per-pfn index of the newest layer holding each page. The layers
+* are applied from the base up - a page which was not present (zero hash) in
+* a newer snapshot is removed even if it exists in an older layer.
+* -- ctx
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Delta_BuildIndex(_In_ PDEVICE_CONTEXT_FILE ctx)
+{
+    BOOL fResult = FALSE;
+    DWORD i, iLayer, cbMemMap = 0;
+    QWORD j, c, cHash, pfn, pfnBase, pfnMax;
+    PFILE_DELTA_LAYER pLayer;
+    PLC_MEMMAP_ENTRY pMemMap = NULL;
+    PQWORD pqwHash = NULL;
+    if(!(ctx->Delta.pbLayer = LocalAlloc(0, (SIZE_T)ctx->Delta.cPfn))) { goto fail; }
+    if(!(pqwHash = LocalAlloc(0, FILE_DELTA_HASH_BATCH * sizeof(QWORD)))) { goto fail; }
+    memset(ctx->Delta.pbLayer, FILE_DELTA_LAYER_NONE, (SIZE_T)ctx->Delta.cPfn);
+    for(i = ctx->Delta.cLayer; i > 0; i--) {
+        iLayer = i - 1;
+        pLayer = &ctx->Delta.Layer[iLayer];
+        if(pLayer->hLC) {
+            // non-delta base snapshot: pages within its memory map are present.
+            if(!LcCommand(pLayer->hLC, LC_CMD_MEMMAP_GET_STRUCT, 0, NULL, (PBYTE*)&pMemMap, &cbMemMap)) { goto fail; }
+            for(j = 0; j < cbMemMap / sizeof(LC_MEMMAP_ENTRY); j++) {
+                pfnMax = min(ctx->Delta.cPfn, (pMemMap[j].pa + pMemMap[j].cb) >> 12);
+                for(pfn = pMemMap[j].pa >> 12; pfn < pfnMax; pfn++) {
+                    ctx->Delta.pbLayer[pfn] = (BYTE)iLayer;
+                }
+            }
+            LcMemFree(pMemMap);
+            pMemMap = NULL;
+            continue;
+        }
+        for(pfnBase = 0; pfnBase < ctx->Delta.cPfn; pfnBase += FILE_DELTA_HASH_BATCH) {
+            c = min(FILE_DELTA_HASH_BATCH, ctx->Delta.cPfn - pfnBase);
+            cHash = (pfnBase < pLayer->cPfn) ? min(c, pLayer->cPfn - pfnBase) : 0;
+            if(cHash && !DeviceFile_Delta_LayerRead(ctx, 0, iLayer, pLayer->oHash + pfnBase * sizeof(QWORD), (DWORD)(cHash * sizeof(QWORD)), (PBYTE)pqwHash)) { goto fail; }
+            for(j = 0; j < c; j++) {
+                pfn = pfnBase + j;
+                if((j >= cHash) || !pqwHash[j]) {
+                    ctx->Delta.pbLayer[pfn] = FILE_DELTA_LAYER_NONE;
+                } else if((pLayer->pqwBitmap[pfn >> 6] >> (pfn & 63)) & 1) {
+                    ctx->Delta.pbLayer[pfn] = (BYTE)iLayer;
+                }
+            }
+        }
+    }
+    fResult = TRUE;
+fail:
+    LcMemFree(pMemMap);
+    LocalFree(pqwHash);
+    return fResult;
+}
+
+/*
+* Scatter read function for delta snapshots - to be called by LeechCore. The
+* memory map is identity mapped so the MEM address is the physical address.
+* Pages held by a non-delta base snapshot are read in one scatter read from
+* the base file device.
+* -- ctxLC
+* -- cpMEMs
+* -- ppMEMs
+*/
+VOID DeviceFile_Delta_ReadScatter(_In_ PLC_CONTEXT ctxLC, _In_ DWORD cpMEMs, _Inout_ PPMEM_SCATTER ppMEMs)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    DWORD iMEM, iFile, iLayer, cBase = 0;
+    QWORD pfn, qwOffset;
+    PFILE_DELTA_LAYER pLayer;
+    PPMEM_SCATTER ppBase = NULL;
+    PMEM_SCATTER pMEM;
+    iFile = DeviceFile_LockAcquire(ctx);
+    for(iMEM = 0; iMEM < cpMEMs; iMEM++) {
+        pMEM = ppMEMs[iMEM];
+        if(pMEM->f || (pMEM->qwA == (QWORD)-1)) { continue; }
+        pfn = pMEM->qwA >> 12;
+        if((pfn >= ctx->Delta.cPfn) || ((pMEM->qwA & 0xfff) + pMEM->cb > 0x1000)) {
+            lcprintfvvv_fn(ctxLC, "READ FAILED:\n        offset=%016llx req_len=%08x\n", pMEM->qwA, pMEM->cb);
+            continue;
+        }
+        if((iLayer = ctx->Delta.pbLayer[pfn]) == FILE_DELTA_LAYER_NONE) { continue; }
+        pLayer = &ctx->Delta.Layer[iLayer];
+        if(pLayer->hLC) {
+            // non-delta base snapshot - read below.
+            if(!ppBase && !(ppBase = LocalAlloc(0, cpMEMs * sizeof(PMEM_SCATTER)))) { continue; }
+            ppBase[cBase++] = pMEM;
+            continue;
+        }
+        qwOffset = pLayer->oPageData + (DeviceFile_Delta_PageIndex(pLayer, pfn) << 12) + (pMEM->qwA & 0xfff);
+        if(iLayer) {
+            EnterCriticalSection(&ctx->Delta.Lock);
+            pMEM->f = DeviceFile_Delta_LayerRead(ctx, iFile, iLayer, qwOffset, pMEM->cb, pMEM->pb);
+            LeaveCriticalSection(&ctx->Delta.Lock);
+        } else {
+            pMEM->f = DeviceFile_Delta_LayerRead(ctx, iFile, 0, qwOffset, pMEM->cb, pMEM->pb);
+        }
+        if(pMEM->f && ctxLC->fPrintf[LC_PRINTF_VVV]) {
+            lcprintf_fn(
+                ctxLC,
+                "READ:\n        offset=%016llx req_len=%08x layer=%i\n",
+                pMEM->qwA,
+                pMEM->cb,
+                iLayer
+            );
+            Util_PrintHexAscii(ctxLC, pMEM->pb, pMEM->cb, 0);
+        }
+    }
+    DeviceFile_LockRelease(ctx, iFile);
+    if(cBase) {
+        LcReadScatter(ctx->Delta.Layer[ctx->Delta.cLayer - 1].hLC, cBase, ppBase);
+    }
+    LocalFree(ppBase);
+}
+
+/*
+* Clean up delta snapshot related resources.
+* -- ctx
+*/
+VOID DeviceFile_Delta_Close(_In_ PDEVICE_CONTEXT_FILE ctx)
+{
+    DWORD i;
+    if(!ctx->Delta.cLayer) { return; }
+    for(i = 0; i < ctx->Delta.cLayer; i++) {
+        if(ctx->Delta.Layer[i].h) { fclose(ctx->Delta.Layer[i].h); }
+        if(ctx->Delta.Layer[i].hLC) { LcClose(ctx->Delta.Layer[i].hLC); }
+        LocalFree(ctx->Delta.Layer[i].pqwBitmap);
+        LocalFree(ctx->Delta.Layer[i].pqwRank);
+    }
+    LocalFree(ctx->Delta.pbLayer);
+    DeleteCriticalSection(&ctx->Delta.Lock);
+    ZeroMemory(&ctx->Delta, sizeof(ctx->Delta));
+}
+
+/*
+* Initialize a delta snapshot: open the chain of parent snapshots down to the
+* base snapshot, build the per-pfn layer index and populate the memory map.
+* -- ctxLC
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_DumpInitialize_Delta(_In_ PLC_CONTEXT ctxLC)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    LC_DELTA_HEADER Hdr;
+    LC_CONFIG LcConfig;
+    PFILE_DELTA_LAYER pLayer;
+    FILE *h = NULL;
+    QWORD cbLayer, cRange;
+    DWORD dwUnitShift;
+    int cch;
+    CHAR szParentPath[MAX_PATH];
+    lcprintfvv_fn(ctxLC, "Delta Snapshot identified.\n");
+    memcpy(&Hdr, &ctx->CrashOrCoreDump.Delta, sizeof(LC_DELTA_HEADER));
+    InitializeCriticalSection(&ctx->Delta.Lock);
+    ctx->Delta.cLayer = 1;
+    pLayer = &ctx->Delta.Layer[0];
+    _snprintf_s(pLayer->szFileName, MAX_PATH, _TRUNCATE, "%s", ctx->szFileName);
+    cbLayer = ctx->cbFile;
+    ctx->tpArch = Hdr.tpArch;
+    // 1: open layers from the top layer down to the base snapshot:
+    while(TRUE) {
+        if(!DeviceFile_Delta_LayerInitialize(ctx, ctx->Delta.cLayer - 1, &Hdr, cbLayer)) {
+            lcprintf(ctxLC, "DEVICE: FAIL: delta: invalid snapshot '%s'.\n", pLayer->szFileName);
+            goto fail;
+        }
+        if(!Hdr.szParent[0]) { break; }
+        if(ctx->Delta.cLayer == FILE_DELTA_LAYERS_MAX) {
+            lcprintf(ctxLC, "DEVICE: FAIL: delta: too many snapshot layers (max %i).\n", FILE_DELTA_LAYERS_MAX);
+            goto fail;
+        }
+        Hdr.szParent[MAX_PATH - 1] = 0;
+        if(!(h = DeviceFile_Delta_OpenParent(pLayer->szFileName, Hdr.szParent, szParentPath))) {
+            lcprintf(ctxLC, "DEVICE: FAIL: delta: unable to open parent snapshot '%s'.\n", Hdr.szParent);
+            goto fail;
+        }
+        pLayer = &ctx->Delta.Layer[ctx->Delta.cLayer++];
+        _snprintf_s(pLayer->szFileName, MAX_PATH, _TRUNCATE, "%s", szParentPath);
+        if(_fseeki64(h, 0, SEEK_END)) { goto fail; }
+        cbLayer = _ftelli64(h);
+        if(_fseeki64(h, 0, SEEK_SET) || (1 != fread(&Hdr, sizeof(LC_DELTA_HEADER), 1, h)) || (Hdr.dwMagic != LC_DELTA_MAGIC)) {
+            // non-delta base snapshot - open as a separate file device:
+            fclose(h);
+            h = NULL;
+            ZeroMemory(&LcConfig, sizeof(LC_CONFIG));
+            LcConfig.dwVersion = LC_CONFIG_VERSION;
+            LcConfig.dwPrintfVerbosity = ctxLC->Config.dwPrintfVerbosity & LC_CONFIG_PRINTF_ENABLED;
+            cch = _snprintf_s(LcConfig.szDevice, _countof(LcConfig.szDevice), _TRUNCATE, "file://file=%s", szParentPath);
+            if((cch < 0) || (cch >= (int)_countof(LcConfig.szDevice))) {
+                lcprintf(ctxLC, "DEVICE: FAIL: delta: base snapshot path too long '%s'.\n", szParentPath);
+                goto fail;
+            }
+            if(!(pLayer->hLC = LcCreate(&LcConfig))) {
+                lcprintf(ctxLC, "DEVICE: FAIL: delta: unable to open base snapshot '%s'.\n", szParentPath);
+                goto fail;
+            }
+            break;
+        }
+        pLayer->h = h;
+        h = NULL;
+    }
+    lcprintfv(ctxLC, "DEVICE: delta: %i snapshot layers.\n", ctx->Delta.cLayer);
+    // 2: build the per-pfn layer index:
+    ctx->Delta.cPfn = ctx->Delta.Layer[0].cPfn;
+    if(!DeviceFile_Delta_BuildIndex(ctx)) {
+        lcprintf(ctxLC, "DEVICE: FAIL: delta: unable to build page index.\n");
+        goto fail;
+    }
+    // 3: populate memory map - fall back to a coarser granularity if fragmented:
+    dwUnitShift = 0;
+    if(DeviceFile_Delta_MemMapWalk(ctxLC, 0, FALSE) > 0x00080000) {
+        lcprintfv(ctxLC, "DEVICE: delta: fragmented snapshot - using coarse memory map.\n");
+        dwUnitShift = 9;
+    }
+    cRange = DeviceFile_Delta_MemMapWalk(ctxLC, dwUnitShift, TRUE);
+    if(!cRange || (cRange == (QWORD)-1)) { goto fail; }
+    // 4: delta snapshots are read through the delta scatter read function:
+    ctxLC->pfnReadScatter = DeviceFile_Delta_ReadScatter;
+    ctxLC->pfnWriteScatter = NULL;
+    ctxLC->Config.fWritable = FALSE;
+    return TRUE;
+fail:
+    if(h) { fclose(h); }
+    DeviceFile_Delta_Close(ctx);
+    return FALSE;
+}
+
+//-----------------------------------------------------------------------------
+// DEDUPLICATED SNAPSHOT FUNCTIONALITY BELOW:
+// A deduplicated snapshot (LC_DUMP_FORMAT_DEDUP) holds a page map with the id
+// of each page in a page store shared between snapshots. The page map is kept
+// in memory - reads are resolved through it to a fixed offset in the store.
+// The page store is opened once per file handle slot.
+//-----------------------------------------------------------------------------
+
+#define FILE_DEDUP_MAP_BATCH                0x00100000      // page map read batch (pfns)
+
+/*
+* Walk the page map and either count or add memory map ranges. The walk is
+* done with a granularity of 2^dwUnitShift pfns - a unit is present if any pfn
+* within it is present.
+* -- ctxLC
+* -- dwUnitShift = 0 (single pfn) or 9 (512 pfns).
+* -- fAdd = add ranges to memory map (otherwise only count ranges).
+* -- return = number of ranges, or (QWORD)-1 on failure.
+*/
+QWORD DeviceFile_Dedup_MemMapWalk(_In_ PLC_CONTEXT ctxLC, _In_ DWORD dwUnitShift, _In_ BOOL fAdd)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    QWORD iUnit, iUnitBase = 0, cUnit, cRange = 0, pfn, pfnMax, pa, cb;
+    BOOL f, fValid = FALSE;
+    cUnit = (ctx->Dedup.cPfn + (1ULL << dwUnitShift) - 1) >> dwUnitShift;
+    for(iUnit = 0; iUnit <= cUnit; iUnit++) {
+        f = FALSE;
+        if(iUnit < cUnit) {
+            pfnMax = min(ctx->Dedup.cPfn, (iUnit + 1) << dwUnitShift);
+            for(pfn = iUnit << dwUnitShift; !f && (pfn < pfnMax); pfn++) {
+                f = (ctx->Dedup.pdwMap[pfn] != LC_DEDUP_PAGE_NONE);
+            }
+        }
+        if(f && !fValid) {
+            fValid = TRUE;
+            iUnitBase = iUnit;
+        }
+        if(!f && fValid) {
+            fValid = FALSE;
+            cRange++;
+            if(fAdd) {
+                pa = iUnitBase << (dwUnitShift + 12);
+                cb = (iUnit - iUnitBase) << (dwUnitShift + 12);
+                if(!LcMemMap_AddRange(ctxLC, pa, cb, pa)) {
+                    lcprintf(ctxLC, "DEVICE: FAIL: unable to add range to memory map. (%016llx %016llx %016llx)\n", pa, cb, pa);
+                    return (QWORD)-1;
+                }
+            }
+        }
+    }
+    return cRange;
+}
+
+/*
+* Scatter read function for deduplicated snapshots - to be called by LeechCore.
+* The memory map is identity mapped so the MEM address is the physical address.
+* -- ctxLC
+* -- cpMEMs
+* -- ppMEMs
+*/
+VOID DeviceFile_Dedup_ReadScatter(_In_ PLC_CONTEXT ctxLC, _In_ DWORD cpMEMs, _Inout_ PPMEM_SCATTER ppMEMs)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    DWORD iMEM, iFile, id;
+    QWORD pfn;
+    PMEM_SCATTER pMEM;
+    iFile = DeviceFile_LockAcquire(ctx);
+    for(iMEM = 0; iMEM < cpMEMs; iMEM++) {
+        pMEM = ppMEMs[iMEM];
+        if(pMEM->f || (pMEM->qwA == (QWORD)-1)) { continue; }
+        pfn = pMEM->qwA >> 12;
+        if((pfn >= ctx->Dedup.cPfn) || ((pMEM->qwA & 0xfff) + pMEM->cb > 0x1000)) {
+            lcprintfvvv_fn(ctxLC, "READ FAILED:\n        offset=%016llx req_len=%08x\n", pMEM->qwA, pMEM->cb);
+            continue;
+        }
+        id = ctx->Dedup.pdwMap[pfn];
+        if(id == LC_DEDUP_PAGE_NONE) { continue; }
+        if(id == LC_DEDUP_PAGE_ZERO) {
+            ZeroMemory(pMEM->pb, pMEM->cb);
+            pMEM->f = TRUE;
+            continue;
+        }
+        pMEM->f = DeviceFile_FileIo(ctx->Dedup.hStore[iFile], LC_DEDUP_STORE_PAGE_OFFSET(id) + (pMEM->qwA & 0xfff), pMEM->cb, pMEM->pb, FALSE);
+        if(pMEM->f && ctxLC->fPrintf[LC_PRINTF_VVV]) {
+            lcprintf_fn(
+                ctxLC,
+                "READ:\n        offset=%016llx req_len=%08x page=%08x\n",
+                pMEM->qwA,
+                pMEM->cb,
+                id
+            );
+            Util_PrintHexAscii(ctxLC, pMEM->pb, pMEM->cb, 0);
+        }
+    }
+    DeviceFile_LockRelease(ctx, iFile);
+}
+
+/*
+* Clean up deduplicated snapshot related resources.
+* -- ctx
+*/
+VOID DeviceFile_Dedup_Close(_In_ PDEVICE_CONTEXT_FILE ctx)
+{
+    DWORD i;
+    for(i = 0; i < FILE_MAX_THREADS; i++) {
+        if(ctx->Dedup.hStore[i]) { fclose(ctx->Dedup.hStore[i]); }
+    }
+    LocalFree(ctx->Dedup.pdwMap);
+    ZeroMemory(&ctx->Dedup, sizeof(ctx->Dedup));
+}
+
+/*
+* Initialize a deduplicated snapshot: open and verify the page store, load the
+* page map and populate the memory map.
+* -- ctxLC
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_DumpInitialize_Dedup(_In_ PLC_CONTEXT ctxLC)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    LC_DEDUP_HEADER Hdr;
+    LC_DEDUP_STORE_HEADER StoreHdr;
+    QWORD pfn, pfnBase, c, cRange;
+    DWORD i, id, dwUnitShift;
+    lcprintfvv_fn(ctxLC, "Deduplicated Snapshot identified.\n");
+    memcpy(&Hdr, &ctx->CrashOrCoreDump.Dedup, sizeof(LC_DEDUP_HEADER));
+    Hdr.szStore[MAX_PATH - 1] = 0;
+    // 1: verify header:
+    if((Hdr.dwVersion != LC_DEDUP_VERSION) || !Hdr.cPfn || (Hdr.cPfn > 0x0000000400000000) || (Hdr.cPageStore > LC_DEDUP_PAGE_MAX)) { goto fail; }
+    if((Hdr.oMap < sizeof(LC_DEDUP_HEADER)) || (Hdr.oMap + Hdr.cPfn * sizeof(DWORD) > ctx->cbFile)) { goto fail; }
+    // 2: open and verify page store (one handle per file handle slot):
+    if(!(ctx->Dedup.hStore[0] = DeviceFile_Delta_OpenParent(ctx->szFileName, Hdr.szStore, ctx->Dedup.szStore))) {
+        lcprintf(ctxLC, "DEVICE: FAIL: dedup: unable to open page store '%s'.\n", Hdr.szStore);
+        goto fail;
+    }
+    if(!DeviceFile_FileIo(ctx->Dedup.hStore[0], 0, sizeof(LC_DEDUP_STORE_HEADER), (PBYTE)&StoreHdr, FALSE)) { goto fail; }
+    if((StoreHdr.dwMagic != LC_DEDUP_STORE_MAGIC) || (StoreHdr.dwVersion != LC_DEDUP_VERSION) || (StoreHdr.qwStoreId != Hdr.qwStoreId) || (StoreHdr.cPage < Hdr.cPageStore)) {
+        lcprintf(ctxLC, "DEVICE: FAIL: dedup: page store '%s' does not match snapshot.\n", ctx->Dedup.szStore);
+        goto fail;
+    }
+    ctx->Dedup.cPageStore = Hdr.cPageStore;
+    for(i = 1; i < FILE_MAX_THREADS; i++) {
+        if(ctx->File[i].h && (fopen_s(&ctx->Dedup.hStore[i], ctx->Dedup.szStore, "rb") || !ctx->Dedup.hStore[i])) { goto fail; }
+    }
+    // 3: load and verify page map:
+    ctx->Dedup.cPfn = Hdr.cPfn;
+    if(!(ctx->Dedup.pdwMap = LocalAlloc(0, (SIZE_T)(Hdr.cPfn * sizeof(DWORD))))) { goto fail; }
+    for(pfnBase = 0; pfnBase < Hdr.cPfn; pfnBase += FILE_DEDUP_MAP_BATCH) {
+        c = min(FILE_DEDUP_MAP_BATCH, Hdr.cPfn - pfnBase);
+        if(!DeviceFile_ReadFile(ctx, 0, Hdr.oMap + pfnBase * sizeof(DWORD), (DWORD)(c * sizeof(DWORD)), (PBYTE)(ctx->Dedup.pdwMap + pfnBase))) { goto fail; }
+    }
+    for(pfn = 0; pfn < Hdr.cPfn; pfn++) {
+        id = ctx->Dedup.pdwMap[pfn];
+        if((id >= ctx->Dedup.cPageStore) && (id != LC_DEDUP_PAGE_NONE) && (id != LC_DEDUP_PAGE_ZERO)) {
+            lcprintf(ctxLC, "DEVICE: FAIL: dedup: invalid page id %08x at pfn %llx.\n", id, pfn);
+            goto fail;
+        }
+    }
+    lcprintfv(ctxLC, "DEVICE: dedup: 0x%llx pfns, page store '%s' (0x%llx pages).\n", Hdr.cPfn, ctx->Dedup.szStore, ctx->Dedup.cPageStore);
+    // 4: populate memory map - fall back to a coarser granularity if fragmented:
+    dwUnitShift = 0;
+    if(DeviceFile_Dedup_MemMapWalk(ctxLC, 0, FALSE) > 0x00080000) {
+        lcprintfv(ctxLC, "DEVICE: dedup: fragmented snapshot - using coarse memory map.\n");
+        dwUnitShift = 9;
+    }
+    cRange = DeviceFile_Dedup_MemMapWalk(ctxLC, dwUnitShift, TRUE);
+    if(!cRange || (cRange == (QWORD)-1)) { goto fail; }
+    // 5: deduplicated snapshots are read through the dedup scatter read function:
+    ctx->tpArch = Hdr.tpArch;
+    ctxLC->pfnReadScatter = DeviceFile_Dedup_ReadScatter;
+    ctxLC->pfnWriteScatter = NULL;
+    ctxLC->Config.fWritable = FALSE;
+    ctx->CrashOrCoreDump.fValidDedupDump = TRUE;
+    return TRUE;
+fail:
+    lcprintf(ctxLC, "DEVICE: FAIL: error parsing deduplicated snapshot.\n");
+    DeviceFile_Dedup_Close(ctx);
+    return FALSE;
+}
+
+//-----------------------------------------------------------------------------
+// WINDOWS HIBERNATION FILE (HIBERFIL.SYS) FUNCTIONALITY BELOW:
+// Windows XP - 7: the hibernation file consists of a chain of restore table
+// pages. Each table lists ranges of pfns whose pages are stored, in order, in
+// the Xpress compressed blocks following the table page.
+// Windows 8+: the boot and kernel restore sets each consist of a sequence of
+// compression sets. A compression set holds up to 16 page descriptors (pfn
+// ranges) followed by the Xpress or Xpress Huffman compressed pages.
+// All tables, block headers and compression sets are parsed once into a range
+// and block index. Blocks are decompressed on
+// demand into a direct-mapped cache. Reads are done by the ReadContigious
+// workers of LeechCore so that blocks are decompressed in parallel.
+//-----------------------------------------------------------------------------
+
+/*
+* Decompress an Xpress (LZ77) compressed buffer [MS-XCA 2.4].
+* -- pbSrc
+* -- cbSrc
+* -- pbDst
+* -- cbDst = exact size of the decompressed data.
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Hibr_XpressDecompress(_In_reads_(cbSrc) PBYTE pbSrc, _In_ DWORD cbSrc, _Out_writes_(cbDst) PBYTE pbDst, _In_ DWORD cbDst)
+{
+    DWORD dwFlags = 0, cFlags = 0, oSrc = 0, oDst = 0, oHalfByte = 0, cbMatch, oMatch;
+    while(oDst < cbDst) {
+        if(!cFlags) {
+            if(oSrc + 4 > cbSrc) { return FALSE; }
+            dwFlags = *(PDWORD)(pbSrc + oSrc);
+            oSrc += 4;
+            cFlags = 32;
+        }
+        cFlags--;
+        if(!((dwFlags >> cFlags) & 1)) {
+            // literal byte:
+            if(oSrc >= cbSrc) { return FALSE; }
+            pbDst[oDst++] = pbSrc[oSrc++];
+            continue;
+        }
+        // match - 13-bit offset and 3-bit length (extended in half-bytes/bytes):
+        if(oSrc + 2 > cbSrc) { return FALSE; }
+        cbMatch = *(PWORD)(pbSrc + oSrc);
+        oSrc += 2;
+        oMatch = (cbMatch >> 3) + 1;
+        cbMatch = cbMatch & 7;
+        if(cbMatch == 7) {
+            if(!oHalfByte) {
+                if(oSrc >= cbSrc) { return FALSE; }
+                oHalfByte = oSrc;
+                cbMatch = pbSrc[oSrc++] & 0x0f;
+            } else {
+                cbMatch = pbSrc[oHalfByte] >> 4;
+                oHalfByte = 0;
+            }
+            if(cbMatch == 15) {
+                if(oSrc >= cbSrc) { return FALSE; }
+                cbMatch = pbSrc[oSrc++];
+                if(cbMatch == 255) {
+                    if(oSrc + 2 > cbSrc) { return FALSE; }
+                    cbMatch = *(PWORD)(pbSrc + oSrc);
+                    oSrc += 2;
+                    if(!cbMatch) {
+                        if(oSrc + 4 > cbSrc) { return FALSE; }
+                        cbMatch = *(PDWORD)(pbSrc + oSrc);
+                        oSrc += 4;
+                    }
+                    if(cbMatch < 15 + 7) { return FALSE; }
+                    cbMatch -= 15 + 7;
+                }
+                cbMatch += 15;
+            }
+            cbMatch += 7;
+        }
+        cbMatch += 3;
+        if((oMatch > oDst) || (cbMatch > cbDst - oDst)) { return FALSE; }
+        for(; cbMatch; cbMatch--, oDst++) {
+            pbDst[oDst] = pbDst[oDst - oMatch];
+        }
+    }
+    return TRUE;
+}
+
+/*
+* Decompress an Xpress Huffman (LZ77+Huffman) compressed buffer [MS-XCA 2.2].
+* Each 64kB of output is preceded by a table of 512 4-bit canonical Huffman
+* code lengths - 256 literals and 256 match symbols.
+* -- pbSrc
+* -- cbSrc
+* -- pbDst
+* -- cbDst = exact size of the decompressed data.
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Hibr_XpressHuffmanDecompress(_In_reads_(cbSrc) PBYTE pbSrc, _In_ DWORD cbSrc, _Out_writes_(cbDst) PBYTE pbDst, _In_ DWORD cbDst)
+{
+    BOOL fResult = FALSE;
+    BYTE pbLen[512];
+    PWORD pwTable = NULL;
+    DWORD i, c, iLen, iSym, iCode, oSrc = 0, oDst = 0, oDstChunkEnd, dwBits, cbMatch, oMatch, cBitOffset;
+    int cBitExtra;
+    if(!(pwTable = LocalAlloc(0, (1 << HIBR_HUFFMAN_TABLE_BITS) * sizeof(WORD)))) { return FALSE; }
+    while(oDst < cbDst) {
+        // 1: build the decoding table (indexed by the next 15 bits) from the code lengths:
+        if(oSrc + 256 + 4 > cbSrc) { goto fail; }
+        for(i = 0; i < 256; i++) {
+            pbLen[i << 1] = pbSrc[oSrc + i] & 0x0f;
+            pbLen[(i << 1) + 1] = pbSrc[oSrc + i] >> 4;
+        }
+        oSrc += 256;
+        for(iCode = 0, iLen = 1; iLen <= HIBR_HUFFMAN_TABLE_BITS; iLen++) {
+            for(iSym = 0; iSym < 512; iSym++) {
+                if(pbLen[iSym] != iLen) { continue; }
+                c = 1 << (HIBR_HUFFMAN_TABLE_BITS - iLen);
+                if(iCode + c > (1 << HIBR_HUFFMAN_TABLE_BITS)) { goto fail; }
+                for(i = 0; i < c; i++) {
+                    pwTable[iCode++] = (WORD)iSym;
+                }
+            }
+        }
+        for(; iCode < (1 << HIBR_HUFFMAN_TABLE_BITS); iCode++) {
+            pwTable[iCode] = 0xffff;
+        }
+        // 2: decode the chunk - the bit stream is read as 16-bit little endian words:
+        dwBits = ((DWORD)*(PWORD)(pbSrc + oSrc) << 16) | *(PWORD)(pbSrc + oSrc + 2);
+        oSrc += 4;
+        cBitExtra = 16;
+        oDstChunkEnd = oDst + HIBR_HUFFMAN_CHUNK;
+        while((oDst < oDstChunkEnd) && (oDst < cbDst)) {
+            iSym = pwTable[dwBits >> (32 - HIBR_HUFFMAN_TABLE_BITS)];
+            if(iSym == 0xffff) { goto fail; }
+            dwBits <<= pbLen[iSym];
+            cBitExtra -= pbLen[iSym];
+            if(cBitExtra < 0) {
+                dwBits |= (DWORD)((oSrc + 2 <= cbSrc) ? *(PWORD)(pbSrc + oSrc) : 0) << (-cBitExtra);
+                oSrc += 2;
+                cBitExtra += 16;
+            }
+            if(iSym < 256) {
+                // literal byte:
+                pbDst[oDst++] = (BYTE)iSym;
+                continue;
+            }
+            // match - 4-bit length (extended in bytes/words) and offset bit length:
+            iSym -= 256;
+            cbMatch = iSym & 0x0f;
+            cBitOffset = iSym >> 4;
+            if(cbMatch == 15) {
+                if(oSrc >= cbSrc) { goto fail; }
+                cbMatch = pbSrc[oSrc++];
+                if(cbMatch == 255) {
+                    if(oSrc + 2 > cbSrc) { goto fail; }
+                    cbMatch = *(PWORD)(pbSrc + oSrc);
+                    oSrc += 2;
+                    if(cbMatch < 15) { goto fail; }
+                    cbMatch -= 15;
+                }
+                cbMatch += 15;
+            }
+            cbMatch += 3;
+            oMatch = (cBitOffset ? (dwBits >> (32 - cBitOffset)) : 0) + (1 << cBitOffset);
+            dwBits <<= cBitOffset;
+            cBitExtra -= cBitOffset;
+            if(cBitExtra < 0) {
+                dwBits |= (DWORD)((oSrc + 2 <= cbSrc) ? *(PWORD)(pbSrc + oSrc) : 0) << (-cBitExtra);
+                oSrc += 2;
+                cBitExtra += 16;
+            }
+            if((oMatch > oDst) || (cbMatch > cbDst - oDst)) { goto fail; }
+            for(; cbMatch; cbMatch--, oDst++) {
+                pbDst[oDst] = pbDst[oDst - oMatch];
+            }
+        }
+    }
+    fResult = TRUE;
+fail:
+    LocalFree(pwTable);
+    return fResult;
+}
+
+/*
+* Add a restored page range to the range index. A range continuing the
+* previous range in both pfn and page stream is merged into it.
+* -- ctx
+* -- pfn
+* -- cPage
+* -- iPage = page stream index of the first page in range.
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Hibr_RangeAdd(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ QWORD pfn, _In_ QWORD cPage, _In_ QWORD iPage)
+{
+    PVOID pvGrow;
+    PHIBR_RANGE pRange;
+    if(ctx->Hibr.cRange) {
+        pRange = ctx->Hibr.pRange + ctx->Hibr.cRange - 1;
+        if((pRange->pfn + pRange->cPage == pfn) && (pRange->iPage + pRange->cPage == iPage)) {
+            pRange->cPage += cPage;
+            return TRUE;
+        }
+    }
+    if(ctx->Hibr.cRange == ctx->Hibr.cRangeMax) {
+        if(ctx->Hibr.cRangeMax >= 0x40000000) { return FALSE; }
+        ctx->Hibr.cRangeMax = max(0x1000, 2 * ctx->Hibr.cRangeMax);
+        if(!(pvGrow = LocalAlloc(0, (SIZE_T)ctx->Hibr.cRangeMax * sizeof(HIBR_RANGE)))) { return FALSE; }
+        if(ctx->Hibr.pRange) { memcpy(pvGrow, ctx->Hibr.pRange, (SIZE_T)ctx->Hibr.cRange * sizeof(HIBR_RANGE)); }
+        LocalFree(ctx->Hibr.pRange);
+        ctx->Hibr.pRange = (PHIBR_RANGE)pvGrow;
+    }
+    pRange = ctx->Hibr.pRange + ctx->Hibr.cRange++;
+    pRange->pfn = pfn;
+    pRange->cPage = cPage;
+    pRange->iPage = iPage;
+    return TRUE;
+}
+
+/*
+* Add a compressed block to the block index.
+* -- ctx
+* -- o = file offset of the (compressed) block data.
+* -- iPage = page stream index of the first page in block.
+* -- cb
+* -- cPage
+* -- fHuffman
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Hibr_BlockAdd(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ QWORD o, _In_ QWORD iPage, _In_ DWORD cb, _In_ DWORD cPage, _In_ BOOL fHuffman)
+{
+    PVOID pvGrow;
+    PHIBR_BLOCK pBlock;
+    if(ctx->Hibr.cBlock == ctx->Hibr.cBlockMax) {
+        ctx->Hibr.cBlockMax = max(0x1000, 2 * ctx->Hibr.cBlockMax);
+        if(!(pvGrow = LocalAlloc(0, (SIZE_T)(ctx->Hibr.cBlockMax * sizeof(HIBR_BLOCK))))) { return FALSE; }
+        if(ctx->Hibr.pBlock) { memcpy(pvGrow, ctx->Hibr.pBlock, (SIZE_T)(ctx->Hibr.cBlock * sizeof(HIBR_BLOCK))); }
+        LocalFree(ctx->Hibr.pBlock);
+        ctx->Hibr.pBlock = (PHIBR_BLOCK)pvGrow;
+    }
+    pBlock = ctx->Hibr.pBlock + ctx->Hibr.cBlock++;
+    pBlock->o = o;
+    pBlock->iPage = iPage;
+    pBlock->cb = cb;
+    pBlock->cPage = (WORD)cPage;
+    pBlock->fHuffman = fHuffman ? 1 : 0;
+    ctx->Hibr.cbBlockMax = max(ctx->Hibr.cbBlockMax, cb);
+    ctx->Hibr.cPageBlockMax = max(ctx->Hibr.cPageBlockMax, cPage);
+    return TRUE;
+}
+
+/*
+* Read and verify an Xpress block header.
+* -- ctx
+* -- iFile = file handle held by caller.
+* -- o = file offset of the block header.
+* -- pcb = size of the (compressed) block data following the header.
+* -- pcPage = number of pages in the block.
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Hibr_BlockHeader(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ DWORD iFile, _In_ QWORD o, _Out_ PDWORD pcb, _Out_ PDWORD pcPage)
+{
+    BYTE pbHdr[HIBR_XPRESS_HEADER_SIZE];
+    if(o + HIBR_XPRESS_HEADER_SIZE > ctx->cbFile) { return FALSE; }
+    if(!DeviceFile_ReadFile(ctx, iFile, o, HIBR_XPRESS_HEADER_SIZE, pbHdr)) { return FALSE; }
+    if(memcmp(pbHdr, HIBR_XPRESS_SIGNATURE, 8)) { return FALSE; }
+    *pcPage = pbHdr[8] + 1;
+    *pcb = (*(PDWORD)(pbHdr + 8) >> 10) + 1;
+    if(*pcb > (*pcPage << 12)) { return FALSE; }
+    return o + HIBR_XPRESS_HEADER_SIZE + *pcb <= ctx->cbFile;
+}
+
+/*
+* Parse a restore table page and the Xpress blocks following it. The table is
+* first parsed with fAdd = FALSE to verify it against a table layout.
+* -- ctx
+* -- pLayout
+* -- iTablePage = page number of the restore table page in the file.
+* -- fAdd = add the ranges and blocks of the table to the index.
+* -- piTablePageNext = page number of the next table page (0 = last table).
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Hibr_TableParse(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ const HIBR_TABLE_LAYOUT *pLayout, _In_ QWORD iTablePage, _In_ BOOL fAdd, _Out_ PQWORD piTablePageNext)
+{
+    BYTE pbTable[0x1000];
+    QWORD i, pfnStart, pfnEnd, oBlock, cPageTable = 0, cPageBlocks = 0, iTablePageNext;
+    DWORD cEntry, cbBlock, cPageBlock;
+    if(((iTablePage + 1) << 12) > ctx->cbFile) { return FALSE; }
+    if(!DeviceFile_ReadFile(ctx, 0, iTablePage << 12, 0x1000, pbTable)) { return FALSE; }
+    iTablePageNext = pLayout->f32 ? *(PDWORD)(pbTable + pLayout->oNextTable) : *(PQWORD)(pbTable + pLayout->oNextTable);
+    cEntry = *(PDWORD)(pbTable + pLayout->oEntryCount);
+    if(!cEntry || (pLayout->cbLink + cEntry * pLayout->cbRange > 0x1000)) { return FALSE; }
+    if(iTablePageNext && ((iTablePageNext <= iTablePage) || ((iTablePageNext + 1) << 12) > ctx->cbFile)) { return FALSE; }
+    // 1: ranges of table:
+    for(i = 0; i < cEntry; i++) {
+        if(pLayout->f32) {
+            pfnStart = *(PDWORD)(pbTable + pLayout->cbLink + i * pLayout->cbRange + pLayout->oStartPage);
+            pfnEnd = *(PDWORD)(pbTable + pLayout->cbLink + i * pLayout->cbRange + pLayout->oEndPage);
+        } else {
+            pfnStart = *(PQWORD)(pbTable + pLayout->cbLink + i * pLayout->cbRange + pLayout->oStartPage);
+            pfnEnd = *(PQWORD)(pbTable + pLayout->cbLink + i * pLayout->cbRange + pLayout->oEndPage);
+        }
+        if((pfnStart >= pfnEnd) || (pfnEnd > 0x0000001000000000)) { return FALSE; }
+        if(fAdd && !DeviceFile_Hibr_RangeAdd(ctx, pfnStart, pfnEnd - pfnStart, ctx->Hibr.cPage + cPageTable)) { return FALSE; }
+        cPageTable += pfnEnd - pfnStart;
+    }
+    // 2: xpress blocks holding the pages of the table ranges:
+    oBlock = (iTablePage + 1) << 12;
+    while(cPageBlocks < cPageTable) {
+        if(!DeviceFile_Hibr_BlockHeader(ctx, 0, oBlock, &cbBlock, &cPageBlock)) { return FALSE; }
+        if(iTablePageNext && (oBlock + HIBR_XPRESS_HEADER_SIZE + cbBlock > (iTablePageNext << 12))) { return FALSE; }
+        if(fAdd && !DeviceFile_Hibr_BlockAdd(ctx, oBlock + HIBR_XPRESS_HEADER_SIZE, ctx->Hibr.cPage + cPageBlocks, cbBlock, cPageBlock, FALSE)) { return FALSE; }
+        cPageBlocks += cPageBlock;
+        oBlock += HIBR_XPRESS_HEADER_SIZE + ((cbBlock + 7) & ~7);
+    }
+    if(fAdd) {
+        ctx->Hibr.cPage += cPageBlocks;
+    }
+    *piTablePageNext = iTablePageNext;
+    return TRUE;
+}
+
+/*
+* Parse a restore set (Windows 8+) - a sequence of compression sets holding
+* cPage pages in total. Each compression set starts with a header DWORD:
+* [7:0] = number of page descriptors, [29:8] = compressed size and [31] =
+* Xpress Huffman flag. Each page descriptor QWORD is: [3:0] = number of pages
+* - 1, [63:4] = pfn. The compressed data follows the page descriptors and is
+* stored uncompressed if its size equals the size of the pages.
+* -- ctx
+* -- iPageFirst = page number of the first compression set in the file.
+* -- cPage = number of pages in the restore set.
+* -- fAdd = add the ranges and sets to the index (otherwise only verify the first set).
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Hibr_SetParse(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ QWORD iPageFirst, _In_ QWORD cPage, _In_ BOOL fAdd)
+{
+    BYTE pbSet[4 + HIBR_SET_DESCRIPTORS_MAX * 8];
+    QWORD o, pfn, qwDesc, cPageDone = 0;
+    DWORD i, dwHdr, cDesc, cb, cPageSet, cPageDesc;
+    if(!iPageFirst || !cPage || (cPage > 0x0000001000000000) || (iPageFirst >= (ctx->cbFile >> 12))) { return FALSE; }
+    o = iPageFirst << 12;
+    while(cPageDone < cPage) {
+        if(o + 4 > ctx->cbFile) { return FALSE; }
+        if(!DeviceFile_ReadFile(ctx, 0, o, (DWORD)min(sizeof(pbSet), ctx->cbFile - o), pbSet)) { return FALSE; }
+        dwHdr = *(PDWORD)pbSet;
+        cDesc = dwHdr & 0xff;
+        cb = (dwHdr >> 8) & 0x003fffff;
+        if(!cDesc || (cDesc > HIBR_SET_DESCRIPTORS_MAX) || (o + 4 + cDesc * 8 > ctx->cbFile)) { return FALSE; }
+        for(i = 0, cPageSet = 0; i < cDesc; i++) {
+            qwDesc = *(PQWORD)(pbSet + 4 + i * 8);
+            pfn = qwDesc >> 4;
+            cPageDesc = (DWORD)(qwDesc & 0x0f) + 1;
+            if(pfn + cPageDesc > 0x0000001000000000) { return FALSE; }
+            if(fAdd && !DeviceFile_Hibr_RangeAdd(ctx, pfn, cPageDesc, ctx->Hibr.cPage + cPageDone + cPageSet)) { return FALSE; }
+            cPageSet += cPageDesc;
+        }
+        o += 4 + cDesc * 8;
+        if(!cb || (cb > (cPageSet << 12)) || (o + cb > ctx->cbFile)) { return FALSE; }
+        if(!fAdd) { return TRUE; }
+        if(!DeviceFile_Hibr_BlockAdd(ctx, o, ctx->Hibr.cPage + cPageDone, cb, cPageSet, (dwHdr & HIBR_SET_HUFFMAN) ? TRUE : FALSE)) { return FALSE; }
+        cPageDone += cPageSet;
+        o += cb;
+    }
+    if(cPageDone != cPage) { return FALSE; }
+    ctx->Hibr.cPage += cPageDone;
+    return TRUE;
+}
+
+/*
+* Reset the range and block index after a failed parse attempt.
+* -- ctx
+*/
+VOID DeviceFile_Hibr_IndexReset(_In_ PDEVICE_CONTEXT_FILE ctx)
+{
+    ctx->Hibr.cPage = 0;
+    ctx->Hibr.cRange = 0;
+    ctx->Hibr.cBlock = 0;
+    ctx->Hibr.cbBlockMax = 0;
+    ctx->Hibr.cPageBlockMax = 0;
+}
+
+/*
+* Parse a Windows 8+ hibernation file into the range and block index. The
+* header layout is detected by verifying the kernel restore set against the
+* known layouts - the kernel restore set must consist of exactly the number
+* of pages given by the header. The boot restore set (pages restored by the
+* boot loader) is added first if it verifies; it is dropped if it's bad.
+* -- ctxLC
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Hibr_SetInitialize(_In_ PLC_CONTEXT ctxLC)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    const HIBR_SET_LAYOUT *pl;
+    QWORD iPageKernel, cPageKernel, iPageBoot, cPageBoot;
+    DWORD iLayout;
+    for(iLayout = 0; iLayout < _countof(HIBR_SET_LAYOUTS); iLayout++) {
+        pl = &HIBR_SET_LAYOUTS[iLayout];
+        iPageKernel = CDMP_QWORD(pl->oFirstKernelRestorePage);
+        cPageKernel = CDMP_QWORD(pl->oKernelPagesProcessed);
+        iPageBoot = CDMP_QWORD(pl->oFirstBootRestorePage);
+        cPageBoot = CDMP_QWORD(pl->oNumPagesForLoader);
+        if(!DeviceFile_Hibr_SetParse(ctx, iPageKernel, cPageKernel, FALSE)) { continue; }
+        if((iPageBoot != iPageKernel) && DeviceFile_Hibr_SetParse(ctx, iPageBoot, cPageBoot, FALSE)) {
+            if(!DeviceFile_Hibr_SetParse(ctx, iPageBoot, cPageBoot, TRUE)) {
+                lcprintfv(ctxLC, "DEVICE: hibernation file: bad boot restore set - boot loader pages ignored.\n");
+                DeviceFile_Hibr_IndexReset(ctx);
+            }
+        }
+        if(!DeviceFile_Hibr_SetParse(ctx, iPageKernel, cPageKernel, TRUE)) {
+            DeviceFile_Hibr_IndexReset(ctx);
+            continue;
+        }
+        ctx->Hibr.pSetLayout = pl;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/*
+* qsort compare function for sorting the restored page ranges by pfn.
+*/
+int DeviceFile_Hibr_RangeCmp(_In_ const void *pv1, _In_ const void *pv2)
+{
+    PHIBR_RANGE p1 = (PHIBR_RANGE)pv1;
+    PHIBR_RANGE p2 = (PHIBR_RANGE)pv2;
+    return (p1->pfn < p2->pfn) ? -1 : ((p1->pfn > p2->pfn) ? 1 : 0);
+}
+
+/*
+* Locate the xpress block holding a pfn.
+* -- ctx
+* -- pfn
+* -- piBlock
+* -- piPageInBlock
+* -- return = FALSE if the pfn does not exist in the hibernation file.
+*/
+_Success_(return)
+BOOL DeviceFile_Hibr_PageLocate(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ QWORD pfn, _Out_ PQWORD piBlock, _Out_ PDWORD piPageInBlock)
+{
+    PHIBR_RANGE pRange;
+    QWORD iPage, i, iMin = 0, iMax;
+    // 1: range by pfn:
+    if(!ctx->Hibr.cRange) { return FALSE; }
+    iMax = ctx->Hibr.cRange - 1;
+    while(iMin < iMax) {
+        i = (iMin + iMax + 1) >> 1;
+        if(ctx->Hibr.pRange[i].pfn <= pfn) {
+            iMin = i;
+        } else {
+            iMax = i - 1;
+        }
+    }
+    pRange = ctx->Hibr.pRange + iMin;
+    if((pfn < pRange->pfn) || (pfn >= pRange->pfn + pRange->cPage)) { return FALSE; }
+    // 2: block by page stream index:
+    iPage = pRange->iPage + (pfn - pRange->pfn);
+    iMin = 0;
+    iMax = ctx->Hibr.cBlock - 1;
+    while(iMin < iMax) {
+        i = (iMin + iMax + 1) >> 1;
+        if(ctx->Hibr.pBlock[i].iPage <= iPage) {
+            iMin = i;
+        } else {
+            iMax = i - 1;
+        }
+    }
+    if(iPage - ctx->Hibr.pBlock[iMin].iPage >= ctx->Hibr.pBlock[iMin].cPage) { return FALSE; }
+    *piBlock = iMin;
+    *piPageInBlock = (DWORD)(iPage - ctx->Hibr.pBlock[iMin].iPage);
+    return TRUE;
+}
+
+/*
+* Read a full decompressed xpress block. Decompressed blocks are kept in a
+* direct-mapped cache since neighbouring reads in the same block are common.
+* -- ctx
+* -- iFile = file handle held by caller.
+* -- iBlock
+* -- pbScratch = scratch buffer of ctx->Hibr.cbBlockMax bytes.
+* -- pbBlock = buffer of ctx->Hibr.cPageBlockMax pages to receive the block.
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Hibr_ReadBlock(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ DWORD iFile, _In_ QWORD iBlock, _In_ PBYTE pbScratch, _Out_ PBYTE pbBlock)
+{
+    PHIBR_BLOCK pBlock = ctx->Hibr.pBlock + iBlock;
+    PHIBR_BLOCK_CACHE_ENTRY pe = NULL;
+    DWORD cbBlock = pBlock->cPage << 12;
+    // 1: try fetch from decompressed block cache:
+    if(ctx->Hibr.pbCache) {
+        pe = (PHIBR_BLOCK_CACHE_ENTRY)(ctx->Hibr.pbCache + (iBlock % ctx->Hibr.cCacheEntry) * ctx->Hibr.cbCacheEntry);
+        EnterCriticalSection(&ctx->Hibr.LockCache);
+        if(pe->iBlock == iBlock + 1) {
+            memcpy(pbBlock, pe->pb, cbBlock);
+            LeaveCriticalSection(&ctx->Hibr.LockCache);
+            return TRUE;
+        }
+        LeaveCriticalSection(&ctx->Hibr.LockCache);
+    }
+    // 2: read block - uncompressed blocks are read directly into the block buffer:
+    if(pBlock->cb == cbBlock) {
+        return DeviceFile_ReadFile(ctx, iFile, pBlock->o, cbBlock, pbBlock);
+    }
+    if(!DeviceFile_ReadFile(ctx, iFile, pBlock->o, pBlock->cb, pbScratch)) { return FALSE; }
+    if(pBlock->fHuffman) {
+        if(!DeviceFile_Hibr_XpressHuffmanDecompress(pbScratch, pBlock->cb, pbBlock, cbBlock)) { return FALSE; }
+    } else {
+        if(!DeviceFile_Hibr_XpressDecompress(pbScratch, pBlock->cb, pbBlock, cbBlock)) { return FALSE; }
+    }
+    // 3: store decompressed block in cache:
+    if(pe) {
+        EnterCriticalSection(&ctx->Hibr.LockCache);
+        memcpy(pe->pb, pbBlock, cbBlock);
+        pe->iBlock = iBlock + 1;
+        LeaveCriticalSection(&ctx->Hibr.LockCache);
+    }
+    return TRUE;
+}
+
+/*
+* Contigious read function for hibernation files - to be called by the
+* LeechCore ReadContigious workers in parallel. The memory map is identity
+* mapped. The MEMs are completed directly so that a page missing from the
+* hibernation file does not fail the remainder of the chunk.
+* -- ctxRC
+*/
+VOID DeviceFile_Hibr_ReadContigious(_Inout_ PLC_READ_CONTIGIOUS_CONTEXT ctxRC)
+{
+    PLC_CONTEXT ctxLC = ctxRC->ctxLC;
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    DWORD iMEM, iFile, oPage, iPageInBlock;
+    QWORD iBlock, iBlockBuffer = (QWORD)-1;
+    PBYTE pbBuffer;
+    PMEM_SCATTER pMEM;
+    ctxRC->cbRead = 0;
+    if(!(pbBuffer = LocalAlloc(0, ((SIZE_T)ctx->Hibr.cPageBlockMax << 12) + ctx->Hibr.cbBlockMax))) { return; }
+    iFile = DeviceFile_LockAcquire(ctx);
+    for(iMEM = 0; iMEM < ctxRC->cMEMs; iMEM++) {
+        pMEM = ctxRC->ppMEMs[iMEM];
+        if(pMEM->f || (pMEM->qwA == (QWORD)-1)) { continue; }
+        oPage = (DWORD)(pMEM->qwA & 0xfff);
+        if(oPage + pMEM->cb > 0x1000) {
+            lcprintfvvv_fn(ctxLC, "READ FAILED (CROSS PAGE):\n        offset=%016llx req_len=%08x\n", pMEM->qwA, pMEM->cb);
+            continue;
+        }
+        if(!DeviceFile_Hibr_PageLocate(ctx, pMEM->qwA >> 12, &iBlock, &iPageInBlock)) {
+            lcprintfvvv_fn(ctxLC, "READ FAILED:\n        offset=%016llx req_len=%08x\n", pMEM->qwA, pMEM->cb);
+            continue;
+        }
+        if(iBlock != iBlockBuffer) {
+            iBlockBuffer = (QWORD)-1;
+            if(!DeviceFile_Hibr_ReadBlock(ctx, iFile, iBlock, pbBuffer + ((SIZE_T)ctx->Hibr.cPageBlockMax << 12), pbBuffer)) {
+                lcprintfvvv_fn(ctxLC, "READ FAILED:\n        offset=%016llx req_len=%08x\n", pMEM->qwA, pMEM->cb);
+                continue;
+            }
+            iBlockBuffer = iBlock;
+        }
+        memcpy(pMEM->pb, pbBuffer + ((SIZE_T)iPageInBlock << 12) + oPage, pMEM->cb);
+        pMEM->f = TRUE;
+        if(ctxLC->fPrintf[LC_PRINTF_VVV]) {
+            lcprintf_fn(
+                ctxLC,
+                "READ:\n        offset=%016llx req_len=%08x\n",
+                pMEM->qwA,
+                pMEM->cb
+            );
+            Util_PrintHexAscii(ctxLC, pMEM->pb, pMEM->cb, 0);
+        }
+    }
+    DeviceFile_LockRelease(ctx, iFile);
+    LocalFree(pbBuffer);
+}
+
+/*
+* Walk the sorted restored page ranges and either count or add memory map
+* ranges. The walk is done with a granularity of 2^dwUnitShift pfns - pfns
+* not present within a present unit will fail to read.
+* -- ctxLC
+* -- dwUnitShift = 0 (single pfn) or 9 (512 pfns).
+* -- fAdd = add ranges to memory map (otherwise only count ranges).
+* -- return = number of ranges, or (QWORD)-1 on failure.
+*/
+QWORD DeviceFile_Hibr_MemMapWalk(_In_ PLC_CONTEXT ctxLC, _In_ DWORD dwUnitShift, _In_ BOOL fAdd)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    QWORD i, iUnitBase = 0, iUnitTop = 0, cRange = 0, pa, cb;
+    PHIBR_RANGE pRange;
+    for(i = 0; i <= ctx->Hibr.cRange; i++) {
+        pRange = ctx->Hibr.pRange + i;
+        if((i < ctx->Hibr.cRange) && iUnitTop && ((pRange->pfn >> dwUnitShift) <= iUnitTop)) {
+            iUnitTop = max(iUnitTop, (pRange->pfn + pRange->cPage + (1ULL << dwUnitShift) - 1) >> dwUnitShift);
+            continue;
+        }
+        if(iUnitTop) {
+            cRange++;
+            if(fAdd) {
+                pa = iUnitBase << (dwUnitShift + 12);
+                cb = (iUnitTop - iUnitBase) << (dwUnitShift + 12);
+                if(!LcMemMap_AddRange(ctxLC, pa, cb, pa)) {
+                    lcprintf(ctxLC, "DEVICE: FAIL: unable to add range to memory map. (%016llx %016llx %016llx)\n", pa, cb, pa);
+                    return (QWORD)-1;
+                }
+            }
+        }
+        if(i < ctx->Hibr.cRange) {
+            iUnitBase = pRange->pfn >> dwUnitShift;
+            iUnitTop = (pRange->pfn + pRange->cPage + (1ULL << dwUnitShift) - 1) >> dwUnitShift;
+        }
+    }
+    return cRange;
+}
+
+/*
+* Clean up hibernation file related resources.
+* -- ctx
+*/
+VOID DeviceFile_Hibr_Close(_In_ PDEVICE_CONTEXT_FILE ctx)
+{
+    if(ctx->Hibr.pbCache) {
+        DeleteCriticalSection(&ctx->Hibr.LockCache);
+        LocalFree(ctx->Hibr.pbCache);
+        ctx->Hibr.pbCache = NULL;
+    }
+    LocalFree(ctx->Hibr.pRange);
+    LocalFree(ctx->Hibr.pBlock);
+    ctx->Hibr.pRange = NULL;
+    ctx->Hibr.pBlock = NULL;
+    ctx->Hibr.cRange = 0;
+    ctx->Hibr.cBlock = 0;
+}
+
+/*
+* Initialize a Windows hibernation file. For Windows XP to Windows 7 the first
+* restore table is located as the page preceding the first Xpress block since
+* the location in the PO_MEMORY_IMAGE header differs between Windows versions.
+* The table layout is detected by verifying the first table against the known
+* layouts. If no restore table is found the file is parsed as a Windows 8+
+* (x64) hibernation file consisting of compression sets.
+* -- ctxLC
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_DumpInitialize_Hibr(_In_ PLC_CONTEXT ctxLC)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    const HIBR_TABLE_LAYOUT *pLayout = NULL;
+    QWORD i, iTablePage = 0, iTablePageNext, cTable, cRange, qwCR3;
+    DWORD iLayout, dwUnitShift, cbBlock, cPageBlock;
+    lcprintfvv_fn(ctxLC, "Windows Hibernation File identified.\n");
+    // 1: locate the first restore table and detect the table layout:
+    for(i = 1; (i < HIBR_TABLE_SCAN_PAGES) && !pLayout; i++) {
+        if(!DeviceFile_Hibr_BlockHeader(ctx, 0, (i + 1) << 12, &cbBlock, &cPageBlock)) { continue; }
+        iTablePage = i;
+        for(iLayout = 0; iLayout < _countof(HIBR_TABLE_LAYOUTS); iLayout++) {
+            if(DeviceFile_Hibr_TableParse(ctx, &HIBR_TABLE_LAYOUTS[iLayout], iTablePage, FALSE, &iTablePageNext)) {
+                pLayout = &HIBR_TABLE_LAYOUTS[iLayout];
+                break;
+            }
+        }
+        break;
+    }
+    if(pLayout) {
+        lcprintfv(ctxLC, "DEVICE: hibernation file: %s restore table layout.\n", pLayout->szName);
+        ctx->Hibr.pLayout = pLayout;
+        ctx->tpArch = pLayout->tpArch;
+    } else {
+        if(!DeviceFile_Hibr_SetInitialize(ctxLC)) {
+            lcprintf(ctxLC, "DEVICE: FAIL: hibernation file: unsupported format.\n");
+            DeviceFile_Hibr_Close(ctx);
+            return FALSE;
+        }
+        lcprintfv(ctxLC, "DEVICE: hibernation file: %s compression set layout.\n", ctx->Hibr.pSetLayout->szName);
+        ctx->tpArch = LC_ARCH_X64;
+        iTablePage = 0;
+    }
+    // 2: parse all restore tables into the range and block index:
+    for(cTable = 0; iTablePage; cTable++) {
+        if((cTable == HIBR_TABLE_MAX) || !DeviceFile_Hibr_TableParse(ctx, pLayout, iTablePage, TRUE, &iTablePageNext)) {
+            lcprintf(ctxLC, "DEVICE: FAIL: hibernation file: bad restore table at page %llx.\n", iTablePage);
+            goto fail;
+        }
+        iTablePage = iTablePageNext;
+    }
+    qsort(ctx->Hibr.pRange, ctx->Hibr.cRange, sizeof(HIBR_RANGE), DeviceFile_Hibr_RangeCmp);
+    lcprintfvv_fn(ctxLC, "tables=%llx ranges=%x blocks=%llx pages=%llx\n", cTable, ctx->Hibr.cRange, ctx->Hibr.cBlock, ctx->Hibr.cPage);
+    // 3: populate memory map - fall back to a coarser granularity if the
+    //    hibernation file is too fragmented to fit in the memory map.
+    dwUnitShift = 0;
+    if(DeviceFile_Hibr_MemMapWalk(ctxLC, 0, FALSE) > 0x00080000) {
+        lcprintfv(ctxLC, "DEVICE: hibernation file: fragmented file - using coarse memory map.\n");
+        dwUnitShift = 9;
+    }
+    cRange = DeviceFile_Hibr_MemMapWalk(ctxLC, dwUnitShift, TRUE);
+    if(!cRange || (cRange == (QWORD)-1)) { goto fail; }
+    // 4: processor state page (x64): KPROCESSOR_STATE.SpecialRegisters.Cr3:
+    if(!pLayout || (pLayout->tpArch == LC_ARCH_X64)) {
+        qwCR3 = *(PQWORD)(ctx->CrashOrCoreDump.pbHdr + 0x1000 + 0x10);
+        if(qwCR3 && !(qwCR3 & 0xfff) && (qwCR3 < LcMemMap_GetMaxAddress(ctxLC))) {
+            ctx->paDtbHint = qwCR3;
+        }
+    }
+    // 5: allocate decompressed block cache:
+    ctx->Hibr.cbCacheEntry = sizeof(HIBR_BLOCK_CACHE_ENTRY) + (ctx->Hibr.cPageBlockMax << 12);
+    ctx->Hibr.cCacheEntry = HIBR_BLOCK_CACHE_SIZE / (ctx->Hibr.cPageBlockMax << 12);
+    if((ctx->Hibr.pbCache = LocalAlloc(LMEM_ZEROINIT, (SIZE_T)ctx->Hibr.cCacheEntry * ctx->Hibr.cbCacheEntry))) {
+        InitializeCriticalSection(&ctx->Hibr.LockCache);
+    }
+    // 6: hibernation files are read by the ReadContigious workers in parallel.
+    //    The ReadContigious scheduler itself must be called single-threaded.
+    ctxLC->fMultiThread = FALSE;
+    ctxLC->pfnReadScatter = NULL;
+    ctxLC->pfnReadContigious = DeviceFile_Hibr_ReadContigious;
+    ctxLC->ReadContigious.cThread = ctx->fMultiThreaded ? FILE_MAX_THREADS : 1;
+    ctxLC->ReadContigious.fLoadBalance = TRUE;
+    ctxLC->pfnWriteScatter = NULL;
+    ctxLC->Config.fWritable = FALSE;
+    ctx->CrashOrCoreDump.fValidHibrDump = TRUE;
+    return TRUE;
+fail:
+    lcprintf(ctxLC, "DEVICE: FAIL: error parsing hibernation file.\n");
+    DeviceFile_Hibr_Close(ctx);
+    return FALSE;
+}
+
+//-----------------------------------------------------------------------------
+// QEMU MIGRATION STREAM FUNCTIONALITY BELOW:
+// A QEMU migration stream (savevm, 'migrate exec:cat > file' or 'migrate file:'
+// with or without the mapped-ram capability) is indexed in a single sequential
+// pass on open. The newest record of each ram block page is kept in a per-page
+// table - data pages by file offset, zero pages by fill byte and xbzrle pages
+// as a delta applied on top of the previous record of the page.
+//-----------------------------------------------------------------------------
+
+typedef struct tdQEMU_READER {
+    PDEVICE_CONTEXT_FILE ctx;
+    QWORD o;                    // stream offset of next byte
+    BOOL fFail;                 // read beyond end of stream (sticky)
+    QWORD oBuffer;
+    DWORD cbBuffer;
+    BYTE pbBuffer[QEMU_READER_BUFFER];
+} QEMU_READER, *PQEMU_READER;
+
+/*
+* Retrieve a pointer to the next cb bytes of the stream and advance the stream
+* position past them. The stream is read through a large sequential buffer.
+* -- pr
+* -- cb = number of bytes (max QEMU_READER_BUFFER).
+* -- return = pointer into the reader buffer, or NULL on end of stream.
+*/
+PBYTE DeviceFile_Qemu_ReaderRead(_In_ PQEMU_READER pr, _In_ DWORD cb)
+{
+    PBYTE pb;
+    if(pr->fFail) { return NULL; }
+    if((pr->o < pr->oBuffer) || (pr->o + cb > pr->oBuffer + pr->cbBuffer)) {
+        pr->oBuffer = pr->o;
+        pr->cbBuffer = (DWORD)min(QEMU_READER_BUFFER, pr->ctx->cbFile - min(pr->o, pr->ctx->cbFile));
+        if((cb > pr->cbBuffer) || !DeviceFile_ReadFile(pr->ctx, 0, pr->oBuffer, pr->cbBuffer, pr->pbBuffer)) {
+            pr->cbBuffer = 0;
+            pr->fFail = TRUE;
+            return NULL;
+        }
+    }
+    pb = pr->pbBuffer + (pr->o - pr->oBuffer);
+    pr->o += cb;
+    return pb;
+}
+
+/*
+* Retrieve a pointer to the next cb bytes of the stream without advancing the
+* stream position.
+* -- pr
+* -- cb
+* -- return
+*/
+PBYTE DeviceFile_Qemu_ReaderPeek(_In_ PQEMU_READER pr, _In_ DWORD cb)
+{
+    PBYTE pb;
+    if((pb = DeviceFile_Qemu_ReaderRead(pr, cb))) {
+        pr->o -= cb;
+    }
+    return pb;
+}
+
+/*
+* Skip cb bytes of the stream without reading them (i.e. page data).
+* -- pr
+* -- cb
+*/
+VOID DeviceFile_Qemu_ReaderSkip(_In_ PQEMU_READER pr, _In_ QWORD cb)
+{
+    if(pr->o + cb > pr->ctx->cbFile) {
+        pr->fFail = TRUE;
+    }
+    pr->o += cb;
+}
+
+/*
+* Read a big-endian integer of cb (1, 2, 4 or 8) bytes from the stream.
+* -- pr
+* -- cb
+* -- return = the value, or zero on end of stream (pr->fFail is set).
+*/
+QWORD DeviceFile_Qemu_ReadBe(_In_ PQEMU_READER pr, _In_ DWORD cb)
+{
+    QWORD qw = 0;
+    DWORD i;
+    PBYTE pb;
+    if(!(pb = DeviceFile_Qemu_ReaderRead(pr, cb))) { return 0; }
+    for(i = 0; i < cb; i++) {
+        qw = (qw << 8) | pb[i];
+    }
+    return qw;
+}
+
+/*
+* Read a string prefixed by its 8-bit length from the stream.
+* -- pr
+* -- sz = buffer to receive the null-terminated string.
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Qemu_ReadString(_In_ PQEMU_READER pr, _Out_writes_(0x100) LPSTR sz)
+{
+    DWORD cch;
+    PBYTE pb;
+    sz[0] = 0;
+    cch = (DWORD)DeviceFile_Qemu_ReadBe(pr, 1);
+    if(!cch || !(pb = DeviceFile_Qemu_ReaderRead(pr, cch))) { return FALSE; }
+    memcpy(sz, pb, cch);
+    sz[cch] = 0;
+    return TRUE;
+}
+
+/*
+* Parse the configuration section: the machine type and the subsections with
+* the target page size and the migration capabilities which alter the format
+* of the ram block list.
+* -- ctxLC
+* -- pr
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Qemu_ParseConfiguration(_In_ PLC_CONTEXT ctxLC, _In_ PQEMU_READER pr)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    CHAR szName[0x100], szCapability[0x100];
+    DWORD cch, cCapability, dwPageShift;
+    PBYTE pb;
+    cch = (DWORD)DeviceFile_Qemu_ReadBe(pr, 4);
+    if(!cch || (cch >= sizeof(ctx->Qemu.szMachine)) || !(pb = DeviceFile_Qemu_ReaderRead(pr, cch))) { return FALSE; }
+    memcpy(ctx->Qemu.szMachine, pb, cch);
+    while((pb = DeviceFile_Qemu_ReaderPeek(pr, 1)) && (pb[0] == QEMU_VM_SUBSECTION)) {
+        DeviceFile_Qemu_ReaderSkip(pr, 1);
+        if(!DeviceFile_Qemu_ReadString(pr, szName)) { return FALSE; }
+        DeviceFile_Qemu_ReadBe(pr, 4);                      // subsection version
+        if(!strcmp(szName, "configuration/target-page-bits")) {
+            dwPageShift = (DWORD)DeviceFile_Qemu_ReadBe(pr, 4);
+            if((dwPageShift < 12) || (dwPageShift > 16)) {
+                lcprintf(ctxLC, "DEVICE: FAIL: qemu: unsupported target page size (%i bits).\n", dwPageShift);
+                return FALSE;
+            }
+            ctx->Qemu.dwPageShift = dwPageShift;
+            ctx->Qemu.cbPage = 1UL << dwPageShift;
+        } else if(!strcmp(szName, "configuration/capabilities")) {
+            cCapability = (DWORD)DeviceFile_Qemu_ReadBe(pr, 4);
+            while(cCapability-- && DeviceFile_Qemu_ReadString(pr, szCapability)) {
+                if(!strcmp(szCapability, "mapped-ram")) { ctx->Qemu.fMappedRam = TRUE; }
+                if(!strcmp(szCapability, "x-ignore-shared")) { ctx->Qemu.fIgnoreShared = TRUE; }
+            }
+        } else if(!strcmp(szName, "configuration/uuid")) {
+            DeviceFile_Qemu_ReaderSkip(pr, 16);
+        } else {
+            lcprintf(ctxLC, "DEVICE: FAIL: qemu: unsupported configuration subsection '%s'.\n", szName);
+            return FALSE;
+        }
+    }
+    return !pr->fFail;
+}
+
+/*
+* Parse the ram block list of the ram setup section. With the mapped-ram
+* capability each ram block is followed by a header locating the dirty page
+* bitmap and the pages of the block in the file - pages not in the bitmap are
+* zero pages and the stream continues after the pages of the block.
+* -- ctxLC
+* -- pr
+* -- cbTotal = total size of all ram blocks.
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Qemu_ParseRamBlocks(_In_ PLC_CONTEXT ctxLC, _In_ PQEMU_READER pr, _In_ QWORD cbTotal)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    PQEMU_RAMBLOCK pBlock;
+    PQWORD pqwBitmap = NULL;
+    QWORD i, qw, oBitmap, oPages, cbBitmap;
+    PBYTE pb;
+    while(cbTotal) {
+        if(ctx->Qemu.cBlock == QEMU_RAMBLOCKS_MAX) { goto fail; }
+        pBlock = &ctx->Qemu.Block[ctx->Qemu.cBlock];
+        if(!DeviceFile_Qemu_ReadString(pr, pBlock->szName)) { goto fail; }
+        pBlock->cb = DeviceFile_Qemu_ReadBe(pr, 8);
+        if(!pBlock->cb || (pBlock->cb > cbTotal) || (pBlock->cb & (ctx->Qemu.cbPage - 1))) { goto fail; }
+        cbTotal -= pBlock->cb;
+        pBlock->cPage = pBlock->cb >> ctx->Qemu.dwPageShift;
+        if(!(pBlock->pqwPage = LocalAlloc(LMEM_ZEROINIT, (SIZE_T)(pBlock->cPage * sizeof(QWORD))))) { goto fail; }
+        ctx->Qemu.cBlock++;
+        // postcopy-ram capability: page size of huge page backed block. The
+        // capability is not recorded in the stream - but the next item of the
+        // list can never be a page size (i.e. a power of two above 4kB).
+        if(!ctx->Qemu.fIgnoreShared && (pb = DeviceFile_Qemu_ReaderPeek(pr, 8))) {
+            qw = _byteswap_uint64(*(PQWORD)pb);
+            if((qw > 0x1000) && (qw <= 0x40000000) && !(qw & (qw - 1))) {
+                DeviceFile_Qemu_ReaderSkip(pr, 8);
+            }
+        }
+        if(ctx->Qemu.fIgnoreShared) {
+            DeviceFile_Qemu_ReaderSkip(pr, 8);              // memory region address
+        }
+        if(ctx->Qemu.fMappedRam) {
+            if(!(pb = DeviceFile_Qemu_ReaderRead(pr, QEMU_MAPPED_RAM_HEADER_SIZE))) { goto fail; }
+            oBitmap = _byteswap_uint64(*(PQWORD)(pb + 12));
+            oPages = _byteswap_uint64(*(PQWORD)(pb + 20));
+            cbBitmap = ((pBlock->cPage + 63) >> 6) * sizeof(QWORD);
+            if((_byteswap_ulong(*(PDWORD)pb) != QEMU_MAPPED_RAM_VERSION) || (_byteswap_uint64(*(PQWORD)(pb + 4)) != ctx->Qemu.cbPage)) { goto fail; }
+            if((cbBitmap > 0x40000000) || (oBitmap + cbBitmap > oPages) || (oPages + pBlock->cb > ctx->cbFile)) { goto fail; }
+            if(!(pqwBitmap = LocalAlloc(0, (SIZE_T)cbBitmap))) { goto fail; }
+            if(!DeviceFile_ReadFile(ctx, 0, oBitmap, (DWORD)cbBitmap, (PBYTE)pqwBitmap)) { goto fail; }
+            for(i = 0; i < pBlock->cPage; i++) {
+                pBlock->pqwPage[i] = ((pqwBitmap[i >> 6] >> (i & 63)) & 1) ? (oPages + (i << ctx->Qemu.dwPageShift)) : QEMU_PAGE_ZERO;
+            }
+            LocalFree(pqwBitmap);
+            pqwBitmap = NULL;
+            pr->o = oPages + pBlock->cb;
+        }
+    }
+    return !pr->fFail;
+fail:
+    LocalFree(pqwBitmap);
+    return FALSE;
+}
+
+/*
+* Parse the ram records of a ram section up to and including the end of
+* section marker. A newer record of a page replaces any older record - except
+* for xbzrle records which are chained to the record they are applied to.
+* -- ctxLC
+* -- pr
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Qemu_ParseRam(_In_ PLC_CONTEXT ctxLC, _In_ PQEMU_READER pr)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    PQEMU_RAMBLOCK pBlock = NULL;
+    PQEMU_XBZRLE pe;
+    CHAR szName[0x100];
+    QWORD qw, iPage;
+    DWORD iBlock, dwFlags, cb;
+    PVOID pvGrow;
+    while(TRUE) {
+        qw = DeviceFile_Qemu_ReadBe(pr, 8);
+        if(pr->fFail) { return FALSE; }
+        dwFlags = (DWORD)(qw & (ctx->Qemu.cbPage - 1));
+        qw -= dwFlags;
+        if(dwFlags & (QEMU_RAM_FLAG_HOOK | QEMU_RAM_FLAG_COMPRESS_PAGE)) {
+            lcprintf(ctxLC, "DEVICE: FAIL: qemu: unsupported ram record (rdma or compressed page) at offset %llx.\n", pr->o - 8);
+            return FALSE;
+        }
+        if(dwFlags & QEMU_RAM_FLAG_MEM_SIZE) {
+            if(!DeviceFile_Qemu_ParseRamBlocks(ctxLC, pr, qw)) { return FALSE; }
+        }
+        if(dwFlags & (QEMU_RAM_FLAG_ZERO | QEMU_RAM_FLAG_PAGE | QEMU_RAM_FLAG_XBZRLE)) {
+            if(!(dwFlags & QEMU_RAM_FLAG_CONTINUE)) {
+                pBlock = NULL;
+                if(!DeviceFile_Qemu_ReadString(pr, szName)) { return FALSE; }
+                for(iBlock = 0; iBlock < ctx->Qemu.cBlock; iBlock++) {
+                    if(!strcmp(szName, ctx->Qemu.Block[iBlock].szName)) {
+                        pBlock = &ctx->Qemu.Block[iBlock];
+                        break;
+                    }
+                }
+            }
+            iPage = qw >> ctx->Qemu.dwPageShift;
+            if(!pBlock || (iPage >= pBlock->cPage)) {
+                lcprintf(ctxLC, "DEVICE: FAIL: qemu: ram record outside of ram blocks at offset %llx.\n", pr->o);
+                return FALSE;
+            }
+            if(dwFlags & QEMU_RAM_FLAG_ZERO) {
+                pBlock->pqwPage[iPage] = QEMU_PAGE_ZERO | DeviceFile_Qemu_ReadBe(pr, 1);
+            } else if(dwFlags & QEMU_RAM_FLAG_PAGE) {
+                pBlock->pqwPage[iPage] = pr->o;
+                DeviceFile_Qemu_ReaderSkip(pr, ctx->Qemu.cbPage);
+            } else {
+                if(DeviceFile_Qemu_ReadBe(pr, 1) != QEMU_XBZRLE_ENCODING) { return FALSE; }
+                cb = (DWORD)DeviceFile_Qemu_ReadBe(pr, 2);
+                if(cb > ctx->Qemu.cbPage) { return FALSE; }
+                if(ctx->Qemu.cXbzrle == ctx->Qemu.cXbzrleMax) {
+                    ctx->Qemu.cXbzrleMax = max(0x1000, 2 * ctx->Qemu.cXbzrleMax);
+                    if(!(pvGrow = LocalAlloc(0, (SIZE_T)(ctx->Qemu.cXbzrleMax * sizeof(QEMU_XBZRLE))))) { return FALSE; }
+                    if(ctx->Qemu.pXbzrle) { memcpy(pvGrow, ctx->Qemu.pXbzrle, (SIZE_T)(ctx->Qemu.cXbzrle * sizeof(QEMU_XBZRLE))); }
+                    LocalFree(ctx->Qemu.pXbzrle);
+                    ctx->Qemu.pXbzrle = (PQEMU_XBZRLE)pvGrow;
+                }
+                pe = ctx->Qemu.pXbzrle + ctx->Qemu.cXbzrle;
+                pe->o = pr->o;
+                pe->cb = cb;
+                pe->qwPrev = pBlock->pqwPage[iPage];
+                pBlock->pqwPage[iPage] = QEMU_PAGE_XBZRLE | ctx->Qemu.cXbzrle++;
+                DeviceFile_Qemu_ReaderSkip(pr, cb);
+            }
+        }
+        if(dwFlags & QEMU_RAM_FLAG_EOS) {
+            return !pr->fFail;
+        }
+    }
+}
+
+/*
+* Walk the sections of the migration stream and index the ram sections. The
+* walk ends at the first device state section (all ram is transferred at this
+* point) or at the end of the stream. A truncated stream (i.e. a capture still
+* in progress or interrupted) is accepted with a warning.
+* -- ctxLC
+* -- pr
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Qemu_ParseStream(_In_ PLC_CONTEXT ctxLC, _In_ PQEMU_READER pr)
+{
+    CHAR szName[0x100];
+    DWORD dwSectionId, dwSectionIdRam = (DWORD)-1;
+    BYTE bType;
+    PBYTE pb;
+    while(TRUE) {
+        bType = (BYTE)DeviceFile_Qemu_ReadBe(pr, 1);
+        if(pr->fFail) { break; }
+        if(bType == QEMU_VM_CONFIGURATION) {
+            if(!DeviceFile_Qemu_ParseConfiguration(ctxLC, pr)) { return FALSE; }
+            continue;
+        }
+        if(bType == QEMU_VM_COMMAND) {
+            DeviceFile_Qemu_ReadBe(pr, 2);                  // command
+            DeviceFile_Qemu_ReaderSkip(pr, DeviceFile_Qemu_ReadBe(pr, 2));
+            continue;
+        }
+        if((bType != QEMU_VM_SECTION_START) && (bType != QEMU_VM_SECTION_PART) && (bType != QEMU_VM_SECTION_END)) {
+            // device state (QEMU_VM_SECTION_FULL) or QEMU_VM_EOF:
+            return TRUE;
+        }
+        dwSectionId = (DWORD)DeviceFile_Qemu_ReadBe(pr, 4);
+        if(bType == QEMU_VM_SECTION_START) {
+            if(!DeviceFile_Qemu_ReadString(pr, szName)) { break; }
+            DeviceFile_Qemu_ReaderSkip(pr, 8);              // instance id + version id
+            if(!strcmp(szName, "ram")) {
+                dwSectionIdRam = dwSectionId;
+            }
+        }
+        if(dwSectionId != dwSectionIdRam) {
+            lcprintf(ctxLC, "DEVICE: WARN: qemu: unsupported iterable section (id %x) - ram records after offset %llx are not indexed.\n", dwSectionId, pr->o);
+            return TRUE;
+        }
+        if(!DeviceFile_Qemu_ParseRam(ctxLC, pr)) {
+            if(!pr->fFail) { return FALSE; }
+            break;
+        }
+        if((pb = DeviceFile_Qemu_ReaderPeek(pr, 1)) && (pb[0] == QEMU_VM_SECTION_FOOTER)) {
+            DeviceFile_Qemu_ReaderSkip(pr, 5);              // footer + section id
+        }
+    }
+    lcprintf(ctxLC, "DEVICE: WARN: qemu: truncated migration stream - analysis may be degraded!\n");
+    return TRUE;
+}
+
+/*
+* Place the guest ram block in the physical address space. On x86 the pc.ram
+* block is split into ram below 4GB (up to the machine type dependent pci hole)
+* and ram above 4GB. The size of ram below 4GB may be overridden by the device
+* parameter lowmem=<size>. Other ram blocks (roms, video memory ..) are not
+* mapped.
+* -- ctxLC
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Qemu_Layout(_In_ PLC_CONTEXT ctxLC)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    LPSTR szMachine = ctx->Qemu.szMachine;
+    PQEMU_RAMBLOCK pBlock;
+    QWORD cbLowMem, paBase = 0;
+    DWORD i, iBlock = (DWORD)-1;
+    BOOL fX86 = !strncmp(szMachine, "pc", 2) || strstr(szMachine, "q35");
+    // 1: locate guest ram block (or the largest block, i.e. memory backend):
+    for(i = 0; i < ctx->Qemu.cBlock; i++) {
+        if(!strcmp(ctx->Qemu.Block[i].szName, "pc.ram")) {
+            iBlock = i;
+            fX86 = TRUE;
+        }
+        if(!strcmp(ctx->Qemu.Block[i].szName, "mach-virt.ram")) {
+            iBlock = i;
+            paBase = QEMU_ARM64_VIRT_RAM_BASE;
+            ctx->tpArch = LC_ARCH_ARM64;
+        }
+    }
+    if(iBlock == (DWORD)-1) {
+        for(iBlock = 0, i = 1; i < ctx->Qemu.cBlock; i++) {
+            if(ctx->Qemu.Block[i].cb > ctx->Qemu.Block[iBlock].cb) { iBlock = i; }
+        }
+        if(!strncmp(szMachine, "virt", 4)) {
+            paBase = QEMU_ARM64_VIRT_RAM_BASE;
+            ctx->tpArch = LC_ARCH_ARM64;
+        }
+    }
+    pBlock = &ctx->Qemu.Block[iBlock];
+    // 2: create regions:
+    ctx->Qemu.Region[0].pa = paBase;
+    ctx->Qemu.Region[0].cb = pBlock->cb;
+    ctx->Qemu.Region[0].iBlock = iBlock;
+    ctx->Qemu.cRegion = 1;
+    if(fX86) {
+        ctx->tpArch = LC_ARCH_X64;
+        cbLowMem = ctx->Qemu.cbLowMem;
+        if(!cbLowMem && strstr(szMachine, "q35")) {
+            cbLowMem = (pBlock->cb >= 0xb0000000) ? QEMU_X86_LOWMEM_Q35 : pBlock->cb;
+        }
+        if(!cbLowMem) {
+            cbLowMem = (pBlock->cb >= 0xe0000000) ? QEMU_X86_LOWMEM_PC : pBlock->cb;
+        }
+        cbLowMem = min(cbLowMem, pBlock->cb) & ~(QWORD)(ctx->Qemu.cbPage - 1);
+        if(!cbLowMem || (cbLowMem > 0x100000000)) { return FALSE; }
+        ctx->Qemu.Region[0].cb = cbLowMem;
+        if(pBlock->cb > cbLowMem) {
+            ctx->Qemu.Region[1].pa = 0x100000000;
+            ctx->Qemu.Region[1].cb = pBlock->cb - cbLowMem;
+            ctx->Qemu.Region[1].oBlock = cbLowMem;
+            ctx->Qemu.Region[1].iBlock = iBlock;
+            ctx->Qemu.cRegion = 2;
+        }
+    }
+    lcprintfv(ctxLC, "DEVICE: qemu: machine '%s' - ram block '%s' (%llx bytes) mapped at %llx.\n", szMachine, pBlock->szName, pBlock->cb, paBase);
+    return TRUE;
+}
+
+/*
+* Retrieve the page entry of a physical address.
+* -- ctx
+* -- pa
+* -- pqwEntry
+* -- return = FALSE if the page does not exist in the stream.
+*/
+_Success_(return)
+BOOL DeviceFile_Qemu_PageEntry(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ QWORD pa, _Out_ PQWORD pqwEntry)
+{
+    PQEMU_REGION pRegion;
+    DWORD i;
+    for(i = 0; i < ctx->Qemu.cRegion; i++) {
+        pRegion = &ctx->Qemu.Region[i];
+        if((pa >= pRegion->pa) && (pa < pRegion->pa + pRegion->cb)) {
+            *pqwEntry = ctx->Qemu.Block[pRegion->iBlock].pqwPage[(pRegion->oBlock + pa - pRegion->pa) >> ctx->Qemu.dwPageShift];
+            return *pqwEntry ? TRUE : FALSE;
+        }
+    }
+    return FALSE;
+}
 
-#define FILE_VMWARE_MEMORY_REGIONS_MAX      0x40
+/*
+* Decode a 1-2 byte ULEB128 encoded xbzrle run length.
+* -- pbSrc
+* -- cbSrc
+* -- pi = source index, advanced past the run length.
+* -- pcRun
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Qemu_XbzrleRun(_In_reads_(cbSrc) PBYTE pbSrc, _In_ DWORD cbSrc, _Inout_ PDWORD pi, _Out_ PDWORD pcRun)
+{
+    if(*pi + 2 > cbSrc) { return FALSE; }
+    *pcRun = pbSrc[(*pi)++];
+    if(*pcRun & 0x80) {
+        if(pbSrc[*pi] & 0x80) { return FALSE; }
+        *pcRun = (*pcRun & 0x7f) | ((DWORD)pbSrc[(*pi)++] << 7);
+    }
+    return TRUE;
+}
 
-typedef struct tdFILE_VMWARE_MEMORY_REGION {
-    BOOL fOffsetFile;
-    BOOL fOffsetMemory;
-    BOOL fSize;
-    QWORD cbOffsetFile;
-    QWORD cbOffsetMemory;
-    QWORD cbSize;
-} FILE_VMWARE_MEMORY_REGION;
+/*
+* Apply xbzrle encoded data - alternating runs of unchanged and changed bytes -
+* on top of the previous page contents.
+* -- pbSrc
+* -- cbSrc
+* -- pbPage = previous page contents, updated in place.
+* -- cbPage
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_Qemu_XbzrleDecode(_In_reads_(cbSrc) PBYTE pbSrc, _In_ DWORD cbSrc, _Inout_updates_bytes_(cbPage) PBYTE pbPage, _In_ DWORD cbPage)
+{
+    DWORD i = 0, d = 0, cRun;
+    while(i < cbSrc) {
+        if(!DeviceFile_Qemu_XbzrleRun(pbSrc, cbSrc, &i, &cRun) || (d + cRun > cbPage)) { return FALSE; }
+        d += cRun;
+        if(!DeviceFile_Qemu_XbzrleRun(pbSrc, cbSrc, &i, &cRun) || !cRun || (d + cRun > cbPage) || (i + cRun > cbSrc)) { return FALSE; }
+        memcpy(pbPage + d, pbSrc + i, cRun);
+        d += cRun;
+        i += cRun;
+    }
+    return TRUE;
+}
 
 /*
-* Try to initialize a VMWare Dump/Save File (.vmem + vmss/vmsn).
-* Also, older VMWare versions may have memory in-lined inside the vmsn file.
+* Read a full page by its page entry. The xbzrle records of a page are applied
+* oldest first on top of the newest non-xbzrle record of the page (or on top of
+* a zero page since guest ram starts out zeroed on the destination).
+* -- ctx
+* -- iFile = file handle held by caller.
+* -- qwEntry
+* -- pbScratch = scratch buffer of ctx->Qemu.cbPage bytes.
+* -- pbPage = buffer of ctx->Qemu.cbPage bytes to receive the page.
+* -- return
 */
-VOID DeviceFile_VMwareDumpInitialize(_In_ PLC_CONTEXT ctxLC, _In_ BOOL fInlineMemory)
+_Success_(return)
+BOOL DeviceFile_Qemu_ReadPage(_In_ PDEVICE_CONTEXT_FILE ctx, _In_ DWORD iFile, _In_ QWORD qwEntry, _In_ PBYTE pbScratch, _Out_ PBYTE pbPage)
 {
-    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
-    FILE_VMWARE_HEADER hdr = { 0 };
-    FILE_VMWARE_GROUP grp = { 0 };
-    FILE_VMWARE_MEMORY_REGION regions[FILE_VMWARE_MEMORY_REGIONS_MAX] = { 0 };
-    CHAR szFileName[MAX_PATH];
-    FILE *pFile = NULL;
-    PBYTE pb;
-    QWORD oTag, paDtbHint = 0, qwMemorySizeMB = 0, qwInlineMemoryOffset = 0;
-    DWORD iGroup, iMemoryRegion, cbTag, cchTag, dwPlatform = 0;
-    strcpy_s(szFileName, _countof(szFileName), ctx->szFileName);
-    // 1: open and verify metadata file
-    memcpy(szFileName + strlen(szFileName) - 5, ".vmss", 5);
-    fopen_s(&pFile, szFileName, "rb");
-    if(!pFile) {
-        memcpy(szFileName + strlen(szFileName) - 5, ".vmsn", 5);
-        fopen_s(&pFile, szFileName, "rb");
+    PQEMU_XBZRLE pe;
+    QWORD qw, i, j, cXbzrle = 0;
+    DWORD cbPage = ctx->Qemu.cbPage;
+    // 1: locate the base record below the xbzrle records:
+    for(qw = qwEntry; qw & QEMU_PAGE_XBZRLE; cXbzrle++) {
+        qw = ctx->Qemu.pXbzrle[qw & QEMU_PAGE_MASK].qwPrev;
     }
-    if(!pFile) {
-        lcprintf(ctxLC, "DEVICE: WARN: Unable to open VMware .vmss or .vmsn file - assuming 1:1 memory space.\n");
-        goto fail;
+    // 2: read base record:
+    if(qw & QEMU_PAGE_ZERO) {
+        memset(pbPage, (BYTE)qw, cbPage);
+    } else if(qw) {
+        if(!DeviceFile_ReadFile(ctx, iFile, qw, cbPage, pbPage)) { return FALSE; }
+    } else if(cXbzrle) {
+        ZeroMemory(pbPage, cbPage);
+    } else {
+        return FALSE;
     }
-    _fseeki64(pFile, 0, SEEK_SET);
-    fread(&hdr, 1, sizeof(FILE_VMWARE_HEADER), pFile);
-    if((hdr.magic != 0xbed3bed3) && (hdr.magic != 0xbed2bed2) && (hdr.magic != 0xbad1bad1) /* && (hdr.magic != 0xbed2bed0) */) {
-        lcprintf(ctxLC, "DEVICE: WARN: Unable to verify file '%s'.\n", szFileName);
-        goto fail;
+    // 3: apply xbzrle records oldest first:
+    for(i = cXbzrle; i; i--) {
+        for(qw = qwEntry, j = 1; j < i; j++) {
+            qw = ctx->Qemu.pXbzrle[qw & QEMU_PAGE_MASK].qwPrev;
+        }
+        pe = ctx->Qemu.pXbzrle + (qw & QEMU_PAGE_MASK);
+        if(!pe->cb) { continue; }
+        if(!DeviceFile_ReadFile(ctx, iFile, pe->o, pe->cb, pbScratch)) { return FALSE; }
+        if(!DeviceFile_Qemu_XbzrleDecode(pbScratch, pe->cb, pbPage, cbPage)) { return FALSE; }
     }
-    // 2: locate memory group(s) and parse memory regions from group tags.
-    for(iGroup = 0; iGroup < hdr.cGroups; iGroup++) {
-        _fseeki64(pFile, 12 + iGroup * sizeof(FILE_VMWARE_GROUP), SEEK_SET);
-        fread(&grp, 1, sizeof(FILE_VMWARE_GROUP), pFile);
-        if(0 == strcmp("Checkpoint", grp.szName)) {
-            if(grp.cbSize > 0x00100000) { continue; }
-            if(_fseeki64(pFile, grp.cbOffset, SEEK_SET)) { continue; }
-            if(!(pb = LocalAlloc(LMEM_ZEROINIT, (SIZE_T)grp.cbSize))) { continue; }
-            if(grp.cbSize != fread(pb, 1, (SIZE_T)grp.cbSize, pFile)) {
-                LocalFree(pb);
-                continue;
-            }
-            oTag = 0;
-            while(oTag + 8 + 4 <= grp.cbSize) {
-                if(!dwPlatform && !memcmp(pb + oTag, "Platform", 0x08)) {
-                    dwPlatform = *(PDWORD)(pb + oTag + 0x08);
-                }
-                if(!qwMemorySizeMB && !memcmp(pb + oTag, "memSize", 0x07)) {
-                    qwMemorySizeMB = *(PDWORD)(pb + oTag + 0x07);
-                }
-                oTag++;
-            }
+    return TRUE;
+}
+
+/*
+* Scatter read function for qemu migration streams - to be called by LeechCore.
+* The memory map is identity mapped so the MEM address is the physical address.
+* Data pages are read directly from the stream - zero and xbzrle pages are
+* reconstructed into a page buffer.
+* -- ctxLC
+* -- cpMEMs
+* -- ppMEMs
+*/
+VOID DeviceFile_Qemu_ReadScatter(_In_ PLC_CONTEXT ctxLC, _In_ DWORD cpMEMs, _Inout_ PPMEM_SCATTER ppMEMs)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    DWORD iMEM, iFile, oPage, cbPage = ctx->Qemu.cbPage;
+    QWORD pfn, pfnBuffer = (QWORD)-1, qwEntry;
+    PBYTE pbBuffer;
+    PMEM_SCATTER pMEM;
+    if(!(pbBuffer = LocalAlloc(0, 2ULL * cbPage))) { return; }
+    iFile = DeviceFile_LockAcquire(ctx);
+    for(iMEM = 0; iMEM < cpMEMs; iMEM++) {
+        pMEM = ppMEMs[iMEM];
+        if(pMEM->f || (pMEM->qwA == (QWORD)-1)) { continue; }
+        pfn = pMEM->qwA >> ctx->Qemu.dwPageShift;
+        oPage = (DWORD)(pMEM->qwA & (cbPage - 1));
+        if(oPage + pMEM->cb > cbPage) {
+            lcprintfvvv_fn(ctxLC, "READ FAILED (CROSS PAGE):\n        offset=%016llx req_len=%08x\n", pMEM->qwA, pMEM->cb);
+            continue;
         }
-        if(0 == strcmp("cpu", grp.szName)) {
-            if(grp.cbSize > 0x00100000) { continue; }
-            if(_fseeki64(pFile, grp.cbOffset, SEEK_SET)) { continue; }
-            if(!(pb = LocalAlloc(LMEM_ZEROINIT, (SIZE_T)grp.cbSize))) { continue; }
-            if(grp.cbSize != fread(pb, 1, (SIZE_T)grp.cbSize, pFile)) {
-                LocalFree(pb);
-                continue;
-            }
-            oTag = 0;
-            while(oTag + 13 + 8 <= grp.cbSize) {
-                if(!paDtbHint && !memcmp(pb + oTag, "hv:ttbrEL1[0]", 13)) {
-                    if(*(PDWORD)(pb + oTag + 13 + 4) >= 0x80000000) {
-                        paDtbHint = *(PDWORD)(pb + oTag + 13 + 4);
-                    }
-                }
-                oTag++;
-            }
+        if(!DeviceFile_Qemu_PageEntry(ctx, pMEM->qwA, &qwEntry)) {
+            lcprintfvvv_fn(ctxLC, "READ FAILED (NOT IN STREAM):\n        offset=%016llx req_len=%08x\n", pMEM->qwA, pMEM->cb);
+            continue;
         }
-        if(0 == strcmp("memory", grp.szName)) {
-            if(grp.cbSize > 0x01000000) { 
-                if(fInlineMemory) {
-                    qwInlineMemoryOffset = (grp.cbOffset + (grp.cbSize & 0xfffff)) & ~0xfff;
-                    grp.cbSize = grp.cbSize & 0xfffff;
-                } else {
-                    continue;
-                }
-            }
-            if(_fseeki64(pFile, grp.cbOffset, SEEK_SET)) { continue; }
-            if(!(pb = LocalAlloc(LMEM_ZEROINIT, (SIZE_T)grp.cbSize))) { continue; }
-            if(grp.cbSize != fread(pb, 1, (SIZE_T)grp.cbSize, pFile)) {
-                LocalFree(pb);
+        if(!(qwEntry & (QEMU_PAGE_ZERO | QEMU_PAGE_XBZRLE))) {
+            if(!DeviceFile_ReadFile(ctx, iFile, qwEntry + oPage, pMEM->cb, pMEM->pb)) {
+                lcprintfvvv_fn(ctxLC, "READ FAILED:\n        offset=%016llx req_len=%08x\n", pMEM->qwA, pMEM->cb);
                 continue;
             }
-            oTag = 0;
-            while((oTag + 6 <= grp.cbSize) && *(PBYTE)(pb + oTag)) {
-                cchTag = *(PBYTE)(pb + oTag + 1);
-                cbTag = 2 + cchTag + 4 + 4 * ((*(PBYTE)(pb + oTag) >> 6) & 3ULL);
-                if(!cchTag || (oTag + cbTag >= grp.cbSize)) { break; }
-                if((cchTag == 0x0a) && !memcmp(pb + oTag + 2, "regionSize", 0x0a) && ((iMemoryRegion = *(PDWORD)(pb + oTag + 2 + 0x0a)) < FILE_VMWARE_MEMORY_REGIONS_MAX)) {
-                    regions[iMemoryRegion].fSize = TRUE;
-                    regions[iMemoryRegion].cbSize = *(PDWORD)(pb + oTag + 2 + 0x0a + 4) * 0x1000ULL;
-                }
-                if((cchTag == 0x09) && !memcmp(pb + oTag + 2, "regionPPN", 0x09) && ((iMemoryRegion = *(PDWORD)(pb + oTag + 2 + 0x09)) < FILE_VMWARE_MEMORY_REGIONS_MAX)) {
-                    regions[iMemoryRegion].fOffsetMemory = TRUE;
-                    regions[iMemoryRegion].cbOffsetMemory = *(PDWORD)(pb + oTag + 2 + 0x09 + 4) * 0x1000ULL;
-                }
-                if((cchTag == 0x0d) && !memcmp(pb + oTag + 2, "regionPageNum", 0x0d) && ((iMemoryRegion = *(PDWORD)(pb + oTag + 2 + 0x0d)) < FILE_VMWARE_MEMORY_REGIONS_MAX)) {
-                    regions[iMemoryRegion].fOffsetFile = TRUE;
-                    regions[iMemoryRegion].cbOffsetFile = qwInlineMemoryOffset + *(PDWORD)(pb + oTag + 2 + 0x0d + 4) * 0x1000ULL;
-                }
-                oTag += cbTag;
-                if((oTag + 4 <= grp.cbSize) && (0 == *(PDWORD)(pb + oTag))) { oTag += 4; }
-            }
-            LocalFree(pb);
-            for(iMemoryRegion = 0; iMemoryRegion < FILE_VMWARE_MEMORY_REGIONS_MAX; iMemoryRegion++) {
-                if(regions[iMemoryRegion].fSize && regions[iMemoryRegion].fOffsetMemory && regions[iMemoryRegion].fOffsetFile) {
-                    LcMemMap_AddRange(ctxLC, regions[iMemoryRegion].cbOffsetMemory, regions[iMemoryRegion].cbSize, LC_MEMMAP_FORCE_OFFSET | regions[iMemoryRegion].cbOffsetFile);
-                    ctx->CrashOrCoreDump.fValidVMwareDump = TRUE;
+        } else {
+            if(pfn != pfnBuffer) {
+                pfnBuffer = (QWORD)-1;
+                if(!DeviceFile_Qemu_ReadPage(ctx, iFile, qwEntry, pbBuffer + cbPage, pbBuffer)) {
+                    lcprintfvvv_fn(ctxLC, "READ FAILED:\n        offset=%016llx req_len=%08x\n", pMEM->qwA, pMEM->cb);
+                    continue;
                 }
+                pfnBuffer = pfn;
             }
+            memcpy(pMEM->pb, pbBuffer + oPage, pMEM->cb);
+        }
+        pMEM->f = TRUE;
+        if(ctxLC->fPrintf[LC_PRINTF_VVV]) {
+            lcprintf_fn(
+                ctxLC,
+                "READ:\n        offset=%016llx req_len=%08x\n",
+                pMEM->qwA,
+                pMEM->cb
+            );
+            Util_PrintHexAscii(ctxLC, pMEM->pb, pMEM->cb, 0);
         }
     }
-    ctx->paDtbHint = paDtbHint;
-    if(!LcMemMap_IsInitialized(ctxLC) && (dwPlatform == 3) && (qwMemorySizeMB > 16)) {
-        // ARM64 - initialize with default physical memory offset of 0x80000000 at zero file offset.
-        ctx->tpArch = LC_ARCH_ARM64;
-        LcMemMap_AddRange(ctxLC, 0x80000000, qwMemorySizeMB * 0x00100000ULL, LC_MEMMAP_FORCE_OFFSET | 0);
-    }
-    if(!LcMemMap_IsInitialized(ctxLC)) {
-        lcprintf(ctxLC, "DEVICE: WARN: No VMware memory regions located - file will be treated as single-region.\n");
-    }
-fail:
-    if(pFile) { fclose(pFile); }
+    DeviceFile_LockRelease(ctx, iFile);
+    LocalFree(pbBuffer);
 }
 
 /*
-* Parsing of the Full Bitmap Microsoft Crashdump file (currently only 64-bits).
+* Walk the page tables of the mapped ram regions and either count or add memory
+* map ranges. The walk is done with a granularity of 2^dwUnitShift pages - a
+* unit is present if any page within it exists in the stream.
 * -- ctxLC
-* -- return
+* -- dwUnitShift = 0 (single page) or 9 (512 pages).
+* -- fAdd = add ranges to memory map (otherwise only count ranges).
+* -- return = number of ranges, or (QWORD)-1 on failure.
 */
-BOOL DeviceFile_MsCrashCoreDumpInitialize_BitmapFullOrActiveMemory(_In_ PLC_CONTEXT ctxLC)
+QWORD DeviceFile_Qemu_MemMapWalk(_In_ PLC_CONTEXT ctxLC, _In_ DWORD dwUnitShift, _In_ BOOL fAdd)
 {
     PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
-    _DUMP_HEADER_BITMAP_FULL64 hdr = { 0 };
-    PBYTE pb = NULL;
-    BOOL fResult = FALSE, fPageValid = FALSE;
-    QWORD cb, cbFileBase, iPageBase, iPage, cMaxBits, iPageEx, b;
-    // 1: fetch header:
-    _fseeki64(ctx->File[0].h, 0x2000, SEEK_SET);
-    fread(&hdr, 1, sizeof(_DUMP_HEADER_BITMAP_FULL64), ctx->File[0].h);
-    if((hdr.Signature != 0x504d5544504d4446) && (hdr.Signature != 0x504d5544504d4453)) { goto fail; }   // !'FDMPDUMP' && !'SDMPDUMP' && 
-    if((hdr.cPages > hdr.cBits) || (hdr.cBits > 0x7fffffff) || (hdr.cbFileBase & 0xfff) || (hdr.cbFileBase > 0x01000000)) { goto fail; }
-    cbFileBase = hdr.cbFileBase;
-    // 2: fetch bits:
-    cb = hdr.cBits / 8;
-    if(!(pb = LocalAlloc(LMEM_ZEROINIT, (SIZE_T)cb))) { goto fail; }
-    if(cb != fread(pb, 1, (SIZE_T)cb, ctx->File[0].h)) { goto fail; }
-    // 3: walk bitmap - add ranges!
-    cMaxBits = hdr.cBits & 0xffffffc0;
-    for(iPage = 0; iPage < cMaxBits; iPage += 64) {
-        b = *(PQWORD)(pb + (iPage >> 3));
-        // all pages valid!
-        if(b == (QWORD)-1) {
-            if(!fPageValid) {
-                fPageValid = TRUE;
-                iPageBase = iPage;
+    PQEMU_REGION pRegion;
+    PQWORD pqwPage;
+    QWORD iUnit, iUnitBase = 0, cUnit, iPage, cPage, cRange = 0, pa, cb;
+    DWORD iRegion, dwShift = dwUnitShift + ctx->Qemu.dwPageShift;
+    BOOL f, fValid;
+    for(iRegion = 0; iRegion < ctx->Qemu.cRegion; iRegion++) {
+        pRegion = &ctx->Qemu.Region[iRegion];
+        pqwPage = ctx->Qemu.Block[pRegion->iBlock].pqwPage + (pRegion->oBlock >> ctx->Qemu.dwPageShift);
+        cPage = pRegion->cb >> ctx->Qemu.dwPageShift;
+        cUnit = (cPage + (1ULL << dwUnitShift) - 1) >> dwUnitShift;
+        fValid = FALSE;
+        for(iUnit = 0; iUnit <= cUnit; iUnit++) {
+            f = FALSE;
+            for(iPage = iUnit << dwUnitShift; (iUnit < cUnit) && !f && (iPage < min(cPage, (iUnit + 1) << dwUnitShift)); iPage++) {
+                f = pqwPage[iPage] ? TRUE : FALSE;
             }
-            continue;
-        }
-        // no pages valid!
-        if(!b && !fPageValid) { continue; }
-        // some valid pages
-        for(iPageEx = 0; iPageEx < 64; iPageEx++) {
-            if((b >> iPageEx) & 1) {
-                // valid
-                if(!fPageValid) {
-                    fPageValid = TRUE;
-                    iPageBase = iPage + iPageEx;
-                }
-            } else {
-                // invalid
-                if(fPageValid) {
-                    cb = (iPage + iPageEx - iPageBase) << 12;
-                    if(!LcMemMap_AddRange(ctxLC, iPageBase << 12, cb, cbFileBase)) {
-                        lcprintf(ctxLC, "DEVICE: FAIL: unable to add range to memory map. (%016llx %016llx %016llx)\n", iPageBase << 12, cb, cbFileBase);
-                        return FALSE;
+            if(f && !fValid) {
+                fValid = TRUE;
+                iUnitBase = iUnit;
+            }
+            if(!f && fValid) {
+                fValid = FALSE;
+                cRange++;
+                if(fAdd) {
+                    pa = pRegion->pa + (iUnitBase << dwShift);
+                    cb = min((iUnit - iUnitBase) << dwShift, pRegion->cb - (iUnitBase << dwShift));
+                    if(!LcMemMap_AddRange(ctxLC, pa, cb, pa)) {
+                        lcprintf(ctxLC, "DEVICE: FAIL: unable to add range to memory map. (%016llx %016llx %016llx)\n", pa, cb, pa);
+                        return (QWORD)-1;
                     }
-                    cbFileBase += cb;
-                    fPageValid = FALSE;
                 }
             }
         }
     }
-    // 4: finalize remaining
-    if(fPageValid) {
-        cb = (iPage - iPageBase) << 12;
-        if(!LcMemMap_AddRange(ctxLC, iPageBase << 12, cb, cbFileBase)) {
-            lcprintf(ctxLC, "DEVICE: FAIL: unable to add range to memory map. (%016llx %016llx %016llx)\n", iPageBase << 12, cb, cbFileBase);
-            return FALSE;
-        }
-    }
-    ctx->CrashOrCoreDump.fValidCrashDump = TRUE;
-    fResult = TRUE;
-fail:
-    if(!fResult) {
-        lcprintf(ctxLC, "DEVICE: FAIL: error parsing 64-bit full bitmap dump.\n");
+    return cRange;
+}
+
+/*
+* Clean up qemu migration stream related resources.
+* -- ctx
+*/
+VOID DeviceFile_Qemu_Close(_In_ PDEVICE_CONTEXT_FILE ctx)
+{
+    DWORD i;
+    for(i = 0; i < ctx->Qemu.cBlock; i++) {
+        LocalFree(ctx->Qemu.Block[i].pqwPage);
+        ctx->Qemu.Block[i].pqwPage = NULL;
     }
-    return fResult;
+    LocalFree(ctx->Qemu.pXbzrle);
+    ctx->Qemu.pXbzrle = NULL;
+    ctx->Qemu.cBlock = 0;
+    ctx->Qemu.cRegion = 0;
+    ctx->Qemu.cXbzrle = 0;
+    ctx->Qemu.cXbzrleMax = 0;
 }
 
 /*
-* Initialize a LiME memory dump. In LiME memory dumps the headers are
-* spread out throughout the dump file (before each memory range).
+* Initialize a QEMU migration stream. The stream is indexed in one sequential
+* pass. Compressed pages (removed compress capability), rdma and ram pages sent
+* over separate multifd channels (other than mapped-ram) are not supported.
 * -- ctxLC
 * -- return
 */
 _Success_(return)
-BOOL DeviceFile_DumpInitialize_LiME(_In_ PLC_CONTEXT ctxLC)
+BOOL DeviceFile_DumpInitialize_Qemu(_In_ PLC_CONTEXT ctxLC)
 {
     PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
-    QWORD cbRangeMax, cbRangeFileMax, cbPreviousRangeMax = 0, oLimeHeader = 0;
-    LIME_MEM_RANGE_HEADER LimeHeader;
-    BOOL f;
-    while((oLimeHeader + sizeof(LIME_MEM_RANGE_HEADER) + 0x1000) <= ctx->cbFile) {
-        ZeroMemory(&LimeHeader, sizeof(LIME_MEM_RANGE_HEADER));
-        _fseeki64(ctx->File[0].h, oLimeHeader, SEEK_SET);
-        fread(&LimeHeader, 1, sizeof(LIME_MEM_RANGE_HEADER), ctx->File[0].h);
-        if(oLimeHeader && !LimeHeader.magic && !LimeHeader.version) {
-            return TRUE;
-        }
-        f = (LimeHeader.magic == LIME_MAGIC) && (LimeHeader.version == LIME_VERSION) &&
-            ((LimeHeader._s_addr & 0xfff) == 0) && (LimeHeader._s_addr >= cbPreviousRangeMax) &&
-            (((LimeHeader._e_addr & 0xfff) == 0xfff) || ((LimeHeader._e_addr & 0xfff) == 0x000)) &&
-            (LimeHeader._s_addr < LimeHeader._e_addr);
-        if(!f) {
-            lcprintf(ctxLC, "DEVICE: FAIL: Parse LiME header at offset: 0x%llx\n", oLimeHeader);
-            return FALSE;
-        }
-        cbRangeMax = (LimeHeader._e_addr + 1) & ~0xfff;
-        cbRangeFileMax = (ctx->cbFile + LimeHeader._s_addr + oLimeHeader - sizeof(LIME_MEM_RANGE_HEADER)) & ~0xfff;
-        if(cbRangeMax > cbRangeFileMax) {
-            lcprintf(ctxLC, "DEVICE: WARN: memory range exceeds file size - adjusting...\n");
-            cbRangeMax = cbRangeFileMax;
-        }
-        if(!LcMemMap_AddRange(ctxLC, (QWORD)LimeHeader._s_addr, cbRangeMax - (QWORD)LimeHeader._s_addr, oLimeHeader + 0x20)) {
-            lcprintf(ctxLC, "DEVICE: FAIL: unable to add range to memory map. (%016llx %016llx %016llx)\n", LimeHeader._s_addr, cbRangeMax - LimeHeader._s_addr, oLimeHeader + 0x20);
-            return FALSE;
+    PQEMU_READER pr = NULL;
+    QWORD i, cPage = 0, cRange;
+    DWORD iBlock, dwVersion, dwUnitShift;
+    lcprintfvv_fn(ctxLC, "QEMU Migration Stream identified.\n");
+    dwVersion = _byteswap_ulong(CDMP_DWORD(0x004));
+    if((dwVersion != QEMU_VM_FILE_VERSION) && (dwVersion != QEMU_VM_FILE_VERSION_COMPAT)) {
+        lcprintf(ctxLC, "DEVICE: FAIL: qemu: unsupported migration stream version %i.\n", dwVersion);
+        return FALSE;
+    }
+    // 1: index the migration stream (default target page size: 4kB):
+    ctx->Qemu.dwPageShift = 12;
+    ctx->Qemu.cbPage = 0x1000;
+    if(!(pr = LocalAlloc(LMEM_ZEROINIT, sizeof(QEMU_READER)))) { goto fail; }
+    pr->ctx = ctx;
+    pr->o = 8;
+    if(!DeviceFile_Qemu_ParseStream(ctxLC, pr) || !ctx->Qemu.cBlock) { goto fail; }
+    for(iBlock = 0; iBlock < ctx->Qemu.cBlock; iBlock++) {
+        for(i = 0; i < ctx->Qemu.Block[iBlock].cPage; i++) {
+            if(ctx->Qemu.Block[iBlock].pqwPage[i]) { cPage++; }
         }
-        oLimeHeader += sizeof(LIME_MEM_RANGE_HEADER) + cbRangeMax - (QWORD)LimeHeader._s_addr;
-        cbPreviousRangeMax = cbRangeMax;
     }
-    return cbPreviousRangeMax ? TRUE : FALSE;
+    lcprintfvv_fn(ctxLC, "machine=%s blocks=%x pages=%llx xbzrle=%llx mapped-ram=%i\n", ctx->Qemu.szMachine, ctx->Qemu.cBlock, cPage, ctx->Qemu.cXbzrle, ctx->Qemu.fMappedRam);
+    if(!cPage) {
+        lcprintf(ctxLC, "DEVICE: FAIL: qemu: no ram pages in migration stream (multifd channels are not supported).\n");
+        goto fail;
+    }
+    // 2: place guest ram in the physical address space and populate memory map
+    //    - fall back to a coarser granularity if the stream is too fragmented.
+    if(!DeviceFile_Qemu_Layout(ctxLC)) { goto fail; }
+    dwUnitShift = 0;
+    if(DeviceFile_Qemu_MemMapWalk(ctxLC, 0, FALSE) > 0x00080000) {
+        lcprintfv(ctxLC, "DEVICE: qemu: fragmented stream - using coarse memory map.\n");
+        dwUnitShift = 9;
+    }
+    cRange = DeviceFile_Qemu_MemMapWalk(ctxLC, dwUnitShift, TRUE);
+    if(!cRange || (cRange == (QWORD)-1)) { goto fail; }
+    // 3: qemu migration streams are read through the qemu scatter read function:
+    ctxLC->pfnReadScatter = DeviceFile_Qemu_ReadScatter;
+    ctxLC->pfnWriteScatter = NULL;
+    ctxLC->Config.fWritable = FALSE;
+    ctx->CrashOrCoreDump.fValidQemuDump = TRUE;
+    LocalFree(pr);
+    return TRUE;
+fail:
+    lcprintf(ctxLC, "DEVICE: FAIL: error parsing qemu migration stream.\n");
+    LocalFree(pr);
+    DeviceFile_Qemu_Close(ctx);
+    return FALSE;
 }
 
 /*
@@ -587,6 +4900,10 @@ BOOL DeviceFile_DumpInitialize_LiME(_In_ PLC_CONTEXT ctxLC)
 * - Microsoft Crash Dump file (full dump only).
 * - LiME dump file.
 * - VirtualBox core dump file.
+* - Kdump compressed dump file (makedumpfile / QEMU dump-guest-memory).
+* - LeechCore delta snapshot file.
+* - Windows hibernation file (Windows XP - Windows 7).
+* - QEMU migration stream (savevm / migrate to file, mapped-ram).
 * This is done by reading the dump header. If this is not a dump file the
 * -- ctxLC
 * -- return = FALSE on fatal non-recoverable error, otherwise TRUE.
@@ -601,8 +4918,7 @@ BOOL DeviceFile_DumpInitialize(_In_ PLC_CONTEXT ctxLC)
     PElf32_Ehdr pElf32 = &ctx->CrashOrCoreDump.Elf32;
     _PPHYSICAL_MEMORY_DESCRIPTOR32 pM32 = (_PPHYSICAL_MEMORY_DESCRIPTOR32)(ctx->CrashOrCoreDump.pbHdr + 0x064);
     _PPHYSICAL_MEMORY_DESCRIPTOR64 pM64 = (_PPHYSICAL_MEMORY_DESCRIPTOR64)(ctx->CrashOrCoreDump.pbHdr + 0x088);
-    _fseeki64(ctx->File[0].h, 0, SEEK_SET);
-    fread(ctx->CrashOrCoreDump.pbHdr, 1, 0x2000, ctx->File[0].h);
+    DeviceFile_ReadFile(ctx, 0, 0, 0x2000, ctx->CrashOrCoreDump.pbHdr);
     if((CDMP_DWORD(0x000) == DUMP_SIGNATURE) && (CDMP_DWORD(0x004) == DUMP_VALID_DUMP64) && (CDMP_DWORD(0xf98) == DUMP_TYPE_FULL) && ((CDMP_DWORD(0x030) == IMAGE_FILE_MACHINE_AMD64) || (CDMP_DWORD(0x030) == IMAGE_FILE_MACHINE_ARM64))) {
         // PAGEDUMP (64-bit memory dump) and FULL DUMP
         lcprintfvv_fn(ctxLC, "64-bit Microsoft Crash Dump identified.\n");
@@ -706,11 +5022,204 @@ BOOL DeviceFile_DumpInitialize(_In_ PLC_CONTEXT ctxLC)
     if((ctx->CrashOrCoreDump.LiME.magic == LIME_MAGIC) && (ctx->CrashOrCoreDump.LiME.version == LIME_VERSION)) {
         // LiME memory dump: ranges are spread out in file -> parse this in separate function:
         if(!DeviceFile_DumpInitialize_LiME(ctxLC)) { return FALSE; }
-        ctx->CrashOrCoreDump.fValidLimeDump;
+        ctx->CrashOrCoreDump.fValidLimeDump = TRUE;
+    }
+    if(!memcmp(ctx->CrashOrCoreDump.Kdump.signature, KDUMP_SIGNATURE, 8) || !memcmp(ctx->CrashOrCoreDump.Kdump.signature, KDUMP_SIGNATURE_DISKDUMP, 8)) {
+        // KDUMP COMPRESSED DUMP: bitmap + page descriptors -> parse this in separate function:
+        if(!DeviceFile_DumpInitialize_Kdump(ctxLC, TRUE)) { return FALSE; }
+    }
+    if(ctx->CrashOrCoreDump.Delta.dwMagic == LC_DELTA_MAGIC) {
+        // DELTA SNAPSHOT: chain of snapshots on top of a base snapshot -> parse this in separate function:
+        if(!DeviceFile_DumpInitialize_Delta(ctxLC)) { return FALSE; }
+    }
+    if(ctx->CrashOrCoreDump.Dedup.dwMagic == LC_DEDUP_MAGIC) {
+        // DEDUPLICATED SNAPSHOT: page map into a shared page store -> parse this in separate function:
+        if(!DeviceFile_DumpInitialize_Dedup(ctxLC)) { return FALSE; }
+    }
+    if((CDMP_DWORD(0x000) == HIBR_SIGNATURE_HIBR) || (CDMP_DWORD(0x000) == HIBR_SIGNATURE_HIBR_LOWER) || (CDMP_DWORD(0x000) == HIBR_SIGNATURE_WAKE) || (CDMP_DWORD(0x000) == HIBR_SIGNATURE_WAKE_LOWER) || (CDMP_DWORD(0x000) == HIBR_SIGNATURE_RSTR)) {
+        // HIBERNATION FILE: restore tables + xpress compressed blocks -> parse this in separate function:
+        if(!DeviceFile_DumpInitialize_Hibr(ctxLC)) { return FALSE; }
+    }
+    if(_byteswap_ulong(CDMP_DWORD(0x000)) == QEMU_VM_FILE_MAGIC) {
+        // QEMU MIGRATION STREAM: sequential stream of ram records -> parse this in separate function:
+        if(!DeviceFile_DumpInitialize_Qemu(ctxLC)) { return FALSE; }
     }
     return TRUE;
 }
 
+//-----------------------------------------------------------------------------
+// SIDECAR INDEX FILE FUNCTIONALITY BELOW:
+// The result of a successful dump file parse (format, header and memory map)
+// is saved to a <dumpfile>.lcidx sidecar file if the index=1 parameter is set.
+// On re-open the sidecar is used instead of re-parsing the dump file provided
+// that the dump file size, modification time and header digest still match.
+//-----------------------------------------------------------------------------
+
+#define FILE_INDEX_MAGIC                0x5844494c      // 'LIDX'
+#define FILE_INDEX_VERSION              1
+#define FILE_INDEX_SUFFIX               ".lcidx"
+#define FILE_INDEX_FORMAT_CRASH         0x01
+#define FILE_INDEX_FORMAT_CORE          0x02
+#define FILE_INDEX_FORMAT_LIME          0x04
+#define FILE_INDEX_FORMAT_VMWARE        0x08
+#define FILE_INDEX_FORMAT_KDUMP         0x10
+
+typedef struct tdFILE_INDEX_HEADER {
+    DWORD dwMagic;
+    DWORD dwVersion;
+    QWORD cbFile;                   // dump file size
+    QWORD qwTimeModified;           // dump file modification time
+    QWORD qwDigest;                 // FNV-1a digest of dump file header and tail
+    DWORD dwFormat;                 // FILE_INDEX_FORMAT_*
+    DWORD f32;
+    DWORD tpArch;
+    DWORD cMemMap;
+    QWORD paDtbHint;
+    BYTE pbHdr[0x2000];             // dump header (CrashOrCoreDump.pbHdr)
+    // LC_MEMMAP_ENTRY[cMemMap] follows
+} FILE_INDEX_HEADER, *PFILE_INDEX_HEADER;
+
+/*
+* Calculate the digest and retrieve the modification time of the dump file.
+* The digest covers the dump header and the last page of the dump file.
+* -- ctx
+* -- pqwDigest
+* -- pqwTimeModified
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFile_IndexDigest(_In_ PDEVICE_CONTEXT_FILE ctx, _Out_ PQWORD pqwDigest, _Out_ PQWORD pqwTimeModified)
+{
+    struct _stat64 st = { 0 };
+    BYTE pbTail[0x1000];
+    QWORD i, qwDigest = 0xcbf29ce484222325;
+    if(_fstat64(_fileno(ctx->File[0].h), &st)) { return FALSE; }
+    if(!DeviceFile_ReadFile(ctx, 0, ctx->cbFile - sizeof(pbTail), sizeof(pbTail), pbTail)) { return FALSE; }
+    for(i = 0; i < sizeof(ctx->CrashOrCoreDump.pbHdr); i++) {
+        qwDigest = (qwDigest ^ ctx->CrashOrCoreDump.pbHdr[i]) * 0x100000001b3;
+    }
+    for(i = 0; i < sizeof(pbTail); i++) {
+        qwDigest = (qwDigest ^ pbTail[i]) * 0x100000001b3;
+    }
+    *pqwDigest = qwDigest;
+    *pqwTimeModified = (QWORD)st.st_mtime;
+    return TRUE;
+}
+
+/*
+* Save the parsed dump file format and memory map to the sidecar index file.
+* Failure to save the index file is not fatal.
+* -- ctxLC
+*/
+VOID DeviceFile_IndexSave(_In_ PLC_CONTEXT ctxLC)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    PFILE_INDEX_HEADER pIdx = NULL;
+    PBYTE pbMemMap = NULL;
+    DWORD cbMemMap = 0;
+    CHAR szIndexFile[MAX_PATH];
+    FILE *hFile = NULL;
+    if(!LcMemMap_IsInitialized(ctxLC)) { return; }     // raw memory dump - nothing to index
+    if(_snprintf_s(szIndexFile, _countof(szIndexFile), _TRUNCATE, "%s%s", ctx->szFileName, FILE_INDEX_SUFFIX) <= 0) { goto fail; }
+    if(!(pIdx = LocalAlloc(LMEM_ZEROINIT, sizeof(FILE_INDEX_HEADER)))) { goto fail; }
+    if(!DeviceFile_IndexDigest(ctx, &pIdx->qwDigest, &pIdx->qwTimeModified)) { goto fail; }
+    if(!LcMemMap_GetRangesAsStruct(ctxLC, &pbMemMap, &cbMemMap)) { goto fail; }
+    pIdx->dwMagic = FILE_INDEX_MAGIC;
+    pIdx->dwVersion = FILE_INDEX_VERSION;
+    pIdx->cbFile = ctx->cbFile;
+    pIdx->dwFormat =
+        (ctx->CrashOrCoreDump.fValidCrashDump ? FILE_INDEX_FORMAT_CRASH : 0) |
+        (ctx->CrashOrCoreDump.fValidCoreDump ? FILE_INDEX_FORMAT_CORE : 0) |
+        (ctx->CrashOrCoreDump.fValidLimeDump ? FILE_INDEX_FORMAT_LIME : 0) |
+        (ctx->CrashOrCoreDump.fValidVMwareDump ? FILE_INDEX_FORMAT_VMWARE : 0) |
+        (ctx->CrashOrCoreDump.fValidKdumpDump ? FILE_INDEX_FORMAT_KDUMP : 0);
+    pIdx->f32 = ctx->CrashOrCoreDump.f32;
+    pIdx->tpArch = ctx->tpArch;
+    pIdx->cMemMap = cbMemMap / sizeof(LC_MEMMAP_ENTRY);
+    pIdx->paDtbHint = ctx->paDtbHint;
+    memcpy(pIdx->pbHdr, ctx->CrashOrCoreDump.pbHdr, sizeof(pIdx->pbHdr));
+    if(fopen_s(&hFile, szIndexFile, "wb") || !hFile) { goto fail; }
+    if(sizeof(FILE_INDEX_HEADER) != fwrite(pIdx, 1, sizeof(FILE_INDEX_HEADER), hFile)) { goto fail; }
+    if(cbMemMap != fwrite(pbMemMap, 1, cbMemMap, hFile)) { goto fail; }
+    fclose(hFile);
+    hFile = NULL;
+    lcprintfvv_fn(ctxLC, "Index file saved: '%s'.\n", szIndexFile);
+    LocalFree(pbMemMap);
+    LocalFree(pIdx);
+    return;
+fail:
+    if(hFile) {
+        fclose(hFile);
+        remove(szIndexFile);
+    }
+    lcprintfv(ctxLC, "DEVICE: WARN: Unable to save index file for: '%s'.\n", ctx->szFileName);
+    LocalFree(pbMemMap);
+    LocalFree(pIdx);
+}
+
+/*
+* Try to load the parsed dump file format and memory map from the sidecar
+* index file. The index is only used if it matches the dump file.
+* -- ctxLC
+* -- return = TRUE if the dump file was initialized from the index file.
+*/
+_Success_(return)
+BOOL DeviceFile_IndexLoad(_In_ PLC_CONTEXT ctxLC)
+{
+    PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    PFILE_INDEX_HEADER pIdx = NULL;
+    PLC_MEMMAP_ENTRY pMemMap = NULL;
+    QWORD i, qwDigest, qwTimeModified;
+    CHAR szIndexFile[MAX_PATH];
+    FILE *hFile = NULL;
+    BOOL fResult = FALSE;
+    if(_snprintf_s(szIndexFile, _countof(szIndexFile), _TRUNCATE, "%s%s", ctx->szFileName, FILE_INDEX_SUFFIX) <= 0) { goto fail; }
+    if(fopen_s(&hFile, szIndexFile, "rb") || !hFile) { goto fail; }
+    if(!(pIdx = LocalAlloc(0, sizeof(FILE_INDEX_HEADER)))) { goto fail; }
+    if(sizeof(FILE_INDEX_HEADER) != fread(pIdx, 1, sizeof(FILE_INDEX_HEADER), hFile)) { goto fail; }
+    if((pIdx->dwMagic != FILE_INDEX_MAGIC) || (pIdx->dwVersion != FILE_INDEX_VERSION) || (pIdx->cbFile != ctx->cbFile)) { goto fail; }
+    if(!pIdx->dwFormat || !pIdx->cMemMap || (pIdx->cMemMap > 0x00100000)) { goto fail; }
+    // verify dump file against index (header digest includes the current dump header):
+    if(!DeviceFile_ReadFile(ctx, 0, 0, sizeof(ctx->CrashOrCoreDump.pbHdr), ctx->CrashOrCoreDump.pbHdr)) { goto fail; }
+    if(!DeviceFile_IndexDigest(ctx, &qwDigest, &qwTimeModified)) { goto fail; }
+    if((qwDigest != pIdx->qwDigest) || (qwTimeModified != pIdx->qwTimeModified) || memcmp(ctx->CrashOrCoreDump.pbHdr, pIdx->pbHdr, sizeof(pIdx->pbHdr))) {
+        lcprintfv(ctxLC, "DEVICE: Index file '%s' is stale - ignoring.\n", szIndexFile);
+        goto fail;
+    }
+    // restore memory map (file offset zero remaps must be forced):
+    if(!(pMemMap = LocalAlloc(0, pIdx->cMemMap * sizeof(LC_MEMMAP_ENTRY)))) { goto fail; }
+    if(pIdx->cMemMap * sizeof(LC_MEMMAP_ENTRY) != fread(pMemMap, 1, pIdx->cMemMap * sizeof(LC_MEMMAP_ENTRY), hFile)) { goto fail; }
+    for(i = 0; i < pIdx->cMemMap; i++) {
+        if(!LcMemMap_AddRange(ctxLC, pMemMap[i].pa, pMemMap[i].cb, LC_MEMMAP_FORCE_OFFSET | pMemMap[i].paRemap)) { goto fail; }
+    }
+    // restore format:
+    ctx->CrashOrCoreDump.fValidCrashDump = (pIdx->dwFormat & FILE_INDEX_FORMAT_CRASH) ? TRUE : FALSE;
+    ctx->CrashOrCoreDump.fValidCoreDump = (pIdx->dwFormat & FILE_INDEX_FORMAT_CORE) ? TRUE : FALSE;
+    ctx->CrashOrCoreDump.fValidLimeDump = (pIdx->dwFormat & FILE_INDEX_FORMAT_LIME) ? TRUE : FALSE;
+    ctx->CrashOrCoreDump.fValidVMwareDump = (pIdx->dwFormat & FILE_INDEX_FORMAT_VMWARE) ? TRUE : FALSE;
+    ctx->CrashOrCoreDump.f32 = pIdx->f32 ? TRUE : FALSE;
+    ctx->tpArch = (LC_ARCH_TP)pIdx->tpArch;
+    ctx->paDtbHint = pIdx->paDtbHint;
+    if((pIdx->dwFormat & FILE_INDEX_FORMAT_KDUMP) && !DeviceFile_DumpInitialize_Kdump(ctxLC, FALSE)) { goto fail; }
+    lcprintfv(ctxLC, "DEVICE: Dump file initialized from index file '%s'.\n", szIndexFile);
+    fResult = TRUE;
+fail:
+    if(!fResult) {
+        ctxLC->cMemMap = 0;
+        ctx->CrashOrCoreDump.fValidCrashDump = FALSE;
+        ctx->CrashOrCoreDump.fValidCoreDump = FALSE;
+        ctx->CrashOrCoreDump.fValidLimeDump = FALSE;
+        ctx->CrashOrCoreDump.fValidVMwareDump = FALSE;
+        ctx->CrashOrCoreDump.f32 = FALSE;
+        ctx->tpArch = LC_ARCH_NA;
+        ctx->paDtbHint = 0;
+    }
+    if(hFile) { fclose(hFile); }
+    LocalFree(pMemMap);
+    LocalFree(pIdx);
+    return fResult;
+}
+
 _Success_(return)
 BOOL DeviceFile_GetOption(_In_ PLC_CONTEXT ctxLC, _In_ QWORD fOption, _Out_ PQWORD pqwValue)
 {
@@ -794,10 +5303,9 @@ BOOL DeviceFile_Command(
     _Out_opt_ PDWORD pcbDataOut
 ) {
     PDEVICE_CONTEXT_FILE ctx = (PDEVICE_CONTEXT_FILE)ctxLC->hDevice;
+    BOOL f;
     PBYTE pb;
     DWORD cb;
-    UNREFERENCED_PARAMETER(cbDataIn);
-    UNREFERENCED_PARAMETER(pbDataIn);
     // GET DUMP HEADER:
     if(fOption == LC_CMD_FILE_DUMPHEADER_GET) {
         if(!ppbDataOut || !ctx->CrashOrCoreDump.fValidCrashDump) { return FALSE; }
@@ -808,6 +5316,20 @@ BOOL DeviceFile_Command(
         *ppbDataOut = pb;
         return TRUE;
     }
+    // COPY-ON-WRITE OVERLAY:
+    if((fOption == LC_CMD_FILE_OVERLAY_SAVE) || (fOption == LC_CMD_FILE_OVERLAY_DISCARD)) {
+        if(!ctx->Overlay.fEnabled) { return FALSE; }
+        if(pbDataIn && (!cbDataIn || pbDataIn[cbDataIn - 1])) { return FALSE; }
+        EnterCriticalSection(&ctx->Overlay.Lock);
+        if(fOption == LC_CMD_FILE_OVERLAY_SAVE) {
+            f = DeviceFile_Overlay_SaveFile(ctx, (LPSTR)pbDataIn);
+        } else {
+            DeviceFile_Overlay_Discard(ctx);
+            f = TRUE;
+        }
+        LeaveCriticalSection(&ctx->Overlay.Lock);
+        return f;
+    }
     return FALSE;
 }
 
@@ -833,6 +5355,17 @@ VOID DeviceFile_Close(_Inout_ PLC_CONTEXT ctxLC)
                 fclose(ctx->File[0].h);
           }
         }  
+        DeviceFile_PartClose(ctx);
+        DeviceFile_Overlay_Close(ctx);
+        DeviceFile_Kdump_Close(ctx);
+        DeviceFile_Hibr_Close(ctx);
+        DeviceFile_Qemu_Close(ctx);
+        DeviceFile_Delta_Close(ctx);
+        DeviceFile_Dedup_Close(ctx);
+        DeviceFile_Zero_Close(ctx);
+        if(ctx->ReadAhead.fEnabled) {
+            DeleteCriticalSection(&ctx->ReadAhead.Lock);
+        }
         LocalFree(ctx);
     }
 }
@@ -840,12 +5373,22 @@ VOID DeviceFile_Close(_Inout_ PLC_CONTEXT ctxLC)
 #define DEVICE_FILE_PARAMETER_FILE                  "file"
 #define DEVICE_FILE_PARAMETER_WRITE                 "write"
 #define DEVICE_FILE_PARAMETER_VOLATILE              "volatile"
+#define DEVICE_FILE_PARAMETER_INDEX                 "index"
+#define DEVICE_FILE_PARAMETER_READAHEAD             "readahead"
+#define DEVICE_FILE_PARAMETER_SWEEP                 "sweep"
+#define DEVICE_FILE_PARAMETER_MULTIPART             "multipart"
+#define DEVICE_FILE_PARAMETER_SPARSE                "sparse"
+#define DEVICE_FILE_PARAMETER_ZEROSCAN              "zeroscan"
+#define DEVICE_FILE_PARAMETER_COW                   "cow"
+#define DEVICE_FILE_PARAMETER_OVERLAY               "overlay"
+#define DEVICE_FILE_PARAMETER_LOWMEM                "lowmem"
 
 _Success_(return)
 BOOL DeviceFile_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO ppLcCreateErrorInfo)
 {
-    DWORD i;
-    LPSTR szType;
+    DWORD i, dwMagic = 0;
+    BOOL fIndex, fSparse, fZeroScan, fOverlay;
+    LPSTR szType, szOverlay = NULL;
     PDEVICE_CONTEXT_FILE ctx;
     PLC_DEVICE_PARAMETER_ENTRY pParam;
     if(ppLcCreateErrorInfo) { *ppLcCreateErrorInfo = NULL; }
@@ -859,10 +5402,18 @@ BOOL DeviceFile_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO
             strncpy_s(ctx->szFileName, _countof(ctx->szFileName), pParam->szValue, _TRUNCATE);
             ctxLC->Config.fVolatile = LcDeviceParameterGetNumeric(ctxLC, DEVICE_FILE_PARAMETER_VOLATILE) ? TRUE : FALSE;
             ctxLC->Config.fWritable = LcDeviceParameterGetNumeric(ctxLC, DEVICE_FILE_PARAMETER_WRITE) ? TRUE : FALSE;
+            if((pParam = LcDeviceParameterGet(ctxLC, DEVICE_FILE_PARAMETER_OVERLAY)) && pParam->szValue[0]) {
+                szOverlay = pParam->szValue;
+            }
         } else {
             // we have a file name on the old format, i.e. fpga://<filename> - use the old format.
             strncpy_s(ctx->szFileName, _countof(ctx->szFileName), ctxLC->Config.szDevice + 7, _countof(ctxLC->Config.szDevice) - 7);
         }
+    } else if((0 == _strnicmp("union://", ctxLC->Config.szDevice, 8)) || (0 == _strnicmp("multifile://", ctxLC->Config.szDevice, 12))) {
+        // union of region files, i.e. union://low.bin@0x0,high.bin@0x100000000
+        if(!DeviceFile_UnionParse(ctxLC, ctx)) { goto fail; }
+        ctxLC->Config.fVolatile = LcDeviceParameterGetNumeric(ctxLC, DEVICE_FILE_PARAMETER_VOLATILE) ? TRUE : FALSE;
+        ctxLC->Config.fWritable = LcDeviceParameterGetNumeric(ctxLC, DEVICE_FILE_PARAMETER_WRITE) ? TRUE : FALSE;
     } else if(0 == _stricmp(ctxLC->Config.szDevice, "livekd")) {
         strcpy_s(ctx->szFileName, _countof(ctx->szFileName), "C:\\WINDOWS\\livekd.dmp");
     } else if(0 == _stricmp(ctxLC->Config.szDevice, "dumpit")) {
@@ -870,14 +5421,26 @@ BOOL DeviceFile_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO
     } else {
         strncpy_s(ctx->szFileName, _countof(ctx->szFileName), ctxLC->Config.szDevice, _countof(ctxLC->Config.szDevice));
     }
+    // copy-on-write overlay (cow=1 or overlay=<file>) - the dump file is opened read-only:
+    fOverlay = szOverlay || LcDeviceParameterGetNumeric(ctxLC, DEVICE_FILE_PARAMETER_COW);
+    if(fOverlay) {
+        ctxLC->Config.fWritable = FALSE;
+    }
     // open backing file:
     if(fopen_s(&ctx->File[0].h, ctx->szFileName, (ctxLC->Config.fWritable ? "r+b" : "rb")) || !ctx->File[0].h) { goto fail; }
     InitializeCriticalSection(&ctx->File[0].Lock);
     if(_fseeki64(ctx->File[0].h, 0, SEEK_END)) { goto fail; }   // seek to end of file
     ctx->cbFile = _ftelli64(ctx->File[0].h);                    // get current file pointer
-    if(ctx->cbFile < 0x01000000) { goto fail; }                 // minimum allowed dump file size = 16MB
-    if(ctx->cbFile > 0xffff000000000000) { goto fail; }         // file too large
     ctxLC->hDevice = (HANDLE)ctx;
+    pParam = LcDeviceParameterGet(ctxLC, DEVICE_FILE_PARAMETER_MULTIPART);
+    if(ctx->fUnion || !pParam || pParam->qwValue) {
+        // multi-part file (image.001, image.002 ..) - auto-detected when the first
+        // part is opened, multipart=1 joins parts from any part, multipart=0 disables:
+        if(!DeviceFile_PartInitialize(ctxLC, (ctxLC->Config.fWritable ? "r+b" : "rb"), !pParam)) { goto fail; }
+    }
+    DeviceFile_ReadFile(ctx, 0, 0, sizeof(DWORD), (PBYTE)&dwMagic);
+    if((ctx->cbFile < 0x01000000) && (dwMagic != LC_DELTA_MAGIC) && (dwMagic != LC_DEDUP_MAGIC) && !ctx->fUnion) { goto fail; }   // minimum allowed dump file size = 16MB (except snapshots and region files)
+    if(ctx->cbFile > 0xffff000000000000) { goto fail; }         // file too large
     // set callback functions and fix up config:
     ctxLC->pfnClose = DeviceFile_Close;
     ctxLC->pfnReadScatter = DeviceFile_ReadScatter;
@@ -897,23 +5460,44 @@ BOOL DeviceFile_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO
         ctxLC->pfnReadScatter = NULL;
         ctxLC->pfnReadContigious = DeviceFile_ReadContigious;
     }
-    if((strlen(ctx->szFileName) >= 6) && (0 == _stricmp(".vmem", ctx->szFileName + strlen(ctx->szFileName) - 5))) {
-        DeviceFile_VMwareDumpInitialize(ctxLC, FALSE);     // vmem - vmware memory dump
-    } else if((ctx->cbFile > 0x10000000) && (strlen(ctx->szFileName) >= 6) && (0 == _stricmp(".vmsn", ctx->szFileName + strlen(ctx->szFileName) - 5))) {
-        DeviceFile_VMwareDumpInitialize(ctxLC, TRUE);     // vmsn - vmware snapshot with memory in-line in file
-    }
-    if(!ctx->CrashOrCoreDump.fValidVMwareDump) {
-        if(!DeviceFile_DumpInitialize(ctxLC)) { goto fail; }
-    }
-    // try upgrade to multi-threaded access:
-    if(!fopen_s(&ctx->File[1].h, ctx->szFileName, (ctxLC->Config.fWritable ? "r+b" : "rb"))) {
+    // try upgrade to multi-threaded access (also used by parallel dump parsing):
+    for(i = 1; i < FILE_MAX_THREADS; i++) {
+        if(fopen_s(&ctx->File[i].h, ctx->szFileName, (ctxLC->Config.fWritable ? "r+b" : "rb")) || !ctx->File[i].h) { break; }
+        if(!DeviceFile_PartOpenHandles(ctx, i, (ctxLC->Config.fWritable ? "r+b" : "rb"))) {
+            fclose(ctx->File[i].h);
+            ctx->File[i].h = NULL;
+            break;
+        }
         // 2nd file handle successfully opened - upgrade to multi-threaded access.
         ctxLC->fMultiThread = TRUE;
         ctx->fMultiThreaded = TRUE;
-        InitializeCriticalSection(&ctx->File[1].Lock);
-        for(i = 2; i < FILE_MAX_THREADS; i++) {
-            if(fopen_s(&ctx->File[i].h, ctx->szFileName, (ctxLC->Config.fWritable ? "r+b" : "rb"))) { break; }
-            InitializeCriticalSection(&ctx->File[i].Lock);
+        InitializeCriticalSection(&ctx->File[i].Lock);
+    }
+    // readahead engine (opt-in with readahead=1, Linux only):
+#ifdef LINUX
+    ctx->ReadAhead.fEnabled = LcDeviceParameterGetNumeric(ctxLC, DEVICE_FILE_PARAMETER_READAHEAD) ? TRUE : FALSE;
+    ctx->ReadAhead.fSweep = LcDeviceParameterGetNumeric(ctxLC, DEVICE_FILE_PARAMETER_SWEEP) ? TRUE : FALSE;
+    if(ctx->ReadAhead.fEnabled) {
+        InitializeCriticalSection(&ctx->ReadAhead.Lock);
+    }
+#endif /* LINUX */
+    // qemu migration stream: size of x86 ram below 4GB (default: machine type dependent):
+    ctx->Qemu.cbLowMem = LcDeviceParameterGetNumeric(ctxLC, DEVICE_FILE_PARAMETER_LOWMEM);
+    fIndex = !ctxLC->Config.fVolatile && LcDeviceParameterGetNumeric(ctxLC, DEVICE_FILE_PARAMETER_INDEX);
+    if(ctx->fUnion) {
+        // union of raw region files - memory map from region declarations:
+        if(!DeviceFile_UnionMemMap(ctxLC)) { goto fail; }
+    } else if(!fIndex || !DeviceFile_IndexLoad(ctxLC)) {
+        if((strlen(ctx->szFileName) >= 6) && (0 == _stricmp(".vmem", ctx->szFileName + strlen(ctx->szFileName) - 5))) {
+            DeviceFile_VMwareDumpInitialize(ctxLC, FALSE);     // vmem - vmware memory dump
+        } else if((ctx->cbFile > 0x10000000) && (strlen(ctx->szFileName) >= 6) && (0 == _stricmp(".vmsn", ctx->szFileName + strlen(ctx->szFileName) - 5))) {
+            DeviceFile_VMwareDumpInitialize(ctxLC, TRUE);     // vmsn - vmware snapshot with memory in-line in file
+        }
+        if(!ctx->CrashOrCoreDump.fValidVMwareDump) {
+            if(!DeviceFile_DumpInitialize(ctxLC)) { goto fail; }
+        }
+        if(fIndex && !ctx->Delta.cLayer && !ctx->CrashOrCoreDump.fValidHibrDump && !ctx->CrashOrCoreDump.fValidQemuDump && !ctx->CrashOrCoreDump.fValidDedupDump) {
+            DeviceFile_IndexSave(ctxLC);
         }
     }
     // print result and return:
@@ -923,10 +5507,33 @@ BOOL DeviceFile_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO
         szType = "ELF Core Dump";
     } else if(ctx->CrashOrCoreDump.fValidVMwareDump) {
         szType = "VMware Dump";
+    } else if(ctx->CrashOrCoreDump.fValidKdumpDump) {
+        szType = "Kdump Compressed Dump";
+    } else if(ctx->CrashOrCoreDump.fValidHibrDump) {
+        szType = "Windows Hibernation File";
+    } else if(ctx->CrashOrCoreDump.fValidQemuDump) {
+        szType = "QEMU Migration Stream";
+    } else if(ctx->CrashOrCoreDump.fValidLimeDump) {
+        szType = "LiME Dump";
+    } else if(ctx->Delta.cLayer) {
+        szType = "Delta Snapshot";
+    } else if(ctx->CrashOrCoreDump.fValidDedupDump) {
+        szType = "Deduplicated Snapshot";
+    } else if(ctx->fUnion) {
+        szType = "Union of Region Files";
     } else {
         LcMemMap_AddRange(ctxLC, 0, ctx->cbFile, 0);
         szType = "RAW Memory Dump";
     }
+    // sparse file holes (default on) and zero page scan (zeroscan=1):
+    // (not for volatile/writable files since known-zero data may change)
+    pParam = LcDeviceParameterGet(ctxLC, DEVICE_FILE_PARAMETER_SPARSE);
+    fSparse = !pParam || pParam->qwValue;
+    fZeroScan = LcDeviceParameterGetNumeric(ctxLC, DEVICE_FILE_PARAMETER_ZEROSCAN) ? TRUE : FALSE;
+    if(!ctxLC->Config.fVolatile && !ctxLC->Config.fWritable && !ctx->CrashOrCoreDump.fValidKdumpDump && !ctx->CrashOrCoreDump.fValidHibrDump && !ctx->CrashOrCoreDump.fValidQemuDump && !ctx->CrashOrCoreDump.fValidDedupDump && !ctx->Delta.cLayer && (fSparse || fZeroScan)) {
+        DeviceFile_Zero_Initialize(ctxLC, fSparse, fZeroScan);
+    }
+    if(fOverlay && !ctxLC->Config.fVolatile && !DeviceFile_Overlay_Initialize(ctxLC, szOverlay)) { goto fail; }
     lcprintfv(ctxLC, "DEVICE: Successfully opened file: '%s' as %s%s%s.\n", ctx->szFileName, (ctxLC->Config.fVolatile ? "volatile " : ""), (ctxLC->Config.fWritable ? "writable " : ""), szType);
     return TRUE;
 fail:
@@ -936,6 +5543,17 @@ fail:
             DeleteCriticalSection(&ctx->File[i].Lock);
         }
     }
+    DeviceFile_PartClose(ctx);
+    DeviceFile_Overlay_Close(ctx);
+    DeviceFile_Kdump_Close(ctx);
+    DeviceFile_Hibr_Close(ctx);
+    DeviceFile_Qemu_Close(ctx);
+    DeviceFile_Delta_Close(ctx);
+    DeviceFile_Dedup_Close(ctx);
+    DeviceFile_Zero_Close(ctx);
+    if(ctx->ReadAhead.fEnabled) {
+        DeleteCriticalSection(&ctx->ReadAhead.Lock);
+    }
     LocalFree(ctx);
     ctxLC->hDevice = 0;
     lcprintf(ctxLC, "DEVICE: ERROR: Failed opening file: '%s'.\n", ctxLC->Config.szDevice);
@@ -15,6 +15,11 @@
 #include "oscompatibility.h"
 #include "util.h"
 #include "ob/ob.h"
+#ifdef LINUX
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#endif /* LINUX */
 
 //-------------------------------------------------------------------------------
 // FPGA defines below.
@@ -91,10 +96,18 @@ typedef struct tdDEVICE_PERFORMANCE {
     DWORD ASYNC_DELAY_2;
 } DEVICE_PERFORMANCE, *PDEVICE_PERFORMANCE;
 
-typedef union tdFPGA_HANDLESOCKET {
-    HANDLE h;
+typedef struct tdFPGA_UDP_CONTEXT {
     SOCKET Socket;
-} FPGA_HANDLESOCKET;
+#ifdef LINUX
+    int hEpoll;
+#endif /* LINUX */
+    BOOL fTimestamp;                    // measure link latency (kernel rx timestamps on linux)
+    QWORD tmTxNs;                       // time of first unanswered transmit, 0 = none
+    QWORD cLatency;
+    QWORD qwLatencySumNs;
+    QWORD qwLatencyMaxNs;
+    struct tdFPGA_UDP_LOOPBACK *pLoopback;
+} FPGA_UDP_CONTEXT, *PFPGA_UDP_CONTEXT;
 
 #define DEVICE_ID_SP605_FT601                   0x00
 #define DEVICE_ID_PCIESCREAMER                  0x01
@@ -159,8 +172,8 @@ typedef struct tdFPGA_NEWASYNC2_MEM_CONTEXT {
     BOOL fWrite;
     BOOL fQueued;
     DWORD cMEM;
-    DWORD iMem;
-    DWORD cMemCpl;
+    DWORD iMem;                         // next MEM to transmit (protected by LockTx)
+    volatile DWORD cMemCpl;             // completed MEMs (interlocked)
     PPMEM_SCATTER ppMEMs;
 } FPGA_NEWASYNC2_MEM_CONTEXT, *PFPGA_NEWASYNC2_MEM_CONTEXT;
 
@@ -170,14 +183,15 @@ typedef struct tdFPGA_NEWASYNC2_MEM_CONTEXT {
 typedef enum tdFPGA_NEWASYNC2_TAG_TYPE {
     FPGA_NEWASYNC2_TAG_TYPE_NONE = 0,
     FPGA_NEWASYNC2_TAG_TYPE_4K = 1,
-    FPGA_NEWASYNC2_TAG_TYPE_TINY = 2
+    FPGA_NEWASYNC2_TAG_TYPE_TINY = 2,
+    FPGA_NEWASYNC2_TAG_TYPE_RESERVED = 3     // claimed - entry is being set up
 } FPGA_NEWASYNC2_TAG_TYPE;
 
 /*
 * Tag entry/state for FPGA_NEWASYNC2
 */
 typedef struct tdFPGA_NEWASYNC2_TAG_ENTRY {
-    FPGA_NEWASYNC2_TAG_TYPE tp;
+    volatile DWORD tp;                  // FPGA_NEWASYNC2_TAG_TYPE (interlocked)
     WORD oMEM;                          // TINY ONLY
     union { WORD cbTag; WORD cCpl; };   // TINY ONLY
     PMEM_SCATTER pMEM;
@@ -186,14 +200,26 @@ typedef struct tdFPGA_NEWASYNC2_TAG_ENTRY {
 
 /*
 * Global context for FPGA_NEWASYNC2
+* Tags and byte credits are allocated lock-free. The thread holding the device
+* lock is the RX demultiplexer which completes requests by tag. While it is
+* active (fRxActive) other threads may transmit their own MRd TLPs under the
+* short-held LockTx which protects the transmit buffer.
 */
 typedef struct tdFPGA_NEWASYNC2_CONTEXT {
     BOOL fEnabled;
+    BOOL fRxActive;                     // RX demultiplexer active (protected by LockTx)
+    CRITICAL_SECTION LockTx;
     OVERLAPPED oOverlapped;
     POB_MAP pmQueue;
-    BYTE iTag;
-    DWORD cAvailTags;
-    DWORD cbAvailCredits;
+    DWORD iTagNext;
+    union {
+        volatile QWORD qwAvail;         // available tags/credits (interlocked)
+        struct {
+            DWORD cbAvailCredits;
+            DWORD cAvailTags;
+        };
+    };
+    DWORD cbCreditDeficit;              // credits still to be withdrawn after a MAX_SIZE_RX decrease (device lock holder only)
     // valid entries are 0x00-0x6f, 0x80-0xef (for backwards compatibility).
     // tags 0x70-7f, 0xf0-ff are reserved as write tags.
     FPGA_NEWASYNC2_TAG_ENTRY Tags[0x100];
@@ -226,6 +252,9 @@ typedef struct tdDEVICE_CONTEXT_FPGA {
         DWORD o;
         DWORD cb;
         DWORD cbMax;
+        DWORD cbRing;                   // ring size if pb is a double-mapped ring buffer, 0 = linear buffer
+        DWORD cbAlloc;                  // allocated buffer size - cbMax never exceeds it
+        HANDLE hRing;                   // WIN32: ring buffer section handle
     } rxbuf;
     struct {
         PBYTE pb;
@@ -236,9 +265,10 @@ typedef struct tdDEVICE_CONTEXT_FPGA {
         HMODULE hModule;
         BOOL fInitialized;
         BOOL f2232h;
+        BOOL fUDP;
         union {
             HANDLE hFTDI;
-            SOCKET SocketUDP;
+            PFPGA_UDP_CONTEXT pUdp;
         };
         PFN_LcSetPerformanceProfile pfnLcSetPerformanceProfile;
         PFN_FT_Create pfnFT_Create;
@@ -268,6 +298,11 @@ typedef struct tdDEVICE_CONTEXT_FPGA {
         BOOL fBarInit;
         LC_BAR Bar[6];
     } tlp_callback;
+    struct {
+        BOOL fThread;                   // background autotune thread running
+        BOOL fAbort;                    // background autotune thread should exit
+        CHAR szFileName[MAX_PATH];      // persisted profile store
+    } autotune;
     BOOL fFT601;
     BOOL fCustomDriver;
 } DEVICE_CONTEXT_FPGA, *PDEVICE_CONTEXT_FPGA;
@@ -618,14 +653,238 @@ VOID TLP_CallbackMRd_Scatter(_Inout_ PTLP_CALLBACK_BUF_MRd_SCATTER pBufferMrd_Sc
 // UDP connectivity implementation below:
 //-------------------------------------------------------------------------------
 
+#define FPGA_UDP_PORT                   28474
+#define FPGA_UDP_CB_DATAGRAM_TX         0x400       // max transmitted datagram size (multiple of 8)
+#define FPGA_UDP_CB_DATAGRAM_RX         0x2400      // max received datagram size (jumbo frame)
+#define FPGA_UDP_MMSG_MAX               0x40        // max datagrams per sendmmsg/recvmmsg call
+#define FPGA_UDP_TIMEOUT_MS             50          // max wait for more data before read is completed
+#define FPGA_UDP_CB_SOCKBUF_DEFAULT     0x00400000
+
+#define FPGA_UDP_LOOPBACK_CB_DATAGRAM   0x400       // loopback responder datagram size (32 rx frames)
+#define FPGA_UDP_LOOPBACK_DEVICE_ID     0x0100      // loopback responder PCIe device id (01:00.0)
+#define FPGA_UDP_LOOPBACK_PA_MAX        0x100000000 // loopback responder emulated memory size (reads above are not completed)
+#define FPGA_UDP_LOOPBACK_SLOT_NONE     7
+
+/*
+* Loopback RawUDP responder emulating a v4 bitstream FPGA: register spaces are
+* kept in memory and memory read TLPs are completed with a pattern where each
+* QWORD holds its own physical address. Used to benchmark the transport.
+*/
+typedef struct tdFPGA_UDP_LOOPBACK {
+    SOCKET Socket;
+    volatile BOOL fStop;
+    volatile BOOL fThread;
+    BOOL fInactivityArmed;              // send "inactivity timer" signal once input is drained
+    struct sockaddr_in saPeer;
+    DWORD cbTx;
+    DWORD iSlot;                        // next data slot in current rx frame
+    DWORD cdwTlp;
+    DWORD dwTlp[0x28];
+    BYTE pbTx[FPGA_UDP_LOOPBACK_CB_DATAGRAM];
+    BYTE pbRx[0x10000];
+    BYTE pbReg[2][4][0x1000];           // register spaces [core/pcie][bank][address]
+} FPGA_UDP_LOOPBACK, *PFPGA_UDP_LOOPBACK;
+
+/*
+* Retrieve the current time in nanoseconds. On Linux the realtime clock is used
+* to be comparable with SO_TIMESTAMPNS kernel receive timestamps.
+*/
+QWORD DeviceFPGA_UDP_TimeNs()
+{
+#ifdef _WIN32
+    QWORD qwFreq, qwNow;
+    QueryPerformanceFrequency((PLARGE_INTEGER)&qwFreq);
+    QueryPerformanceCounter((PLARGE_INTEGER)&qwNow);
+    return (qwNow / qwFreq) * 1000000000 + (qwNow % qwFreq) * 1000000000 / qwFreq;
+#endif /* _WIN32 */
+#ifdef LINUX
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (QWORD)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif /* LINUX */
+}
+
+/*
+* Record a link latency sample - the time from the first unanswered transmit to
+* the reception of the first datagram after it.
+* -- pUdp
+* -- qwRxNs = receive time.
+*/
+VOID DeviceFPGA_UDP_LatencySample(_In_ PFPGA_UDP_CONTEXT pUdp, _In_ QWORD qwRxNs)
+{
+    QWORD qwLatencyNs;
+    if(!pUdp->tmTxNs || (qwRxNs < pUdp->tmTxNs)) { return; }
+    qwLatencyNs = qwRxNs - pUdp->tmTxNs;
+    pUdp->tmTxNs = 0;
+    pUdp->cLatency++;
+    pUdp->qwLatencySumNs += qwLatencyNs;
+    pUdp->qwLatencyMaxNs = max(pUdp->qwLatencyMaxNs, qwLatencyNs);
+}
+
+/*
+* Transmit a buffer as one or more datagrams of at most FPGA_UDP_CB_DATAGRAM_TX
+* bytes. On Linux the datagrams are handed to the kernel in sendmmsg batches.
+* -- pUdp
+* -- pb
+* -- cb
+* -- fTimestamp = record transmit time for latency measurement.
+* -- return = bytes transmitted, SOCKET_ERROR on error.
+*/
+int DeviceFPGA_UDP_Send(_In_ PFPGA_UDP_CONTEXT pUdp, _In_reads_(cb) PBYTE pb, _In_ DWORD cb, _In_ BOOL fTimestamp)
+{
+    DWORD o = 0, cbTx = 0;
+    if(fTimestamp && pUdp->fTimestamp && !pUdp->tmTxNs) {
+        pUdp->tmTxNs = DeviceFPGA_UDP_TimeNs();
+    }
+#ifdef _WIN32
+    int status;
+    while(o < cb) {
+        status = send(pUdp->Socket, (const char*)(pb + o), min(FPGA_UDP_CB_DATAGRAM_TX, cb - o), 0);
+        if(status == SOCKET_ERROR) { return SOCKET_ERROR; }
+        o += min(FPGA_UDP_CB_DATAGRAM_TX, cb - o);
+        cbTx += status;
+    }
+#endif /* _WIN32 */
+#ifdef LINUX
+    int i, status;
+    DWORD c;
+    struct pollfd pfd = { .fd = pUdp->Socket, .events = POLLOUT };
+    struct mmsghdr msgs[FPGA_UDP_MMSG_MAX];
+    struct iovec iovs[FPGA_UDP_MMSG_MAX];
+    while(o < cb) {
+        ZeroMemory(msgs, sizeof(msgs));
+        for(c = 0; (c < FPGA_UDP_MMSG_MAX) && (o < cb); c++) {
+            iovs[c].iov_base = pb + o;
+            iovs[c].iov_len = min(FPGA_UDP_CB_DATAGRAM_TX, cb - o);
+            msgs[c].msg_hdr.msg_iov = &iovs[c];
+            msgs[c].msg_hdr.msg_iovlen = 1;
+            o += (DWORD)iovs[c].iov_len;
+        }
+        for(i = 0; i < (int)c; i += status) {
+            status = sendmmsg(pUdp->Socket, msgs + i, c - i, 0);
+            if(status <= 0) {
+                // socket send buffer full -> wait for it to drain:
+                if((status < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) && (poll(&pfd, 1, FPGA_UDP_TIMEOUT_MS) > 0)) {
+                    status = 0;
+                    continue;
+                }
+                return SOCKET_ERROR;
+            }
+        }
+        for(i = 0; i < (int)c; i++) {
+            cbTx += msgs[i].msg_len;
+        }
+    }
+#endif /* LINUX */
+    return (int)cbTx;
+}
+
+/*
+* Receive all immediately available datagrams (without waiting) into a
+* contiguous buffer. On Linux up to FPGA_UDP_MMSG_MAX datagrams are received
+* per recvmmsg call, each into its own slot which is then compacted.
+* -- pUdp
+* -- pb
+* -- cb
+* -- return = bytes received (0 = no data available), SOCKET_ERROR on error.
+*/
+int DeviceFPGA_UDP_Recv(_In_ PFPGA_UDP_CONTEXT pUdp, _Out_writes_(cb) PBYTE pb, _In_ DWORD cb)
+{
+#ifdef _WIN32
+    int status = recv(pUdp->Socket, (char*)pb, cb, 0);
+    if(status == SOCKET_ERROR) {
+        return (WSAGetLastError() == WSAEWOULDBLOCK) ? 0 : SOCKET_ERROR;
+    }
+    if(status && pUdp->tmTxNs) {
+        DeviceFPGA_UDP_LatencySample(pUdp, DeviceFPGA_UDP_TimeNs());
+    }
+    return status;
+#endif /* _WIN32 */
+#ifdef LINUX
+    int i, status;
+    DWORD c, o = 0, cbSlot;
+    struct cmsghdr *pCmsg;
+    struct timespec *pts;
+    struct mmsghdr msgs[FPGA_UDP_MMSG_MAX];
+    struct iovec iovs[FPGA_UDP_MMSG_MAX];
+    BYTE pbCmsg[CMSG_SPACE(sizeof(struct timespec))];
+    cbSlot = (cb >= FPGA_UDP_CB_DATAGRAM_RX) ? FPGA_UDP_CB_DATAGRAM_RX : cb;
+    c = min(FPGA_UDP_MMSG_MAX, cb / cbSlot);
+    ZeroMemory(msgs, sizeof(msgs));
+    for(i = 0; i < (int)c; i++) {
+        iovs[i].iov_base = pb + i * cbSlot;
+        iovs[i].iov_len = cbSlot;
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    if(pUdp->tmTxNs) {
+        // kernel receive timestamp of first datagram only:
+        msgs[0].msg_hdr.msg_control = pbCmsg;
+        msgs[0].msg_hdr.msg_controllen = sizeof(pbCmsg);
+    }
+    status = recvmmsg(pUdp->Socket, msgs, c, MSG_DONTWAIT, NULL);
+    if(status < 0) {
+        return ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) ? 0 : SOCKET_ERROR;
+    }
+    if(status && pUdp->tmTxNs) {
+        for(pCmsg = CMSG_FIRSTHDR(&msgs[0].msg_hdr); pCmsg; pCmsg = CMSG_NXTHDR(&msgs[0].msg_hdr, pCmsg)) {
+            if((pCmsg->cmsg_level == SOL_SOCKET) && (pCmsg->cmsg_type == SCM_TIMESTAMPNS)) {
+                pts = (struct timespec*)CMSG_DATA(pCmsg);
+                DeviceFPGA_UDP_LatencySample(pUdp, (QWORD)pts->tv_sec * 1000000000 + pts->tv_nsec);
+            }
+        }
+    }
+    for(i = 0; i < status; i++) {
+        if(iovs[i].iov_base != pb + o) {
+            memmove(pb + o, iovs[i].iov_base, msgs[i].msg_len);
+        }
+        o += msgs[i].msg_len;
+    }
+    return (int)o;
+#endif /* LINUX */
+}
+
+/*
+* Wait for the socket to become readable.
+* -- pUdp
+* -- dwTimeoutMs
+* -- return = TRUE if readable, FALSE on timeout.
+*/
+BOOL DeviceFPGA_UDP_Wait(_In_ PFPGA_UDP_CONTEXT pUdp, _In_ DWORD dwTimeoutMs)
+{
+#ifdef _WIN32
+    fd_set fds;
+    struct timeval tv = { .tv_sec = 0, .tv_usec = dwTimeoutMs * 1000 };
+    FD_ZERO(&fds);
+    FD_SET(pUdp->Socket, &fds);
+    return select(0, &fds, NULL, NULL, &tv) > 0;
+#endif /* _WIN32 */
+#ifdef LINUX
+    struct epoll_event ev;
+    return epoll_wait(pUdp->hEpoll, &ev, 1, dwTimeoutMs) > 0;
+#endif /* LINUX */
+}
+
 /*
 * Emulate the FT601 Close function by closing socket.
 */
 ULONG WINAPI DeviceFPGA_UDP_FT60x_FT_Close(HANDLE ftHandle)
 {
-    FPGA_HANDLESOCKET hs;
-    hs.h = ftHandle;
-    closesocket(hs.Socket);
+    PFPGA_UDP_CONTEXT pUdp = (PFPGA_UDP_CONTEXT)ftHandle;
+    if(!pUdp) { return 0; }
+    if(pUdp->Socket) { closesocket(pUdp->Socket); }
+#ifdef LINUX
+    if(pUdp->hEpoll > 0) { close(pUdp->hEpoll); }
+#endif /* LINUX */
+    if(pUdp->pLoopback) {
+        pUdp->pLoopback->fStop = TRUE;
+        while(pUdp->pLoopback->fThread) {
+            Sleep(10);
+        }
+        if(pUdp->pLoopback->Socket) { closesocket(pUdp->pLoopback->Socket); }
+        LocalFree(pUdp->pLoopback);
+    }
+    LocalFree(pUdp);
     return 0;
 }
 
@@ -643,9 +902,7 @@ ULONG WINAPI DeviceFPGA_UDP_FT60x_FT_AbortPipe(HANDLE ftHandle, UCHAR ucPipeID)
 */
 ULONG WINAPI DeviceFPGA_UDP_FT60x_FT_WritePipe(HANDLE ftHandle, UCHAR ucPipeID, PUCHAR pucBuffer, ULONG ulBufferLength, PULONG pulBytesTransferred, PVOID pOverlapped)
 {
-    FPGA_HANDLESOCKET hs;
-    hs.h = ftHandle;
-    int retval = send(hs.Socket, pucBuffer, ulBufferLength, 0);
+    int retval = DeviceFPGA_UDP_Send((PFPGA_UDP_CONTEXT)ftHandle, pucBuffer, ulBufferLength, TRUE);
     if(retval == SOCKET_ERROR) {
         *pulBytesTransferred = 0;
         return 1;
@@ -657,93 +914,335 @@ ULONG WINAPI DeviceFPGA_UDP_FT60x_FT_WritePipe(HANDLE ftHandle, UCHAR ucPipeID,
 /*
 * Emulate the FT601 WritePipe function when reading UDP packets to keep
 * function call compatibility for the FPGA device module.
+* Read until the FPGA "inactivity timer" signal packet is received or until no
+* data have been received for FPGA_UDP_TIMEOUT_MS. The thread sleeps in the
+* kernel until data arrives instead of polling.
 */
 ULONG WINAPI DeviceFPGA_UDP_FT60x_FT_ReadPipe(HANDLE ftHandle, UCHAR ucPipeID, PUCHAR pucBuffer, ULONG ulBufferLength, PULONG pulBytesTransferred, PVOID pOverlapped)
 {
     int status;
-    DWORD cbTx, cSleep = 0, cbRead, cbReadTotal = 0, cPass = 0;
+    DWORD cbReadTotal = 0;
     BYTE pbTx[] = { 0x01, 0x00, 0x01, 0x00,  0x80, 0x02, 0x23, 0x77 };                  // cmd msg: inactivity timer enable - 1ms
-    FPGA_HANDLESOCKET hs;
-    hs.h = ftHandle;
-    DeviceFPGA_UDP_FT60x_FT_WritePipe(ftHandle, 0, pbTx, sizeof(pbTx), &cbTx, NULL);    //          - previously configured by DeviceFPGA_GetDeviceID_FpgaVersion()
+    PFPGA_UDP_CONTEXT pUdp = (PFPGA_UDP_CONTEXT)ftHandle;
+    DeviceFPGA_UDP_Send(pUdp, pbTx, sizeof(pbTx), FALSE);                                //          - previously configured by DeviceFPGA_GetDeviceID_FpgaVersion()
     *pulBytesTransferred = 0;
-    status = 1;
-    while(status && ulBufferLength) {
-        status = recvfrom(hs.Socket, pucBuffer, ulBufferLength, 0, NULL, NULL);
-        if(status == SOCKET_ERROR) {
-            if((cbReadTotal >= 32) && (*(PDWORD)(pucBuffer - 32) == 0xeffffff3) && (*(PDWORD)(pucBuffer - 28) == 0xdeceffff)) { // "inactivity timer" signal packet.
-                break;
-            }
-            if(WSAEWOULDBLOCK == WSAGetLastError()) {
-                if(++cSleep < 10 * 50) {    // wait for completion max ~50ms
-                    if(cSleep < 5) {
-                        SwitchToThread();
-                    } else {
-                        usleep(100);
-                    }
-                    continue;
-                }
-                break;
-            }
-            return 1;
+    while(ulBufferLength) {
+        status = DeviceFPGA_UDP_Recv(pUdp, pucBuffer, ulBufferLength);
+        if(status == SOCKET_ERROR) { return 1; }
+        if(status) {
+            cbReadTotal += status;
+            ulBufferLength -= status;
+            pucBuffer += status;
+            continue;
+        }
+        if((cbReadTotal >= 32) && (*(PDWORD)(pucBuffer - 32) == 0xeffffff3) && (*(PDWORD)(pucBuffer - 28) == 0xdeceffff)) { // "inactivity timer" signal packet.
+            break;
+        }
+        if(!DeviceFPGA_UDP_Wait(pUdp, FPGA_UDP_TIMEOUT_MS)) {
+            break;
         }
-        cSleep = 0;
-        cPass++;
-        cbRead = min(ulBufferLength, (DWORD)status);
-        cbReadTotal += cbRead;
-        ulBufferLength -= cbRead;
-        pucBuffer += cbRead;
     }
     *pulBytesTransferred = cbReadTotal;
     return 0;
 }
 
+/*
+* Loopback responder: transmit the pending rx frames datagram (if any).
+*/
+VOID DeviceFPGA_UDP_Loopback_Flush(_In_ PFPGA_UDP_LOOPBACK pLb)
+{
+    if(pLb->cbTx) {
+        sendto(pLb->Socket, (const char*)pLb->pbTx, pLb->cbTx, 0, (struct sockaddr*)&pLb->saPeer, sizeof(pLb->saPeer));
+    }
+    pLb->cbTx = 0;
+    pLb->iSlot = FPGA_UDP_LOOPBACK_SLOT_NONE;
+}
+
+/*
+* Loopback responder: append a DWORD to the rx frame stream. A rx frame is a
+* status DWORD (0xe in the top nibble, one nibble per data DWORD) followed by
+* seven data DWORDs. Unused slots are marked with nibble 0xf.
+* -- pLb
+* -- dwData
+* -- bStatus = 0 = TLP, 4 = TLP last, 1 = PCIe register, 3 = core register.
+*/
+VOID DeviceFPGA_UDP_Loopback_Put(_In_ PFPGA_UDP_LOOPBACK pLb, _In_ DWORD dwData, _In_ BYTE bStatus)
+{
+    PDWORD pdwFrame;
+    if(pLb->iSlot >= FPGA_UDP_LOOPBACK_SLOT_NONE) {
+        if(pLb->cbTx + 32 > sizeof(pLb->pbTx)) {
+            DeviceFPGA_UDP_Loopback_Flush(pLb);
+        }
+        memset(pLb->pbTx + pLb->cbTx, 0xff, 32);
+        *(PDWORD)(pLb->pbTx + pLb->cbTx) = 0xefffffff;
+        pLb->cbTx += 32;
+        pLb->iSlot = 0;
+    }
+    pdwFrame = (PDWORD)(pLb->pbTx + pLb->cbTx - 32);
+    pdwFrame[0] = (pdwFrame[0] & ~(0x0f << (pLb->iSlot << 2))) | ((DWORD)bStatus << (pLb->iSlot << 2));
+    pdwFrame[1 + pLb->iSlot] = dwData;
+    pLb->iSlot++;
+}
+
+/*
+* Loopback responder: complete a received MRd32/MRd64 TLP with CplD TLPs split
+* at 128-byte read completion boundaries. Reads of non-existing memory are not
+* completed at all which the read functions treat as failed reads.
+*/
+VOID DeviceFPGA_UDP_Loopback_MRd(_In_ PFPGA_UDP_LOOPBACK pLb)
+{
+    QWORD qwA;
+    DWORD j, cb, cbCpl, dwHdr0, dwHdr1;
+    if(pLb->cdwTlp < 3) { return; }
+    dwHdr0 = _byteswap_ulong(pLb->dwTlp[0]);
+    dwHdr1 = _byteswap_ulong(pLb->dwTlp[1]);
+    if(((dwHdr0 >> 24) == TLP_MRd32) && (pLb->cdwTlp == 3)) {
+        qwA = _byteswap_ulong(pLb->dwTlp[2]);
+    } else if(((dwHdr0 >> 24) == TLP_MRd64) && (pLb->cdwTlp == 4)) {
+        qwA = ((QWORD)_byteswap_ulong(pLb->dwTlp[2]) << 32) | _byteswap_ulong(pLb->dwTlp[3]);
+    } else {
+        return;
+    }
+    qwA &= ~3ULL;
+    cb = ((dwHdr0 & 0x3ff) ? (dwHdr0 & 0x3ff) : 0x400) << 2;
+    if(qwA + cb > FPGA_UDP_LOOPBACK_PA_MAX) { return; }
+    while(cb) {
+        cbCpl = min(cb, 0x80 - (DWORD)(qwA & 0x7f));
+        DeviceFPGA_UDP_Loopback_Put(pLb, _byteswap_ulong(((DWORD)TLP_CplD << 24) | (cbCpl >> 2)), 0);
+        DeviceFPGA_UDP_Loopback_Put(pLb, _byteswap_ulong((FPGA_UDP_LOOPBACK_DEVICE_ID << 16) | (cb & 0xfff)), 0);
+        DeviceFPGA_UDP_Loopback_Put(pLb, _byteswap_ulong((dwHdr1 & 0xffffff00) | (DWORD)(qwA & 0x7f)), 0);
+        for(j = 0; j < cbCpl; j += 4, qwA += 4) {
+            DeviceFPGA_UDP_Loopback_Put(pLb, (qwA & 4) ? (DWORD)(qwA >> 32) : (DWORD)(qwA & ~7ULL), (j + 4 == cbCpl) ? 4 : 0);
+        }
+        cb -= cbCpl;
+    }
+}
+
+/*
+* Loopback responder: process a received datagram of (data, command) DWORD pairs.
+*/
+VOID DeviceFPGA_UDP_Loopback_Process(_In_ PFPGA_UDP_LOOPBACK pLb, _In_ DWORD cb)
+{
+    BYTE bCmd, bTarget;
+    WORD wAddrBE, wAddr;
+    PBYTE pbReg;
+    DWORD o, dwData, dwCmd;
+    for(o = 0; o + 8 <= cb; o += 8) {
+        dwData = *(PDWORD)(pLb->pbRx + o);
+        dwCmd = *(PDWORD)(pLb->pbRx + o + 4);
+        if((dwCmd >> 24) != 0x77) { continue; }     // not a command (i.e. ftdi workaround dummy filler)
+        bCmd = (BYTE)(dwCmd >> 16);
+        if((bCmd == 0x00) || (bCmd == 0x04)) {
+            // TX TLP / TX TLP VALID LAST:
+            if(pLb->cdwTlp < _countof(pLb->dwTlp)) {
+                pLb->dwTlp[pLb->cdwTlp++] = dwData;
+            }
+            if(bCmd == 0x04) {
+                DeviceFPGA_UDP_Loopback_MRd(pLb);
+                pLb->cdwTlp = 0;
+            }
+            continue;
+        }
+        if(!(bCmd & 0x30) || ((bCmd & 0x03) != FPGA_REG_CORE && (bCmd & 0x03) != FPGA_REG_PCIE)) { continue; }
+        // bitstream v4 register read/write:
+        bTarget = bCmd & 0x03;
+        wAddrBE = (WORD)dwCmd;
+        wAddr = _byteswap_ushort(wAddrBE);
+        pbReg = pLb->pbReg[(bTarget == FPGA_REG_CORE) ? 0 : 1][wAddr >> 14];
+        wAddr &= 0xfff;
+        if(bCmd & 0x10) {
+            DeviceFPGA_UDP_Loopback_Put(pLb, wAddrBE | ((DWORD)pbReg[wAddr] << 16) | ((DWORD)pbReg[(wAddr + 1) & 0xfff] << 24), bTarget);
+        }
+        if(bCmd & 0x20) {
+            pbReg[wAddr] = (pbReg[wAddr] & ~(BYTE)(dwData >> 16)) | ((BYTE)dwData & (BYTE)(dwData >> 16));
+            pbReg[(wAddr + 1) & 0xfff] = (pbReg[(wAddr + 1) & 0xfff] & ~(BYTE)(dwData >> 24)) | ((BYTE)(dwData >> 8) & (BYTE)(dwData >> 24));
+            if((bTarget == FPGA_REG_CORE) && ((wAddrBE & 0xff) == 0x80) && (wAddr == 0x0002) && (pbReg[2] & 0x01)) {
+                // core read-write 0x0002 bit 0: inactivity timer enable (one-shot):
+                pLb->fInactivityArmed = TRUE;
+                pbReg[2] &= ~0x01;
+            }
+        }
+    }
+}
+
+/*
+* Loopback responder thread: wait for datagrams, process all pending ones and
+* then flush the replies - followed by the "inactivity timer" signal packet if
+* armed (the real FPGA sends it after 1ms of inactivity).
+*/
+DWORD DeviceFPGA_UDP_Loopback_ThreadProc(_In_ PFPGA_UDP_LOOPBACK pLb)
+{
+    int cbRx;
+    fd_set fds;
+    struct timeval tv;
+#ifdef _WIN32
+    int cbAddr;
+#endif /* _WIN32 */
+#ifdef LINUX
+    socklen_t cbAddr;
+#endif /* LINUX */
+    while(!pLb->fStop) {
+        FD_ZERO(&fds);
+        FD_SET(pLb->Socket, &fds);
+        tv.tv_sec = 0;
+        tv.tv_usec = FPGA_UDP_TIMEOUT_MS * 1000;
+        if(select((int)pLb->Socket + 1, &fds, NULL, NULL, &tv) <= 0) { continue; }
+        while(TRUE) {
+            cbAddr = sizeof(pLb->saPeer);
+            cbRx = recvfrom(pLb->Socket, (char*)pLb->pbRx, sizeof(pLb->pbRx), 0, (struct sockaddr*)&pLb->saPeer, &cbAddr);
+            if(cbRx <= 0) { break; }
+            DeviceFPGA_UDP_Loopback_Process(pLb, (DWORD)cbRx);
+        }
+        DeviceFPGA_UDP_Loopback_Flush(pLb);
+        if(pLb->fInactivityArmed) {
+            pLb->fInactivityArmed = FALSE;
+            DeviceFPGA_UDP_Loopback_Put(pLb, 0xdeceffff, 0x03);
+            DeviceFPGA_UDP_Loopback_Flush(pLb);
+        }
+    }
+    pLb->fThread = FALSE;
+    return 1;
+}
+
+/*
+* Start a loopback RawUDP responder on an ephemeral port of the address given.
+* -- pUdp
+* -- dwIpv4Addr
+* -- pwUdpPort = receives the responder port.
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFPGA_UDP_Loopback_Start(_Inout_ PFPGA_UDP_CONTEXT pUdp, _In_ DWORD dwIpv4Addr, _Out_ PWORD pwUdpPort)
+{
+    HANDLE hThread;
+    PFPGA_UDP_LOOPBACK pLb;
+    struct sockaddr_in sAddr = { 0 };
+#ifdef _WIN32
+    int cbAddr = sizeof(sAddr);
+    u_long mode = 1;
+    WSADATA WsaData;
+    if(WSAStartup(MAKEWORD(2, 2), &WsaData)) { return FALSE; }
+#endif /* _WIN32 */
+#ifdef LINUX
+    socklen_t cbAddr = sizeof(sAddr);
+#endif /* LINUX */
+    if(!(pLb = pUdp->pLoopback = LocalAlloc(LMEM_ZEROINIT, sizeof(FPGA_UDP_LOOPBACK)))) { return FALSE; }
+    pLb->iSlot = FPGA_UDP_LOOPBACK_SLOT_NONE;
+    pLb->pbReg[0][0][0x08] = 4;                                                     // core read-only: version major
+    pLb->pbReg[0][0][0x09] = 14;                                                    // core read-only: version minor
+    pLb->pbReg[0][0][0x0a] = DEVICE_ID_NETV2_UDP;                                   // core read-only: fpga id
+    pLb->pbReg[1][0][0x08] = (BYTE)(FPGA_UDP_LOOPBACK_DEVICE_ID >> 8);              // pcie read-only: device id (big endian)
+    pLb->pbReg[1][0][0x09] = (BYTE)FPGA_UDP_LOOPBACK_DEVICE_ID;
+    if((pLb->Socket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, IPPROTO_UDP)) == INVALID_SOCKET) {
+        pLb->Socket = 0;
+        return FALSE;
+    }
+#ifdef _WIN32
+    ioctlsocket(pLb->Socket, FIONBIO, &mode);
+#endif /* _WIN32 */
+    sAddr.sin_family = AF_INET;
+    sAddr.sin_addr.s_addr = dwIpv4Addr;
+    if(bind(pLb->Socket, (struct sockaddr*)&sAddr, sizeof(sAddr)) == SOCKET_ERROR) { return FALSE; }
+    if(getsockname(pLb->Socket, (struct sockaddr*)&sAddr, &cbAddr) == SOCKET_ERROR) { return FALSE; }
+    *pwUdpPort = ntohs(sAddr.sin_port);
+    pLb->fThread = TRUE;
+    if(!(hThread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)DeviceFPGA_UDP_Loopback_ThreadProc, pLb, 0, NULL))) {
+        pLb->fThread = FALSE;
+        return FALSE;
+    }
+    CloseHandle(hThread);
+    return TRUE;
+}
+
 /*
 * Create a non-blocking UDP socket by connecting to the address/port specified.
+* -- pUdp
 * -- dwIpv4Addr
 * -- wUdpPort
-* -- return = the socket, 0 on error.
+* -- cbSockBuf = socket receive buffer size (send buffer is a quarter).
+* -- dwBusyPollUs = SO_BUSY_POLL in uS (0 = disabled) [linux only].
+* -- return
 */
-SOCKET DeviceFPGA_UDP_Connect(_In_ DWORD dwIpv4Addr, _In_ WORD wUdpPort)
+_Success_(return)
+BOOL DeviceFPGA_UDP_Connect(_Inout_ PFPGA_UDP_CONTEXT pUdp, _In_ DWORD dwIpv4Addr, _In_ WORD wUdpPort, _In_ DWORD cbSockBuf, _In_ DWORD dwBusyPollUs)
 {
     int status;
     struct sockaddr_in sAddr;
     SOCKET Sock = 0;
-    int rcvbuf = 0x00080000;
+    int rcvbuf = (int)cbSockBuf, sndbuf = (int)(cbSockBuf >> 2);
 #ifdef _WIN32
     u_long mode = 1;  // 1 == non-blocking socket - Windows only ???
     WSADATA WsaData;
-    if(WSAStartup(MAKEWORD(2, 2), &WsaData)) { return 0; }
+    if(WSAStartup(MAKEWORD(2, 2), &WsaData)) { return FALSE; }
 #endif /* _WIN32 */
+#ifdef LINUX
+    int one = 1, busypoll = (int)dwBusyPollUs;
+    struct epoll_event ev = { .events = EPOLLIN };
+#endif /* LINUX */
     sAddr.sin_family = AF_INET;
     sAddr.sin_port = htons(wUdpPort);
     sAddr.sin_addr.s_addr = dwIpv4Addr;
-    if((Sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, IPPROTO_UDP)) != INVALID_SOCKET) {
+    if((Sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, IPPROTO_UDP)) == INVALID_SOCKET) { return FALSE; }
+    pUdp->Socket = Sock;
 #ifdef _WIN32
-        ioctlsocket(Sock, FIONBIO, &mode);
+    ioctlsocket(Sock, FIONBIO, &mode);
+    setsockopt(Sock, SOL_SOCKET, SO_RCVBUF, (const char*)&rcvbuf, sizeof(int));
 #endif /* _WIN32 */
-        setsockopt(Sock, SOL_SOCKET, SO_RCVBUF, (const char*)&rcvbuf, sizeof(int));
-        status = connect(Sock, (struct sockaddr*)&sAddr, sizeof(sAddr));
-        if(status == SOCKET_ERROR) {
-            closesocket(Sock);
-            return 0;
-        }
-        rcvbuf = 0x00080000;
-        setsockopt(Sock, SOL_SOCKET, SO_RCVBUF, (const char*)&rcvbuf, sizeof(int));
-        return Sock;
+#ifdef LINUX
+    // try exceed net.core.rmem_max (requires CAP_NET_ADMIN) before falling back:
+    if(setsockopt(Sock, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(int))) {
+        setsockopt(Sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(int));
     }
-    return 0;
+    if(pUdp->fTimestamp) {
+        setsockopt(Sock, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(int));
+    }
+#ifdef SO_BUSY_POLL
+    if(busypoll) {
+        setsockopt(Sock, SOL_SOCKET, SO_BUSY_POLL, &busypoll, sizeof(int));
+    }
+#endif /* SO_BUSY_POLL */
+#endif /* LINUX */
+    setsockopt(Sock, SOL_SOCKET, SO_SNDBUF, (const char*)&sndbuf, sizeof(int));
+    status = connect(Sock, (struct sockaddr*)&sAddr, sizeof(sAddr));
+    if(status == SOCKET_ERROR) { return FALSE; }
+#ifdef LINUX
+    if((pUdp->hEpoll = epoll_create1(EPOLL_CLOEXEC)) <= 0) { return FALSE; }
+    ev.data.fd = Sock;
+    if(epoll_ctl(pUdp->hEpoll, EPOLL_CTL_ADD, Sock, &ev)) { return FALSE; }
+#endif /* LINUX */
+    return TRUE;
 }
 
+#define FPGA_PARAMETER_UDP_LOOPBACK    "udploopback"
+#define FPGA_PARAMETER_UDP_SOCKBUF     "udpbuf"
+#define FPGA_PARAMETER_UDP_BUSYPOLL    "udpbusypoll"
+#define FPGA_PARAMETER_UDP_TIMESTAMP   "udptimestamp"
+
 /*
 * Initialize a FPGA RawUDP Device.
+* -- ctxLC
 * -- ctx
+* -- dwIpv4Addr
 * -- return = NULL on success, Error message on fail.
 */
-LPSTR DeviceFPGA_InitializeUDP(_In_ PDEVICE_CONTEXT_FPGA ctx, _In_ DWORD dwIpv4Addr)
+LPSTR DeviceFPGA_InitializeUDP(_In_ PLC_CONTEXT ctxLC, _In_ PDEVICE_CONTEXT_FPGA ctx, _In_ DWORD dwIpv4Addr)
 {
-    ctx->dev.SocketUDP = DeviceFPGA_UDP_Connect(dwIpv4Addr, 28474);
-    if(!ctx->dev.SocketUDP) {
+    PFPGA_UDP_CONTEXT pUdp;
+    WORD wUdpPort = FPGA_UDP_PORT;
+    DWORD cbSockBuf = (DWORD)LcDeviceParameterGetNumeric(ctxLC, FPGA_PARAMETER_UDP_SOCKBUF);
+    if(!(pUdp = LocalAlloc(LMEM_ZEROINIT, sizeof(FPGA_UDP_CONTEXT)))) {
+        return "Out of memory";
+    }
+    ctx->dev.pUdp = pUdp;
+    pUdp->fTimestamp = LcDeviceParameterGetNumeric(ctxLC, FPGA_PARAMETER_UDP_TIMESTAMP) ? TRUE : FALSE;
+    if(LcDeviceParameterGetNumeric(ctxLC, FPGA_PARAMETER_UDP_LOOPBACK) && !DeviceFPGA_UDP_Loopback_Start(pUdp, dwIpv4Addr, &wUdpPort)) {
+        DeviceFPGA_UDP_FT60x_FT_Close(pUdp);
+        ctx->dev.pUdp = NULL;
+        return "Unable to start RawUDP loopback responder";
+    }
+    if(!DeviceFPGA_UDP_Connect(pUdp, dwIpv4Addr, wUdpPort, cbSockBuf ? cbSockBuf : FPGA_UDP_CB_SOCKBUF_DEFAULT, (DWORD)LcDeviceParameterGetNumeric(ctxLC, FPGA_PARAMETER_UDP_BUSYPOLL))) {
+        DeviceFPGA_UDP_FT60x_FT_Close(pUdp);
+        ctx->dev.pUdp = NULL;
         return "Unable to connect to RawUDP FPGA device";
     }
     ctx->dev.pfnFT_AbortPipe = DeviceFPGA_UDP_FT60x_FT_AbortPipe;
@@ -751,6 +1250,7 @@ LPSTR DeviceFPGA_InitializeUDP(_In_ PDEVICE_CONTEXT_FPGA ctx, _In_ DWORD dwIpv4A
     ctx->dev.pfnFT_Close = DeviceFPGA_UDP_FT60x_FT_Close;
     ctx->dev.pfnFT_ReadPipe = DeviceFPGA_UDP_FT60x_FT_ReadPipe;
     ctx->dev.pfnFT_WritePipe = DeviceFPGA_UDP_FT60x_FT_WritePipe;
+    ctx->dev.fUDP = TRUE;
     ctx->dev.fInitialized = TRUE;
     return NULL;
 }
@@ -1113,6 +1613,154 @@ fail:
 // FPGA implementation below:
 //-------------------------------------------------------------------------------
 
+/*
+* The async2 rx buffer is a ring buffer where the same physical pages are
+* mapped twice back to back. Transport reads land directly in the ring and
+* TLPs spanning the wrap are parsed contiguously through the second mapping.
+* If the double mapping isn't possible a linear buffer is used instead - in
+* which case the unconsumed tail is periodically moved back to the front.
+*/
+#define FPGA_RXBUF_GRANULARITY          0x10000     // ring buffer mapping granularity (64kB)
+#define FPGA_RXBUF_CB_SYNC(cbRx)        ((DWORD)(1.30 * (cbRx) + 0x2000))   // synchronous rx buffer size for a MAX_SIZE_RX (+margin)
+#define FPGA_RXBUF_CB_ASYNC(cbRead)     (2 * (cbRead) + 0x10000)            // async2 rx buffer size for an ASYNC_MAX_READSIZE (+margin)
+#define FPGA_RXBUF_CB_RX_TUNE_MAX       0x3c000     // largest MAX_SIZE_RX selected by autotune
+#define FPGA_RXBUF_CB_READ_TUNE_MAX     0x40000     // largest ASYNC_MAX_READSIZE selected by autotune
+
+#ifdef _WIN32
+#ifndef MEM_RESERVE_PLACEHOLDER
+#define MEM_RESERVE_PLACEHOLDER         0x00040000
+#define MEM_REPLACE_PLACEHOLDER         0x00004000
+#define MEM_PRESERVE_PLACEHOLDER        0x00000002
+#endif /* MEM_RESERVE_PLACEHOLDER */
+
+typedef PVOID(WINAPI *PFN_VirtualAlloc2)(HANDLE Process, PVOID BaseAddress, SIZE_T Size, ULONG AllocationType, ULONG PageProtection, PVOID ExtendedParameters, ULONG ParameterCount);
+typedef PVOID(WINAPI *PFN_MapViewOfFile3)(HANDLE FileMapping, HANDLE Process, PVOID BaseAddress, ULONG64 Offset, SIZE_T ViewSize, ULONG AllocationType, ULONG PageProtection, PVOID ExtendedParameters, ULONG ParameterCount);
+
+_Success_(return)
+BOOL DeviceFPGA_RxBuf_AllocRing(_In_ PDEVICE_CONTEXT_FPGA ctx, _In_ DWORD cb)
+{
+    HMODULE hKernelBase;
+    PFN_VirtualAlloc2 pfnVirtualAlloc2;
+    PFN_MapViewOfFile3 pfnMapViewOfFile3;
+    PBYTE pb, pb1 = NULL, pb2 = NULL;
+    HANDLE hSection;
+    if(!(hKernelBase = GetModuleHandleA("kernelbase.dll"))) { return FALSE; }
+    pfnVirtualAlloc2 = (PFN_VirtualAlloc2)GetProcAddress(hKernelBase, "VirtualAlloc2");
+    pfnMapViewOfFile3 = (PFN_MapViewOfFile3)GetProcAddress(hKernelBase, "MapViewOfFile3");
+    if(!pfnVirtualAlloc2 || !pfnMapViewOfFile3) { return FALSE; }
+    if(!(hSection = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, cb, NULL))) { return FALSE; }
+    if(!(pb = pfnVirtualAlloc2(NULL, NULL, 2ULL * cb, MEM_RESERVE | MEM_RESERVE_PLACEHOLDER, PAGE_NOACCESS, NULL, 0))) {
+        CloseHandle(hSection);
+        return FALSE;
+    }
+    VirtualFree(pb, cb, MEM_RELEASE | MEM_PRESERVE_PLACEHOLDER);
+    pb1 = pfnMapViewOfFile3(hSection, NULL, pb, 0, cb, MEM_REPLACE_PLACEHOLDER, PAGE_READWRITE, NULL, 0);
+    pb2 = pfnMapViewOfFile3(hSection, NULL, pb + cb, 0, cb, MEM_REPLACE_PLACEHOLDER, PAGE_READWRITE, NULL, 0);
+    if(!pb1 || !pb2) {
+        if(pb1) { UnmapViewOfFile(pb1); } else { VirtualFree(pb, 0, MEM_RELEASE); }
+        if(pb2) { UnmapViewOfFile(pb2); } else { VirtualFree(pb + cb, 0, MEM_RELEASE); }
+        CloseHandle(hSection);
+        return FALSE;
+    }
+    ctx->rxbuf.pb = pb;
+    ctx->rxbuf.cbRing = cb;
+    ctx->rxbuf.hRing = hSection;
+    return TRUE;
+}
+
+VOID DeviceFPGA_RxBuf_Free(_In_ PDEVICE_CONTEXT_FPGA ctx)
+{
+    if(ctx->rxbuf.cbRing) {
+        UnmapViewOfFile(ctx->rxbuf.pb);
+        UnmapViewOfFile(ctx->rxbuf.pb + ctx->rxbuf.cbRing);
+        CloseHandle(ctx->rxbuf.hRing);
+    } else {
+        LocalFree(ctx->rxbuf.pb);
+    }
+    ctx->rxbuf.pb = NULL;
+    ctx->rxbuf.cbRing = 0;
+    ctx->rxbuf.cbAlloc = 0;
+}
+#endif /* _WIN32 */
+#ifdef LINUX
+_Success_(return)
+BOOL DeviceFPGA_RxBuf_AllocRing(_In_ PDEVICE_CONTEXT_FPGA ctx, _In_ DWORD cb)
+{
+    int fd;
+    PBYTE pb;
+    if((fd = memfd_create("leechcore_fpga_rx", 0)) < 0) { return FALSE; }
+    if(ftruncate(fd, cb)) { goto fail; }
+    if(MAP_FAILED == (pb = mmap(NULL, 2ULL * cb, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0))) { goto fail; }
+    if((MAP_FAILED == mmap(pb, cb, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0)) ||
+       (MAP_FAILED == mmap(pb + cb, cb, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0))) {
+        munmap(pb, 2ULL * cb);
+        goto fail;
+    }
+    close(fd);
+    ctx->rxbuf.pb = pb;
+    ctx->rxbuf.cbRing = cb;
+    return TRUE;
+fail:
+    close(fd);
+    return FALSE;
+}
+
+VOID DeviceFPGA_RxBuf_Free(_In_ PDEVICE_CONTEXT_FPGA ctx)
+{
+    if(ctx->rxbuf.cbRing) {
+        munmap(ctx->rxbuf.pb, 2ULL * ctx->rxbuf.cbRing);
+    } else {
+        LocalFree(ctx->rxbuf.pb);
+    }
+    ctx->rxbuf.pb = NULL;
+    ctx->rxbuf.cbRing = 0;
+    ctx->rxbuf.cbAlloc = 0;
+}
+#endif /* LINUX */
+
+/*
+* Allocate the rx buffer - as a double-mapped ring buffer if possible.
+* -- ctx
+* -- cb = buffer size, rounded up to the mapping granularity (64kB).
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFPGA_RxBuf_Alloc(_In_ PDEVICE_CONTEXT_FPGA ctx, _In_ DWORD cb)
+{
+    cb = (cb + FPGA_RXBUF_GRANULARITY - 1) & ~(FPGA_RXBUF_GRANULARITY - 1);
+    if(!DeviceFPGA_RxBuf_AllocRing(ctx, cb) && !(ctx->rxbuf.pb = LocalAlloc(0, cb))) { return FALSE; }
+    ctx->rxbuf.cbAlloc = cb;
+    return TRUE;
+}
+
+/*
+* Ensure room for a transport read of cbRead bytes at the rx buffer write
+* position. A ring buffer only rebases its offsets once the read position
+* has passed the wrap - no data is moved. A linear buffer moves the
+* unconsumed tail back to the front of the buffer.
+* -- ctx
+* -- cbRead
+*/
+VOID DeviceFPGA_RxBuf_Realign(_In_ PDEVICE_CONTEXT_FPGA ctx, _In_ DWORD cbRead)
+{
+    if(ctx->rxbuf.cbRing) {
+        if(ctx->rxbuf.o >= ctx->rxbuf.cbRing) {
+            ctx->rxbuf.o -= ctx->rxbuf.cbRing;
+            ctx->rxbuf.cb -= ctx->rxbuf.cbRing;
+        }
+        if(ctx->rxbuf.cb - ctx->rxbuf.o + cbRead > ctx->rxbuf.cbRing) {
+            // should never happen - drop unconsumed data rather than overwrite it.
+            ctx->rxbuf.o = ctx->rxbuf.cb = 0;
+        }
+        return;
+    }
+    if(ctx->rxbuf.cb + cbRead > ctx->rxbuf.cbMax) {
+        memcpy(ctx->rxbuf.pb, ctx->rxbuf.pb + ctx->rxbuf.o, ctx->rxbuf.cb - ctx->rxbuf.o);
+        ctx->rxbuf.cb -= ctx->rxbuf.o;
+        ctx->rxbuf.o = 0;
+    }
+}
+
 VOID DeviceFPGA_ReInitializeFTDI(_In_ PDEVICE_CONTEXT_FPGA ctx)
 {
     // called to try to recover link in case of unstable devices.
@@ -1129,6 +1777,10 @@ VOID DeviceFPGA_Close(_Inout_ PLC_CONTEXT ctxLC)
     PDEVICE_CONTEXT_FPGA ctx = (PDEVICE_CONTEXT_FPGA)ctxLC->hDevice;
     DWORD cbTMP;
     if(!ctx) { return; }
+    ctx->autotune.fAbort = TRUE;
+    while(ctx->autotune.fThread) {
+        Sleep(10);
+    }
     while(!TryEnterCriticalSection(&ctx->Lock)) {
         Sleep(50);
     }
@@ -1151,8 +1803,9 @@ VOID DeviceFPGA_Close(_Inout_ PLC_CONTEXT ctxLC)
     } __except(EXCEPTION_EXECUTE_HANDLER) { ; }
 #endif /* WIN32 */
     DeleteCriticalSection(&ctx->Lock);
+    DeleteCriticalSection(&ctx->async2.LockTx);
     Ob_DECREF(ctx->async2.pmQueue);
-    LocalFree(ctx->rxbuf.pb);
+    DeviceFPGA_RxBuf_Free(ctx);
     LocalFree(ctx->txbuf.pb);
     LocalFree(ctx);
     ctxLC->hDevice = 0;
@@ -2356,6 +3009,119 @@ VOID DeviceFPGA_Synch_ReadScatter(_In_ PLC_CONTEXT ctxLC, _In_ DWORD cMEMs, _Ino
 // TLP ASYNC2 handling functionality below:
 //-------------------------------------------------------------------------------
 
+/*
+* Reserve tags and byte credits for a single MEM (lock-free). The reservation
+* only succeeds if at least the minimum number of tags/credits are available
+* so that the primary (RX demultiplexer) thread isn't starved by submitters.
+* -- ctx
+* -- cTag = number of tags to reserve.
+* -- cbCredit = number of byte credits to reserve.
+* -- cTagMin = minimum number of tags required to be available.
+* -- cbCreditMin = minimum number of byte credits required to be available.
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFPGA_Async2_TagReserve(_In_ PDEVICE_CONTEXT_FPGA ctx, _In_ DWORD cTag, _In_ DWORD cbCredit, _In_ DWORD cTagMin, _In_ DWORD cbCreditMin)
+{
+    QWORD qwAvail, qwAvailNew;
+    do {
+        qwAvail = ctx->async2.qwAvail;
+        if((DWORD)(qwAvail >> 32) < max(cTag, cTagMin)) { return FALSE; }
+        if((DWORD)qwAvail < max(cbCredit, cbCreditMin)) { return FALSE; }
+        qwAvailNew = qwAvail - (((QWORD)cTag << 32) | cbCredit);
+    } while(qwAvail != InterlockedCompareExchange64(&ctx->async2.qwAvail, qwAvailNew, qwAvail));
+    return TRUE;
+}
+
+/*
+* Withdraw byte credits owed after a MAX_SIZE_RX decrease from the available
+* credits. Credits held by reads in flight cannot be withdrawn until they are
+* returned - the remainder stays as a deficit. The available credit count is
+* never allowed to underflow (which would borrow from the tag count).
+* Only called by the device lock holder.
+* -- ctx
+*/
+VOID DeviceFPGA_Async2_CreditSettle(_In_ PDEVICE_CONTEXT_FPGA ctx)
+{
+    QWORD qwAvail;
+    DWORD cbTake;
+    do {
+        qwAvail = ctx->async2.qwAvail;
+        cbTake = min(ctx->async2.cbCreditDeficit, (DWORD)qwAvail);
+        if(!cbTake) { return; }
+    } while(qwAvail != InterlockedCompareExchange64(&ctx->async2.qwAvail, qwAvail - cbTake, qwAvail));
+    ctx->async2.cbCreditDeficit -= cbTake;
+}
+
+/*
+* Adjust the total number of byte credits on a MAX_SIZE_RX change. Other
+* threads may hold credits for reads in flight so a decrease is settled by
+* DeviceFPGA_Async2_CreditSettle() as far as possible now, and later as the
+* credits are returned. Only called by the device lock holder.
+* -- ctx
+* -- cbOld
+* -- cbNew
+*/
+VOID DeviceFPGA_Async2_CreditAdjust(_In_ PDEVICE_CONTEXT_FPGA ctx, _In_ DWORD cbOld, _In_ DWORD cbNew)
+{
+    DWORD cbPay;
+    if(cbNew >= cbOld) {
+        cbPay = min(ctx->async2.cbCreditDeficit, cbNew - cbOld);
+        ctx->async2.cbCreditDeficit -= cbPay;
+        InterlockedAdd64(&ctx->async2.qwAvail, cbNew - cbOld - cbPay);
+    } else {
+        ctx->async2.cbCreditDeficit += cbOld - cbNew;
+        DeviceFPGA_Async2_CreditSettle(ctx);
+    }
+}
+
+/*
+* Claim a free tag slot (lock-free). A tag and its credits must already have
+* been reserved with DeviceFPGA_Async2_TagReserve(). The tag is returned in the
+* reserved state; it's published by DeviceFPGA_Async2_TagPublish().
+* -- ctx
+* -- return = the tag.
+*/
+BYTE DeviceFPGA_Async2_TagClaim(_In_ PDEVICE_CONTEXT_FPGA ctx)
+{
+    BYTE iTag;
+    while(TRUE) {
+        iTag = (BYTE)(InterlockedIncrement(&ctx->async2.iTagNext) % 0xEF);
+        if(FPGA_NEWASYNC2_TAG_TYPE_NONE == InterlockedCompareExchange(&ctx->async2.Tags[iTag].tp, FPGA_NEWASYNC2_TAG_TYPE_RESERVED, FPGA_NEWASYNC2_TAG_TYPE_NONE)) {
+            return iTag;
+        }
+    }
+}
+
+/*
+* Publish a claimed tag once its entry is set up - completions received for
+* the tag are processed only after it has been published.
+* -- ctx
+* -- iTag
+* -- tp
+*/
+VOID DeviceFPGA_Async2_TagPublish(_In_ PDEVICE_CONTEXT_FPGA ctx, _In_ BYTE iTag, _In_ FPGA_NEWASYNC2_TAG_TYPE tp)
+{
+    InterlockedCompareExchange(&ctx->async2.Tags[iTag].tp, tp, FPGA_NEWASYNC2_TAG_TYPE_RESERVED);
+}
+
+/*
+* Free a completed (or timed out) tag and return its tag and byte credits.
+* -- ctx
+* -- pTag
+*/
+VOID DeviceFPGA_Async2_TagFree(_In_ PDEVICE_CONTEXT_FPGA ctx, _In_ PFPGA_NEWASYNC2_TAG_ENTRY pTag)
+{
+    DWORD tp = pTag->tp;
+    if((tp != FPGA_NEWASYNC2_TAG_TYPE_4K) && (tp != FPGA_NEWASYNC2_TAG_TYPE_TINY)) { return; }
+    pTag->oMEM = 0;
+    pTag->pMEM = NULL;
+    pTag->pMemContext = NULL;
+    if(tp == InterlockedCompareExchange(&pTag->tp, FPGA_NEWASYNC2_TAG_TYPE_NONE, tp)) {
+        InterlockedAdd64(&ctx->async2.qwAvail, (1ULL << 32) | ((tp == FPGA_NEWASYNC2_TAG_TYPE_4K) ? 0x1000 : 0x80));
+    }
+}
+
 /*
 * Generic callback function that may be used by TLP capable devices to aid the
 * collection of memory read completions. Receives single TLP packet.
@@ -2370,6 +3136,7 @@ VOID DeviceFPGA_Async2_Read_RxTlpSingle_MRdCpl(_In_ PLC_CONTEXT ctxLC, _In_ PDEV
     PTLP_HDR hdr = (PTLP_HDR)pb;
     PDWORD buf = (PDWORD)pb;
     WORD c, o, cbAdjust = 0;
+    DWORD tp;
     PMEM_SCATTER pMEM;
     PFPGA_NEWASYNC2_TAG_ENTRY pTag;
     buf[0] = _byteswap_ulong(buf[0]);
@@ -2378,12 +3145,14 @@ VOID DeviceFPGA_Async2_Read_RxTlpSingle_MRdCpl(_In_ PLC_CONTEXT ctxLC, _In_ PDEV
     if(cb < ((DWORD)hdr->Length << 2) + 12) { return; }                         // Insufficient length
     if((hdr->TypeFmt != TLP_CplD) && (hdr->TypeFmt != TLP_Cpl)) { return; }     // Not a completion
     pTag = ctx->async2.Tags + hdrC->Tag;
+    tp = pTag->tp;                                                              // read type before entry (published tag)
+    MemoryBarrier();                                                            // acquire: pairs with publishing CAS in DeviceFPGA_Async2_TagPublish()
     pMEM = pTag->pMEM;
     // 4K COMPLETION:
-    if(pTag->tp == FPGA_NEWASYNC2_TAG_TYPE_4K) {
+    if(tp == FPGA_NEWASYNC2_TAG_TYPE_4K) {
         // Cpl: -> free MEM and tag
         if(hdr->TypeFmt == TLP_Cpl) {
-            pTag->pMemContext->cMemCpl++;
+            InterlockedIncrement(&pTag->pMemContext->cMemCpl);
             goto free_tag;
         }
         // CplD:
@@ -2393,17 +3162,17 @@ VOID DeviceFPGA_Async2_Read_RxTlpSingle_MRdCpl(_In_ PLC_CONTEXT ctxLC, _In_ PDEV
         memcpy(pMEM->pb + o, pb + 12, c);
         MEM_SCATTER_STACK_ADD(pMEM, 1, c);
         if(pMEM->cb == MEM_SCATTER_STACK_PEEK(pMEM, 1)) {
-            pTag->pMemContext->cMemCpl++;
+            InterlockedIncrement(&pTag->pMemContext->cMemCpl);
             goto free_tag;
         }
         return;
     }
     // TINY COMPLETION:
-    if(pTag->tp == FPGA_NEWASYNC2_TAG_TYPE_TINY) {
+    if(tp == FPGA_NEWASYNC2_TAG_TYPE_TINY) {
         if(hdr->TypeFmt == TLP_Cpl) {
             MEM_SCATTER_STACK_ADD(pMEM, 1, 0x10000ULL + pTag->cbTag);
             if(pMEM->cb == (MEM_SCATTER_STACK_PEEK(pMEM, 1) & 0x1fff)) {
-                pTag->pMemContext->cMemCpl++;
+                InterlockedIncrement(&pTag->pMemContext->cMemCpl);
             }
             goto free_tag;
         }
@@ -2429,7 +3198,7 @@ VOID DeviceFPGA_Async2_Read_RxTlpSingle_MRdCpl(_In_ PLC_CONTEXT ctxLC, _In_ PDEV
         memcpy(pMEM->pb + o, pb + 12 + cbAdjust, c);
         MEM_SCATTER_STACK_ADD(pMEM, 1, c);
         if(pMEM->cb == (MEM_SCATTER_STACK_PEEK(pMEM, 1) & 0x1fff)) {
-            pTag->pMemContext->cMemCpl++;
+            InterlockedIncrement(&pTag->pMemContext->cMemCpl);
         }
         pTag->cbTag -= c;
         if(!pTag->cbTag) {
@@ -2439,16 +3208,7 @@ VOID DeviceFPGA_Async2_Read_RxTlpSingle_MRdCpl(_In_ PLC_CONTEXT ctxLC, _In_ PDEV
     }
     return;
 free_tag:
-    ctx->async2.cAvailTags++;
-    if(pTag->tp == FPGA_NEWASYNC2_TAG_TYPE_4K) {
-        ctx->async2.cbAvailCredits += 0x1000;
-    }
-    if(pTag->tp == FPGA_NEWASYNC2_TAG_TYPE_TINY) {
-        ctx->async2.cbAvailCredits += 0x80;
-    }
-    pTag->tp = FPGA_NEWASYNC2_TAG_TYPE_NONE;
-    pTag->pMemContext = NULL;
-    pTag->pMEM = NULL;
+    DeviceFPGA_Async2_TagFree(ctx, pTag);
 }
 
 /*
@@ -2464,7 +3224,7 @@ DWORD DeviceFPGA_Async2_Read_RxTlpSingle(_In_ PLC_CONTEXT ctxLC, _In_ PDEVICE_CO
 {
     BYTE pbTlp[TLP_RX_MAX_SIZE];
     PDWORD pdwTlp = (PDWORD)pbTlp;
-    DWORD i = 0, j, dwStatus, cdwTlp = 0, iStartWord;
+    DWORD i = 0, j, dwStatus, dwFrameTlp, dwFrameLast, dwMask, cdwTlp = 0, iStartWord;
     // skip over initial ftdi workaround dummy fillers / non valid octa-dwords
     while((i < cdwData) && ((pdwData[i] & 0xf0000000) != 0xe0000000)) {
         i++;
@@ -2482,6 +3242,32 @@ DWORD DeviceFPGA_Async2_Read_RxTlpSingle(_In_ PLC_CONTEXT ctxLC, _In_ PDEVICE_CO
         if((dwStatus & 0xf0000000) != 0xe0000000) {
             continue;
         }
+        // decode whole frame at once into per-nibble status bits (bit0 of
+        // each nibble): dwFrameTlp = tlp dword, dwFrameLast = tlp last dword.
+        dwFrameTlp = ~(dwStatus | (dwStatus >> 1)) & 0x01111111;
+        dwFrameLast = dwFrameTlp & (dwStatus >> 2);
+        if(!dwFrameTlp) {
+            i += 7;
+            continue;
+        }
+        // fast path: seven tlp dwords without tlp end -> copy frame as block:
+        if((dwFrameTlp == 0x01111111) && !dwFrameLast && (cdwTlp + 7 <= TLP_RX_MAX_SIZE_IN_DWORDS)) {
+            memcpy(pdwTlp + cdwTlp, pdwData + i, 7 * sizeof(DWORD));
+            cdwTlp += 7;
+            i += 7;
+            continue;
+        }
+        // fast path: tlp dwords up to and including the tlp end -> copy as block:
+        if(dwFrameLast) {
+            for(j = 0; !(dwFrameLast & (1 << (j << 2))); j++);
+            dwMask = 0x01111111 >> ((6 - j) << 2);
+            if(((dwFrameTlp & dwMask) == dwMask) && (cdwTlp + j + 1 <= TLP_RX_MAX_SIZE_IN_DWORDS)) {
+                memcpy(pdwTlp + cdwTlp, pdwData + i, ((SIZE_T)j + 1) * sizeof(DWORD));
+                cdwTlp += j + 1;
+                goto tlp_last;
+            }
+        }
+        // slow path: mixed frame -> process dword by dword:
         for(j = 0; j < 7; j++, i++) {
             if((dwStatus & 0x03) == 0x00) { // PCIe TLP
                 if(cdwTlp >= TLP_RX_MAX_SIZE / sizeof(DWORD)) {
@@ -2492,25 +3278,27 @@ DWORD DeviceFPGA_Async2_Read_RxTlpSingle(_In_ PLC_CONTEXT ctxLC, _In_ PDEVICE_CO
                 pdwTlp[cdwTlp++] = pdwData[i];
             }
             if((dwStatus & 0x07) == 0x04) { // PCIe TLP and LAST
-                if((cdwTlp < 3) || (cdwTlp > TLP_RX_MAX_SIZE_IN_DWORDS)) {
-                    printf("Device Info: FPGA: Bad PCIe TLP received! Should not happen!\n");
-                    pdwData[iStartWord] = pdwData[iStartWord] | (0xffffffff >> (28 - (j << 2)));
-                    return iStartWord | 0x80000000;
-                }
-                if(ctxLC->fPrintf[LC_PRINTF_VVV]) {
-                    TLP_Print(ctxLC, pbTlp, cdwTlp << 2, FALSE);
-                }
-                if(ctx->tlp_callback.pBqRx) {
-                    ObByteQueue_Push(ctx->tlp_callback.pBqRx, 0, (SIZE_T)cdwTlp << 2, pbTlp);
-                }
-                DeviceFPGA_Async2_Read_RxTlpSingle_MRdCpl(ctxLC, ctx, pbTlp, cdwTlp << 2);
-                pdwData[iStartWord] = pdwData[iStartWord] | (0xffffffff >> (28 - (j << 2)));
-                return iStartWord | 0x80000000;
+                goto tlp_last;
             }
             dwStatus >>= 4;
         }
     }
     return 0;
+tlp_last:
+    if((cdwTlp < 3) || (cdwTlp > TLP_RX_MAX_SIZE_IN_DWORDS)) {
+        printf("Device Info: FPGA: Bad PCIe TLP received! Should not happen!\n");
+        pdwData[iStartWord] = pdwData[iStartWord] | (0xffffffff >> (28 - (j << 2)));
+        return iStartWord | 0x80000000;
+    }
+    if(ctxLC->fPrintf[LC_PRINTF_VVV]) {
+        TLP_Print(ctxLC, pbTlp, cdwTlp << 2, FALSE);
+    }
+    if(ctx->tlp_callback.pBqRx) {
+        ObByteQueue_Push(ctx->tlp_callback.pBqRx, 0, (SIZE_T)cdwTlp << 2, pbTlp);
+    }
+    DeviceFPGA_Async2_Read_RxTlpSingle_MRdCpl(ctxLC, ctx, pbTlp, cdwTlp << 2);
+    pdwData[iStartWord] = pdwData[iStartWord] | (0xffffffff >> (28 - (j << 2)));
+    return iStartWord | 0x80000000;
 }
 
 /*
@@ -2535,21 +3323,6 @@ BOOL DeviceFPGA_Async2_Read_RxTlpFromBuffer(_In_ PLC_CONTEXT ctxLC, _In_ PDEVICE
 */
 VOID DeviceFPGA_WriteScatter(_In_ PLC_CONTEXT ctxLC, _In_ DWORD cpMEMs, _Inout_ PPMEM_SCATTER ppMEMs);
 
-inline BYTE DeviceFPGA_Async2_Read_TxTlp_NextTag(_In_ PDEVICE_CONTEXT_FPGA ctx)
-{
-    BYTE iTag = ctx->async2.iTag;
-    while(TRUE) {
-        iTag++;
-        if(iTag == 0xEF) {
-            iTag = 0;
-        }
-        if(ctx->async2.Tags[iTag].tp == FPGA_NEWASYNC2_TAG_TYPE_NONE) {
-            ctx->async2.iTag = iTag;
-            return iTag;
-        }
-    }
-}
-
 VOID DeviceFPGA_Async2_Read_TxTlpSingle_MrdTlp(_In_ PLC_CONTEXT ctxLC, _In_ PDEVICE_CONTEXT_FPGA ctx, _In_ WORD wTlpDwLength, _In_ BYTE iTag, _In_ QWORD qwA)
 {
     BOOL f32 = (qwA < 0x100000000);
@@ -2581,6 +3354,35 @@ VOID DeviceFPGA_Async2_Read_TxTlpSingle_MrdTlp(_In_ PLC_CONTEXT ctxLC, _In_ PDEV
     DeviceFPGA_TxTlp(ctxLC, ctx, (PBYTE)tx, f32 ? 12 : 16, FALSE, FALSE);
 }
 
+/*
+* Retrieve the number of tags and byte credits required to read a MEM.
+* -- ctx
+* -- pMEM
+* -- pf4K = TRUE if the MEM is read with a single 4K MRd TLP.
+* -- pcbCredit
+* -- return = number of tags, 0 on invalid MEM.
+*/
+DWORD DeviceFPGA_Async2_Read_TxTlp_TagCount(_In_ PDEVICE_CONTEXT_FPGA ctx, _In_ PMEM_SCATTER pMEM, _Out_ PBOOL pf4K, _Out_ PDWORD pcbCredit)
+{
+    DWORD cb1, cTag;
+    *pf4K = (pMEM->cb == 0x1000) && !ctx->fAlgorithmReadTiny && !(pMEM->qwA & 0xfff);
+    *pcbCredit = 0x1000;
+    if(*pf4K) { return 1; }
+    if(!pMEM->cb) { return 0; }                                             // bad size
+    if((pMEM->qwA & 0xfff) + pMEM->cb > 0x1000) { return 0; }              // page traverse
+    cb1 = min(pMEM->cb, 0x80 - (DWORD)(pMEM->qwA & 0x7f));
+    cTag = 1 + ((pMEM->cb - cb1 + 0x7f) >> 7);
+    *pcbCredit = cTag << 7;
+    return cTag;
+}
+
+/*
+* Transmit the MRd TLPs of a single MEM. Tags and credits for the MEM must
+* already have been reserved by the caller.
+* -- ctxLC
+* -- ctx
+* -- pTX
+*/
 VOID DeviceFPGA_Async2_Read_TxTlpSingle(_In_ PLC_CONTEXT ctxLC, _In_ PDEVICE_CONTEXT_FPGA ctx, _In_ PFPGA_NEWASYNC2_MEM_CONTEXT pTX)
 {
     BYTE iTag;
@@ -2589,20 +3391,15 @@ VOID DeviceFPGA_Async2_Read_TxTlpSingle(_In_ PLC_CONTEXT ctxLC, _In_ PDEVICE_CON
     PMEM_SCATTER pMEM = pTX->ppMEMs[pTX->iMem];
     // 4K READ:
     if((pMEM->cb == 0x1000) && !ctx->fAlgorithmReadTiny && !(pMEM->qwA & 0xfff)) {
-        iTag = DeviceFPGA_Async2_Read_TxTlp_NextTag(ctx);
+        iTag = DeviceFPGA_Async2_TagClaim(ctx);
         pTag = &ctx->async2.Tags[iTag];
-        pTag->tp = FPGA_NEWASYNC2_TAG_TYPE_4K;
         pTag->pMemContext = pTX;
         pTag->pMEM = pMEM;
         pTag->oMEM = 0;
-        ctx->async2.cbAvailCredits -= 0x1000;
-        ctx->async2.cAvailTags--;
+        DeviceFPGA_Async2_TagPublish(ctx, iTag, FPGA_NEWASYNC2_TAG_TYPE_4K);
         DeviceFPGA_Async2_Read_TxTlpSingle_MrdTlp(ctxLC, ctx, 0, iTag, pMEM->qwA);
         return;
     }
-    // TINY READ: VALIDITY CHECKS:
-    if(!pMEM->cb) { goto fail; }                                            // bad size
-    if((pMEM->qwA & 0xfff) + pMEM->cb > 0x1000) { goto fail; }              // page traverse
     // TINY READ LOOP:
     o = 0;
     while(o < pMEM->cb) {
@@ -2613,30 +3410,38 @@ VOID DeviceFPGA_Async2_Read_TxTlpSingle(_In_ PLC_CONTEXT ctxLC, _In_ PDEVICE_CON
             cb = min(0x80, pMEM->cb - o);
             cdw = cb >> 2;
         }
-        iTag = DeviceFPGA_Async2_Read_TxTlp_NextTag(ctx);
+        iTag = DeviceFPGA_Async2_TagClaim(ctx);
         pTag = &ctx->async2.Tags[iTag];
-        pTag->tp = FPGA_NEWASYNC2_TAG_TYPE_TINY;
         pTag->pMemContext = pTX;
         pTag->pMEM = pMEM;
         pTag->oMEM = (WORD)o;
         pTag->cbTag = (WORD)cb;
-        ctx->async2.cbAvailCredits -= 0x80;
-        ctx->async2.cAvailTags--;
+        DeviceFPGA_Async2_TagPublish(ctx, iTag, FPGA_NEWASYNC2_TAG_TYPE_TINY);
         DeviceFPGA_Async2_Read_TxTlpSingle_MrdTlp(ctxLC, ctx, (WORD)cdw, iTag, pMEM->qwA + o);
         o += cb;
     }
-    return;
-fail:
-    pTX->cMemCpl++;
 }
 
+/*
+* Transmit MRd TLPs for a MEM context. This may be called by the RX
+* demultiplexer thread (holding the device lock) as well as by submitting
+* threads for their own MEM context. TLPs are only transmitted while the RX
+* demultiplexer is active since it's the only thread receiving completions.
+* -- ctxLC
+* -- ctx
+* -- pTX = MEM context to transmit, NULL to fetch from queue.
+* -- fPrimary = TRUE if the MEM context belongs to the RX demultiplexer.
+* -- return = the MEM context if not all TLPs could be transmitted, NULL otherwise.
+*/
 PFPGA_NEWASYNC2_MEM_CONTEXT DeviceFPGA_Async2_Read_TxTlp(_In_ PLC_CONTEXT ctxLC, _In_ PDEVICE_CONTEXT_FPGA ctx, _In_ PFPGA_NEWASYNC2_MEM_CONTEXT pTX, _In_ BOOL fPrimary)
 {
-    DWORD i = 0;
-    BOOL fTX = FALSE;
+    DWORD i = 0, cTag, cbCredit;
+    BOOL fTX = FALSE, f4K, fReserved;
     PMEM_SCATTER pMEM;
     SIZE_T cbTlpRaw;
     BYTE pbTlpRaw[TLP_RX_MAX_SIZE];
+    EnterCriticalSection(&ctx->async2.LockTx);
+    if(!ctx->async2.fRxActive) { goto finish; }
     // TX queued RAW TLPs (if any) from other threads and flush:
     if(ObByteQueue_Size(ctx->tlp_callback.pBqTx)) {
         while(ObByteQueue_Pop(ctx->tlp_callback.pBqTx, NULL, sizeof(pbTlpRaw), pbTlpRaw, &cbTlpRaw)) {
@@ -2650,35 +3455,31 @@ PFPGA_NEWASYNC2_MEM_CONTEXT DeviceFPGA_Async2_Read_TxTlp(_In_ PLC_CONTEXT ctxLC,
             if(pTX->iMem < pTX->cMEM) { break; }
             i++;
         }
-        if(!pTX) { return NULL; }
+        if(!pTX) { goto finish; }
         if(pTX->fWrite) {
             // WriteTX: Dequeue and transmit:
             ObMap_Remove(ctx->async2.pmQueue, pTX);
             DeviceFPGA_WriteScatter(ctxLC, pTX->cMEM, pTX->ppMEMs);
-            return NULL;
+            pTX = NULL;
+            goto finish;
         }
     }
     // TX TLPs per MEM:
     while(pTX->iMem < pTX->cMEM) {
         // Skip already completed/invalid MEMs:
         pMEM = pTX->ppMEMs[pTX->iMem];
-        if(pMEM->f || MEM_SCATTER_ADDR_ISINVALID(pMEM)) {
-            pTX->cMemCpl++;
+        if(pMEM->f || MEM_SCATTER_ADDR_ISINVALID(pMEM) || !(cTag = DeviceFPGA_Async2_Read_TxTlp_TagCount(ctx, pMEM, &f4K, &cbCredit))) {
+            InterlockedIncrement(&pTX->cMemCpl);
             pTX->iMem++;
             continue;
         }
         // Ensure enough tags and byte credits are available:
         if(fPrimary) {
-            if(ctx->async2.cbAvailCredits < 0x1000) { break; }
-            if(ctx->fAlgorithmReadTiny || (pMEM->cb != 0x1000)) {
-                if(ctx->async2.cAvailTags < 32) { break; }
-            } else {
-                if(ctx->async2.cAvailTags == 0) { break; }
-            }
+            fReserved = DeviceFPGA_Async2_TagReserve(ctx, cTag, cbCredit, f4K ? 1 : 32, 0x1000);
         } else {
-            if(ctx->async2.cbAvailCredits < 0x2000) { break; }
-            if(ctx->async2.cAvailTags < 64) { break; }
+            fReserved = DeviceFPGA_Async2_TagReserve(ctx, cTag, cbCredit, 64, 0x2000);
         }
+        if(!fReserved) { break; }
         // TX single TLP:
         DeviceFPGA_Async2_Read_TxTlpSingle(ctxLC, ctx, pTX);
         pTX->iMem++;
@@ -2688,12 +3489,26 @@ PFPGA_NEWASYNC2_MEM_CONTEXT DeviceFPGA_Async2_Read_TxTlp(_In_ PLC_CONTEXT ctxLC,
         // Flush TLPs to FPGA device:
         DeviceFPGA_TxTlp(ctxLC, ctx, NULL, 0, TRUE, TRUE);
     }
-    if(pTX->iMem < pTX->cMEM) {
-        return pTX;
+    if(pTX->iMem >= pTX->cMEM) {
+        // All MEMs transmitted -> remove from queue.
+        ObMap_Remove(ctx->async2.pmQueue, pTX);
+        pTX = NULL;
     }
-    // All MEMs completed -> remove from queue and return.
-    ObMap_Remove(ctx->async2.pmQueue, pTX);
-    return NULL;
+finish:
+    LeaveCriticalSection(&ctx->async2.LockTx);
+    return pTX;
+}
+
+/*
+* Set the RX demultiplexer active state. Only called by the device lock holder.
+* -- ctx
+* -- fRxActive
+*/
+VOID DeviceFPGA_Async2_RxActive(_In_ PDEVICE_CONTEXT_FPGA ctx, _In_ BOOL fRxActive)
+{
+    EnterCriticalSection(&ctx->async2.LockTx);
+    ctx->async2.fRxActive = fRxActive;
+    LeaveCriticalSection(&ctx->async2.LockTx);
 }
 
 VOID DeviceFPGA_Async2_ReadScatter_DoWork(_In_ PLC_CONTEXT ctxLC, _In_ PDEVICE_CONTEXT_FPGA ctx, _In_ PFPGA_NEWASYNC2_MEM_CONTEXT pMemCtxPrimary)
@@ -2708,6 +3523,7 @@ VOID DeviceFPGA_Async2_ReadScatter_DoWork(_In_ PLC_CONTEXT ctxLC, _In_ PDEVICE_C
     // RX INITIAL / (LATENCY OPTIMIZED FOR SMALLER READS):
     usleep(ctx->perf.ASYNC_DELAY_1);
     cbReadInitialMax = min(cbMAX_READSIZE, pMemCtxPrimary->cMEM * 0x1800);
+    DeviceFPGA_RxBuf_Realign(ctx, cbMAX_READSIZE);
     status = ctx->dev.pfnFT_ReadPipe(ctx->dev.hFTDI, 0x82, ctx->rxbuf.pb + ctx->rxbuf.cb, cbReadInitialMax, &cbRead, NULL);
     if(status && (status != FT_IO_PENDING)) {
         return;
@@ -2716,11 +3532,11 @@ VOID DeviceFPGA_Async2_ReadScatter_DoWork(_In_ PLC_CONTEXT ctxLC, _In_ PDEVICE_C
     DeviceFPGA_Async2_Read_RxTlpFromBuffer(ctxLC, ctx);
     // MAIN READ LOOP:
     while(TRUE) {
-        // REALIGN 16MB BUFFER IF REQUIRED:
-        if(ctx->rxbuf.cb + cbMAX_READSIZE > ctx->rxbuf.cbMax) {
-            memcpy(ctx->rxbuf.pb, ctx->rxbuf.pb + ctx->rxbuf.o, ctx->rxbuf.cb - ctx->rxbuf.o);
-            ctx->rxbuf.cb -= ctx->rxbuf.o;
-            ctx->rxbuf.o = 0;
+        // WRAP RING BUFFER / REALIGN 16MB BUFFER IF REQUIRED:
+        DeviceFPGA_RxBuf_Realign(ctx, cbMAX_READSIZE);
+        // WITHDRAW RETURNED CREDITS OWED AFTER A MAX_SIZE_RX DECREASE:
+        if(ctx->async2.cbCreditDeficit) {
+            DeviceFPGA_Async2_CreditSettle(ctx);
         }
         // EXIT CRITERIA: PRIMARY READ&PROCESSING COMPLETED:
         if(pMemCtxPrimary->cMEM == pMemCtxPrimary->cMemCpl) {
@@ -2760,16 +3576,7 @@ fail_timeout:
     for(i = 0; i < 0x100; i++) {
         pTag = ctx->async2.Tags + i;
         if(pTag->pMemContext == pMemCtxPrimary) {
-            if(pTag->tp == FPGA_NEWASYNC2_TAG_TYPE_4K) {
-                ctx->async2.cbAvailCredits += 0x1000;
-            } else if(pTag->tp == FPGA_NEWASYNC2_TAG_TYPE_TINY) {
-                ctx->async2.cbAvailCredits += 0x80;
-            }
-            ctx->async2.cAvailTags++;
-            pTag->tp = FPGA_NEWASYNC2_TAG_TYPE_NONE;
-            pTag->oMEM = 0;
-            pTag->pMEM = NULL;
-            pTag->pMemContext = NULL;
+            DeviceFPGA_Async2_TagFree(ctx, pTag);
         }
     }
     return;
@@ -2786,6 +3593,7 @@ VOID DeviceFPGA_Async2_ReadOnlyFast_DoWork(_In_ PLC_CONTEXT ctxLC, _In_ PDEVICE_
     BOOL fAsync = !ctx->dev.f2232h;
     DWORD status, cbRead = 0;
     // RX INITIAL / (LATENCY OPTIMIZED FOR SMALLER READS):
+    DeviceFPGA_RxBuf_Realign(ctx, ctx->perf.ASYNC_MAX_READSIZE);
     status = ctx->dev.pfnFT_ReadPipe(ctx->dev.hFTDI, 0x82, ctx->rxbuf.pb + ctx->rxbuf.cb, ctx->perf.ASYNC_MAX_READSIZE, &cbRead, NULL);
     if(status && (status != FT_IO_PENDING)) {
         return;
@@ -2796,12 +3604,8 @@ VOID DeviceFPGA_Async2_ReadOnlyFast_DoWork(_In_ PLC_CONTEXT ctxLC, _In_ PDEVICE_
     }
     // MAIN READ LOOP:
     while(TRUE) {
-        // REALIGN 16MB BUFFER IF REQUIRED:
-        if(ctx->rxbuf.cb + ctx->perf.ASYNC_MAX_READSIZE > ctx->rxbuf.cbMax) {
-            memcpy(ctx->rxbuf.pb, ctx->rxbuf.pb + ctx->rxbuf.o, ctx->rxbuf.cb - ctx->rxbuf.o);
-            ctx->rxbuf.cb -= ctx->rxbuf.o;
-            ctx->rxbuf.o = 0;
-        }
+        // WRAP RING BUFFER / REALIGN 16MB BUFFER IF REQUIRED:
+        DeviceFPGA_RxBuf_Realign(ctx, ctx->perf.ASYNC_MAX_READSIZE);
         // SLEEP(EXIT) ON EMPTY OVERLAPPED READ:
         if((cbRead == 0) || (cbRead == 0x14)) {
             return;
@@ -2845,16 +3649,22 @@ VOID DeviceFPGA_Async2_ReadScatter(_In_ PLC_CONTEXT ctxLC, _In_ DWORD cMEMs, _In
     MemCtx.ppMEMs = ppMEMs;
     // 2: Dispatch to worker function (behind lock):
     if(TryEnterCriticalSection(&ctx->Lock)) {
-        // lock aquired without blocking -> do work without queuing:
+        // lock aquired without blocking -> become rx demultiplexer and do work without queuing:
+        DeviceFPGA_Async2_RxActive(ctx, TRUE);
         DeviceFPGA_Async2_ReadScatter_DoWork(ctxLC, ctx, &MemCtx);
+        DeviceFPGA_Async2_RxActive(ctx, FALSE);
         LeaveCriticalSection(&ctx->Lock);
     } else {
-        // lock not aquired -> queue work:
+        // lock not aquired -> queue work and transmit own TLPs while the
+        // active rx demultiplexer completes them by tag:
         ObMap_Push(ctx->async2.pmQueue, 0, &MemCtx);
+        DeviceFPGA_Async2_Read_TxTlp(ctxLC, ctx, &MemCtx, FALSE);
         EnterCriticalSection(&ctx->Lock);
         ObMap_Remove(ctx->async2.pmQueue, &MemCtx);
         if(MemCtx.cMemCpl < MemCtx.cMEM) {
+            DeviceFPGA_Async2_RxActive(ctx, TRUE);
             DeviceFPGA_Async2_ReadScatter_DoWork(ctxLC, ctx, &MemCtx);
+            DeviceFPGA_Async2_RxActive(ctx, FALSE);
         }
         LeaveCriticalSection(&ctx->Lock);
     }
@@ -3185,6 +3995,382 @@ BOOL DeviceFPGA_WriteTlp(_In_ PLC_CONTEXT ctxLC, _In_ PBYTE pbTlp, _In_ DWORD cb
     return DeviceFPGA_TxTlp(ctxLC, ctx, pbTlp, cbTlp, FALSE, TRUE);
 }
 
+
+//-------------------------------------------------------------------------------
+// FPGA performance profile autotune functionality below:
+//-------------------------------------------------------------------------------
+
+#define FPGA_AUTOTUNE_PA_DEFAULT            0x01000000
+#define FPGA_AUTOTUNE_PAGES_DEFAULT         0x1000
+#define FPGA_AUTOTUNE_PAGES_MAX             0x10000
+#define FPGA_AUTOTUNE_BATCH                 0x400
+#define FPGA_AUTOTUNE_LATENCY_ROUNDS        0x20
+#define FPGA_AUTOTUNE_FILE                  "leechcore_fpga_autotune.txt"
+#define FPGA_AUTOTUNE_FILE_MAX              0x00100000
+#define FPGA_AUTOTUNE_FILE_FIELDS           13
+#define FPGA_AUTOTUNE_FILE_HEADER           "# fpga_id device_id pcie_gen pcie_width max_size_rx max_size_tx delay_read delay_write retry_on_error f_tiny async_max_readsize async_delay_1 async_delay_2 (hex)\n"
+
+#define FPGA_AUTOTUNE_MODE_ALL              0
+#define FPGA_AUTOTUNE_MODE_SYNC             1
+#define FPGA_AUTOTUNE_MODE_ASYNC            2
+
+typedef struct tdFPGA_AUTOTUNE_PARAM {
+    LPSTR szName;
+    DWORD oField;           // DWORD field offset in DEVICE_PERFORMANCE
+    DWORD tpMode;           // FPGA_AUTOTUNE_MODE_*
+    BOOL fRelative;         // values in percent of the value before tuning the parameter
+    DWORD dwAlign;
+    DWORD dwMin;
+    DWORD dwMax;            // 0 = limited by tx buffer size
+    DWORD cValues;
+    DWORD dwValues[5];
+} FPGA_AUTOTUNE_PARAM, *PFPGA_AUTOTUNE_PARAM;
+
+static const FPGA_AUTOTUNE_PARAM FPGA_AUTOTUNE_PARAMS[] = {
+    { "MAX_SIZE_RX",        offsetof(DEVICE_PERFORMANCE, MAX_SIZE_RX),        FPGA_AUTOTUNE_MODE_ALL,   TRUE,  0x1000, 0x4000, FPGA_RXBUF_CB_RX_TUNE_MAX, 4, { 50, 75, 125, 150 } },
+    { "MAX_SIZE_TX",        offsetof(DEVICE_PERFORMANCE, MAX_SIZE_TX),        FPGA_AUTOTUNE_MODE_ALL,   TRUE,  0x10,   0x200,  0,       3, { 25, 50, 75 } },
+    { "DELAY_READ",         offsetof(DEVICE_PERFORMANCE, DELAY_READ),         FPGA_AUTOTUNE_MODE_SYNC,  TRUE,  1,      0,      2000,    4, { 0, 50, 75, 150 } },
+    { "DELAY_WRITE",        offsetof(DEVICE_PERFORMANCE, DELAY_WRITE),        FPGA_AUTOTUNE_MODE_ALL,   TRUE,  1,      0,      1000,    3, { 0, 50, 150 } },
+    { "ASYNC_MAX_READSIZE", offsetof(DEVICE_PERFORMANCE, ASYNC_MAX_READSIZE), FPGA_AUTOTUNE_MODE_ASYNC, FALSE, 0x1000, 0x4000, FPGA_RXBUF_CB_READ_TUNE_MAX, 5, { 0x4000, 0x8000, 0x10000, 0x20000, 0x40000 } },
+    { "ASYNC_DELAY_1",      offsetof(DEVICE_PERFORMANCE, ASYNC_DELAY_1),      FPGA_AUTOTUNE_MODE_ASYNC, FALSE, 1,      0,      1000,    4, { 0, 5, 25, 100 } },
+    { "ASYNC_DELAY_2",      offsetof(DEVICE_PERFORMANCE, ASYNC_DELAY_2),      FPGA_AUTOTUNE_MODE_ASYNC, FALSE, 1,      0,      1000,    4, { 0, 5, 25, 100 } },
+    { "RETRY_ON_ERROR",     offsetof(DEVICE_PERFORMANCE, RETRY_ON_ERROR),     FPGA_AUTOTUNE_MODE_ALL,   FALSE, 1,      0,      1,       2, { 0, 1 } },
+    { "F_TINY",             offsetof(DEVICE_PERFORMANCE, F_TINY),             FPGA_AUTOTUNE_MODE_ALL,   FALSE, 1,      0,      1,       2, { 0, 1 } },
+};
+
+typedef struct tdFPGA_AUTOTUNE_RESULT {
+    QWORD cbps;             // throughput (bytes/s) of pages readable by the initial profile
+    DWORD cFail;            // failed reads of pages readable by the initial profile
+    DWORD dwLatencyUs;      // average single page read latency
+} FPGA_AUTOTUNE_RESULT, *PFPGA_AUTOTUNE_RESULT;
+
+#define FPGA_AUTOTUNE_PERF_FIELD(pPerf, oField)     (*(PDWORD)((PBYTE)(pPerf) + (oField)))
+
+/*
+* Apply a performance profile. The device lock must be held. Other threads may
+* still have async2 reads in flight holding rx credits, the credits are thus
+* adjusted to the new MAX_SIZE_RX by DeviceFPGA_Async2_CreditAdjust().
+* -- ctx
+* -- pPerf
+*/
+VOID DeviceFPGA_AutoTune_Apply(_In_ PDEVICE_CONTEXT_FPGA ctx, _In_ PDEVICE_PERFORMANCE pPerf)
+{
+    DWORD cbRxOld = ctx->perf.MAX_SIZE_RX;
+    memcpy(&ctx->perf, pPerf, sizeof(DEVICE_PERFORMANCE));
+    ctx->fAlgorithmReadTiny = ctx->perf.F_TINY ? TRUE : FALSE;
+    if(ctx->async2.fEnabled) {
+        DeviceFPGA_Async2_CreditAdjust(ctx, cbRxOld, ctx->perf.MAX_SIZE_RX);
+        ctx->perf.ASYNC_MAX_READSIZE = min(ctx->perf.ASYNC_MAX_READSIZE, ((ctx->rxbuf.cbAlloc - 0x10000) / 2) & ~0xfff);
+    } else if(!ctx->dev.f2232h) {
+        ctx->rxbuf.cbMax = min(ctx->rxbuf.cbAlloc, FPGA_RXBUF_CB_SYNC(ctx->perf.MAX_SIZE_RX));
+    }
+}
+
+/*
+* Measure the current performance profile by reading the test range once in
+* batches, followed by a number of single page reads for latency.
+* -- ctxLC
+* -- pa = test range base address.
+* -- cPages = test range size in pages.
+* -- ppMEMs = FPGA_AUTOTUNE_BATCH MEMs.
+* -- pbMap = per page readable map, written if fBaseline.
+* -- fBaseline
+* -- pResult
+*/
+VOID DeviceFPGA_AutoTune_Measure(_In_ PLC_CONTEXT ctxLC, _In_ QWORD pa, _In_ DWORD cPages, _In_ PPMEM_SCATTER ppMEMs, _Inout_updates_bytes_(cPages) PBYTE pbMap, _In_ BOOL fBaseline, _Out_ PFPGA_AUTOTUNE_RESULT pResult)
+{
+    DWORD i, j, c, cGood = 0;
+    QWORD qwFreq, qwStart, qwStop;
+    ZeroMemory(pResult, sizeof(FPGA_AUTOTUNE_RESULT));
+    QueryPerformanceFrequency((PLARGE_INTEGER)&qwFreq);
+    // throughput & completion errors:
+    QueryPerformanceCounter((PLARGE_INTEGER)&qwStart);
+    for(i = 0; i < cPages; i += c) {
+        c = min(FPGA_AUTOTUNE_BATCH, cPages - i);
+        for(j = 0; j < c; j++) {
+            ppMEMs[j]->f = FALSE;
+            ppMEMs[j]->qwA = pa + ((QWORD)(i + j) << 12);
+        }
+        DeviceFPGA_ReadScatter_DoLock(ctxLC, c, ppMEMs);
+        for(j = 0; j < c; j++) {
+            if(fBaseline) { pbMap[i + j] = ppMEMs[j]->f ? 1 : 0; }
+            if(!pbMap[i + j]) { continue; }
+            if(ppMEMs[j]->f) {
+                cGood++;
+            } else {
+                pResult->cFail++;
+            }
+        }
+    }
+    QueryPerformanceCounter((PLARGE_INTEGER)&qwStop);
+    pResult->cbps = ((QWORD)cGood << 12) * qwFreq / max(1, qwStop - qwStart);
+    // single page latency:
+    QueryPerformanceCounter((PLARGE_INTEGER)&qwStart);
+    for(i = 0; i < FPGA_AUTOTUNE_LATENCY_ROUNDS; i++) {
+        ppMEMs[0]->f = FALSE;
+        ppMEMs[0]->qwA = pa + ((QWORD)(i % cPages) << 12);
+        DeviceFPGA_ReadScatter_DoLock(ctxLC, 1, ppMEMs);
+    }
+    QueryPerformanceCounter((PLARGE_INTEGER)&qwStop);
+    pResult->dwLatencyUs = (DWORD)((qwStop - qwStart) * 1000000 / max(1, qwFreq * FPGA_AUTOTUNE_LATENCY_ROUNDS));
+}
+
+/*
+* Compare a candidate profile result with the best result so far. Failed reads
+* are never traded for throughput; a small throughput loss is accepted for
+* fewer failed reads or a clearly lower latency. A small margin is required
+* for throughput gains to avoid chasing measurement noise.
+* -- pCandidate
+* -- pBest
+* -- return
+*/
+BOOL DeviceFPGA_AutoTune_IsBetter(_In_ PFPGA_AUTOTUNE_RESULT pCandidate, _In_ PFPGA_AUTOTUNE_RESULT pBest)
+{
+    if(pCandidate->cFail > pBest->cFail) { return FALSE; }
+    if(pCandidate->cFail < pBest->cFail) { return pCandidate->cbps * 10 >= pBest->cbps * 9; }
+    if(pCandidate->cbps * 100 > pBest->cbps * 103) { return TRUE; }
+    return (pCandidate->cbps * 100 >= pBest->cbps * 98) && (pCandidate->dwLatencyUs * 10 < pBest->dwLatencyUs * 8);
+}
+
+/*
+* Parse a profile store line: FPGA_AUTOTUNE_FILE_FIELDS hex numbers.
+* -- sz
+* -- pdw
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFPGA_AutoTune_ParseLine(_In_ LPSTR sz, _Out_writes_(FPGA_AUTOTUNE_FILE_FIELDS) PDWORD pdw)
+{
+    DWORD i;
+    LPSTR szEnd;
+    if(sz[0] == '#') { return FALSE; }
+    for(i = 0; i < FPGA_AUTOTUNE_FILE_FIELDS; i++) {
+        pdw[i] = strtoul(sz, &szEnd, 16);
+        if(szEnd == sz) { return FALSE; }
+        sz = szEnd;
+    }
+    return TRUE;
+}
+
+/*
+* Check whether a parsed profile store line belongs to the current device; the
+* key is FPGA ID, device ID and PCIe link gen/width.
+*/
+BOOL DeviceFPGA_AutoTune_IsKey(_In_ PDEVICE_CONTEXT_FPGA ctx, _In_reads_(FPGA_AUTOTUNE_FILE_FIELDS) PDWORD pdw)
+{
+    return
+        (pdw[0] == ctx->wFpgaID) &&
+        (pdw[1] == ctx->wDeviceId) &&
+        (pdw[2] == DeviceFPGA_PHY_GetPCIeGen(ctx)) &&
+        (pdw[3] == DeviceFPGA_PHY_GetLinkWidth(ctx));
+}
+
+/*
+* Load the persisted profile of the current device from the profile store into
+* ctx->perf. Must be called before the rx/tx buffers are allocated.
+* -- ctxLC
+* -- ctx
+* -- return = TRUE if a profile was found and loaded.
+*/
+_Success_(return)
+BOOL DeviceFPGA_AutoTune_Load(_In_ PLC_CONTEXT ctxLC, _In_ PDEVICE_CONTEXT_FPGA ctx)
+{
+    FILE *hFile = NULL;
+    CHAR szLine[0x100];
+    DWORD dw[FPGA_AUTOTUNE_FILE_FIELDS];
+    BOOL fResult = FALSE;
+    if(fopen_s(&hFile, ctx->autotune.szFileName, "r") || !hFile) { return FALSE; }
+    while(fgets(szLine, sizeof(szLine), hFile)) {
+        if(!DeviceFPGA_AutoTune_ParseLine(szLine, dw) || !DeviceFPGA_AutoTune_IsKey(ctx, dw)) { continue; }
+        if((dw[4] < 0x1000) || (dw[4] > 0x00800000) || (dw[5] < 0x10) || (dw[5] > 0x00100000) || (dw[10] < 0x1000) || (dw[10] > 0x00800000)) { continue; }
+        ctx->perf.MAX_SIZE_RX = dw[4] & ~0xfff;
+        ctx->perf.MAX_SIZE_TX = dw[5];
+        ctx->perf.DELAY_READ = dw[6];
+        ctx->perf.DELAY_WRITE = dw[7];
+        ctx->perf.RETRY_ON_ERROR = dw[8] ? 1 : 0;
+        ctx->perf.F_TINY = dw[9] ? 1 : 0;
+        ctx->perf.ASYNC_MAX_READSIZE = dw[10] & ~0xfff;
+        ctx->perf.ASYNC_DELAY_1 = dw[11];
+        ctx->perf.ASYNC_DELAY_2 = dw[12];
+        fResult = TRUE;
+    }
+    fclose(hFile);
+    if(fResult) {
+        lcprintfv(ctxLC, "DEVICE: FPGA: AUTOTUNE: profile loaded from '%s'.\n", ctx->autotune.szFileName);
+    }
+    return fResult;
+}
+
+/*
+* Persist the current profile to the profile store - replacing any previous
+* profile of the current device and keeping the profiles of other devices.
+* -- ctxLC
+* -- ctx
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFPGA_AutoTune_Save(_In_ PLC_CONTEXT ctxLC, _In_ PDEVICE_CONTEXT_FPGA ctx)
+{
+    FILE *hFile = NULL;
+    CHAR szLine[0x100];
+    DWORD dw[FPGA_AUTOTUNE_FILE_FIELDS];
+    LPSTR szOut = NULL;
+    SIZE_T o, cch;
+    BOOL fResult = FALSE;
+    if(!(szOut = LocalAlloc(0, FPGA_AUTOTUNE_FILE_MAX))) { goto fail; }
+    o = _snprintf_s(szOut, FPGA_AUTOTUNE_FILE_MAX, _TRUNCATE, "%s", FPGA_AUTOTUNE_FILE_HEADER);
+    if(!fopen_s(&hFile, ctx->autotune.szFileName, "r") && hFile) {
+        while(fgets(szLine, sizeof(szLine), hFile)) {
+            if(!DeviceFPGA_AutoTune_ParseLine(szLine, dw) || DeviceFPGA_AutoTune_IsKey(ctx, dw)) { continue; }
+            cch = strlen(szLine);
+            if(o + cch + sizeof(szLine) + 1 > FPGA_AUTOTUNE_FILE_MAX) { break; }
+            memcpy(szOut + o, szLine, cch);
+            o += cch;
+            if(szLine[cch - 1] != '\n') { szOut[o++] = '\n'; }
+        }
+        fclose(hFile);
+        hFile = NULL;
+    }
+    o += _snprintf_s(szOut + o, FPGA_AUTOTUNE_FILE_MAX - o, _TRUNCATE, "%02x %04x %x %x %x %x %x %x %x %x %x %x %x\n",
+        ctx->wFpgaID,
+        ctx->wDeviceId,
+        DeviceFPGA_PHY_GetPCIeGen(ctx),
+        DeviceFPGA_PHY_GetLinkWidth(ctx),
+        ctx->perf.MAX_SIZE_RX,
+        ctx->perf.MAX_SIZE_TX,
+        ctx->perf.DELAY_READ,
+        ctx->perf.DELAY_WRITE,
+        ctx->perf.RETRY_ON_ERROR,
+        ctx->perf.F_TINY,
+        ctx->perf.ASYNC_MAX_READSIZE,
+        ctx->perf.ASYNC_DELAY_1,
+        ctx->perf.ASYNC_DELAY_2
+    );
+    if(fopen_s(&hFile, ctx->autotune.szFileName, "w") || !hFile) { goto fail; }
+    fResult = (o == fwrite(szOut, 1, o, hFile));
+fail:
+    if(hFile) { fclose(hFile); }
+    LocalFree(szOut);
+    if(!fResult) {
+        lcprintfv(ctxLC, "DEVICE: FPGA: AUTOTUNE: unable to save profile to '%s'.\n", ctx->autotune.szFileName);
+    }
+    return fResult;
+}
+
+/*
+* Tune the performance profile against the current target. The profile
+* parameters are searched one at a time (coordinate descent); the best value
+* of a parameter is kept before moving on to the next one. Test reads are made
+* from a read-only physical address range. The device lock is only held while
+* a candidate profile is measured, in-between other threads read using the
+* best profile so far. The best profile is applied and, unless flag
+* LC_FPGA_AUTOTUNE_FLAG_NOSAVE, persisted to the profile store.
+* -- ctxLC
+* -- pTune = request in / result out.
+* -- return
+*/
+_Success_(return)
+BOOL DeviceFPGA_AutoTune(_In_ PLC_CONTEXT ctxLC, _Inout_ PLC_FPGA_AUTOTUNE pTune)
+{
+    PDEVICE_CONTEXT_FPGA ctx = (PDEVICE_CONTEXT_FPGA)ctxLC->hDevice;
+    BOOL fResult = FALSE, fBetter;
+    QWORD pa;
+    DWORD i, cPages, cReadable = 0, tpMode, iValue, dwValue, dwBase, dwMax;
+    const FPGA_AUTOTUNE_PARAM *pParam;
+    PBYTE pbMap = NULL;
+    PPMEM_SCATTER ppMEMs = NULL;
+    DEVICE_PERFORMANCE PerfBest, PerfCandidate;
+    FPGA_AUTOTUNE_RESULT ResultInitial, ResultBest, Result;
+    pa = pTune->paBase ? (pTune->paBase & ~0xfff) : FPGA_AUTOTUNE_PA_DEFAULT;
+    cPages = pTune->cPages ? min(FPGA_AUTOTUNE_PAGES_MAX, pTune->cPages) : FPGA_AUTOTUNE_PAGES_DEFAULT;
+    tpMode = ctx->async2.fEnabled ? FPGA_AUTOTUNE_MODE_ASYNC : FPGA_AUTOTUNE_MODE_SYNC;
+    pTune->cCandidates = 0;
+    if(!ctx->wDeviceId) { goto fail; }
+    if(!(pbMap = LocalAlloc(0, cPages))) { goto fail; }
+    if(!LcAllocScatter1(FPGA_AUTOTUNE_BATCH, &ppMEMs)) { goto fail; }
+    // 1: baseline measurement with the initial profile:
+    EnterCriticalSection(&ctx->Lock);
+    ctx->perf.F_TINY = ctx->fAlgorithmReadTiny ? 1 : 0;
+    memcpy(&PerfBest, &ctx->perf, sizeof(DEVICE_PERFORMANCE));
+    DeviceFPGA_AutoTune_Measure(ctxLC, pa, cPages, ppMEMs, pbMap, TRUE, &ResultInitial);
+    LeaveCriticalSection(&ctx->Lock);
+    for(i = 0; i < cPages; i++) {
+        cReadable += pbMap[i];
+    }
+    if(!cReadable) {
+        lcprintfv(ctxLC, "DEVICE: FPGA: AUTOTUNE: no readable memory at %llx-%llx.\n", pa, pa + ((QWORD)cPages << 12) - 1);
+        goto fail;
+    }
+    memcpy(&ResultBest, &ResultInitial, sizeof(FPGA_AUTOTUNE_RESULT));
+    pTune->cCandidates = 1;
+    // 2: search parameters valid for the current read algorithm:
+    for(i = 0; (i < _countof(FPGA_AUTOTUNE_PARAMS)) && !ctx->autotune.fAbort; i++) {
+        pParam = &FPGA_AUTOTUNE_PARAMS[i];
+        if((pParam->tpMode != FPGA_AUTOTUNE_MODE_ALL) && (pParam->tpMode != tpMode)) { continue; }
+        dwBase = FPGA_AUTOTUNE_PERF_FIELD(&PerfBest, pParam->oField);
+        dwMax = pParam->dwMax ? pParam->dwMax : (ctx->txbuf.cbMax - 0x10000);
+        for(iValue = 0; (iValue < pParam->cValues) && !ctx->autotune.fAbort; iValue++) {
+            dwValue = pParam->fRelative ? (DWORD)((QWORD)dwBase * pParam->dwValues[iValue] / 100) : pParam->dwValues[iValue];
+            dwValue = max(pParam->dwMin, min(dwMax, dwValue - (dwValue % pParam->dwAlign)));
+            if(dwValue == FPGA_AUTOTUNE_PERF_FIELD(&PerfBest, pParam->oField)) { continue; }
+            memcpy(&PerfCandidate, &PerfBest, sizeof(DEVICE_PERFORMANCE));
+            FPGA_AUTOTUNE_PERF_FIELD(&PerfCandidate, pParam->oField) = dwValue;
+            EnterCriticalSection(&ctx->Lock);
+            DeviceFPGA_AutoTune_Apply(ctx, &PerfCandidate);
+            DeviceFPGA_AutoTune_Measure(ctxLC, pa, cPages, ppMEMs, pbMap, FALSE, &Result);
+            fBetter = DeviceFPGA_AutoTune_IsBetter(&Result, &ResultBest);
+            DeviceFPGA_AutoTune_Apply(ctx, fBetter ? &PerfCandidate : &PerfBest);
+            LeaveCriticalSection(&ctx->Lock);
+            pTune->cCandidates++;
+            lcprintfvv(ctxLC, "DEVICE: FPGA: AUTOTUNE: %-18s %6x: %7llu kB/s fail: %i latency: %ius%s\n",
+                pParam->szName, dwValue, Result.cbps >> 10, Result.cFail, Result.dwLatencyUs, (fBetter ? " [BEST]" : ""));
+            if(fBetter) {
+                memcpy(&PerfBest, &PerfCandidate, sizeof(DEVICE_PERFORMANCE));
+                memcpy(&ResultBest, &Result, sizeof(FPGA_AUTOTUNE_RESULT));
+            }
+        }
+    }
+    if(ctx->autotune.fAbort) { goto fail; }
+    // 3: return and persist result:
+    pTune->dwThroughputInitial = (DWORD)(ResultInitial.cbps >> 10);
+    pTune->dwThroughput = (DWORD)(ResultBest.cbps >> 10);
+    pTune->dwErrorPPM = (DWORD)((QWORD)ResultBest.cFail * 1000000 / cReadable);
+    pTune->dwLatencyUs = ResultBest.dwLatencyUs;
+    pTune->dwMaxSizeRx = PerfBest.MAX_SIZE_RX;
+    pTune->dwMaxSizeTx = PerfBest.MAX_SIZE_TX;
+    pTune->dwDelayRead = PerfBest.DELAY_READ;
+    pTune->dwDelayWrite = PerfBest.DELAY_WRITE;
+    pTune->dwRetryOnError = PerfBest.RETRY_ON_ERROR;
+    pTune->fTiny = PerfBest.F_TINY;
+    pTune->dwAsyncMaxReadSize = PerfBest.ASYNC_MAX_READSIZE;
+    pTune->dwAsyncDelay1 = PerfBest.ASYNC_DELAY_1;
+    pTune->dwAsyncDelay2 = PerfBest.ASYNC_DELAY_2;
+    lcprintfv(ctxLC, "DEVICE: FPGA: AUTOTUNE: %i profiles: %i kB/s -> %i kB/s, errors: %i ppm, latency: %ius.\n",
+        pTune->cCandidates, pTune->dwThroughputInitial, pTune->dwThroughput, pTune->dwErrorPPM, pTune->dwLatencyUs);
+    if(!(pTune->dwFlags & LC_FPGA_AUTOTUNE_FLAG_NOSAVE)) {
+        EnterCriticalSection(&ctx->Lock);
+        DeviceFPGA_AutoTune_Save(ctxLC, ctx);
+        LeaveCriticalSection(&ctx->Lock);
+    }
+    fResult = TRUE;
+fail:
+    LcMemFree(ppMEMs);
+    LocalFree(pbMap);
+    return fResult;
+}
+
+/*
+* Background autotune thread started on open by device parameter autotune.
+*/
+DWORD DeviceFPGA_AutoTune_ThreadProc(_In_ PLC_CONTEXT ctxLC)
+{
+    PDEVICE_CONTEXT_FPGA ctx = (PDEVICE_CONTEXT_FPGA)ctxLC->hDevice;
+    LC_FPGA_AUTOTUNE Tune = { .dwVersion = LC_FPGA_AUTOTUNE_VERSION };
+    DeviceFPGA_AutoTune(ctxLC, &Tune);
+    ctx->autotune.fThread = FALSE;
+    return 1;
+}
+
 _Success_(return)
 BOOL DeviceFPGA_Command(
     _In_ PLC_CONTEXT ctxLC,
@@ -3200,6 +4386,7 @@ BOOL DeviceFPGA_Command(
     PLC_TLP pTLP;
     PBYTE pb;
     HANDLE hThread;
+    PLC_FPGA_AUTOTUNE pTune;
     qwOptionLo = fOption & 0x00000000ffffffff;
     qwOptionHi = fOption & 0xffffffff00000000;
     if(ppbDataOut) { *ppbDataOut = NULL; }
@@ -3335,6 +4522,23 @@ BOOL DeviceFPGA_Command(
             DeviceFPGA_ProbeMEM(ctxLC, *(PQWORD)pbDataIn, (DWORD)qwOptionLo, *ppbDataOut);
             if(pcbDataOut) { *pcbDataOut = (DWORD)qwOptionLo; }
             return TRUE;
+        case LC_CMD_FPGA_AUTOTUNE:
+            if(ctx->autotune.fThread) { return FALSE; }
+            if(pbDataIn && ((cbDataIn != sizeof(LC_FPGA_AUTOTUNE)) || (((PLC_FPGA_AUTOTUNE)pbDataIn)->dwVersion != LC_FPGA_AUTOTUNE_VERSION))) { return FALSE; }
+            if(!(pTune = LocalAlloc(LMEM_ZEROINIT, sizeof(LC_FPGA_AUTOTUNE)))) { return FALSE; }
+            if(pbDataIn) { memcpy(pTune, pbDataIn, sizeof(LC_FPGA_AUTOTUNE)); }
+            pTune->dwVersion = LC_FPGA_AUTOTUNE_VERSION;
+            if(!DeviceFPGA_AutoTune(ctxLC, pTune)) {
+                LocalFree(pTune);
+                return FALSE;
+            }
+            if(ppbDataOut) {
+                *ppbDataOut = (PBYTE)pTune;
+                if(pcbDataOut) { *pcbDataOut = sizeof(LC_FPGA_AUTOTUNE); }
+            } else {
+                LocalFree(pTune);
+            }
+            return TRUE;
     }
     return FALSE;
 }
@@ -3439,6 +4643,14 @@ BOOL DeviceFPGA_GetOption(_In_ PLC_CONTEXT ctxLC, _In_ QWORD fOption, _Out_ PQWO
         case LC_OPT_FPGA_TLP_READ_CB_WITHINFO:
             *pqwValue = ctx->tlp_callback.fInfo ? 1 : 0;
             return TRUE;
+        case LC_OPT_FPGA_UDP_LATENCY:
+            if(!ctx->dev.fUDP || !ctx->dev.pUdp->cLatency) { return FALSE; }
+            *pqwValue = ctx->dev.pUdp->qwLatencySumNs / ctx->dev.pUdp->cLatency;
+            return TRUE;
+        case LC_OPT_FPGA_UDP_LATENCY_MAX:
+            if(!ctx->dev.fUDP || !ctx->dev.pUdp->cLatency) { return FALSE; }
+            *pqwValue = ctx->dev.pUdp->qwLatencyMaxNs;
+            return TRUE;
         case LC_OPT_FPGA_TLP_READ_CB_FILTERCPL:
             *pqwValue = ctx->tlp_callback.fNoCpl ? 1 : 0;
             return TRUE;
@@ -3534,30 +4746,37 @@ BOOL DeviceFPGA_SetOption_DoLock(_In_ PLC_CONTEXT ctxLC, _In_ QWORD fOption, _In
 #define FPGA_PARAMETER_DEVICE_ID       "bdf"
 #define FPGA_PARAMETER_DRIVER          "driver"
 #define FPGA_PARAMETER_FT601           "ft601"
+#define FPGA_PARAMETER_AUTOTUNE        "autotune"
+#define FPGA_PARAMETER_AUTOTUNE_FILE   "autotunefile"
 
 #define FPGA_PARAMETER_ALGO_TINY                0x01
 #define FPGA_PARAMETER_ALGO_SYNCHRONOUS         0x02
 
+#define FPGA_PARAMETER_AUTOTUNE_LOAD            0x01    // load persisted profile, tune in background if none.
+#define FPGA_PARAMETER_AUTOTUNE_FORCE           0x02    // always tune in background.
+
 _Success_(return)
 BOOL DeviceFPGA_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO ppLcCreateErrorInfo)
 {
     DWORD dwIpAddr;
-    QWORD v;
+    QWORD v, qwAutoTune;
     LPSTR szDeviceError = NULL;
     PDEVICE_CONTEXT_FPGA ctx;
     PLC_DEVICE_PARAMETER_ENTRY pParam;
-    BOOL fFT601 = FALSE, fCustomDriver = FALSE;
+    HANDLE hThread;
+    BOOL fFT601 = FALSE, fCustomDriver = FALSE, fAutoTuneLoaded = FALSE;
     if(ppLcCreateErrorInfo) { *ppLcCreateErrorInfo = NULL; }
     ctx = LocalAlloc(LMEM_ZEROINIT, sizeof(DEVICE_CONTEXT_FPGA));
     if(!ctx) { return FALSE; }
     InitializeCriticalSection(&ctx->Lock);
+    InitializeCriticalSection(&ctx->async2.LockTx);
     ctxLC->hDevice = (HANDLE)ctx;
     ctx->qwDeviceIndex = LcDeviceParameterGetNumeric(ctxLC, FPGA_PARAMETER_DEVICE_INDEX);
     if((pParam = LcDeviceParameterGet(ctxLC, FPGA_PARAMETER_UDP_ADDRESS)) && pParam->szValue) {
         dwIpAddr = inet_addr(pParam->szValue);
         szDeviceError = ((dwIpAddr == 0) || (dwIpAddr == (DWORD)-1)) ?
             "Bad IPv4 address" :
-            DeviceFPGA_InitializeUDP(ctx, dwIpAddr);
+            DeviceFPGA_InitializeUDP(ctxLC, ctx, dwIpAddr);
     } else if((pParam = LcDeviceParameterGet(ctxLC, FPGA_PARAMETER_FT2232H)) && pParam->szValue) {
         szDeviceError = DeviceFPGA_InitializeFT2232(ctx);
     } else {
@@ -3579,10 +4798,20 @@ BOOL DeviceFPGA_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO
         szDeviceError = "Unable to retrieve required Device PCIe ID";
         goto fail;
     }
+    if((v = LcDeviceParameterGetNumeric(ctxLC, FPGA_PARAMETER_DEVICE_ID)))   { ctx->wDeviceId = (WORD)v; }
     DeviceFPGA_SetPerformanceProfile(ctx);
-    ctx->rxbuf.cbMax = ctx->dev.f2232h ? 0x01000000 : (DWORD)(1.30 * ctx->perf.MAX_SIZE_RX + 0x2000);  // buffer size tuned to lowest possible (+margin) for performance (FT601).
-    ctx->rxbuf.pb = LocalAlloc(0, 0x01000000);
-    if(!ctx->rxbuf.pb) { goto fail; }
+    // load persisted autotune profile (if any) before buffers are allocated:
+    if((pParam = LcDeviceParameterGet(ctxLC, FPGA_PARAMETER_AUTOTUNE_FILE)) && pParam->szValue[0]) {
+        strncpy_s(ctx->autotune.szFileName, _countof(ctx->autotune.szFileName), pParam->szValue, _TRUNCATE);
+    } else {
+        Util_GetPathLib(ctx->autotune.szFileName);
+        strncat_s(ctx->autotune.szFileName, _countof(ctx->autotune.szFileName), FPGA_AUTOTUNE_FILE, _TRUNCATE);
+    }
+    qwAutoTune = LcDeviceParameterGetNumeric(ctxLC, FPGA_PARAMETER_AUTOTUNE);
+    if(qwAutoTune == FPGA_PARAMETER_AUTOTUNE_LOAD) {
+        fAutoTuneLoaded = DeviceFPGA_AutoTune_Load(ctxLC, ctx);
+    }
+    ctx->rxbuf.cbMax = ctx->dev.f2232h ? 0x01000000 : FPGA_RXBUF_CB_SYNC(ctx->perf.MAX_SIZE_RX);  // buffer size tuned to lowest possible (+margin) for performance (FT601).
     ctx->txbuf.cbMax = ctx->perf.MAX_SIZE_TX + 0x10000;
     ctx->txbuf.pb = LocalAlloc(0, ctx->txbuf.cbMax);
     if(!ctx->txbuf.pb) { goto fail; }
@@ -3600,7 +4829,6 @@ BOOL DeviceFPGA_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO
     if((v = LcDeviceParameterGetNumeric(ctxLC, FPGA_PARAMETER_DELAY_PROBE))) { ctx->perf.DELAY_PROBE_READ = (DWORD)v; }
     if((v = LcDeviceParameterGetNumeric(ctxLC, FPGA_PARAMETER_READ_RETRY)))  { ctx->perf.RETRY_ON_ERROR = (DWORD)v; }
     if((v = LcDeviceParameterGetNumeric(ctxLC, FPGA_PARAMETER_READ_SIZE)))   { ctx->perf.MAX_SIZE_RX = min(ctx->perf.MAX_SIZE_RX, (DWORD)v & ~0xfff); }
-    if((v = LcDeviceParameterGetNumeric(ctxLC, FPGA_PARAMETER_DEVICE_ID)))   { ctx->wDeviceId = (WORD)v; }
     v = LcDeviceParameterGetNumeric(ctxLC, FPGA_PARAMETER_READ_ALGORITHM);
     ctx->fAlgorithmReadTiny = ((v & FPGA_PARAMETER_ALGO_TINY) ? TRUE : FALSE) || ctx->perf.F_TINY;
     ctx->async2.fEnabled = ctx->async2.fEnabled && !(v & FPGA_PARAMETER_ALGO_SYNCHRONOUS) && !ctx->perf.RX_FLUSH_LIMIT;
@@ -3609,8 +4837,12 @@ BOOL DeviceFPGA_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO
         if(!(ctx->async2.pmQueue = ObMap_New(NULL, OB_MAP_FLAGS_NOKEY))) { goto fail; }
         ctx->async2.cbAvailCredits = ctx->perf.MAX_SIZE_RX;
         ctx->async2.cAvailTags = 0xe0;
-        ctx->rxbuf.cbMax = 0x01000000;
+        if(!ctx->dev.f2232h) {
+            ctx->rxbuf.cbMax = max(ctx->rxbuf.cbMax, FPGA_RXBUF_CB_ASYNC(max(ctx->perf.ASYNC_MAX_READSIZE, FPGA_RXBUF_CB_READ_TUNE_MAX)));
+        }
     }
+    // allocate rx buffer - with room for the largest sizes autotune may select:
+    if(!DeviceFPGA_RxBuf_Alloc(ctx, ctx->dev.f2232h ? ctx->rxbuf.cbMax : max(ctx->rxbuf.cbMax, FPGA_RXBUF_CB_SYNC(FPGA_RXBUF_CB_RX_TUNE_MAX)))) { goto fail; }
     // return
     lcprintfv(ctxLC, 
         "DEVICE: FPGA: %s PCIe gen%i x%i [%i,%i,%i] [v%i.%i,%04x] [%s,%s]\n",
@@ -3629,6 +4861,15 @@ BOOL DeviceFPGA_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO
     if(ctxLC->fPrintf[LC_PRINTF_VV]) {
         DeviceFPGA_ConfigPrint(ctxLC, ctx);
     }
+    // tune performance profile in background (if requested and not loaded):
+    if(qwAutoTune && !fAutoTuneLoaded) {
+        ctx->autotune.fThread = TRUE;
+        if((hThread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)DeviceFPGA_AutoTune_ThreadProc, ctxLC, 0, NULL))) {
+            CloseHandle(hThread);
+        } else {
+            ctx->autotune.fThread = FALSE;
+        }
+    }
     return TRUE;
 fail:
     if(ctxLC->fPrintf[LC_PRINTF_VV] && ctx->dev.fInitialized) {
@@ -0,0 +1,260 @@
+// device_kcore.c : implementation of the linux live memory acquisition device.
+//                  physical memory is read from /proc/kcore - the PT_LOAD
+//                  segments of the kcore ELF core file which are backed by
+//                  System RAM in /proc/iomem make up the memory map. If kcore
+//                  is not available /dev/crash (if present) is used instead.
+//                  reads are served by parallel positioned reads (pread).
+//
+// Syntax: kcore[://file=<file>]
+//
+// (c) Ulf Frisk, 2020-2023
+// Author: Ulf Frisk, pcileech@frizk.net
+//
+#include "leechcore.h"
+#include "leechcore_device.h"
+#include "leechcore_internal.h"
+#include "util.h"
+#ifdef LINUX
+
+#define KCORE_FILE_KCORE                "/proc/kcore"
+#define KCORE_FILE_CRASH                "/dev/crash"
+#define KCORE_FILE_IOMEM                "/proc/iomem"
+#define KCORE_PARAMETER_FILE            "file"
+#define KCORE_IOMEM_MAX                 0x400
+#define KCORE_PHDR_MAX                  0x1000
+#define KCORE_READ_THREADS              4
+#define KCORE_READ_CHUNK_SIZE           0x00400000      // 4MB buffer / thread
+
+typedef struct tdKCORE_RANGE {
+    QWORD pa;
+    QWORD cb;
+    QWORD oFile;
+} KCORE_RANGE, *PKCORE_RANGE;
+
+typedef struct tdDEVICE_CONTEXT_KCORE {
+    int fd;
+    BOOL fElf;                      // TRUE = kcore, FALSE = physical address file offsets (/dev/crash)
+    DWORD cRam;
+    KCORE_RANGE Ram[KCORE_IOMEM_MAX];
+    CHAR szFileName[MAX_PATH];
+} DEVICE_CONTEXT_KCORE, *PDEVICE_CONTEXT_KCORE;
+
+//-----------------------------------------------------------------------------
+// MEMORY MAP FUNCTIONALITY BELOW:
+//-----------------------------------------------------------------------------
+
+/*
+* Parse the top-level 'System RAM' ranges of /proc/iomem. Addresses are only
+* shown to privileged users - unprivileged users will see zero addresses.
+* -- ctx
+* -- return = TRUE if at least one non-zero System RAM range was found.
+*/
+_Success_(return)
+BOOL DeviceKcore_IomemLoad(_In_ PDEVICE_CONTEXT_KCORE ctx)
+{
+    FILE *hFile;
+    CHAR szLine[MAX_PATH];
+    LPSTR szEnd;
+    QWORD paBase, paTop;
+    if(fopen_s(&hFile, KCORE_FILE_IOMEM, "r") || !hFile) { return FALSE; }
+    while(fgets(szLine, sizeof(szLine), hFile) && (ctx->cRam < KCORE_IOMEM_MAX)) {
+        if((szLine[0] == ' ') || !strstr(szLine, ": System RAM")) { continue; }
+        paBase = strtoull(szLine, &szEnd, 16);
+        if(*szEnd != '-') { continue; }
+        paTop = strtoull(szEnd + 1, NULL, 16) + 1;
+        paBase = (paBase + 0xfff) & ~0xfff;
+        paTop = paTop & ~0xfff;
+        if(paTop <= paBase) { continue; }
+        ctx->Ram[ctx->cRam].pa = paBase;
+        ctx->Ram[ctx->cRam].cb = paTop - paBase;
+        ctx->Ram[ctx->cRam].oFile = paBase;
+        ctx->cRam++;
+    }
+    fclose(hFile);
+    return ctx->cRam > 0;
+}
+
+/*
+* Check whether a physical memory range is backed by System RAM.
+* -- ctx
+* -- pa
+* -- cb
+* -- return
+*/
+BOOL DeviceKcore_IomemIsRam(_In_ PDEVICE_CONTEXT_KCORE ctx, _In_ QWORD pa, _In_ QWORD cb)
+{
+    DWORD i;
+    for(i = 0; i < ctx->cRam; i++) {
+        if((pa >= ctx->Ram[i].pa) && (pa + cb <= ctx->Ram[i].pa + ctx->Ram[i].cb)) { return TRUE; }
+    }
+    return FALSE;
+}
+
+int DeviceKcore_RangeCmp(_In_ const void *pv1, _In_ const void *pv2)
+{
+    PKCORE_RANGE p1 = (PKCORE_RANGE)pv1, p2 = (PKCORE_RANGE)pv2;
+    if(p1->pa != p2->pa) { return (p1->pa < p2->pa) ? -1 : 1; }
+    return (p1->cb > p2->cb) ? -1 : ((p1->cb < p2->cb) ? 1 : 0);
+}
+
+/*
+* Parse the PT_LOAD segments of the kcore ELF core file into the memory map.
+* Only segments with a physical address which are backed by System RAM are
+* used. Kernel text is mapped both by its own segment and by the direct map -
+* overlapping segments are skipped in favor of the larger segment.
+* -- ctxLC
+* -- ctx
+* -- return
+*/
+_Success_(return)
+BOOL DeviceKcore_ElfMemMap(_In_ PLC_CONTEXT ctxLC, _In_ PDEVICE_CONTEXT_KCORE ctx)
+{
+    BOOL fResult = FALSE;
+    DWORD i, cRange = 0;
+    QWORD paTop = 0;
+    Elf64_Ehdr Ehdr;
+    PElf64_Phdr pPhdr = NULL;
+    PKCORE_RANGE pRange = NULL;
+    if(sizeof(Elf64_Ehdr) != pread(ctx->fd, &Ehdr, sizeof(Elf64_Ehdr), 0)) { return FALSE; }
+    if((*(PDWORD)Ehdr.e_ident != ELF_EI_MAGIC) || (*(PWORD)(Ehdr.e_ident + 4) != ELF_EI_CLASSDATA_64)) { return FALSE; }
+    if((Ehdr.e_type != ELF_ET_CORE) || (Ehdr.e_phentsize != sizeof(Elf64_Phdr)) || !Ehdr.e_phnum || (Ehdr.e_phnum > KCORE_PHDR_MAX)) {
+        lcprintf(ctxLC, "DEVICE: KCORE: FAIL: unable to parse elf header\n");
+        return FALSE;
+    }
+    if(!(pPhdr = LocalAlloc(0, Ehdr.e_phnum * sizeof(Elf64_Phdr)))) { goto fail; }
+    if(!(pRange = LocalAlloc(0, Ehdr.e_phnum * sizeof(KCORE_RANGE)))) { goto fail; }
+    if((ssize_t)(Ehdr.e_phnum * sizeof(Elf64_Phdr)) != pread(ctx->fd, pPhdr, Ehdr.e_phnum * sizeof(Elf64_Phdr), Ehdr.e_phoff)) { goto fail; }
+    for(i = 0; i < Ehdr.e_phnum; i++) {
+        if((pPhdr[i].p_type != ELF_PT_LOAD) || (pPhdr[i].p_paddr == (QWORD)-1) || !pPhdr[i].p_filesz) { continue; }
+        if((pPhdr[i].p_paddr & 0xfff) || (pPhdr[i].p_filesz & 0xfff) || (pPhdr[i].p_offset & 0xfff)) { continue; }
+        if(ctx->cRam && !DeviceKcore_IomemIsRam(ctx, pPhdr[i].p_paddr, pPhdr[i].p_filesz)) { continue; }
+        pRange[cRange].pa = pPhdr[i].p_paddr;
+        pRange[cRange].cb = pPhdr[i].p_filesz;
+        pRange[cRange].oFile = pPhdr[i].p_offset;
+        cRange++;
+    }
+    qsort(pRange, cRange, sizeof(KCORE_RANGE), DeviceKcore_RangeCmp);
+    for(i = 0; i < cRange; i++) {
+        if(pRange[i].pa < paTop) { continue; }
+        if(!LcMemMap_AddRange(ctxLC, pRange[i].pa, pRange[i].cb, pRange[i].oFile)) {
+            lcprintf(ctxLC, "DEVICE: FAIL: unable to add range to memory map. (%016llx %016llx %016llx)\n", pRange[i].pa, pRange[i].cb, pRange[i].oFile);
+            goto fail;
+        }
+        paTop = pRange[i].pa + pRange[i].cb;
+        fResult = TRUE;
+    }
+fail:
+    LocalFree(pPhdr);
+    LocalFree(pRange);
+    return fResult;
+}
+
+//-----------------------------------------------------------------------------
+// GENERAL FUNCTIONALITY BELOW:
+//-----------------------------------------------------------------------------
+
+/*
+* Read a contiguous chunk. Reads are positioned (pread) and may be issued in
+* parallel by the read contiguous threads on the shared file descriptor.
+* Short reads are retried from where they stopped (/dev/crash returns at most
+* one page per read).
+* -- ctxRC
+*/
+VOID DeviceKcore_ReadContigious(_Inout_ PLC_READ_CONTIGIOUS_CONTEXT ctxRC)
+{
+    PDEVICE_CONTEXT_KCORE ctx = (PDEVICE_CONTEXT_KCORE)ctxRC->ctxLC->hDevice;
+    ssize_t cbRead;
+    while(ctxRC->cbRead < ctxRC->cb) {
+        cbRead = pread(ctx->fd, ctxRC->pb + ctxRC->cbRead, ctxRC->cb - ctxRC->cbRead, ctxRC->paBase + ctxRC->cbRead);
+        if(cbRead <= 0) { break; }
+        ctxRC->cbRead += (DWORD)cbRead;
+    }
+}
+
+VOID DeviceKcore_Close(_Inout_ PLC_CONTEXT ctxLC)
+{
+    PDEVICE_CONTEXT_KCORE ctx = (PDEVICE_CONTEXT_KCORE)ctxLC->hDevice;
+    if(ctx) {
+        ctxLC->hDevice = 0;
+        if(ctx->fd >= 0) { close(ctx->fd); }
+        LocalFree(ctx);
+    }
+}
+
+/*
+* Open the kcore (or /dev/crash) file and initialize the memory map from it.
+* -- ctxLC
+* -- ctx
+* -- szFileName
+* -- return
+*/
+_Success_(return)
+BOOL DeviceKcore_OpenFile(_In_ PLC_CONTEXT ctxLC, _In_ PDEVICE_CONTEXT_KCORE ctx, _In_ LPSTR szFileName)
+{
+    DWORD i;
+    if((ctx->fd = open(szFileName, O_RDONLY)) < 0) {
+        lcprintfv(ctxLC, "DEVICE: KCORE: unable to open '%s' (errno: %i).\n", szFileName, errno);
+        return FALSE;
+    }
+    strncpy_s(ctx->szFileName, _countof(ctx->szFileName), szFileName, _TRUNCATE);
+    if(DeviceKcore_ElfMemMap(ctxLC, ctx)) {
+        ctx->fElf = TRUE;
+        return TRUE;
+    }
+    if(LcMemMap_IsInitialized(ctxLC) || !ctx->cRam) { goto fail; }
+    // not elf - file offset is physical address (/dev/crash):
+    for(i = 0; i < ctx->cRam; i++) {
+        if(!LcMemMap_AddRange(ctxLC, ctx->Ram[i].pa, ctx->Ram[i].cb, ctx->Ram[i].oFile)) { goto fail; }
+    }
+    return TRUE;
+fail:
+    close(ctx->fd);
+    ctx->fd = -1;
+    return FALSE;
+}
+
+_Success_(return)
+BOOL DeviceKcore_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO ppLcCreateErrorInfo)
+{
+    PDEVICE_CONTEXT_KCORE ctx;
+    PLC_DEVICE_PARAMETER_ENTRY pParam;
+    if(ppLcCreateErrorInfo) { *ppLcCreateErrorInfo = NULL; }
+    if(!(ctx = (PDEVICE_CONTEXT_KCORE)LocalAlloc(LMEM_ZEROINIT, sizeof(DEVICE_CONTEXT_KCORE)))) { return FALSE; }
+    ctx->fd = -1;
+    ctxLC->hDevice = (HANDLE)ctx;
+    // 1: load system ram ranges and open kcore / crash file:
+    if(!DeviceKcore_IomemLoad(ctx)) {
+        lcprintfv(ctxLC, "DEVICE: KCORE: WARNING: unable to read System RAM ranges from '%s' (not root?).\n", KCORE_FILE_IOMEM);
+    }
+    if((pParam = LcDeviceParameterGet(ctxLC, KCORE_PARAMETER_FILE)) && pParam->szValue[0]) {
+        if(!DeviceKcore_OpenFile(ctxLC, ctx, pParam->szValue)) { goto fail; }
+    } else if(!DeviceKcore_OpenFile(ctxLC, ctx, KCORE_FILE_KCORE) && !DeviceKcore_OpenFile(ctxLC, ctx, KCORE_FILE_CRASH)) {
+        goto fail;
+    }
+    // 2: set callback functions and fix up config:
+    ctxLC->Config.fVolatile = TRUE;
+    ctxLC->pfnClose = DeviceKcore_Close;
+    ctxLC->pfnReadContigious = DeviceKcore_ReadContigious;
+    ctxLC->ReadContigious.cThread = KCORE_READ_THREADS;
+    ctxLC->ReadContigious.cbChunkSize = KCORE_READ_CHUNK_SIZE;
+    ctxLC->ReadContigious.fLoadBalance = TRUE;
+    lcprintfv(ctxLC, "DEVICE: KCORE: Successfully opened '%s' (%s).\n", ctx->szFileName, ctx->fElf ? "ELF core" : "physical address");
+    return TRUE;
+fail:
+    lcprintf(ctxLC, "DEVICE: KCORE: FAIL: unable to open kcore device (root required).\n");
+    DeviceKcore_Close(ctxLC);
+    return FALSE;
+}
+
+#endif /* LINUX */
+#ifdef _WIN32
+
+_Success_(return)
+BOOL DeviceKcore_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO ppLcCreateErrorInfo)
+{
+    lcprintfv(ctxLC, "DEVICE: FAIL: 'kcore' memory acquisition only supported on Linux.\n");
+    if(ppLcCreateErrorInfo) { *ppLcCreateErrorInfo = NULL; }
+    return FALSE;
+}
+
+#endif /* _WIN32 */
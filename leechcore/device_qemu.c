@@ -0,0 +1,465 @@
+// device_qemu.c : implementation of the qemu/kvm live memory acquisition device.
+//                 guest physical memory is either read directly from the address
+//                 space of the qemu process with batched process_vm_readv() calls
+//                 or from a direct mapping of the guest ram backing file (qemu
+//                 memory-backend-file / memory-backend-memfd in /dev/shm or on
+//                 hugetlbfs) in which case reads are plain memory copies.
+//
+// The guest ram block is located in /proc/<pid>/maps - either by name (ram=)
+// or as the largest writable mapping of the process. The guest physical
+// layout is the qemu x86 below-4G / above-4G split or is given by a layout
+// file with lines on the format: <pa_base> <pa_top> <ram_offset>
+// The below-4G size depends on the machine type (pc/q35) which is read from
+// the qemu command line or given by machine=. If the machine type is unknown
+// and the guest ram is large enough to be split lowmem= must be given.
+//
+// Syntax: qemu://pid=<pid>[,ram=<name>][,hva=<addr>,size=<cb>]
+//                [,machine=pc|q35][,lowmem=<cb>][,layout=<file>][,ro=1]
+//         qemu://shm=<file>[,machine=pc|q35][,lowmem=<cb>][,layout=<file>][,ro=1]
+//         (shm files without a path are opened in /dev/shm)
+//
+// (c) Ulf Frisk, 2020-2023
+// Author: Ulf Frisk, pcileech@frizk.net
+//
+#include "leechcore.h"
+#include "leechcore_device.h"
+#include "leechcore_internal.h"
+#include "util.h"
+#ifdef LINUX
+
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+#define QEMU_PARAMETER_PID              "pid"
+#define QEMU_PARAMETER_RAM              "ram"
+#define QEMU_PARAMETER_HVA              "hva"
+#define QEMU_PARAMETER_SIZE             "size"
+#define QEMU_PARAMETER_LOWMEM           "lowmem"
+#define QEMU_PARAMETER_LAYOUT           "layout"
+#define QEMU_PARAMETER_READONLY         "ro"
+#define QEMU_PARAMETER_SHM              "shm"
+#define QEMU_PARAMETER_MACHINE          "machine"
+#define QEMU_IOV_MAX                    0x100
+#define QEMU_Q35_LOWMEM_THRESHOLD       0xb0000000      // q35: ram >= 2.75GB is split at 2GB
+#define QEMU_Q35_LOWMEM_SPLIT           0x80000000
+#define QEMU_PC_LOWMEM_THRESHOLD        0xe0000000      // pc (i440fx): ram >= 3.5GB is split at 3GB
+#define QEMU_PC_LOWMEM_SPLIT            0xc0000000
+#define QEMU_HIGHMEM_BASE               0x100000000
+
+typedef enum tdQEMU_MACHINE {
+    QEMU_MACHINE_UNKNOWN = 0,
+    QEMU_MACHINE_PC      = 1,
+    QEMU_MACHINE_Q35     = 2,
+} QEMU_MACHINE;
+
+typedef struct tdDEVICE_CONTEXT_QEMU {
+    pid_t pid;
+    QWORD vaRam;
+    QWORD cbRam;
+    PBYTE pbShm;                    // direct mapping of guest ram (shm mode)
+} DEVICE_CONTEXT_QEMU, *PDEVICE_CONTEXT_QEMU;
+
+//-----------------------------------------------------------------------------
+// GUEST MEMORY LAYOUT FUNCTIONALITY BELOW:
+//-----------------------------------------------------------------------------
+
+/*
+* Locate the guest ram block in the qemu process by parsing /proc/<pid>/maps.
+* If a name is given the first writable mapping with a path containing the
+* name is used, otherwise the largest writable mapping is used.
+* -- pid
+* -- szRam = optional ram block name (i.e. 'pc.ram' for a memfd backend).
+* -- pva
+* -- pcb
+* -- return
+*/
+_Success_(return)
+BOOL DeviceQemu_RamFind(_In_ pid_t pid, _In_opt_ LPSTR szRam, _Out_ PQWORD pva, _Out_ PQWORD pcb)
+{
+    FILE *hFile;
+    CHAR szMaps[MAX_PATH], szLine[0x400];
+    LPSTR szEnd, szPath;
+    QWORD vaBase, vaTop;
+    *pva = 0; *pcb = 0;
+    _snprintf_s(szMaps, _countof(szMaps), _TRUNCATE, "/proc/%i/maps", pid);
+    if(fopen_s(&hFile, szMaps, "r") || !hFile) { return FALSE; }
+    while(fgets(szLine, sizeof(szLine), hFile)) {
+        vaBase = strtoull(szLine, &szEnd, 16);
+        if(*szEnd != '-') { continue; }
+        vaTop = strtoull(szEnd + 1, &szEnd, 16);
+        if((szEnd[0] != ' ') || (szEnd[1] != 'r') || (szEnd[2] != 'w') || (vaTop <= vaBase)) { continue; }
+        szPath = strchr(szEnd, '/');
+        if(szRam && szRam[0]) {
+            if(!szPath || !strstr(szPath, szRam)) { continue; }
+            *pva = vaBase;
+            *pcb = vaTop - vaBase;
+            break;
+        }
+        if(szPath && strncmp(szPath, "/dev/", 5) && strncmp(szPath, "/memfd:", 7) && !strstr(szPath, "hugepages")) { continue; }
+        if(vaTop - vaBase > *pcb) {
+            *pva = vaBase;
+            *pcb = vaTop - vaBase;
+        }
+    }
+    fclose(hFile);
+    return *pcb ? TRUE : FALSE;
+}
+
+/*
+* Parse a qemu machine type from a -machine option string (i.e. 'q35',
+* 'pc-q35-8.2,accel=kvm', 'accel=kvm,type=pc' or 'pc-i440fx-8.2'). The type
+* is the first option without a name or the value of the type= option.
+* -- sz
+* -- tpDefault = machine type to return if no type is given.
+* -- return
+*/
+QEMU_MACHINE DeviceQemu_MachineParse(_In_ LPSTR sz, _In_ QEMU_MACHINE tpDefault)
+{
+    LPSTR szType = NULL;
+    while(sz && *sz) {
+        if(0 == _strnicmp(sz, "type=", 5)) {
+            szType = sz + 5;
+            break;
+        }
+        if(!szType && (!strchr(sz, '=') || (strchr(sz, ',') && (strchr(sz, ',') < strchr(sz, '='))))) {
+            szType = sz;
+        }
+        if((sz = strchr(sz, ','))) { sz++; }
+    }
+    if(!szType) { return tpDefault; }
+    if((0 == _strnicmp(szType, "q35", 3)) || (0 == _strnicmp(szType, "pc-q35", 6))) { return QEMU_MACHINE_Q35; }
+    if((0 == _strnicmp(szType, "pc", 2)) && (!szType[2] || (szType[2] == ',') || (szType[2] == '-'))) { return QEMU_MACHINE_PC; }
+    return QEMU_MACHINE_UNKNOWN;
+}
+
+/*
+* Retrieve the guest machine type - either from the machine= parameter or
+* from the -machine / -M argument on the command line of the qemu process.
+* An x86 qemu without a machine argument defaults to the pc machine type.
+* -- ctxLC
+* -- pid = qemu process id (0 if not known).
+* -- return
+*/
+QEMU_MACHINE DeviceQemu_MachineType(_In_ PLC_CONTEXT ctxLC, _In_ pid_t pid)
+{
+    FILE *hFile;
+    CHAR szCmdline[MAX_PATH], szArgs[0x4000];
+    LPSTR szArg, szArgPrev = NULL;
+    QEMU_MACHINE tpMachine = QEMU_MACHINE_UNKNOWN;
+    PLC_DEVICE_PARAMETER_ENTRY pParam;
+    SIZE_T cbArgs, o;
+    if((pParam = LcDeviceParameterGet(ctxLC, QEMU_PARAMETER_MACHINE)) && pParam->szValue[0]) {
+        return DeviceQemu_MachineParse(pParam->szValue, QEMU_MACHINE_UNKNOWN);
+    }
+    if(!pid) { return QEMU_MACHINE_UNKNOWN; }
+    _snprintf_s(szCmdline, _countof(szCmdline), _TRUNCATE, "/proc/%i/cmdline", pid);
+    if(fopen_s(&hFile, szCmdline, "rb") || !hFile) { return QEMU_MACHINE_UNKNOWN; }
+    cbArgs = fread(szArgs, 1, sizeof(szArgs) - 1, hFile);
+    fclose(hFile);
+    if(!cbArgs) { return QEMU_MACHINE_UNKNOWN; }
+    szArgs[cbArgs] = 0;
+    // arguments are null-separated - argv[0] is the qemu binary:
+    if(strstr(szArgs, "qemu-system-x86_64") || strstr(szArgs, "qemu-system-i386")) {
+        tpMachine = QEMU_MACHINE_PC;
+    }
+    for(o = 0; o < cbArgs; o += strlen(szArg) + 1) {
+        szArg = szArgs + o;
+        if(szArgPrev && (!strcmp(szArgPrev, "-machine") || !strcmp(szArgPrev, "--machine") || !strcmp(szArgPrev, "-M"))) {
+            return DeviceQemu_MachineParse(szArg, tpMachine);
+        }
+        szArgPrev = szArg;
+    }
+    return tpMachine;
+}
+
+/*
+* Initialize the memory map from the guest physical layout. The memory map
+* remaps guest physical addresses to qwRemapBase + ram block offset. The
+* layout is either read from a layout file or is the qemu x86 default with
+* ram below 4GB up to lowmem and the remainder of the ram above 4GB.
+* -- ctxLC
+* -- cbRam = size of the guest ram block.
+* -- qwRemapBase
+* -- tpMachine = machine type - determines the default lowmem split.
+* -- return
+*/
+_Success_(return)
+BOOL DeviceQemu_MemMapInitialize(_In_ PLC_CONTEXT ctxLC, _In_ QWORD cbRam, _In_ QWORD qwRemapBase, _In_ QEMU_MACHINE tpMachine)
+{
+    FILE *hFile;
+    CHAR szLine[MAX_PATH];
+    LPSTR szLayout, sz;
+    QWORD paBase, paTop, oRam, cbLow;
+    PLC_DEVICE_PARAMETER_ENTRY pParam;
+    if((pParam = LcDeviceParameterGet(ctxLC, QEMU_PARAMETER_LAYOUT)) && pParam->szValue[0]) {
+        szLayout = pParam->szValue;
+        if(fopen_s(&hFile, szLayout, "r") || !hFile) {
+            lcprintf(ctxLC, "DEVICE: QEMU: FAIL: unable to open layout file '%s'.\n", szLayout);
+            return FALSE;
+        }
+        while(fgets(szLine, sizeof(szLine), hFile)) {
+            sz = szLine;
+            while((*sz == ' ') || (*sz == '\t')) { sz++; }
+            if(!*sz || (*sz == '#') || (*sz == '\r') || (*sz == '\n')) { continue; }
+            paBase = strtoull(sz, &sz, 16);
+            paTop = strtoull(sz, &sz, 16);
+            oRam = strtoull(sz, &sz, 16);
+            if((paTop <= paBase) || (oRam + paTop + 1 - paBase > cbRam)) {
+                lcprintf(ctxLC, "DEVICE: QEMU: FAIL: invalid layout range %llx-%llx -> %llx.\n", paBase, paTop, oRam);
+                fclose(hFile);
+                return FALSE;
+            }
+            if(!LcMemMap_AddRange(ctxLC, paBase, paTop + 1 - paBase, LC_MEMMAP_FORCE_OFFSET | (qwRemapBase + oRam))) {
+                lcprintf(ctxLC, "DEVICE: QEMU: FAIL: unable to add layout range %llx-%llx (ranges must be page aligned and ascending).\n", paBase, paTop);
+                fclose(hFile);
+                return FALSE;
+            }
+        }
+        fclose(hFile);
+        return LcMemMap_IsInitialized(ctxLC);
+    }
+    cbRam = cbRam & ~0xfff;
+    cbLow = LcDeviceParameterGetNumeric(ctxLC, QEMU_PARAMETER_LOWMEM);
+    if(!cbLow) {
+        if(cbRam < QEMU_Q35_LOWMEM_THRESHOLD) {
+            cbLow = cbRam;
+        } else if(tpMachine == QEMU_MACHINE_Q35) {
+            cbLow = QEMU_Q35_LOWMEM_SPLIT;
+        } else if(tpMachine == QEMU_MACHINE_PC) {
+            cbLow = (cbRam >= QEMU_PC_LOWMEM_THRESHOLD) ? QEMU_PC_LOWMEM_SPLIT : cbRam;
+        } else {
+            lcprintf(ctxLC, "DEVICE: QEMU: FAIL: unknown machine type - specify machine=pc|q35 or lowmem=.\n");
+            return FALSE;
+        }
+    }
+    cbLow = min(cbLow & ~0xfff, cbRam);
+    if(!cbLow || (cbLow > QEMU_HIGHMEM_BASE)) { return FALSE; }
+    if(!LcMemMap_AddRange(ctxLC, 0, cbLow, LC_MEMMAP_FORCE_OFFSET | qwRemapBase)) { return FALSE; }
+    if((cbRam > cbLow) && !LcMemMap_AddRange(ctxLC, QEMU_HIGHMEM_BASE, cbRam - cbLow, LC_MEMMAP_FORCE_OFFSET | (qwRemapBase + cbLow))) { return FALSE; }
+    return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// GENERAL FUNCTIONALITY BELOW:
+//-----------------------------------------------------------------------------
+
+/*
+* Read or write MEMs with batched process_vm_readv() / process_vm_writev().
+* Up to QEMU_IOV_MAX MEMs are transferred per system call. Transfers stop at
+* the first failing MEM - in which case the transfer is resumed after it.
+* The memory map has already translated the MEM addresses to process virtual
+* addresses.
+* -- ctxLC
+* -- cpMEMs
+* -- ppMEMs
+* -- fWrite
+*/
+VOID DeviceQemu_ReadWriteScatter(_In_ PLC_CONTEXT ctxLC, _In_ DWORD cpMEMs, _Inout_ PPMEM_SCATTER ppMEMs, _In_ BOOL fWrite)
+{
+    PDEVICE_CONTEXT_QEMU ctx = (PDEVICE_CONTEXT_QEMU)ctxLC->hDevice;
+    struct iovec iovLocal[QEMU_IOV_MAX], iovRemote[QEMU_IOV_MAX];
+    PMEM_SCATTER pMEMs[QEMU_IOV_MAX], pMEM;
+    DWORD i = 0, c, o;
+    ssize_t cbIo;
+    while(i < cpMEMs) {
+        // 1: gather batch of MEMs
+        for(c = 0; (i < cpMEMs) && (c < QEMU_IOV_MAX); i++) {
+            pMEM = ppMEMs[i];
+            if(pMEM->f || MEM_SCATTER_ADDR_ISINVALID(pMEM)) { continue; }
+            pMEMs[c] = pMEM;
+            iovLocal[c].iov_base = pMEM->pb;
+            iovLocal[c].iov_len = pMEM->cb;
+            iovRemote[c].iov_base = (PVOID)pMEM->qwA;
+            iovRemote[c].iov_len = pMEM->cb;
+            c++;
+        }
+        // 2: transfer batch - skip past any failing MEM and resume
+        for(o = 0; o < c; o++) {
+            cbIo = fWrite ?
+                process_vm_writev(ctx->pid, iovLocal + o, c - o, iovRemote + o, c - o, 0) :
+                process_vm_readv(ctx->pid, iovLocal + o, c - o, iovRemote + o, c - o, 0);
+            if(cbIo < 0) { cbIo = 0; }
+            while((o < c) && ((size_t)cbIo >= iovLocal[o].iov_len)) {
+                cbIo -= iovLocal[o].iov_len;
+                pMEMs[o]->f = TRUE;
+                o++;
+            }
+        }
+    }
+}
+
+VOID DeviceQemu_ReadScatter(_In_ PLC_CONTEXT ctxLC, _In_ DWORD cpMEMs, _Inout_ PPMEM_SCATTER ppMEMs)
+{
+    DeviceQemu_ReadWriteScatter(ctxLC, cpMEMs, ppMEMs, FALSE);
+}
+
+VOID DeviceQemu_WriteScatter(_In_ PLC_CONTEXT ctxLC, _In_ DWORD cpMEMs, _Inout_ PPMEM_SCATTER ppMEMs)
+{
+    DeviceQemu_ReadWriteScatter(ctxLC, cpMEMs, ppMEMs, TRUE);
+}
+
+/*
+* Read MEMs from the direct mapping of the guest ram (shm mode). The memory
+* map has already translated the MEM addresses to offsets into the mapping.
+* No system calls are made - the function is safe to call multi-threaded.
+* -- ctxLC
+* -- cpMEMs
+* -- ppMEMs
+*/
+VOID DeviceQemu_Shm_ReadScatter(_In_ PLC_CONTEXT ctxLC, _In_ DWORD cpMEMs, _Inout_ PPMEM_SCATTER ppMEMs)
+{
+    PDEVICE_CONTEXT_QEMU ctx = (PDEVICE_CONTEXT_QEMU)ctxLC->hDevice;
+    PMEM_SCATTER pMEM;
+    DWORD i;
+    for(i = 0; i < cpMEMs; i++) {
+        pMEM = ppMEMs[i];
+        if(pMEM->f || MEM_SCATTER_ADDR_ISINVALID(pMEM) || (pMEM->qwA + pMEM->cb > ctx->cbRam)) { continue; }
+        memcpy(pMEM->pb, ctx->pbShm + pMEM->qwA, pMEM->cb);
+        pMEM->f = TRUE;
+    }
+}
+
+VOID DeviceQemu_Shm_WriteScatter(_In_ PLC_CONTEXT ctxLC, _In_ DWORD cpMEMs, _Inout_ PPMEM_SCATTER ppMEMs)
+{
+    PDEVICE_CONTEXT_QEMU ctx = (PDEVICE_CONTEXT_QEMU)ctxLC->hDevice;
+    PMEM_SCATTER pMEM;
+    DWORD i;
+    for(i = 0; i < cpMEMs; i++) {
+        pMEM = ppMEMs[i];
+        if(pMEM->f || MEM_SCATTER_ADDR_ISINVALID(pMEM) || (pMEM->qwA + pMEM->cb > ctx->cbRam)) { continue; }
+        memcpy(ctx->pbShm + pMEM->qwA, pMEM->pb, pMEM->cb);
+        pMEM->f = TRUE;
+    }
+}
+
+VOID DeviceQemu_Close(_Inout_ PLC_CONTEXT ctxLC)
+{
+    PDEVICE_CONTEXT_QEMU ctx = (PDEVICE_CONTEXT_QEMU)ctxLC->hDevice;
+    if(ctx) {
+        ctxLC->hDevice = 0;
+        if(ctx->pbShm) { munmap(ctx->pbShm, ctx->cbRam); }
+        LocalFree(ctx);
+    }
+}
+
+/*
+* Map the guest ram backing file (shm mode). The whole file is mapped shared
+* so that guest writes are immediately visible in the mapping.
+* -- ctxLC
+* -- ctx
+* -- szShm
+* -- fReadOnly
+* -- return
+*/
+_Success_(return)
+BOOL DeviceQemu_Shm_Open(_In_ PLC_CONTEXT ctxLC, _In_ PDEVICE_CONTEXT_QEMU ctx, _In_ LPSTR szShm, _In_ BOOL fReadOnly)
+{
+    int fd;
+    struct stat st;
+    PVOID pv;
+    CHAR szFileName[MAX_PATH];
+    if(strchr(szShm, '/')) {
+        strncpy_s(szFileName, _countof(szFileName), szShm, _TRUNCATE);
+    } else {
+        _snprintf_s(szFileName, _countof(szFileName), _TRUNCATE, "/dev/shm/%s", szShm);
+    }
+    if((fd = open(szFileName, fReadOnly ? O_RDONLY : O_RDWR)) < 0) {
+        lcprintf(ctxLC, "DEVICE: QEMU: FAIL: unable to open '%s' (errno: %i).\n", szFileName, errno);
+        return FALSE;
+    }
+    if(fstat(fd, &st) || (st.st_size < 0x1000)) {
+        lcprintf(ctxLC, "DEVICE: QEMU: FAIL: invalid size of '%s'.\n", szFileName);
+        close(fd);
+        return FALSE;
+    }
+    pv = mmap(NULL, st.st_size, fReadOnly ? PROT_READ : (PROT_READ | PROT_WRITE), MAP_SHARED, fd, 0);
+    close(fd);
+    if(pv == MAP_FAILED) {
+        lcprintf(ctxLC, "DEVICE: QEMU: FAIL: unable to map '%s' (errno: %i).\n", szFileName, errno);
+        return FALSE;
+    }
+    ctx->pbShm = (PBYTE)pv;
+    ctx->cbRam = st.st_size;
+    return TRUE;
+}
+
+_Success_(return)
+BOOL DeviceQemu_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO ppLcCreateErrorInfo)
+{
+    BOOL fReadOnly;
+    PDEVICE_CONTEXT_QEMU ctx;
+    PLC_DEVICE_PARAMETER_ENTRY pParam;
+    struct iovec iovLocal, iovRemote;
+    BYTE pbProbe[8];
+    if(ppLcCreateErrorInfo) { *ppLcCreateErrorInfo = NULL; }
+    if(!(ctx = (PDEVICE_CONTEXT_QEMU)LocalAlloc(LMEM_ZEROINIT, sizeof(DEVICE_CONTEXT_QEMU)))) { return FALSE; }
+    ctxLC->hDevice = (HANDLE)ctx;
+    fReadOnly = LcDeviceParameterGetNumeric(ctxLC, QEMU_PARAMETER_READONLY) ? TRUE : FALSE;
+    // shm mode: direct mapping of the guest ram backing file
+    if((pParam = LcDeviceParameterGet(ctxLC, QEMU_PARAMETER_SHM)) && pParam->szValue[0]) {
+        if(!DeviceQemu_Shm_Open(ctxLC, ctx, pParam->szValue, fReadOnly)) { goto fail; }
+        if(!LcMemMap_IsInitialized(ctxLC) && !DeviceQemu_MemMapInitialize(ctxLC, ctx->cbRam, 0, DeviceQemu_MachineType(ctxLC, 0))) {
+            lcprintf(ctxLC, "DEVICE: QEMU: FAIL: unable to initialize guest memory layout.\n");
+            goto fail;
+        }
+        ctxLC->fMultiThread = TRUE;
+        ctxLC->Config.fVolatile = TRUE;
+        ctxLC->pfnClose = DeviceQemu_Close;
+        ctxLC->pfnReadScatter = DeviceQemu_Shm_ReadScatter;
+        ctxLC->pfnWriteScatter = fReadOnly ? NULL : DeviceQemu_Shm_WriteScatter;
+        lcprintfv(ctxLC, "DEVICE: QEMU: Successfully mapped shared memory '%s' (ram: %llx).\n", pParam->szValue, ctx->cbRam);
+        return TRUE;
+    }
+    // 1: locate guest ram block in qemu process
+    if(!(ctx->pid = (pid_t)LcDeviceParameterGetNumeric(ctxLC, QEMU_PARAMETER_PID))) {
+        lcprintf(ctxLC, "DEVICE: QEMU: FAIL: no qemu process id given (pid=).\n");
+        goto fail;
+    }
+    ctx->vaRam = LcDeviceParameterGetNumeric(ctxLC, QEMU_PARAMETER_HVA);
+    ctx->cbRam = LcDeviceParameterGetNumeric(ctxLC, QEMU_PARAMETER_SIZE);
+    if(!ctx->vaRam || !ctx->cbRam) {
+        pParam = LcDeviceParameterGet(ctxLC, QEMU_PARAMETER_RAM);
+        if(!DeviceQemu_RamFind(ctx->pid, pParam ? pParam->szValue : NULL, &ctx->vaRam, &ctx->cbRam)) {
+            lcprintf(ctxLC, "DEVICE: QEMU: FAIL: unable to locate guest ram in process %i.\n", ctx->pid);
+            goto fail;
+        }
+    }
+    // 2: verify access to the qemu process (ptrace permissions required)
+    iovLocal.iov_base = pbProbe;
+    iovLocal.iov_len = sizeof(pbProbe);
+    iovRemote.iov_base = (PVOID)ctx->vaRam;
+    iovRemote.iov_len = sizeof(pbProbe);
+    if(sizeof(pbProbe) != process_vm_readv(ctx->pid, &iovLocal, 1, &iovRemote, 1, 0)) {
+        lcprintf(ctxLC, "DEVICE: QEMU: FAIL: unable to read process %i memory (errno: %i).\n", ctx->pid, errno);
+        goto fail;
+    }
+    // 3: initialize memory map (if not already set)
+    if(!LcMemMap_IsInitialized(ctxLC) && !DeviceQemu_MemMapInitialize(ctxLC, ctx->cbRam, ctx->vaRam, DeviceQemu_MachineType(ctxLC, ctx->pid))) {
+        lcprintf(ctxLC, "DEVICE: QEMU: FAIL: unable to initialize guest memory layout.\n");
+        goto fail;
+    }
+    // 4: set callback functions and fix up config
+    ctxLC->fMultiThread = TRUE;
+    ctxLC->Config.fVolatile = TRUE;
+    ctxLC->pfnClose = DeviceQemu_Close;
+    ctxLC->pfnReadScatter = DeviceQemu_ReadScatter;
+    ctxLC->pfnWriteScatter = fReadOnly ? NULL : DeviceQemu_WriteScatter;
+    lcprintfv(ctxLC, "DEVICE: QEMU: Successfully connected to process %i (ram: %llx +%llx).\n", ctx->pid, ctx->vaRam, ctx->cbRam);
+    return TRUE;
+fail:
+    DeviceQemu_Close(ctxLC);
+    return FALSE;
+}
+
+#endif /* LINUX */
+#ifdef _WIN32
+
+_Success_(return)
+BOOL DeviceQemu_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO ppLcCreateErrorInfo)
+{
+    lcprintfv(ctxLC, "DEVICE: QEMU: FAIL: memory acquisition only supported on Linux.\n");
+    if(ppLcCreateErrorInfo) { *ppLcCreateErrorInfo = NULL; }
+    return FALSE;
+}
+
+#endif /* _WIN32 */
@@ -0,0 +1,683 @@
+// device_record.c : implementation of the record and replay devices.
+//                   the record device is a wrapper device which logs every
+//                   read and write request of an inner device - addresses,
+//                   sizes, results, timing and data - to a trace file.
+//                   the replay device serves a recorded trace back without
+//                   the original device - as fast as possible or with the
+//                   original timing of the recorded device.
+//
+// Syntax: record://<inner-device>,tracefile=<file>[,tracededup=1]
+//         replay://file=<file>[,timing=1]
+//
+// (c) Ulf Frisk, 2020-2023
+// Author: Ulf Frisk, pcileech@frizk.net
+//
+#include "leechcore.h"
+#include "leechcore_device.h"
+#include "leechcore_internal.h"
+#include "util.h"
+
+#define TRACE_MAGIC                     0x5254434c      // 'LCTR'
+#define TRACE_VERSION                   1
+#define TRACE_TP_READ                   1
+#define TRACE_TP_WRITE                  2
+#define TRACE_PARAMETER_FILE            "tracefile"
+#define TRACE_PARAMETER_DEDUP           "tracededup"
+#define REPLAY_PARAMETER_FILE           "file"
+#define REPLAY_PARAMETER_TIMING         "timing"
+#define REPLAY_RESYNC_MAX               0x100           // max records to skip ahead to find a matching request
+
+/*
+* Header of a trace file. The memory map (LC_MEMMAP_ENTRY[cMemMap]) of the
+* recorded device follows the header, then the records in request order.
+*/
+typedef struct tdTRACE_HEADER {
+    DWORD dwMagic;
+    DWORD dwVersion;
+    QWORD qwFreq;                   // timestamp ticks per second
+    QWORD paMax;
+    BOOL fVolatile;
+    BOOL fWritable;
+    DWORD cMemMap;
+    DWORD _Reserved;
+    CHAR szDevice[MAX_PATH];        // recorded inner device (information only)
+} TRACE_HEADER, *PTRACE_HEADER;
+
+/*
+* A single read or write request. The TRACE_MEM[cMEM] array follows the record
+* and is in turn followed by cbData bytes of data referenced by the MEMs. With
+* deduplication a MEM may instead refer to identical data of an earlier record.
+*/
+typedef struct tdTRACE_RECORD {
+    DWORD tp;                       // TRACE_TP_*
+    DWORD cMEM;
+    QWORD tmStart;                  // ticks since start of recording
+    QWORD tmDuration;               // ticks spent in the recorded device
+    QWORD cbData;
+} TRACE_RECORD, *PTRACE_RECORD;
+
+typedef struct tdTRACE_MEM {
+    QWORD qwA;
+    DWORD cb;
+    BOOL f;
+    QWORD oData;                    // file offset of data (0 = no data)
+} TRACE_MEM, *PTRACE_MEM;
+
+typedef struct tdTRACE_DEDUP_ENTRY {
+    QWORD qwHash;
+    QWORD oData;
+} TRACE_DEDUP_ENTRY, *PTRACE_DEDUP_ENTRY;
+
+typedef struct tdDEVICE_CONTEXT_RECORD {
+    HANDLE hLC;                     // inner device
+    FILE *hFile;
+    QWORD oFile;                    // end of trace file
+    QWORD tmStart;
+    QWORD cRecord;
+    BOOL fError;                    // trace file write failed - recording stopped
+    DWORD cMEMMax;
+    PTRACE_MEM pMEMs;
+    struct {
+        BOOL fEnabled;
+        QWORD c;
+        QWORD cTable;               // power of 2
+        PTRACE_DEDUP_ENTRY pTable;
+        QWORD cbSaved;
+        BYTE pbCompare[0x1000];
+    } Dedup;
+    CHAR szFileName[MAX_PATH];
+} DEVICE_CONTEXT_RECORD, *PDEVICE_CONTEXT_RECORD;
+
+typedef struct tdREPLAY_RECORD {
+    QWORD oRecord;                  // file offset of TRACE_RECORD
+    QWORD tmStart;
+    QWORD tmDuration;
+    DWORD tp;
+    DWORD cMEM;
+} REPLAY_RECORD, *PREPLAY_RECORD;
+
+typedef struct tdREPLAY_PAGE {
+    QWORD pa;
+    QWORD oData;
+    QWORD iRecord;
+} REPLAY_PAGE, *PREPLAY_PAGE;
+
+typedef struct tdDEVICE_CONTEXT_REPLAY {
+    FILE *hFile;
+    BOOL fTiming;
+    QWORD qwFreq;
+    QWORD qwFreqTrace;
+    QWORD tmStart;                  // start of replay (corresponds to trace timestamp 0)
+    QWORD iRecord;                  // next record expected to be requested
+    QWORD cRecord;
+    PREPLAY_RECORD pRecord;
+    QWORD cPage;
+    PREPLAY_PAGE pPage;             // latest full page data - sorted by pa
+    DWORD cMEMMax;
+    PTRACE_MEM pMEMs;
+    struct {
+        QWORD cMatch;
+        QWORD cMismatch;
+    } Stat;
+} DEVICE_CONTEXT_REPLAY, *PDEVICE_CONTEXT_REPLAY;
+
+/*
+* Ensure the MEM buffer of a record/replay context is large enough.
+* -- ppMEMs
+* -- pcMEMMax
+* -- cMEM
+* -- return
+*/
+_Success_(return)
+BOOL DeviceRecord_MEMsEnsure(_Inout_ PTRACE_MEM *ppMEMs, _Inout_ PDWORD pcMEMMax, _In_ DWORD cMEM)
+{
+    PTRACE_MEM pMEMs;
+    if(cMEM <= *pcMEMMax) { return TRUE; }
+    if(!(pMEMs = LocalAlloc(0, (SIZE_T)cMEM * sizeof(TRACE_MEM)))) { return FALSE; }
+    LocalFree(*ppMEMs);
+    *ppMEMs = pMEMs;
+    *pcMEMMax = cMEM;
+    return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// RECORD FUNCTIONALITY BELOW:
+//-----------------------------------------------------------------------------
+
+QWORD DeviceRecord_DataHash(_In_reads_(cb) PBYTE pb, _In_ DWORD cb)
+{
+    DWORD i;
+    QWORD qwHash = 0xcbf29ce484222325 ^ cb;
+    for(i = 0; i + 8 <= cb; i += 8) {
+        qwHash = (qwHash ^ *(PQWORD)(pb + i)) * 0x100000001b3;
+    }
+    for(; i < cb; i++) {
+        qwHash = (qwHash ^ pb[i]) * 0x100000001b3;
+    }
+    return qwHash;
+}
+
+/*
+* Find identical data already written to the trace file. Candidates with a
+* matching hash are read back and compared to rule out hash collisions.
+* -- ctx
+* -- qwHash
+* -- pb
+* -- cb
+* -- return = file offset of identical data, 0 if not found.
+*/
+QWORD DeviceRecord_DedupFind(_In_ PDEVICE_CONTEXT_RECORD ctx, _In_ QWORD qwHash, _In_reads_(cb) PBYTE pb, _In_ DWORD cb)
+{
+    QWORD i;
+    PTRACE_DEDUP_ENTRY pe;
+    if(!ctx->Dedup.cTable) { return 0; }
+    for(i = qwHash & (ctx->Dedup.cTable - 1); (pe = ctx->Dedup.pTable + i)->oData; i = (i + 1) & (ctx->Dedup.cTable - 1)) {
+        if(pe->qwHash != qwHash) { continue; }
+        if(_fseeki64(ctx->hFile, pe->oData, SEEK_SET)) { continue; }
+        if(cb != fread(ctx->Dedup.pbCompare, 1, cb, ctx->hFile)) { continue; }
+        if(!memcmp(ctx->Dedup.pbCompare, pb, cb)) { return pe->oData; }
+    }
+    return 0;
+}
+
+/*
+* Insert data written to the trace file into the deduplication table. The
+* table is grown (and rehashed) when half full.
+* -- ctx
+* -- qwHash
+* -- oData
+*/
+VOID DeviceRecord_DedupInsert(_In_ PDEVICE_CONTEXT_RECORD ctx, _In_ QWORD qwHash, _In_ QWORD oData)
+{
+    QWORD i, j, cTableOld = ctx->Dedup.cTable;
+    PTRACE_DEDUP_ENTRY pTableOld = ctx->Dedup.pTable, pTable;
+    if(2 * (ctx->Dedup.c + 1) > ctx->Dedup.cTable) {
+        ctx->Dedup.cTable = max(0x1000, 2 * cTableOld);
+        if(!(pTable = LocalAlloc(LMEM_ZEROINIT, (SIZE_T)ctx->Dedup.cTable * sizeof(TRACE_DEDUP_ENTRY)))) {
+            ctx->Dedup.cTable = cTableOld;
+            return;
+        }
+        for(j = 0; j < cTableOld; j++) {
+            if(!pTableOld[j].oData) { continue; }
+            for(i = pTableOld[j].qwHash & (ctx->Dedup.cTable - 1); pTable[i].oData; i = (i + 1) & (ctx->Dedup.cTable - 1));
+            pTable[i] = pTableOld[j];
+        }
+        ctx->Dedup.pTable = pTable;
+        LocalFree(pTableOld);
+    }
+    for(i = qwHash & (ctx->Dedup.cTable - 1); ctx->Dedup.pTable[i].oData; i = (i + 1) & (ctx->Dedup.cTable - 1));
+    ctx->Dedup.pTable[i].qwHash = qwHash;
+    ctx->Dedup.pTable[i].oData = oData;
+    ctx->Dedup.c++;
+}
+
+/*
+* Append a request and its result to the trace file. Data is stored for
+* successful reads and for all writes. Recording is stopped if the trace file
+* can't be written - the trace then ends with the last complete record.
+* -- ctxLC
+* -- tp = TRACE_TP_*
+* -- cpMEMs
+* -- ppMEMs
+* -- tmStart
+* -- tmDuration
+*/
+VOID DeviceRecord_Log(_In_ PLC_CONTEXT ctxLC, _In_ DWORD tp, _In_ DWORD cpMEMs, _In_ PPMEM_SCATTER ppMEMs, _In_ QWORD tmStart, _In_ QWORD tmDuration)
+{
+    PDEVICE_CONTEXT_RECORD ctx = (PDEVICE_CONTEXT_RECORD)ctxLC->hDevice;
+    DWORD i;
+    QWORD qwHash, oDataBase, cbSaved = 0;
+    PMEM_SCATTER pMEM;
+    PTRACE_MEM pe;
+    TRACE_RECORD Rec = { 0 };
+    if(ctx->fError) { return; }
+    if(!DeviceRecord_MEMsEnsure(&ctx->pMEMs, &ctx->cMEMMax, cpMEMs)) { return; }
+    Rec.tp = tp;
+    Rec.cMEM = cpMEMs;
+    Rec.tmStart = tmStart - ctx->tmStart;
+    Rec.tmDuration = tmDuration;
+    oDataBase = ctx->oFile + sizeof(TRACE_RECORD) + (QWORD)cpMEMs * sizeof(TRACE_MEM);
+    // 1: fill MEM entries and assign data offsets - data already in the trace
+    //    file is referred to rather than stored again:
+    for(i = 0; i < cpMEMs; i++) {
+        pMEM = ppMEMs[i];
+        pe = ctx->pMEMs + i;
+        pe->qwA = pMEM->qwA;
+        pe->cb = pMEM->cb;
+        pe->f = pMEM->f;
+        pe->oData = 0;
+        if(!pMEM->cb || (pMEM->cb > 0x1000) || ((tp == TRACE_TP_READ) && !pMEM->f)) { continue; }
+        if(ctx->Dedup.fEnabled) {
+            qwHash = DeviceRecord_DataHash(pMEM->pb, pMEM->cb);
+            if((pe->oData = DeviceRecord_DedupFind(ctx, qwHash, pMEM->pb, pMEM->cb))) {
+                cbSaved += pMEM->cb;
+                continue;
+            }
+        }
+        pe->oData = oDataBase + Rec.cbData;
+        Rec.cbData += pMEM->cb;
+    }
+    // 2: write record, MEM entries and new data:
+    if(_fseeki64(ctx->hFile, ctx->oFile, SEEK_SET)) { goto fail; }
+    if((1 != fwrite(&Rec, sizeof(TRACE_RECORD), 1, ctx->hFile)) || (cpMEMs != fwrite(ctx->pMEMs, sizeof(TRACE_MEM), cpMEMs, ctx->hFile))) { goto fail; }
+    for(i = 0; i < cpMEMs; i++) {
+        if((ctx->pMEMs[i].oData >= oDataBase) && (ppMEMs[i]->cb != fwrite(ppMEMs[i]->pb, 1, ppMEMs[i]->cb, ctx->hFile))) { goto fail; }
+    }
+    // 3: new data is available for deduplication once written:
+    for(i = 0; ctx->Dedup.fEnabled && (i < cpMEMs); i++) {
+        if(ctx->pMEMs[i].oData >= oDataBase) {
+            DeviceRecord_DedupInsert(ctx, DeviceRecord_DataHash(ppMEMs[i]->pb, ppMEMs[i]->cb), ctx->pMEMs[i].oData);
+        }
+    }
+    ctx->Dedup.cbSaved += cbSaved;
+    ctx->oFile = oDataBase + Rec.cbData;
+    ctx->cRecord++;
+    return;
+fail:
+    ctx->fError = TRUE;
+    lcprintf(ctxLC, "DEVICE: RECORD: FAIL: unable to write trace file '%s' - recording stopped after %lli requests.\n", ctx->szFileName, ctx->cRecord);
+}
+
+VOID DeviceRecord_ReadScatter(_In_ PLC_CONTEXT ctxLC, _In_ DWORD cpMEMs, _Inout_ PPMEM_SCATTER ppMEMs)
+{
+    PDEVICE_CONTEXT_RECORD ctx = (PDEVICE_CONTEXT_RECORD)ctxLC->hDevice;
+    QWORD tmStart, tmEnd;
+    QueryPerformanceCounter((PLARGE_INTEGER)&tmStart);
+    LcReadScatter(ctx->hLC, cpMEMs, ppMEMs);
+    QueryPerformanceCounter((PLARGE_INTEGER)&tmEnd);
+    DeviceRecord_Log(ctxLC, TRACE_TP_READ, cpMEMs, ppMEMs, tmStart, tmEnd - tmStart);
+}
+
+VOID DeviceRecord_WriteScatter(_In_ PLC_CONTEXT ctxLC, _In_ DWORD cpMEMs, _Inout_ PPMEM_SCATTER ppMEMs)
+{
+    PDEVICE_CONTEXT_RECORD ctx = (PDEVICE_CONTEXT_RECORD)ctxLC->hDevice;
+    QWORD tmStart, tmEnd;
+    QueryPerformanceCounter((PLARGE_INTEGER)&tmStart);
+    LcWriteScatter(ctx->hLC, cpMEMs, ppMEMs);
+    QueryPerformanceCounter((PLARGE_INTEGER)&tmEnd);
+    DeviceRecord_Log(ctxLC, TRACE_TP_WRITE, cpMEMs, ppMEMs, tmStart, tmEnd - tmStart);
+}
+
+_Success_(return)
+BOOL DeviceRecord_GetOption(_In_ PLC_CONTEXT ctxLC, _In_ QWORD fOption, _Out_ PQWORD pqwValue)
+{
+    PDEVICE_CONTEXT_RECORD ctx = (PDEVICE_CONTEXT_RECORD)ctxLC->hDevice;
+    return LcGetOption(ctx->hLC, fOption, pqwValue);
+}
+
+_Success_(return)
+BOOL DeviceRecord_SetOption(_In_ PLC_CONTEXT ctxLC, _In_ QWORD fOption, _In_ QWORD qwValue)
+{
+    PDEVICE_CONTEXT_RECORD ctx = (PDEVICE_CONTEXT_RECORD)ctxLC->hDevice;
+    return LcSetOption(ctx->hLC, fOption, qwValue);
+}
+
+_Success_(return)
+BOOL DeviceRecord_Command(_In_ PLC_CONTEXT ctxLC, _In_ QWORD fOption, _In_ DWORD cbDataIn, _In_reads_opt_(cbDataIn) PBYTE pbDataIn, _Out_opt_ PBYTE *ppbDataOut, _Out_opt_ PDWORD pcbDataOut)
+{
+    PDEVICE_CONTEXT_RECORD ctx = (PDEVICE_CONTEXT_RECORD)ctxLC->hDevice;
+    return LcCommand(ctx->hLC, fOption, cbDataIn, pbDataIn, ppbDataOut, pcbDataOut);
+}
+
+VOID DeviceRecord_Close(_Inout_ PLC_CONTEXT ctxLC)
+{
+    PDEVICE_CONTEXT_RECORD ctx = (PDEVICE_CONTEXT_RECORD)ctxLC->hDevice;
+    if(ctx) {
+        ctxLC->hDevice = 0;
+        if(ctx->hFile) {
+            fclose(ctx->hFile);
+            lcprintfv(ctxLC, "DEVICE: RECORD: %lli requests recorded to '%s' (0x%llx bytes, deduplicated: 0x%llx bytes).\n", ctx->cRecord, ctx->szFileName, ctx->oFile, ctx->Dedup.cbSaved);
+        }
+        LcClose(ctx->hLC);
+        LocalFree(ctx->Dedup.pTable);
+        LocalFree(ctx->pMEMs);
+        LocalFree(ctx);
+    }
+}
+
+_Success_(return)
+BOOL DeviceRecord_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO ppLcCreateErrorInfo)
+{
+    PDEVICE_CONTEXT_RECORD ctx;
+    PLC_DEVICE_PARAMETER_ENTRY pParam;
+    LC_CONFIG LcConfig;
+    LPSTR szParameters[] = { TRACE_PARAMETER_FILE, TRACE_PARAMETER_DEDUP };
+    PLC_MEMMAP_ENTRY pMemMap = NULL;
+    DWORD cbMemMap = 0;
+    QWORD qwVolatile = 0, qwReadOnly = 1;
+    TRACE_HEADER Hdr = { 0 };
+    if(ppLcCreateErrorInfo) { *ppLcCreateErrorInfo = NULL; }
+    if(!(ctx = (PDEVICE_CONTEXT_RECORD)LocalAlloc(LMEM_ZEROINIT, sizeof(DEVICE_CONTEXT_RECORD)))) { return FALSE; }
+    ctxLC->hDevice = (HANDLE)ctx;
+    if(!(pParam = LcDeviceParameterGet(ctxLC, TRACE_PARAMETER_FILE)) || !pParam->szValue[0]) {
+        lcprintf(ctxLC, "DEVICE: RECORD: FAIL: parameter '%s' is required.\n", TRACE_PARAMETER_FILE);
+        goto fail;
+    }
+    strncpy_s(ctx->szFileName, _countof(ctx->szFileName), pParam->szValue, _TRUNCATE);
+    ctx->Dedup.fEnabled = LcDeviceParameterGetNumeric(ctxLC, TRACE_PARAMETER_DEDUP) ? TRUE : FALSE;
+    // 1: open inner device (memory map is mirrored from inner device):
+    if(!(ctx->hLC = LcCreate_WrapperInnerDevice(ctxLC, _countof(szParameters), szParameters, &LcConfig, ppLcCreateErrorInfo))) {
+        goto fail;
+    }
+    LcGetOption(ctx->hLC, LC_OPT_CORE_VOLATILE, &qwVolatile);
+    LcGetOption(ctx->hLC, LC_OPT_CORE_READONLY, &qwReadOnly);
+    // 2: create trace file and write header and memory map:
+    if(fopen_s(&ctx->hFile, ctx->szFileName, "w+b") || !ctx->hFile) {
+        lcprintf(ctxLC, "DEVICE: RECORD: FAIL: unable to create trace file '%s'.\n", ctx->szFileName);
+        goto fail;
+    }
+    if(!LcMemMap_GetRangesAsStruct(ctxLC, (PBYTE*)&pMemMap, &cbMemMap)) { goto fail; }
+    Hdr.dwMagic = TRACE_MAGIC;
+    Hdr.dwVersion = TRACE_VERSION;
+    QueryPerformanceFrequency((PLARGE_INTEGER)&Hdr.qwFreq);
+    Hdr.paMax = LcMemMap_GetMaxAddress(ctxLC);
+    Hdr.fVolatile = qwVolatile ? TRUE : FALSE;
+    Hdr.fWritable = qwReadOnly ? FALSE : TRUE;
+    Hdr.cMemMap = cbMemMap / sizeof(LC_MEMMAP_ENTRY);
+    strncpy_s(Hdr.szDevice, _countof(Hdr.szDevice), LcConfig.szDevice, _TRUNCATE);
+    if((1 != fwrite(&Hdr, sizeof(TRACE_HEADER), 1, ctx->hFile)) || (cbMemMap && (1 != fwrite(pMemMap, cbMemMap, 1, ctx->hFile)))) {
+        lcprintf(ctxLC, "DEVICE: RECORD: FAIL: unable to write trace file '%s'.\n", ctx->szFileName);
+        LocalFree(pMemMap);
+        goto fail;
+    }
+    LocalFree(pMemMap);
+    ctx->oFile = sizeof(TRACE_HEADER) + cbMemMap;
+    QueryPerformanceCounter((PLARGE_INTEGER)&ctx->tmStart);
+    // 3: set callback functions and fix up config:
+    ctxLC->Config.fVolatile = Hdr.fVolatile;
+    ctxLC->pfnClose = DeviceRecord_Close;
+    ctxLC->pfnReadScatter = DeviceRecord_ReadScatter;
+    ctxLC->pfnWriteScatter = Hdr.fWritable ? DeviceRecord_WriteScatter : NULL;
+    ctxLC->pfnGetOption = DeviceRecord_GetOption;
+    ctxLC->pfnSetOption = DeviceRecord_SetOption;
+    ctxLC->pfnCommand = DeviceRecord_Command;
+    lcprintfv(ctxLC, "DEVICE: RECORD: Recording '%s' to trace file '%s'.\n", LcConfig.szDevice, ctx->szFileName);
+    return TRUE;
+fail:
+    DeviceRecord_Close(ctxLC);
+    return FALSE;
+}
+
+//-----------------------------------------------------------------------------
+// REPLAY FUNCTIONALITY BELOW:
+//-----------------------------------------------------------------------------
+
+int DeviceReplay_PageCmp(_In_ const void *pv1, _In_ const void *pv2)
+{
+    PREPLAY_PAGE p1 = (PREPLAY_PAGE)pv1, p2 = (PREPLAY_PAGE)pv2;
+    if(p1->pa != p2->pa) { return (p1->pa < p2->pa) ? -1 : 1; }
+    return (p1->iRecord < p2->iRecord) ? -1 : ((p1->iRecord > p2->iRecord) ? 1 : 0);
+}
+
+/*
+* Retrieve the file offset of the latest recorded full page data of a page.
+* -- ctx
+* -- pa = page aligned address.
+* -- return = file offset of page data, 0 if not recorded.
+*/
+QWORD DeviceReplay_PageFind(_In_ PDEVICE_CONTEXT_REPLAY ctx, _In_ QWORD pa)
+{
+    QWORD i, iLo = 0, iHi = ctx->cPage;
+    while(iLo < iHi) {
+        i = (iLo + iHi) >> 1;
+        if(ctx->pPage[i].pa < pa) {
+            iLo = i + 1;
+        } else {
+            iHi = i;
+        }
+    }
+    return ((iLo < ctx->cPage) && (ctx->pPage[iLo].pa == pa)) ? ctx->pPage[iLo].oData : 0;
+}
+
+/*
+* Read the MEM entries of a recorded request into ctx->pMEMs.
+* -- ctx
+* -- pRecord
+* -- return
+*/
+_Success_(return)
+BOOL DeviceReplay_RecordMEMs(_In_ PDEVICE_CONTEXT_REPLAY ctx, _In_ PREPLAY_RECORD pRecord)
+{
+    if(!DeviceRecord_MEMsEnsure(&ctx->pMEMs, &ctx->cMEMMax, pRecord->cMEM)) { return FALSE; }
+    if(_fseeki64(ctx->hFile, pRecord->oRecord + sizeof(TRACE_RECORD), SEEK_SET)) { return FALSE; }
+    return pRecord->cMEM == fread(ctx->pMEMs, sizeof(TRACE_MEM), pRecord->cMEM, ctx->hFile);
+}
+
+/*
+* Find the recorded request matching a request. The next expected record is
+* tried first, then records up to REPLAY_RESYNC_MAX ahead of it.
+* -- ctx
+* -- tp = TRACE_TP_*
+* -- cpMEMs
+* -- ppMEMs
+* -- return = the matching record (MEM entries are read into ctx->pMEMs).
+*/
+PREPLAY_RECORD DeviceReplay_RecordMatch(_In_ PDEVICE_CONTEXT_REPLAY ctx, _In_ DWORD tp, _In_ DWORD cpMEMs, _In_ PPMEM_SCATTER ppMEMs)
+{
+    QWORD iRecord;
+    DWORD i;
+    PREPLAY_RECORD pRecord;
+    for(iRecord = ctx->iRecord; (iRecord < ctx->cRecord) && (iRecord < ctx->iRecord + REPLAY_RESYNC_MAX); iRecord++) {
+        pRecord = ctx->pRecord + iRecord;
+        if((pRecord->tp != tp) || (pRecord->cMEM != cpMEMs)) { continue; }
+        if(!DeviceReplay_RecordMEMs(ctx, pRecord)) { continue; }
+        for(i = 0; i < cpMEMs; i++) {
+            if((ctx->pMEMs[i].qwA != ppMEMs[i]->qwA) || (ctx->pMEMs[i].cb != ppMEMs[i]->cb)) { break; }
+        }
+        if(i == cpMEMs) {
+            ctx->iRecord = iRecord + 1;
+            return pRecord;
+        }
+    }
+    return NULL;
+}
+
+/*
+* Convert a number of timestamp ticks to microseconds without overflow.
+* -- tm
+* -- qwFreq = timestamp ticks per second.
+* -- return
+*/
+QWORD DeviceReplay_TicksToUs(_In_ QWORD tm, _In_ QWORD qwFreq)
+{
+    return (tm / qwFreq) * 1000000 + ((tm % qwFreq) * 1000000) / qwFreq;
+}
+
+/*
+* Wait until the recorded completion time of a request - its recorded start
+* offset plus its recorded duration - has passed since the start of replay
+* (original timing). Requests replayed later than recorded are not delayed.
+* -- ctx
+* -- pRecord
+*/
+VOID DeviceReplay_Wait(_In_ PDEVICE_CONTEXT_REPLAY ctx, _In_ PREPLAY_RECORD pRecord)
+{
+    QWORD tmNow, usEnd, usElapsed;
+    usEnd = DeviceReplay_TicksToUs(pRecord->tmStart + pRecord->tmDuration, ctx->qwFreqTrace);
+    QueryPerformanceCounter((PLARGE_INTEGER)&tmNow);
+    usElapsed = DeviceReplay_TicksToUs(tmNow - ctx->tmStart, ctx->qwFreq);
+    if(usElapsed < usEnd) {
+        usleep((DWORD)min(usEnd - usElapsed, 0xffffffff));
+    }
+}
+
+VOID DeviceReplay_ReadScatter(_In_ PLC_CONTEXT ctxLC, _In_ DWORD cpMEMs, _Inout_ PPMEM_SCATTER ppMEMs)
+{
+    PDEVICE_CONTEXT_REPLAY ctx = (PDEVICE_CONTEXT_REPLAY)ctxLC->hDevice;
+    QWORD oData;
+    DWORD i;
+    PMEM_SCATTER pMEM;
+    PREPLAY_RECORD pRecord;
+    if((pRecord = DeviceReplay_RecordMatch(ctx, TRACE_TP_READ, cpMEMs, ppMEMs))) {
+        // recorded request - replay recorded result:
+        ctx->Stat.cMatch++;
+        for(i = 0; i < cpMEMs; i++) {
+            pMEM = ppMEMs[i];
+            if(pMEM->f || !ctx->pMEMs[i].f || !ctx->pMEMs[i].oData) { continue; }
+            if(_fseeki64(ctx->hFile, ctx->pMEMs[i].oData, SEEK_SET)) { continue; }
+            pMEM->f = (pMEM->cb == fread(pMEM->pb, 1, pMEM->cb, ctx->hFile));
+        }
+        if(ctx->fTiming) {
+            DeviceReplay_Wait(ctx, pRecord);
+        }
+        return;
+    }
+    // request not in trace - serve from latest recorded full page data:
+    ctx->Stat.cMismatch++;
+    for(i = 0; i < cpMEMs; i++) {
+        pMEM = ppMEMs[i];
+        if(pMEM->f || MEM_SCATTER_ADDR_ISINVALID(pMEM) || ((pMEM->qwA & 0xfff) + pMEM->cb > 0x1000)) { continue; }
+        if(!(oData = DeviceReplay_PageFind(ctx, pMEM->qwA & ~0xfff))) { continue; }
+        if(_fseeki64(ctx->hFile, oData + (pMEM->qwA & 0xfff), SEEK_SET)) { continue; }
+        pMEM->f = (pMEM->cb == fread(pMEM->pb, 1, pMEM->cb, ctx->hFile));
+    }
+}
+
+VOID DeviceReplay_WriteScatter(_In_ PLC_CONTEXT ctxLC, _In_ DWORD cpMEMs, _Inout_ PPMEM_SCATTER ppMEMs)
+{
+    PDEVICE_CONTEXT_REPLAY ctx = (PDEVICE_CONTEXT_REPLAY)ctxLC->hDevice;
+    DWORD i;
+    PREPLAY_RECORD pRecord;
+    if(!(pRecord = DeviceReplay_RecordMatch(ctx, TRACE_TP_WRITE, cpMEMs, ppMEMs))) {
+        ctx->Stat.cMismatch++;
+        return;
+    }
+    ctx->Stat.cMatch++;
+    for(i = 0; i < cpMEMs; i++) {
+        ppMEMs[i]->f = ctx->pMEMs[i].f;
+    }
+    if(ctx->fTiming) {
+        DeviceReplay_Wait(ctx, pRecord);
+    }
+}
+
+VOID DeviceReplay_Close(_Inout_ PLC_CONTEXT ctxLC)
+{
+    PDEVICE_CONTEXT_REPLAY ctx = (PDEVICE_CONTEXT_REPLAY)ctxLC->hDevice;
+    if(ctx) {
+        ctxLC->hDevice = 0;
+        if(ctx->Stat.cMatch || ctx->Stat.cMismatch) {
+            lcprintfv(ctxLC, "DEVICE: REPLAY: %lli / %lli recorded requests replayed, %lli requests not found in trace.\n", ctx->Stat.cMatch, ctx->cRecord, ctx->Stat.cMismatch);
+        }
+        if(ctx->hFile) { fclose(ctx->hFile); }
+        LocalFree(ctx->pRecord);
+        LocalFree(ctx->pPage);
+        LocalFree(ctx->pMEMs);
+        LocalFree(ctx);
+    }
+}
+
+/*
+* Index the records of the trace file and the latest recorded data of each
+* full page (used for requests not found in the trace).
+* -- ctx
+* -- oFile = file offset of the first record.
+* -- return
+*/
+_Success_(return)
+BOOL DeviceReplay_Index(_In_ PDEVICE_CONTEXT_REPLAY ctx, _In_ QWORD oFile)
+{
+    DWORD i;
+    QWORD cRecordMax = 0, cPageMax = 0;
+    PVOID pv;
+    TRACE_RECORD Rec;
+    PREPLAY_RECORD pRecord;
+    PTRACE_MEM pe;
+    while(!_fseeki64(ctx->hFile, oFile, SEEK_SET) && (1 == fread(&Rec, sizeof(TRACE_RECORD), 1, ctx->hFile))) {
+        if(ctx->cRecord == cRecordMax) {
+            cRecordMax = max(0x1000, 2 * cRecordMax);
+            if(!(pv = LocalAlloc(0, (SIZE_T)cRecordMax * sizeof(REPLAY_RECORD)))) { return FALSE; }
+            if(ctx->pRecord) { memcpy(pv, ctx->pRecord, (SIZE_T)ctx->cRecord * sizeof(REPLAY_RECORD)); }
+            LocalFree(ctx->pRecord);
+            ctx->pRecord = pv;
+        }
+        pRecord = ctx->pRecord + ctx->cRecord;
+        pRecord->oRecord = oFile;
+        pRecord->tmStart = Rec.tmStart;
+        pRecord->tmDuration = Rec.tmDuration;
+        pRecord->tp = Rec.tp;
+        pRecord->cMEM = Rec.cMEM;
+        if(!DeviceReplay_RecordMEMs(ctx, pRecord)) { break; }     // truncated trace
+        for(i = 0; (Rec.tp == TRACE_TP_READ) && (i < Rec.cMEM); i++) {
+            pe = ctx->pMEMs + i;
+            if(!pe->f || !pe->oData || (pe->cb != 0x1000) || (pe->qwA & 0xfff)) { continue; }
+            if(ctx->cPage == cPageMax) {
+                cPageMax = max(0x1000, 2 * cPageMax);
+                if(!(pv = LocalAlloc(0, (SIZE_T)cPageMax * sizeof(REPLAY_PAGE)))) { return FALSE; }
+                if(ctx->pPage) { memcpy(pv, ctx->pPage, (SIZE_T)ctx->cPage * sizeof(REPLAY_PAGE)); }
+                LocalFree(ctx->pPage);
+                ctx->pPage = pv;
+            }
+            ctx->pPage[ctx->cPage].pa = pe->qwA;
+            ctx->pPage[ctx->cPage].oData = pe->oData;
+            ctx->pPage[ctx->cPage].iRecord = ctx->cRecord;
+            ctx->cPage++;
+        }
+        ctx->cRecord++;
+        oFile += sizeof(TRACE_RECORD) + (QWORD)Rec.cMEM * sizeof(TRACE_MEM) + Rec.cbData;
+    }
+    // sort pages by address - keep only the latest recorded data of each page:
+    if(ctx->cPage) {
+        qsort(ctx->pPage, (size_t)ctx->cPage, sizeof(REPLAY_PAGE), DeviceReplay_PageCmp);
+        for(cPageMax = ctx->cPage, ctx->cPage = 0, i = 0; i < cPageMax; i++) {
+            if((i + 1 < cPageMax) && (ctx->pPage[i].pa == ctx->pPage[i + 1].pa)) { continue; }
+            ctx->pPage[ctx->cPage++] = ctx->pPage[i];
+        }
+    }
+    return TRUE;
+}
+
+_Success_(return)
+BOOL DeviceReplay_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO ppLcCreateErrorInfo)
+{
+    PDEVICE_CONTEXT_REPLAY ctx;
+    PLC_DEVICE_PARAMETER_ENTRY pParam;
+    PLC_MEMMAP_ENTRY pMemMap = NULL;
+    TRACE_HEADER Hdr = { 0 };
+    DWORD i;
+    if(ppLcCreateErrorInfo) { *ppLcCreateErrorInfo = NULL; }
+    if(!(ctx = (PDEVICE_CONTEXT_REPLAY)LocalAlloc(LMEM_ZEROINIT, sizeof(DEVICE_CONTEXT_REPLAY)))) { return FALSE; }
+    ctxLC->hDevice = (HANDLE)ctx;
+    // 1: open trace file and read header and memory map:
+    if(!(pParam = LcDeviceParameterGet(ctxLC, REPLAY_PARAMETER_FILE)) || !pParam->szValue[0]) {
+        lcprintf(ctxLC, "DEVICE: REPLAY: FAIL: parameter '%s' is required.\n", REPLAY_PARAMETER_FILE);
+        goto fail;
+    }
+    if(fopen_s(&ctx->hFile, pParam->szValue, "rb") || !ctx->hFile) {
+        lcprintf(ctxLC, "DEVICE: REPLAY: FAIL: unable to open trace file '%s'.\n", pParam->szValue);
+        goto fail;
+    }
+    if((1 != fread(&Hdr, sizeof(TRACE_HEADER), 1, ctx->hFile)) || (Hdr.dwMagic != TRACE_MAGIC) || (Hdr.dwVersion != TRACE_VERSION) || !Hdr.qwFreq || (Hdr.cMemMap > 0x00100000)) {
+        lcprintf(ctxLC, "DEVICE: REPLAY: FAIL: invalid trace file '%s'.\n", pParam->szValue);
+        goto fail;
+    }
+    if(Hdr.cMemMap) {
+        if(!(pMemMap = LocalAlloc(0, Hdr.cMemMap * sizeof(LC_MEMMAP_ENTRY)))) { goto fail; }
+        if(Hdr.cMemMap != fread(pMemMap, sizeof(LC_MEMMAP_ENTRY), Hdr.cMemMap, ctx->hFile)) {
+            LocalFree(pMemMap);
+            goto fail;
+        }
+        for(i = 0; i < Hdr.cMemMap; i++) {
+            LcMemMap_AddRange(ctxLC, pMemMap[i].pa, pMemMap[i].cb, pMemMap[i].paRemap);
+        }
+        LocalFree(pMemMap);
+    } else if(Hdr.paMax) {
+        LcMemMap_AddRange(ctxLC, 0, (Hdr.paMax + 0xfff) & ~0xfff, 0);
+    }
+    // 2: index records:
+    if(!DeviceReplay_Index(ctx, sizeof(TRACE_HEADER) + (QWORD)Hdr.cMemMap * sizeof(LC_MEMMAP_ENTRY))) { goto fail; }
+    ctx->qwFreqTrace = Hdr.qwFreq;
+    QueryPerformanceFrequency((PLARGE_INTEGER)&ctx->qwFreq);
+    ctx->fTiming = LcDeviceParameterGetNumeric(ctxLC, REPLAY_PARAMETER_TIMING) ? TRUE : FALSE;
+    QueryPerformanceCounter((PLARGE_INTEGER)&ctx->tmStart);
+    // 3: set callback functions and fix up config:
+    ctxLC->Config.fVolatile = Hdr.fVolatile;
+    ctxLC->pfnClose = DeviceReplay_Close;
+    ctxLC->pfnReadScatter = DeviceReplay_ReadScatter;
+    ctxLC->pfnWriteScatter = Hdr.fWritable ? DeviceReplay_WriteScatter : NULL;
+    lcprintfv(ctxLC, "DEVICE: REPLAY: Replaying %lli requests of '%s' %s.\n", ctx->cRecord, Hdr.szDevice, ctx->fTiming ? "with original timing" : "as fast as possible");
+    return TRUE;
+fail:
+    DeviceReplay_Close(ctxLC);
+    return FALSE;
+}
@@ -0,0 +1,1219 @@
+// dump.c : implementation of the streaming memory dump writer (LC_CMD_DUMP_TO_FILE).
+//
+// Device reads are overlapped with file writes: one or more reader threads
+// read fixed-size chunks of physical memory into a ring of buffers while the
+// calling thread writes completed buffers to file. Unreadable pages are not
+// written which leaves them as holes (sparse on supported file systems).
+// Progress is checkpointed to an append-only <file>.lcjournal which allows an
+// interrupted dump to be resumed (LC_DUMP_FLAG_RESUME).
+// Delta snapshots (LC_DUMP_FORMAT_DELTA) are written by the same pipeline but
+// only pages whose hash differ from the base snapshot are appended to file.
+// Deduplicated snapshots (LC_DUMP_FORMAT_DEDUP) append unique pages to a page
+// store shared between snapshots and write a page map of page ids to file.
+//
+// (c) Ulf Frisk, 2020-2023
+// Author: Ulf Frisk, pcileech@frizk.net
+//
+#include "leechcore.h"
+#include "leechcore_device.h"
+#include "leechcore_internal.h"
+#include "oscompatibility.h"
+#ifdef _WIN32
+#include <io.h>
+#endif /* _WIN32 */
+
+#define LC_DUMP_CHUNK_SIZE              0x00200000      // 2MB per buffer
+#define LC_DUMP_CHUNK_PAGES             (LC_DUMP_CHUNK_SIZE >> 12)
+#define LC_DUMP_READERS_MAX             4
+#define LC_DUMP_BUFFERS_PER_READER      4
+#define LC_DUMP_ELF_PHDR_MAX            0x200           // max segments accepted by the file device
+#define LC_DUMP_CRASH_RUNS_MAX          0x80            // max runs accepted by the file device
+#define LC_DUMP_MEMMAP_SUFFIX           ".memmap"
+#define LC_DUMP_JOURNAL_SUFFIX          ".lcjournal"
+#define LC_DUMP_JOURNAL_MAGIC           0x4e4a434c      // 'LCJN'
+#define LC_DUMP_JOURNAL_VERSION         1
+#define LC_DUMP_JOURNAL_RECORD_MAGIC    0x524a434c      // 'LCJR'
+#define LC_DUMP_JOURNAL_INTERVAL        0x40            // checkpoint every 64 chunks (128MB)
+#define LC_DUMP_DELTA_HASH_BATCH        0x00010000      // base hash table read batch (pfns)
+#define LC_DUMP_DEDUP_STORE_SUFFIX      ".lcstore"
+
+#define LC_DUMP_ELF_EI_MAGIC            0x464c457f
+#define LC_DUMP_ELF_EI_CLASSDATA_64     0x0102
+#define LC_DUMP_ELF_EI_VERSION          0x01
+#define LC_DUMP_ELF_ET_CORE             0x04
+#define LC_DUMP_ELF_EM_X86_64           62
+#define LC_DUMP_ELF_EM_AARCH64          183
+#define LC_DUMP_ELF_PT_LOAD             0x00000001
+#define LC_DUMP_ELF_PF_RWX              0x00000007
+
+#define LC_DUMP_CRASH_SIGNATURE         0x45474150      // 'PAGE'
+#define LC_DUMP_CRASH_VALID_DUMP64      0x34365544      // 'DU64'
+#define LC_DUMP_CRASH_TYPE_FULL         1
+#define LC_DUMP_CRASH_HEADER_SIZE       0x2000
+#define LC_DUMP_CRASH_MACHINE_AMD64     0x8664
+#define LC_DUMP_CRASH_MACHINE_ARM64     0xaa64
+
+typedef struct tdLC_DUMP_ELF64_EHDR {
+    DWORD e_ident_magic;
+    WORD e_ident_classdata;
+    BYTE e_ident_version;
+    BYTE e_ident_pad[9];
+    WORD e_type;
+    WORD e_machine;
+    DWORD e_version;
+    QWORD e_entry;
+    QWORD e_phoff;
+    QWORD e_shoff;
+    DWORD e_flags;
+    WORD e_ehsize;
+    WORD e_phentsize;
+    WORD e_phnum;
+    WORD e_shentsize;
+    WORD e_shnum;
+    WORD e_shstrndx;
+} LC_DUMP_ELF64_EHDR, *PLC_DUMP_ELF64_EHDR;
+
+typedef struct tdLC_DUMP_ELF64_PHDR {
+    DWORD p_type;
+    DWORD p_flags;
+    QWORD p_offset;
+    QWORD p_vaddr;
+    QWORD p_paddr;
+    QWORD p_filesz;
+    QWORD p_memsz;
+    QWORD p_align;
+} LC_DUMP_ELF64_PHDR, *PLC_DUMP_ELF64_PHDR;
+
+typedef struct tdLC_DUMP_JOURNAL_HEADER {
+    DWORD dwMagic;
+    DWORD dwVersion;
+    DWORD tpFormat;
+    DWORD cRange;
+    QWORD qwRangeDigest;            // digest of dumped ranges and file offsets
+    QWORD cbFile;
+    QWORD cChunk;
+} LC_DUMP_JOURNAL_HEADER, *PLC_DUMP_JOURNAL_HEADER;
+
+typedef struct tdLC_DUMP_JOURNAL_RECORD {
+    DWORD dwMagic;
+    DWORD _Reserved;
+    QWORD iChunkNext;               // all chunks prior to this chunk are completed
+    QWORD cbWritten;
+    QWORD cbFail;
+} LC_DUMP_JOURNAL_RECORD, *PLC_DUMP_JOURNAL_RECORD;
+
+typedef struct tdLC_DUMP_CHUNK {
+    QWORD pa;
+    QWORD oFile;
+    DWORD cb;
+} LC_DUMP_CHUNK, *PLC_DUMP_CHUNK;
+
+typedef struct tdLC_DUMP_BUFFER {
+    HANDLE hEventEmpty;             // signalled when buffer may be filled by reader
+    HANDLE hEventFull;              // signalled when buffer may be written by writer
+    PBYTE pb;
+    PPMEM_SCATTER ppMEMs;
+    PQWORD pqwHash;                 // delta/dedup snapshot: page hashes (calculated by reader)
+} LC_DUMP_BUFFER, *PLC_DUMP_BUFFER;
+
+typedef struct tdLC_DUMP_READER {
+    struct tdLC_DUMP_CONTEXT *ctx;
+    DWORD iReader;
+    HANDLE hThread;
+    HANDLE hEventFinish;
+} LC_DUMP_READER, *PLC_DUMP_READER;
+
+typedef struct tdLC_DUMP_CONTEXT {
+    PLC_CONTEXT ctxLC;
+    PLC_DUMP_TO_FILE pReq;
+    PLC_DUMP_PROGRESS pProgress;
+    LC_DUMP_PROGRESS ProgressLocal; // used if no progress counters are supplied
+    BOOL fAbort;
+    FILE *hFile;
+    FILE *hFileJournal;
+    QWORD cbFile;                   // total size of output file
+    DWORD cRange;
+    PLC_MEMMAP_ENTRY pRange;        // ranges to dump (paRemap = file offset)
+    QWORD cChunk;
+    QWORD iChunkStart;              // first chunk to dump (> 0 if resumed)
+    PLC_DUMP_CHUNK pChunk;
+    DWORD cBuffer;
+    LC_DUMP_BUFFER Buffer[LC_DUMP_READERS_MAX * LC_DUMP_BUFFERS_PER_READER];
+    DWORD cReader;
+    LC_DUMP_READER Reader[LC_DUMP_READERS_MAX];
+    struct {
+        BOOL fEnabled;
+        QWORD cPfn;
+        QWORD cPfnBase;
+        PQWORD pqwHashBase;         // page hashes of base snapshot (NULL = no base)
+        PQWORD pqwHash;             // page hashes of this snapshot
+        PQWORD pqwBitmap;           // stored pages
+        QWORD cPageStored;
+    } Delta;
+    struct {
+        BOOL fEnabled;
+        FILE *hFileStore;
+        CHAR szStore[MAX_PATH + sizeof(LC_DUMP_DEDUP_STORE_SUFFIX)];
+        LC_DEDUP_STORE_HEADER StoreHdr;
+        QWORD qwHashZero;           // hash of the all-zero page
+        QWORD cPageStoreBase;       // number of pages in store prior to this dump
+        QWORD cPage;                // number of pages in store
+        QWORD cPageMax;
+        PQWORD pqwHash;             // page hash of each page in store
+        QWORD cTable;
+        PDWORD pdwTable;            // page hash table (open addressing): page id + 1, 0 = empty
+        QWORD cPfn;
+        PDWORD pdwMap;              // page map of this snapshot: page id of each pfn
+        PBYTE pbCompare;            // collision check: page read back from store
+    } Dedup;
+} LC_DUMP_CONTEXT, *PLC_DUMP_CONTEXT;
+
+//-----------------------------------------------------------------------------
+// DUMP LAYOUT AND FILE HEADERS BELOW:
+//-----------------------------------------------------------------------------
+
+/*
+* Retrieve the ranges to dump from the memory map clipped to the requested
+* address range. If no memory map exists the whole address space of the
+* device is dumped.
+* -- ctx
+* -- return
+*/
+_Success_(return)
+BOOL LcDump_InitializeRanges(_In_ PLC_DUMP_CONTEXT ctx)
+{
+    PLC_MEMMAP_ENTRY pMemMap = NULL;
+    LC_MEMMAP_ENTRY eDefault = { 0 };
+    DWORD i, cMemMap = 0, cbMemMap = 0;
+    QWORD paMin, paMax, qwAddrMax = 0;
+    paMin = (ctx->pReq->paMin + 0xfff) & ~0xfff;
+    paMax = ctx->pReq->paMax ? (ctx->pReq->paMax & ~0xfff) : (QWORD)-1;
+    if(LcCommand(ctx->ctxLC, LC_CMD_MEMMAP_GET_STRUCT, 0, NULL, (PBYTE*)&pMemMap, &cbMemMap) && cbMemMap) {
+        cMemMap = cbMemMap / sizeof(LC_MEMMAP_ENTRY);
+    } else {
+        LcMemFree(pMemMap);
+        pMemMap = NULL;
+        if(!LcGetOption(ctx->ctxLC, LC_OPT_CORE_ADDR_MAX, &qwAddrMax) || !qwAddrMax) { return FALSE; }
+        eDefault.cb = (qwAddrMax + 0xfff) & ~0xfff;
+        cMemMap = 1;
+    }
+    if(!(ctx->pRange = LocalAlloc(LMEM_ZEROINIT, cMemMap * sizeof(LC_MEMMAP_ENTRY)))) {
+        LcMemFree(pMemMap);
+        return FALSE;
+    }
+    for(i = 0; i < cMemMap; i++) {
+        ctx->pRange[ctx->cRange].pa = max(paMin, (pMemMap ? pMemMap : &eDefault)[i].pa);
+        ctx->pRange[ctx->cRange].cb = min(paMax, (pMemMap ? pMemMap : &eDefault)[i].pa + (pMemMap ? pMemMap : &eDefault)[i].cb);
+        if(ctx->pRange[ctx->cRange].cb <= ctx->pRange[ctx->cRange].pa) { continue; }
+        ctx->pRange[ctx->cRange].cb -= ctx->pRange[ctx->cRange].pa;
+        ctx->cRange++;
+    }
+    LcMemFree(pMemMap);
+    return ctx->cRange > 0;
+}
+
+/*
+* Assign file offsets to the ranges according to the output format and split
+* the ranges into chunks.
+* -- ctx
+* -- return
+*/
+_Success_(return)
+BOOL LcDump_InitializeLayout(_In_ PLC_DUMP_CONTEXT ctx)
+{
+    DWORD i;
+    QWORD o, oFile, iChunk = 0;
+    switch(ctx->pReq->tpFormat) {
+        case LC_DUMP_FORMAT_RAW:
+            oFile = 0;
+            break;
+        case LC_DUMP_FORMAT_ELF:
+            if(ctx->cRange > LC_DUMP_ELF_PHDR_MAX) {
+                lcprintf(ctx->ctxLC, "DUMP: FAIL: too many memory ranges for elf core dump (%i).\n", ctx->cRange);
+                return FALSE;
+            }
+            oFile = (sizeof(LC_DUMP_ELF64_EHDR) + ctx->cRange * sizeof(LC_DUMP_ELF64_PHDR) + 0xfff) & ~0xfff;
+            break;
+        case LC_DUMP_FORMAT_CRASHDUMP:
+            if(ctx->cRange > LC_DUMP_CRASH_RUNS_MAX) {
+                lcprintf(ctx->ctxLC, "DUMP: FAIL: too many memory ranges for crash dump (%i).\n", ctx->cRange);
+                return FALSE;
+            }
+            oFile = LC_DUMP_CRASH_HEADER_SIZE;
+            break;
+        case LC_DUMP_FORMAT_DELTA:
+            // pages are appended to file - the file offsets of the chunks are not used.
+            oFile = LC_DELTA_PAGE_DATA_OFFSET;
+            break;
+        case LC_DUMP_FORMAT_DEDUP:
+            // pages are appended to the page store - the file offsets of the chunks are not used.
+            oFile = LC_DEDUP_MAP_OFFSET;
+            break;
+        default:
+            return FALSE;
+    }
+    for(i = 0; i < ctx->cRange; i++) {
+        ctx->pRange[i].paRemap = (ctx->pReq->tpFormat == LC_DUMP_FORMAT_RAW) ? ctx->pRange[i].pa : oFile;
+        oFile = ctx->pRange[i].paRemap + ctx->pRange[i].cb;
+        ctx->cChunk += (ctx->pRange[i].cb + LC_DUMP_CHUNK_SIZE - 1) / LC_DUMP_CHUNK_SIZE;
+        ctx->pProgress->cbTotal += ctx->pRange[i].cb;
+    }
+    ctx->cbFile = oFile;
+    if(!(ctx->pChunk = LocalAlloc(0, ctx->cChunk * sizeof(LC_DUMP_CHUNK)))) { return FALSE; }
+    for(i = 0; i < ctx->cRange; i++) {
+        for(o = 0; o < ctx->pRange[i].cb; o += LC_DUMP_CHUNK_SIZE) {
+            ctx->pChunk[iChunk].pa = ctx->pRange[i].pa + o;
+            ctx->pChunk[iChunk].oFile = ctx->pRange[i].paRemap + o;
+            ctx->pChunk[iChunk].cb = (DWORD)min(LC_DUMP_CHUNK_SIZE, ctx->pRange[i].cb - o);
+            iChunk++;
+        }
+    }
+    return TRUE;
+}
+
+/*
+* Write the ELF64 core dump header and program headers.
+* -- ctx
+* -- return
+*/
+_Success_(return)
+BOOL LcDump_WriteHeaderElf(_In_ PLC_DUMP_CONTEXT ctx)
+{
+    BOOL fResult;
+    DWORD i, cb;
+    QWORD qwArch = 0;
+    PBYTE pb;
+    PLC_DUMP_ELF64_EHDR pEhdr;
+    PLC_DUMP_ELF64_PHDR pPhdr;
+    cb = sizeof(LC_DUMP_ELF64_EHDR) + ctx->cRange * sizeof(LC_DUMP_ELF64_PHDR);
+    if(!(pb = LocalAlloc(LMEM_ZEROINIT, cb))) { return FALSE; }
+    LcGetOption(ctx->ctxLC, LC_OPT_MEMORYINFO_ARCH, &qwArch);
+    pEhdr = (PLC_DUMP_ELF64_EHDR)pb;
+    pEhdr->e_ident_magic = LC_DUMP_ELF_EI_MAGIC;
+    pEhdr->e_ident_classdata = LC_DUMP_ELF_EI_CLASSDATA_64;
+    pEhdr->e_ident_version = LC_DUMP_ELF_EI_VERSION;
+    pEhdr->e_type = LC_DUMP_ELF_ET_CORE;
+    pEhdr->e_machine = (qwArch == LC_ARCH_ARM64) ? LC_DUMP_ELF_EM_AARCH64 : LC_DUMP_ELF_EM_X86_64;
+    pEhdr->e_version = LC_DUMP_ELF_EI_VERSION;
+    pEhdr->e_phoff = sizeof(LC_DUMP_ELF64_EHDR);
+    pEhdr->e_ehsize = sizeof(LC_DUMP_ELF64_EHDR);
+    pEhdr->e_phentsize = sizeof(LC_DUMP_ELF64_PHDR);
+    pEhdr->e_phnum = (WORD)ctx->cRange;
+    pPhdr = (PLC_DUMP_ELF64_PHDR)(pb + sizeof(LC_DUMP_ELF64_EHDR));
+    for(i = 0; i < ctx->cRange; i++) {
+        pPhdr[i].p_type = LC_DUMP_ELF_PT_LOAD;
+        pPhdr[i].p_flags = LC_DUMP_ELF_PF_RWX;
+        pPhdr[i].p_offset = ctx->pRange[i].paRemap;
+        pPhdr[i].p_paddr = ctx->pRange[i].pa;
+        pPhdr[i].p_filesz = ctx->pRange[i].cb;
+        pPhdr[i].p_memsz = ctx->pRange[i].cb;
+        pPhdr[i].p_align = 0x1000;
+    }
+    fResult = (cb == fwrite(pb, 1, cb, ctx->hFile));
+    LocalFree(pb);
+    return fResult;
+}
+
+/*
+* Write a Microsoft 64-bit full crash dump header. If the device is a crash
+* dump file its header is used as a template, otherwise a minimal header is
+* created from the memory info options of the device (if any).
+* -- ctx
+* -- return
+*/
+_Success_(return)
+BOOL LcDump_WriteHeaderCrash(_In_ PLC_DUMP_CONTEXT ctx)
+{
+    BOOL fResult;
+    DWORD i, cbHdr = 0;
+    QWORD qw, cPages = 0;
+    PBYTE pb, pbHdr = NULL;
+    if(!(pb = LocalAlloc(LMEM_ZEROINIT, LC_DUMP_CRASH_HEADER_SIZE))) { return FALSE; }
+    if(LcCommand(ctx->ctxLC, LC_CMD_FILE_DUMPHEADER_GET, 0, NULL, &pbHdr, &cbHdr) && (cbHdr == LC_DUMP_CRASH_HEADER_SIZE) && (*(PDWORD)(pbHdr + 0x004) == LC_DUMP_CRASH_VALID_DUMP64)) {
+        memcpy(pb, pbHdr, LC_DUMP_CRASH_HEADER_SIZE);
+    } else {
+        *(PDWORD)(pb + 0x008) = 0xf;
+        if(LcGetOption(ctx->ctxLC, LC_OPT_MEMORYINFO_OS_VERSION_MINOR, &qw)) { *(PDWORD)(pb + 0x00c) = (DWORD)qw; }
+        if(LcGetOption(ctx->ctxLC, LC_OPT_MEMORYINFO_OS_DTB, &qw)) { *(PQWORD)(pb + 0x010) = qw; }
+        if(LcGetOption(ctx->ctxLC, LC_OPT_MEMORYINFO_OS_PFN, &qw)) { *(PQWORD)(pb + 0x018) = qw; }
+        if(LcGetOption(ctx->ctxLC, LC_OPT_MEMORYINFO_OS_PsLoadedModuleList, &qw)) { *(PQWORD)(pb + 0x020) = qw; }
+        if(LcGetOption(ctx->ctxLC, LC_OPT_MEMORYINFO_OS_PsActiveProcessHead, &qw)) { *(PQWORD)(pb + 0x028) = qw; }
+        *(PDWORD)(pb + 0x030) = (LcGetOption(ctx->ctxLC, LC_OPT_MEMORYINFO_ARCH, &qw) && (qw == LC_ARCH_ARM64)) ? LC_DUMP_CRASH_MACHINE_ARM64 : LC_DUMP_CRASH_MACHINE_AMD64;
+        if(LcGetOption(ctx->ctxLC, LC_OPT_MEMORYINFO_OS_NUM_PROCESSORS, &qw)) { *(PDWORD)(pb + 0x034) = (DWORD)qw; }
+        if(LcGetOption(ctx->ctxLC, LC_OPT_MEMORYINFO_OS_KdDebuggerDataBlock, &qw)) { *(PQWORD)(pb + 0x080) = qw; }
+    }
+    LcMemFree(pbHdr);
+    *(PDWORD)(pb + 0x000) = LC_DUMP_CRASH_SIGNATURE;
+    *(PDWORD)(pb + 0x004) = LC_DUMP_CRASH_VALID_DUMP64;
+    // physical memory descriptor (runs):
+    *(PDWORD)(pb + 0x088) = ctx->cRange;
+    for(i = 0; i < ctx->cRange; i++) {
+        *(PQWORD)(pb + 0x098 + i * 0x10ULL) = ctx->pRange[i].pa >> 12;
+        *(PQWORD)(pb + 0x0a0 + i * 0x10ULL) = ctx->pRange[i].cb >> 12;
+        cPages += ctx->pRange[i].cb >> 12;
+    }
+    *(PQWORD)(pb + 0x090) = cPages;
+    *(PDWORD)(pb + 0xf98) = LC_DUMP_CRASH_TYPE_FULL;
+    *(PQWORD)(pb + 0xfa0) = ctx->cbFile;
+    fResult = (LC_DUMP_CRASH_HEADER_SIZE == fwrite(pb, 1, LC_DUMP_CRASH_HEADER_SIZE, ctx->hFile));
+    LocalFree(pb);
+    return fResult;
+}
+
+/*
+* Write the <file>.memmap sidecar file. The format is the text memory map
+* format accepted by LC_CMD_MEMMAP_SET with the file offsets as remap address.
+* -- ctx
+*/
+VOID LcDump_WriteMemMap(_In_ PLC_DUMP_CONTEXT ctx)
+{
+    DWORD i;
+    FILE *hFile = NULL;
+    CHAR szFileName[MAX_PATH + sizeof(LC_DUMP_MEMMAP_SUFFIX)];
+    _snprintf_s(szFileName, _countof(szFileName), _TRUNCATE, "%s%s", ctx->pReq->szFileName, LC_DUMP_MEMMAP_SUFFIX);
+    if(fopen_s(&hFile, szFileName, "w") || !hFile) {
+        lcprintf(ctx->ctxLC, "DUMP: WARN: unable to write memory map file '%s'.\n", szFileName);
+        return;
+    }
+    for(i = 0; i < ctx->cRange; i++) {
+        fprintf(hFile, "%04x %16llx - %16llx -> %16llx\n", i, ctx->pRange[i].pa, ctx->pRange[i].pa + ctx->pRange[i].cb - 1, ctx->pRange[i].paRemap);
+    }
+    fclose(hFile);
+}
+
+//-----------------------------------------------------------------------------
+// RESUME JOURNAL BELOW:
+// The writer completes chunks in order. The index of the next chunk to write
+// is appended to the journal every LC_DUMP_JOURNAL_INTERVAL chunks after the
+// output file has been flushed to disk. A resumed dump continues at the last
+// checkpoint provided that the format and the dumped ranges are unchanged.
+//-----------------------------------------------------------------------------
+
+/*
+* Flush a file to disk.
+* -- hFile
+*/
+VOID LcDump_FileSync(_In_ FILE *hFile)
+{
+    fflush(hFile);
+#ifdef _WIN32
+    _commit(_fileno(hFile));
+#endif /* _WIN32 */
+#ifdef LINUX
+    fsync(fileno(hFile));
+#endif /* LINUX */
+}
+
+/*
+* Retrieve the file name of the journal file.
+* -- ctx
+* -- szFileName
+*/
+VOID LcDump_JournalFileName(_In_ PLC_DUMP_CONTEXT ctx, _Out_writes_(MAX_PATH + sizeof(LC_DUMP_JOURNAL_SUFFIX)) LPSTR szFileName)
+{
+    _snprintf_s(szFileName, MAX_PATH + sizeof(LC_DUMP_JOURNAL_SUFFIX), _TRUNCATE, "%s%s", ctx->pReq->szFileName, LC_DUMP_JOURNAL_SUFFIX);
+}
+
+/*
+* Create the journal header of the current dump.
+* -- ctx
+* -- pHdr
+*/
+VOID LcDump_JournalHeader(_In_ PLC_DUMP_CONTEXT ctx, _Out_ PLC_DUMP_JOURNAL_HEADER pHdr)
+{
+    QWORD i, qwDigest = 0xcbf29ce484222325;     // FNV-1a
+    PBYTE pb = (PBYTE)ctx->pRange;
+    for(i = 0; i < ctx->cRange * sizeof(LC_MEMMAP_ENTRY); i++) {
+        qwDigest = (qwDigest ^ pb[i]) * 0x100000001b3;
+    }
+    ZeroMemory(pHdr, sizeof(LC_DUMP_JOURNAL_HEADER));
+    pHdr->dwMagic = LC_DUMP_JOURNAL_MAGIC;
+    pHdr->dwVersion = LC_DUMP_JOURNAL_VERSION;
+    pHdr->tpFormat = ctx->pReq->tpFormat;
+    pHdr->cRange = ctx->cRange;
+    pHdr->qwRangeDigest = qwDigest;
+    pHdr->cbFile = ctx->cbFile;
+    pHdr->cChunk = ctx->cChunk;
+}
+
+/*
+* Read an existing journal and set the resume point (ctx->iChunkStart) and
+* progress counters from the last complete checkpoint record.
+* -- ctx
+*/
+VOID LcDump_JournalResume(_In_ PLC_DUMP_CONTEXT ctx)
+{
+    FILE *hFile = NULL;
+    LC_DUMP_JOURNAL_HEADER Hdr, HdrFile;
+    LC_DUMP_JOURNAL_RECORD Rec, RecLast = { 0 };
+    CHAR szFileName[MAX_PATH + sizeof(LC_DUMP_JOURNAL_SUFFIX)];
+    QWORD i;
+    LcDump_JournalFileName(ctx, szFileName);
+    if(fopen_s(&hFile, szFileName, "rb") || !hFile) { return; }
+    LcDump_JournalHeader(ctx, &Hdr);
+    if((1 != fread(&HdrFile, sizeof(LC_DUMP_JOURNAL_HEADER), 1, hFile)) || memcmp(&Hdr, &HdrFile, sizeof(LC_DUMP_JOURNAL_HEADER))) {
+        lcprintf(ctx->ctxLC, "DUMP: WARN: journal does not match dump - restarting.\n");
+        fclose(hFile);
+        return;
+    }
+    while(1 == fread(&Rec, sizeof(LC_DUMP_JOURNAL_RECORD), 1, hFile)) {
+        if((Rec.dwMagic != LC_DUMP_JOURNAL_RECORD_MAGIC) || (Rec.iChunkNext > ctx->cChunk) || (Rec.iChunkNext < RecLast.iChunkNext)) { break; }
+        RecLast = Rec;
+    }
+    fclose(hFile);
+    ctx->iChunkStart = RecLast.iChunkNext;
+    ctx->pProgress->cbWritten = RecLast.cbWritten;
+    ctx->pProgress->cbFail = RecLast.cbFail;
+    for(i = 0; i < ctx->iChunkStart; i++) {
+        ctx->pProgress->cbRead += ctx->pChunk[i].cb;
+    }
+    if(ctx->iChunkStart) {
+        lcprintfv(ctx->ctxLC, "DUMP: resuming at 0x%llx of 0x%llx bytes.\n", ctx->pProgress->cbRead, ctx->pProgress->cbTotal);
+    }
+}
+
+/*
+* Open the journal for appending checkpoints. A new journal is created unless
+* the dump is resumed.
+* -- ctx
+* -- return
+*/
+_Success_(return)
+BOOL LcDump_JournalOpen(_In_ PLC_DUMP_CONTEXT ctx)
+{
+    LC_DUMP_JOURNAL_HEADER Hdr;
+    CHAR szFileName[MAX_PATH + sizeof(LC_DUMP_JOURNAL_SUFFIX)];
+    LcDump_JournalFileName(ctx, szFileName);
+    if(ctx->iChunkStart) {
+        return !fopen_s(&ctx->hFileJournal, szFileName, "ab") && ctx->hFileJournal;
+    }
+    if(fopen_s(&ctx->hFileJournal, szFileName, "wb") || !ctx->hFileJournal) { return FALSE; }
+    LcDump_JournalHeader(ctx, &Hdr);
+    if(1 != fwrite(&Hdr, sizeof(LC_DUMP_JOURNAL_HEADER), 1, ctx->hFileJournal)) { return FALSE; }
+    LcDump_FileSync(ctx->hFileJournal);
+    return TRUE;
+}
+
+/*
+* Append a checkpoint to the journal. The output file is flushed to disk
+* before the checkpoint is written.
+* -- ctx
+* -- iChunkNext
+*/
+VOID LcDump_JournalCheckpoint(_In_ PLC_DUMP_CONTEXT ctx, _In_ QWORD iChunkNext)
+{
+    LC_DUMP_JOURNAL_RECORD Rec = { 0 };
+    if(!ctx->hFileJournal) { return; }
+    LcDump_FileSync(ctx->hFile);
+    Rec.dwMagic = LC_DUMP_JOURNAL_RECORD_MAGIC;
+    Rec.iChunkNext = iChunkNext;
+    Rec.cbWritten = ctx->pProgress->cbWritten;
+    Rec.cbFail = ctx->pProgress->cbFail;
+    fwrite(&Rec, sizeof(LC_DUMP_JOURNAL_RECORD), 1, ctx->hFileJournal);
+    LcDump_FileSync(ctx->hFileJournal);
+}
+
+/*
+* Close the journal. The journal is deleted if the dump is completed.
+* -- ctx
+* -- fCompleted
+*/
+VOID LcDump_JournalClose(_In_ PLC_DUMP_CONTEXT ctx, _In_ BOOL fCompleted)
+{
+    CHAR szFileName[MAX_PATH + sizeof(LC_DUMP_JOURNAL_SUFFIX)];
+    if(!ctx->hFileJournal) { return; }
+    fclose(ctx->hFileJournal);
+    ctx->hFileJournal = NULL;
+    if(fCompleted) {
+        LcDump_JournalFileName(ctx, szFileName);
+        remove(szFileName);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// DELTA SNAPSHOT BELOW:
+// Pages are hashed by the reader threads. Pages whose hash differ from the hash
+// of the same page in the base snapshot are appended to the file and marked in
+// the stored page bitmap. The base hashes are read from the hash table of the
+// base if it is a delta snapshot - otherwise the base is opened by the file
+// device and the pages to dump are read and hashed.
+//-----------------------------------------------------------------------------
+
+/*
+* Calculate the hash of a 4kB page. The hash is never zero (zero = no page).
+* -- pb
+* -- return
+*/
+QWORD LcDump_DeltaPageHash(_In_reads_(0x1000) PBYTE pb)
+{
+    DWORD i;
+    PQWORD pq = (PQWORD)pb;
+    QWORD qw0, qw1, h0 = 0x9e3779b97f4a7c15, h1 = 0xc2b2ae3d27d4eb4f;
+    for(i = 0; i < 0x200; i += 2) {
+        // two independent lanes to hide multiplication latency.
+        qw0 = h0 ^ (pq[i] * 0x87c37b91114253d5);
+        qw1 = h1 ^ (pq[i + 1] * 0x4cf5ad432745937f);
+        h0 = _rotl64(qw0, 31) * 0x4cf5ad432745937f;
+        h1 = _rotl64(qw1, 33) * 0x87c37b91114253d5;
+    }
+    h0 ^= h1 * 0x9e3779b97f4a7c15;
+    h0 ^= h0 >> 29;
+    return h0 ? h0 : 1;
+}
+
+/*
+* Calculate the base page hashes by reading the pages to dump from a base
+* snapshot which is not a delta snapshot. Unreadable pages hash to zero.
+* -- ctx
+* -- return
+*/
+_Success_(return)
+BOOL LcDump_DeltaBaseHashesFromDevice(_In_ PLC_DUMP_CONTEXT ctx)
+{
+    BOOL fResult = FALSE;
+    LC_CONFIG LcConfig = { 0 };
+    HANDLE hLC = NULL;
+    PBYTE pb = NULL;
+    PPMEM_SCATTER ppMEMs = NULL;
+    DWORD i, cPages;
+    QWORD iChunk, pfn;
+    int cch;
+    LcConfig.dwVersion = LC_CONFIG_VERSION;
+    LcConfig.dwPrintfVerbosity = ctx->ctxLC->Config.dwPrintfVerbosity & LC_CONFIG_PRINTF_ENABLED;
+    cch = _snprintf_s(LcConfig.szDevice, _countof(LcConfig.szDevice), _TRUNCATE, "file://file=%s", ctx->pReq->szBaseFileName);
+    if((cch < 0) || (cch >= (int)_countof(LcConfig.szDevice))) {
+        lcprintf(ctx->ctxLC, "DUMP: FAIL: base snapshot path too long.\n");
+        goto fail;
+    }
+    if(!(hLC = LcCreate(&LcConfig))) { goto fail; }
+    if(!(pb = LocalAlloc(0, LC_DUMP_CHUNK_SIZE))) { goto fail; }
+    if(!LcAllocScatter2(LC_DUMP_CHUNK_SIZE, pb, LC_DUMP_CHUNK_PAGES, &ppMEMs)) { goto fail; }
+    if(!(ctx->Delta.pqwHashBase = LocalAlloc(LMEM_ZEROINIT, ctx->Delta.cPfn * sizeof(QWORD)))) { goto fail; }
+    ctx->Delta.cPfnBase = ctx->Delta.cPfn;
+    lcprintfv(ctx->ctxLC, "DUMP: hashing base snapshot '%s'.\n", ctx->pReq->szBaseFileName);
+    for(iChunk = 0; iChunk < ctx->cChunk; iChunk++) {
+        if(ctx->pProgress->fAbort) { goto fail; }
+        cPages = ctx->pChunk[iChunk].cb >> 12;
+        for(i = 0; i < cPages; i++) {
+            ppMEMs[i]->qwA = ctx->pChunk[iChunk].pa + ((QWORD)i << 12);
+            ppMEMs[i]->f = FALSE;
+        }
+        LcReadScatter(hLC, cPages, ppMEMs);
+        for(i = 0; i < cPages; i++) {
+            pfn = ppMEMs[i]->qwA >> 12;
+            ctx->Delta.pqwHashBase[pfn] = ppMEMs[i]->f ? LcDump_DeltaPageHash(ppMEMs[i]->pb) : 0;
+        }
+    }
+    fResult = TRUE;
+fail:
+    LcMemFree(ppMEMs);
+    LocalFree(pb);
+    if(hLC) { LcClose(hLC); }
+    return fResult;
+}
+
+/*
+* Load the base page hashes. If the base snapshot is a delta snapshot its page
+* hash table is used as-is, otherwise the base snapshot is read and hashed.
+* -- ctx
+* -- return
+*/
+_Success_(return)
+BOOL LcDump_DeltaBaseHashes(_In_ PLC_DUMP_CONTEXT ctx)
+{
+    BOOL fResult = FALSE;
+    FILE *hFile = NULL;
+    LC_DELTA_HEADER Hdr = { 0 };
+    if(fopen_s(&hFile, ctx->pReq->szBaseFileName, "rb") || !hFile) { goto fail; }
+    if((1 != fread(&Hdr, sizeof(LC_DELTA_HEADER), 1, hFile)) || (Hdr.dwMagic != LC_DELTA_MAGIC)) {
+        fclose(hFile);
+        return LcDump_DeltaBaseHashesFromDevice(ctx);
+    }
+    if(Hdr.dwVersion != LC_DELTA_VERSION) { goto fail; }
+    ctx->Delta.cPfnBase = min(Hdr.cPfn, ctx->Delta.cPfn);
+    if(!(ctx->Delta.pqwHashBase = LocalAlloc(0, max(1, ctx->Delta.cPfnBase) * sizeof(QWORD)))) { goto fail; }
+    if(_fseeki64(hFile, Hdr.oHash, SEEK_SET)) { goto fail; }
+    if(ctx->Delta.cPfnBase != fread(ctx->Delta.pqwHashBase, sizeof(QWORD), ctx->Delta.cPfnBase, hFile)) { goto fail; }
+    fResult = TRUE;
+fail:
+    if(hFile) { fclose(hFile); }
+    return fResult;
+}
+
+/*
+* Initialize a delta snapshot: allocate the page hash table and the stored
+* page bitmap, load the base hashes and position the file at the page data.
+* -- ctx
+* -- return
+*/
+_Success_(return)
+BOOL LcDump_DeltaInitialize(_In_ PLC_DUMP_CONTEXT ctx)
+{
+    DWORD i;
+    ctx->Delta.fEnabled = TRUE;
+    for(i = 0; i < ctx->cRange; i++) {
+        ctx->Delta.cPfn = max(ctx->Delta.cPfn, (ctx->pRange[i].pa + ctx->pRange[i].cb) >> 12);
+    }
+    if(!(ctx->Delta.pqwHash = LocalAlloc(LMEM_ZEROINIT, ctx->Delta.cPfn * sizeof(QWORD)))) { return FALSE; }
+    if(!(ctx->Delta.pqwBitmap = LocalAlloc(LMEM_ZEROINIT, ((ctx->Delta.cPfn + 511) >> 9) * 8 * sizeof(QWORD)))) { return FALSE; }
+    if(ctx->pReq->szBaseFileName[0] && !LcDump_DeltaBaseHashes(ctx)) {
+        lcprintf(ctx->ctxLC, "DUMP: FAIL: unable to read base snapshot '%s'.\n", ctx->pReq->szBaseFileName);
+        return FALSE;
+    }
+    return !_fseeki64(ctx->hFile, LC_DELTA_PAGE_DATA_OFFSET, SEEK_SET);
+}
+
+/*
+* Append the successfully read pages of a chunk which differ from the base
+* snapshot to the file.
+* -- ctx
+* -- pChunk
+* -- pBuffer
+* -- return
+*/
+_Success_(return)
+BOOL LcDump_DeltaWriteChunk(_In_ PLC_DUMP_CONTEXT ctx, _In_ PLC_DUMP_CHUNK pChunk, _In_ PLC_DUMP_BUFFER pBuffer)
+{
+    DWORD i, cPages = pChunk->cb >> 12;
+    QWORD pfn, qwHash;
+    for(i = 0; i < cPages; i++) {
+        pfn = (pChunk->pa >> 12) + i;
+        qwHash = pBuffer->pqwHash[i];
+        ctx->Delta.pqwHash[pfn] = qwHash;
+        if(!qwHash) {
+            ctx->pProgress->cbFail += 0x1000;
+            continue;
+        }
+        if(ctx->Delta.pqwHashBase && (pfn < ctx->Delta.cPfnBase) && (ctx->Delta.pqwHashBase[pfn] == qwHash)) { continue; }
+        if(0x1000 != fwrite(pBuffer->pb + ((QWORD)i << 12), 1, 0x1000, ctx->hFile)) { return FALSE; }
+        ctx->Delta.pqwBitmap[pfn >> 6] |= 1ULL << (pfn & 63);
+        ctx->Delta.cPageStored++;
+        ctx->pProgress->cbWritten += 0x1000;
+    }
+    return TRUE;
+}
+
+/*
+* Write the stored page bitmap, the page hash table and the header of a
+* completed delta snapshot.
+* -- ctx
+* -- return
+*/
+_Success_(return)
+BOOL LcDump_DeltaFinish(_In_ PLC_DUMP_CONTEXT ctx)
+{
+    BOOL fResult = FALSE;
+    QWORD qwArch = 0, cqwBitmap = ((ctx->Delta.cPfn + 511) >> 9) * 8;
+    PLC_DELTA_HEADER pHdr;
+    if(!(pHdr = LocalAlloc(LMEM_ZEROINIT, LC_DELTA_PAGE_DATA_OFFSET))) { return FALSE; }
+    LcGetOption(ctx->ctxLC, LC_OPT_MEMORYINFO_ARCH, &qwArch);
+    pHdr->dwMagic = LC_DELTA_MAGIC;
+    pHdr->dwVersion = LC_DELTA_VERSION;
+    pHdr->cPfn = ctx->Delta.cPfn;
+    pHdr->cPageStored = ctx->Delta.cPageStored;
+    pHdr->oPageData = LC_DELTA_PAGE_DATA_OFFSET;
+    pHdr->oBitmap = pHdr->oPageData + (ctx->Delta.cPageStored << 12);
+    pHdr->oHash = pHdr->oBitmap + cqwBitmap * sizeof(QWORD);
+    pHdr->tpArch = (DWORD)qwArch;
+    strncpy_s(pHdr->szParent, _countof(pHdr->szParent), ctx->pReq->szBaseFileName, _TRUNCATE);
+    if(_fseeki64(ctx->hFile, pHdr->oBitmap, SEEK_SET)) { goto fail; }
+    if(cqwBitmap != fwrite(ctx->Delta.pqwBitmap, sizeof(QWORD), cqwBitmap, ctx->hFile)) { goto fail; }
+    if(ctx->Delta.cPfn != fwrite(ctx->Delta.pqwHash, sizeof(QWORD), ctx->Delta.cPfn, ctx->hFile)) { goto fail; }
+    if(_fseeki64(ctx->hFile, 0, SEEK_SET)) { goto fail; }
+    if(LC_DELTA_PAGE_DATA_OFFSET != fwrite(pHdr, 1, LC_DELTA_PAGE_DATA_OFFSET, ctx->hFile)) { goto fail; }
+    ctx->cbFile = pHdr->oHash + ctx->Delta.cPfn * sizeof(QWORD);
+    lcprintfv(ctx->ctxLC, "DUMP: delta snapshot: 0x%llx pages stored.\n", ctx->Delta.cPageStored);
+    fResult = TRUE;
+fail:
+    LocalFree(pHdr);
+    return fResult;
+}
+
+//-----------------------------------------------------------------------------
+// DEDUPLICATED SNAPSHOT BELOW:
+// Pages are hashed by the reader threads. The writer looks up the hash in a
+// hash table of all pages in the page store - on a match the stored page is
+// read back and compared to rule out hash collisions. Pages not found in the
+// store are appended to it. All-zero pages are not stored. The page id of each
+// pfn is recorded in the page map which is written to the snapshot file.
+//-----------------------------------------------------------------------------
+
+/*
+* Check whether a 4kB page is all zeroes.
+* -- pb
+* -- return
+*/
+BOOL LcDump_DedupIsZeroPage(_In_reads_(0x1000) PBYTE pb)
+{
+    DWORD i;
+    PQWORD pq = (PQWORD)pb;
+    for(i = 0; i < 0x200; i++) {
+        if(pq[i]) { return FALSE; }
+    }
+    return TRUE;
+}
+
+/*
+* Insert a stored page into the page hash table.
+* -- ctx
+* -- id = page id.
+*/
+VOID LcDump_DedupTableInsert(_In_ PLC_DUMP_CONTEXT ctx, _In_ DWORD id)
+{
+    QWORD i = ctx->Dedup.pqwHash[id] & (ctx->Dedup.cTable - 1);
+    while(ctx->Dedup.pdwTable[i]) {
+        i = (i + 1) & (ctx->Dedup.cTable - 1);
+    }
+    ctx->Dedup.pdwTable[i] = id + 1;
+}
+
+/*
+* Find a page in the page store. Pages with a matching hash are read back from
+* the store and compared - a hash collision is treated as a different page.
+* -- ctx
+* -- qwHash
+* -- pb
+* -- return = page id, or LC_DEDUP_PAGE_NONE if not found.
+*/
+DWORD LcDump_DedupPageFind(_In_ PLC_DUMP_CONTEXT ctx, _In_ QWORD qwHash, _In_reads_(0x1000) PBYTE pb)
+{
+    QWORD i;
+    DWORD id;
+    for(i = qwHash & (ctx->Dedup.cTable - 1); ctx->Dedup.pdwTable[i]; i = (i + 1) & (ctx->Dedup.cTable - 1)) {
+        id = ctx->Dedup.pdwTable[i] - 1;
+        if(ctx->Dedup.pqwHash[id] != qwHash) { continue; }
+        if(_fseeki64(ctx->Dedup.hFileStore, LC_DEDUP_STORE_PAGE_OFFSET(id), SEEK_SET)) { continue; }
+        if(0x1000 != fread(ctx->Dedup.pbCompare, 1, 0x1000, ctx->Dedup.hFileStore)) { continue; }
+        if(!memcmp(ctx->Dedup.pbCompare, pb, 0x1000)) { return id; }
+    }
+    return LC_DEDUP_PAGE_NONE;
+}
+
+/*
+* Open the page store - or create it if it does not exist - and load the page
+* hashes of the already stored pages into the page hash table.
+* -- ctx
+* -- return
+*/
+_Success_(return)
+BOOL LcDump_DedupStoreOpen(_In_ PLC_DUMP_CONTEXT ctx)
+{
+    QWORD id, qwStoreId;
+    DWORD c;
+    if(!fopen_s(&ctx->Dedup.hFileStore, ctx->Dedup.szStore, "r+b") && ctx->Dedup.hFileStore) {
+        if(1 != fread(&ctx->Dedup.StoreHdr, sizeof(LC_DEDUP_STORE_HEADER), 1, ctx->Dedup.hFileStore)) { return FALSE; }
+        if((ctx->Dedup.StoreHdr.dwMagic != LC_DEDUP_STORE_MAGIC) || (ctx->Dedup.StoreHdr.dwVersion != LC_DEDUP_VERSION)) { return FALSE; }
+        if(ctx->Dedup.StoreHdr.cPage > LC_DEDUP_PAGE_MAX) { return FALSE; }
+    } else {
+        ctx->Dedup.hFileStore = NULL;
+        if(fopen_s(&ctx->Dedup.hFileStore, ctx->Dedup.szStore, "w+b") || !ctx->Dedup.hFileStore) { return FALSE; }
+        qwStoreId = GetTickCount64() ^ (QWORD)(SIZE_T)ctx;
+        for(c = 0; ctx->Dedup.szStore[c]; c++) {
+            qwStoreId = (qwStoreId ^ (BYTE)ctx->Dedup.szStore[c]) * 0x100000001b3;
+        }
+        memcpy(ctx->Dedup.pbCompare, &qwStoreId, sizeof(QWORD));
+        ctx->Dedup.StoreHdr.dwMagic = LC_DEDUP_STORE_MAGIC;
+        ctx->Dedup.StoreHdr.dwVersion = LC_DEDUP_VERSION;
+        ctx->Dedup.StoreHdr.qwStoreId = LcDump_DeltaPageHash(ctx->Dedup.pbCompare);
+        ZeroMemory(ctx->Dedup.pbCompare, 0x1000);
+        if(1 != fwrite(&ctx->Dedup.StoreHdr, sizeof(LC_DEDUP_STORE_HEADER), 1, ctx->Dedup.hFileStore)) { return FALSE; }
+    }
+    ctx->Dedup.cPageStoreBase = ctx->Dedup.StoreHdr.cPage;
+    ctx->Dedup.cPage = ctx->Dedup.cPageStoreBase;
+    ctx->Dedup.cPageMax = min(LC_DEDUP_PAGE_MAX, ctx->Dedup.cPageStoreBase + (ctx->pProgress->cbTotal >> 12));
+    for(ctx->Dedup.cTable = 0x1000; ctx->Dedup.cTable < 2 * ctx->Dedup.cPageMax; ctx->Dedup.cTable <<= 1);
+    if(!(ctx->Dedup.pqwHash = LocalAlloc(0, (SIZE_T)max(1, ctx->Dedup.cPageMax) * sizeof(QWORD)))) { return FALSE; }
+    if(!(ctx->Dedup.pdwTable = LocalAlloc(LMEM_ZEROINIT, (SIZE_T)ctx->Dedup.cTable * sizeof(DWORD)))) { return FALSE; }
+    for(id = 0; id < ctx->Dedup.cPageStoreBase; id += LC_DEDUP_STORE_GROUP_PAGES) {
+        c = (DWORD)min(LC_DEDUP_STORE_GROUP_PAGES, ctx->Dedup.cPageStoreBase - id);
+        if(_fseeki64(ctx->Dedup.hFileStore, LC_DEDUP_STORE_HASH_OFFSET(id), SEEK_SET)) { return FALSE; }
+        if(c != fread(ctx->Dedup.pqwHash + id, sizeof(QWORD), c, ctx->Dedup.hFileStore)) { return FALSE; }
+    }
+    for(id = 0; id < ctx->Dedup.cPageStoreBase; id++) {
+        LcDump_DedupTableInsert(ctx, (DWORD)id);
+    }
+    return TRUE;
+}
+
+/*
+* Initialize a deduplicated snapshot: allocate the page map and open the page
+* store. If no page store is given <file>.lcstore is used.
+* -- ctx
+* -- return
+*/
+_Success_(return)
+BOOL LcDump_DedupInitialize(_In_ PLC_DUMP_CONTEXT ctx)
+{
+    DWORD i;
+    ctx->Dedup.fEnabled = TRUE;
+    for(i = 0; i < ctx->cRange; i++) {
+        ctx->Dedup.cPfn = max(ctx->Dedup.cPfn, (ctx->pRange[i].pa + ctx->pRange[i].cb) >> 12);
+    }
+    if(!(ctx->Dedup.pdwMap = LocalAlloc(0, (SIZE_T)ctx->Dedup.cPfn * sizeof(DWORD)))) { return FALSE; }
+    memset(ctx->Dedup.pdwMap, 0xff, (SIZE_T)ctx->Dedup.cPfn * sizeof(DWORD));
+    if(!(ctx->Dedup.pbCompare = LocalAlloc(LMEM_ZEROINIT, 0x1000))) { return FALSE; }
+    ctx->Dedup.qwHashZero = LcDump_DeltaPageHash(ctx->Dedup.pbCompare);
+    if(ctx->pReq->szBaseFileName[0]) {
+        strncpy_s(ctx->Dedup.szStore, _countof(ctx->Dedup.szStore), ctx->pReq->szBaseFileName, _TRUNCATE);
+    } else {
+        _snprintf_s(ctx->Dedup.szStore, _countof(ctx->Dedup.szStore), _TRUNCATE, "%s%s", ctx->pReq->szFileName, LC_DUMP_DEDUP_STORE_SUFFIX);
+    }
+    if(!LcDump_DedupStoreOpen(ctx)) {
+        lcprintf(ctx->ctxLC, "DUMP: FAIL: unable to open page store '%s'.\n", ctx->Dedup.szStore);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+* Record the successfully read pages of a chunk in the page map. Pages not
+* already in the page store are appended to it.
+* -- ctx
+* -- pChunk
+* -- pBuffer
+* -- return
+*/
+_Success_(return)
+BOOL LcDump_DedupWriteChunk(_In_ PLC_DUMP_CONTEXT ctx, _In_ PLC_DUMP_CHUNK pChunk, _In_ PLC_DUMP_BUFFER pBuffer)
+{
+    DWORD i, id, cPages = pChunk->cb >> 12;
+    QWORD pfn, qwHash;
+    PBYTE pb;
+    for(i = 0; i < cPages; i++) {
+        pfn = (pChunk->pa >> 12) + i;
+        pb = pBuffer->pb + ((QWORD)i << 12);
+        qwHash = pBuffer->pqwHash[i];
+        if(!qwHash) {
+            ctx->pProgress->cbFail += 0x1000;
+            continue;
+        }
+        if((qwHash == ctx->Dedup.qwHashZero) && LcDump_DedupIsZeroPage(pb)) {
+            ctx->Dedup.pdwMap[pfn] = LC_DEDUP_PAGE_ZERO;
+            continue;
+        }
+        if((id = LcDump_DedupPageFind(ctx, qwHash, pb)) == LC_DEDUP_PAGE_NONE) {
+            if(ctx->Dedup.cPage >= ctx->Dedup.cPageMax) { return FALSE; }
+            id = (DWORD)ctx->Dedup.cPage;
+            if(_fseeki64(ctx->Dedup.hFileStore, LC_DEDUP_STORE_PAGE_OFFSET(id), SEEK_SET)) { return FALSE; }
+            if(0x1000 != fwrite(pb, 1, 0x1000, ctx->Dedup.hFileStore)) { return FALSE; }
+            ctx->Dedup.pqwHash[id] = qwHash;
+            LcDump_DedupTableInsert(ctx, id);
+            ctx->Dedup.cPage++;
+            ctx->pProgress->cbWritten += 0x1000;
+        }
+        ctx->Dedup.pdwMap[pfn] = id;
+    }
+    return TRUE;
+}
+
+/*
+* Complete the page store and write the header and the page map of a completed
+* deduplicated snapshot. The hash blocks of the page store are written and
+* synced to disk before the store header is updated with the new page count.
+* -- ctx
+* -- return
+*/
+_Success_(return)
+BOOL LcDump_DedupFinish(_In_ PLC_DUMP_CONTEXT ctx)
+{
+    BOOL fResult = FALSE;
+    QWORD id, qwArch = 0;
+    DWORD c;
+    LPSTR sz, szStore;
+    PLC_DEDUP_HEADER pHdr;
+    if(!(pHdr = LocalAlloc(LMEM_ZEROINIT, LC_DEDUP_MAP_OFFSET))) { return FALSE; }
+    // 1: page store - hash blocks of groups with new pages and header:
+    for(id = ctx->Dedup.cPageStoreBase & ~(QWORD)(LC_DEDUP_STORE_GROUP_PAGES - 1); id < ctx->Dedup.cPage; id += LC_DEDUP_STORE_GROUP_PAGES) {
+        c = (DWORD)min(LC_DEDUP_STORE_GROUP_PAGES, ctx->Dedup.cPage - id);
+        if(_fseeki64(ctx->Dedup.hFileStore, LC_DEDUP_STORE_HASH_OFFSET(id), SEEK_SET)) { goto fail; }
+        if(c != fwrite(ctx->Dedup.pqwHash + id, sizeof(QWORD), c, ctx->Dedup.hFileStore)) { goto fail; }
+    }
+    LcDump_FileSync(ctx->Dedup.hFileStore);
+    ctx->Dedup.StoreHdr.cPage = ctx->Dedup.cPage;
+    if(_fseeki64(ctx->Dedup.hFileStore, 0, SEEK_SET)) { goto fail; }
+    if(1 != fwrite(&ctx->Dedup.StoreHdr, sizeof(LC_DEDUP_STORE_HEADER), 1, ctx->Dedup.hFileStore)) { goto fail; }
+    LcDump_FileSync(ctx->Dedup.hFileStore);
+    // 2: snapshot - header and page map. The default page store is recorded
+    //    without path since it is located next to the snapshot.
+    szStore = ctx->Dedup.szStore;
+    for(sz = ctx->Dedup.szStore; !ctx->pReq->szBaseFileName[0] && *sz; sz++) {
+        if((*sz == '/') || (*sz == '\\')) { szStore = sz + 1; }
+    }
+    LcGetOption(ctx->ctxLC, LC_OPT_MEMORYINFO_ARCH, &qwArch);
+    pHdr->dwMagic = LC_DEDUP_MAGIC;
+    pHdr->dwVersion = LC_DEDUP_VERSION;
+    pHdr->cPfn = ctx->Dedup.cPfn;
+    pHdr->oMap = LC_DEDUP_MAP_OFFSET;
+    pHdr->qwStoreId = ctx->Dedup.StoreHdr.qwStoreId;
+    pHdr->cPageStore = ctx->Dedup.cPage;
+    pHdr->tpArch = (DWORD)qwArch;
+    strncpy_s(pHdr->szStore, _countof(pHdr->szStore), szStore, _TRUNCATE);
+    if(_fseeki64(ctx->hFile, 0, SEEK_SET)) { goto fail; }
+    if(LC_DEDUP_MAP_OFFSET != fwrite(pHdr, 1, LC_DEDUP_MAP_OFFSET, ctx->hFile)) { goto fail; }
+    if(ctx->Dedup.cPfn != fwrite(ctx->Dedup.pdwMap, sizeof(DWORD), (SIZE_T)ctx->Dedup.cPfn, ctx->hFile)) { goto fail; }
+    ctx->cbFile = LC_DEDUP_MAP_OFFSET + ctx->Dedup.cPfn * sizeof(DWORD);
+    ctx->pProgress->cbWritten += ctx->cbFile;
+    lcprintfv(ctx->ctxLC, "DUMP: dedup snapshot: 0x%llx new pages stored, 0x%llx pages in store '%s'.\n", ctx->Dedup.cPage - ctx->Dedup.cPageStoreBase, ctx->Dedup.cPage, ctx->Dedup.szStore);
+    fResult = TRUE;
+fail:
+    LocalFree(pHdr);
+    return fResult;
+}
+
+//-----------------------------------------------------------------------------
+// READ/WRITE PIPELINE BELOW:
+//-----------------------------------------------------------------------------
+
+/*
+* Reader thread: read the chunks assigned to the reader (every cReader:th
+* chunk) into the buffers assigned to the chunks. If the dump is aborted
+* buffers are passed on to the writer without being read.
+* -- pReader
+*/
+DWORD LcDump_ReaderThreadProc(_In_ PLC_DUMP_READER pReader)
+{
+    PLC_DUMP_CONTEXT ctx = pReader->ctx;
+    DWORD i, cPages;
+    QWORD iChunk;
+    PLC_DUMP_CHUNK pChunk;
+    PLC_DUMP_BUFFER pBuffer;
+    for(iChunk = ctx->iChunkStart + pReader->iReader; iChunk < ctx->cChunk; iChunk += ctx->cReader) {
+        pChunk = &ctx->pChunk[iChunk];
+        pBuffer = &ctx->Buffer[(iChunk - ctx->iChunkStart) % ctx->cBuffer];
+        WaitForSingleObject(pBuffer->hEventEmpty, INFINITE);
+        if(!ctx->fAbort) {
+            cPages = pChunk->cb >> 12;
+            for(i = 0; i < cPages; i++) {
+                pBuffer->ppMEMs[i]->qwA = pChunk->pa + ((QWORD)i << 12);
+                pBuffer->ppMEMs[i]->f = FALSE;
+            }
+            LcReadScatter(ctx->ctxLC, cPages, pBuffer->ppMEMs);
+            if(ctx->Delta.fEnabled || ctx->Dedup.fEnabled) {
+                for(i = 0; i < cPages; i++) {
+                    pBuffer->pqwHash[i] = pBuffer->ppMEMs[i]->f ? LcDump_DeltaPageHash(pBuffer->ppMEMs[i]->pb) : 0;
+                }
+            }
+        }
+        SetEvent(pBuffer->hEventFull);
+    }
+    SetEvent(pReader->hEventFinish);
+    return 0;
+}
+
+/*
+* Write the successfully read pages of a chunk to file. Contiguous pages are
+* written with a single write; failed pages are skipped (left sparse).
+* -- ctx
+* -- pChunk
+* -- pBuffer
+* -- return
+*/
+_Success_(return)
+BOOL LcDump_WriteChunk(_In_ PLC_DUMP_CONTEXT ctx, _In_ PLC_DUMP_CHUNK pChunk, _In_ PLC_DUMP_BUFFER pBuffer)
+{
+    DWORD i, iRun, cPages = pChunk->cb >> 12;
+    for(i = 0; i < cPages; i++) {
+        if(!pBuffer->ppMEMs[i]->f) {
+            ctx->pProgress->cbFail += 0x1000;
+            continue;
+        }
+        for(iRun = i; (i + 1 < cPages) && pBuffer->ppMEMs[i + 1]->f; i++);
+        if(_fseeki64(ctx->hFile, pChunk->oFile + ((QWORD)iRun << 12), SEEK_SET)) { return FALSE; }
+        if(((i + 1 - iRun) << 12) != fwrite(pBuffer->pb + ((QWORD)iRun << 12), 1, (i + 1 - iRun) << 12, ctx->hFile)) { return FALSE; }
+        ctx->pProgress->cbWritten += (QWORD)(i + 1 - iRun) << 12;
+    }
+    return TRUE;
+}
+
+/*
+* Run the read/write pipeline. The calling thread acts as the writer and
+* writes the chunks in order as they are completed by the reader threads.
+* -- ctx
+* -- return
+*/
+_Success_(return)
+BOOL LcDump_Pipeline(_In_ PLC_DUMP_CONTEXT ctx)
+{
+    BOOL fResult = TRUE, fWrite;
+    DWORD i;
+    QWORD iChunk;
+    PLC_DUMP_BUFFER pBuffer;
+    // 1: initialize buffers and start reader threads:
+    ctx->cReader = ctx->ctxLC->fMultiThread ? LC_DUMP_READERS_MAX : 1;
+    ctx->cBuffer = ctx->cReader * LC_DUMP_BUFFERS_PER_READER;
+    for(i = 0; i < ctx->cBuffer; i++) {
+        pBuffer = &ctx->Buffer[i];
+        if(!(pBuffer->pb = LocalAlloc(0, LC_DUMP_CHUNK_SIZE))) { return FALSE; }
+        if(!LcAllocScatter2(LC_DUMP_CHUNK_SIZE, pBuffer->pb, LC_DUMP_CHUNK_PAGES, &pBuffer->ppMEMs)) { return FALSE; }
+        if(!(pBuffer->hEventEmpty = CreateEvent(NULL, FALSE, TRUE, NULL))) { return FALSE; }
+        if(!(pBuffer->hEventFull = CreateEvent(NULL, FALSE, FALSE, NULL))) { return FALSE; }
+        if((ctx->Delta.fEnabled || ctx->Dedup.fEnabled) && !(pBuffer->pqwHash = LocalAlloc(0, LC_DUMP_CHUNK_PAGES * sizeof(QWORD)))) { return FALSE; }
+    }
+    for(i = 0; i < ctx->cReader; i++) {
+        ctx->Reader[i].ctx = ctx;
+        ctx->Reader[i].iReader = i;
+        if(!(ctx->Reader[i].hEventFinish = CreateEvent(NULL, TRUE, FALSE, NULL))) { break; }
+        if(!(ctx->Reader[i].hThread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)LcDump_ReaderThreadProc, &ctx->Reader[i], 0, NULL))) { break; }
+    }
+    if(i < ctx->cReader) {
+        // unable to start all reader threads - abort (started readers pass their chunks without reading):
+        lcprintf(ctx->ctxLC, "DUMP: FAIL: unable to start reader threads.\n");
+        ctx->fAbort = TRUE;
+        fResult = FALSE;
+    }
+    // 2: write chunks in order as they are completed:
+    for(iChunk = ctx->iChunkStart; iChunk < ctx->cChunk; iChunk++) {
+        if(!ctx->Reader[(iChunk - ctx->iChunkStart) % ctx->cReader].hThread) { continue; }
+        pBuffer = &ctx->Buffer[(iChunk - ctx->iChunkStart) % ctx->cBuffer];
+        WaitForSingleObject(pBuffer->hEventFull, INFINITE);
+        if(ctx->pProgress->fAbort && !ctx->fAbort) {
+            lcprintf(ctx->ctxLC, "DUMP: aborted by caller.\n");
+            LcDump_JournalCheckpoint(ctx, iChunk);
+            ctx->fAbort = TRUE;
+            fResult = FALSE;
+        }
+        if(!ctx->fAbort) {
+            if(ctx->Delta.fEnabled) {
+                fWrite = LcDump_DeltaWriteChunk(ctx, &ctx->pChunk[iChunk], pBuffer);
+            } else if(ctx->Dedup.fEnabled) {
+                fWrite = LcDump_DedupWriteChunk(ctx, &ctx->pChunk[iChunk], pBuffer);
+            } else {
+                fWrite = LcDump_WriteChunk(ctx, &ctx->pChunk[iChunk], pBuffer);
+            }
+            if(!fWrite) {
+                lcprintf(ctx->ctxLC, "DUMP: FAIL: unable to write to file '%s'.\n", ctx->pReq->szFileName);
+                ctx->fAbort = TRUE;
+                fResult = FALSE;
+            }
+            ctx->pProgress->cbRead += ctx->pChunk[iChunk].cb;
+            if(!ctx->fAbort && !((iChunk + 1) % LC_DUMP_JOURNAL_INTERVAL)) {
+                LcDump_JournalCheckpoint(ctx, iChunk + 1);
+            }
+        }
+        SetEvent(pBuffer->hEventEmpty);
+    }
+    // 3: wait for reader threads to exit:
+    for(i = 0; i < ctx->cReader; i++) {
+        if(ctx->Reader[i].hThread) {
+            WaitForSingleObject(ctx->Reader[i].hEventFinish, INFINITE);
+        }
+    }
+    return fResult;
+}
+
+/*
+* Clean up the dump context.
+* -- ctx
+*/
+VOID LcDump_Close(_In_ PLC_DUMP_CONTEXT ctx)
+{
+    DWORD i;
+    for(i = 0; i < LC_DUMP_READERS_MAX; i++) {
+        if(ctx->Reader[i].hThread) { CloseHandle(ctx->Reader[i].hThread); }
+        if(ctx->Reader[i].hEventFinish) { CloseHandle(ctx->Reader[i].hEventFinish); }
+    }
+    for(i = 0; i < LC_DUMP_READERS_MAX * LC_DUMP_BUFFERS_PER_READER; i++) {
+        if(ctx->Buffer[i].hEventEmpty) { CloseHandle(ctx->Buffer[i].hEventEmpty); }
+        if(ctx->Buffer[i].hEventFull) { CloseHandle(ctx->Buffer[i].hEventFull); }
+        LcMemFree(ctx->Buffer[i].ppMEMs);
+        LocalFree(ctx->Buffer[i].pb);
+        LocalFree(ctx->Buffer[i].pqwHash);
+    }
+    if(ctx->hFile) { fclose(ctx->hFile); }
+    LcDump_JournalClose(ctx, FALSE);
+    LocalFree(ctx->Delta.pqwHashBase);
+    LocalFree(ctx->Delta.pqwHash);
+    LocalFree(ctx->Delta.pqwBitmap);
+    if(ctx->Dedup.hFileStore) { fclose(ctx->Dedup.hFileStore); }
+    LocalFree(ctx->Dedup.pqwHash);
+    LocalFree(ctx->Dedup.pdwTable);
+    LocalFree(ctx->Dedup.pdwMap);
+    LocalFree(ctx->Dedup.pbCompare);
+    LocalFree(ctx->pChunk);
+    LocalFree(ctx->pRange);
+    LocalFree(ctx);
+}
+
+/*
+* Dump the physical memory of a device to file - LC_CMD_DUMP_TO_FILE.
+* The dump is done by the calling thread (reads are done by reader threads)
+* and does not hold the LeechCore lock; other LeechCore calls may be made
+* while the dump is ongoing.
+* -- ctxLC
+* -- cbDataIn
+* -- pbDataIn = PLC_DUMP_TO_FILE
+* -- return
+*/
+_Success_(return)
+BOOL LcDump_ToFile(_In_ PLC_CONTEXT ctxLC, _In_ DWORD cbDataIn, _In_reads_opt_(cbDataIn) PBYTE pbDataIn)
+{
+    BOOL fResult = FALSE;
+    PLC_DUMP_CONTEXT ctx = NULL;
+    PLC_DUMP_TO_FILE pReq = (PLC_DUMP_TO_FILE)pbDataIn;
+    DWORD dwFlags;
+    if(!pReq || (cbDataIn < sizeof(LC_DUMP_TO_FILE)) || (pReq->dwVersion != LC_DUMP_TO_FILE_VERSION)) { return FALSE; }
+    if(!pReq->szFileName[0]) { return FALSE; }
+    dwFlags = pReq->dwFlags;
+    if((pReq->tpFormat == LC_DUMP_FORMAT_DELTA) || (pReq->tpFormat == LC_DUMP_FORMAT_DEDUP)) {
+        // delta/dedup snapshot pages are appended - no resume and no memory map file.
+        dwFlags |= LC_DUMP_FLAG_NO_JOURNAL | LC_DUMP_FLAG_NO_MEMMAP_FILE;
+    }
+    if(!(ctx = LocalAlloc(LMEM_ZEROINIT, sizeof(LC_DUMP_CONTEXT)))) { return FALSE; }
+    ctx->ctxLC = ctxLC;
+    ctx->pReq = pReq;
+    ctx->pProgress = pReq->pProgress ? pReq->pProgress : &ctx->ProgressLocal;
+    ctx->pProgress->cbTotal = 0;
+    ctx->pProgress->cbRead = 0;
+    ctx->pProgress->cbFail = 0;
+    ctx->pProgress->cbWritten = 0;
+    ctx->pProgress->fCompleted = FALSE;
+    // 1: layout and file header:
+    if(!LcDump_InitializeRanges(ctx)) {
+        lcprintf(ctxLC, "DUMP: FAIL: no memory to dump.\n");
+        goto fail;
+    }
+    if(!LcDump_InitializeLayout(ctx)) { goto fail; }
+    if((dwFlags & LC_DUMP_FLAG_RESUME) && !(dwFlags & LC_DUMP_FLAG_NO_JOURNAL)) {
+        LcDump_JournalResume(ctx);
+        if(ctx->iChunkStart && (fopen_s(&ctx->hFile, pReq->szFileName, "r+b") || !ctx->hFile)) {
+            lcprintf(ctxLC, "DUMP: WARN: unable to open file '%s' for resume - restarting.\n", pReq->szFileName);
+            ctx->hFile = NULL;
+            ctx->iChunkStart = 0;
+            ctx->pProgress->cbRead = 0;
+            ctx->pProgress->cbFail = 0;
+            ctx->pProgress->cbWritten = 0;
+        }
+    }
+    if(!ctx->hFile && (fopen_s(&ctx->hFile, pReq->szFileName, "wb") || !ctx->hFile)) {
+        lcprintf(ctxLC, "DUMP: FAIL: unable to create file '%s'.\n", pReq->szFileName);
+        goto fail;
+    }
+    if(!(dwFlags & LC_DUMP_FLAG_NO_JOURNAL) && !LcDump_JournalOpen(ctx)) {
+        lcprintf(ctxLC, "DUMP: WARN: unable to create journal - dump cannot be resumed.\n");
+        LcDump_JournalClose(ctx, FALSE);
+    }
+    if((pReq->tpFormat == LC_DUMP_FORMAT_ELF) && !LcDump_WriteHeaderElf(ctx)) { goto fail; }
+    if((pReq->tpFormat == LC_DUMP_FORMAT_CRASHDUMP) && !LcDump_WriteHeaderCrash(ctx)) { goto fail; }
+    if((pReq->tpFormat == LC_DUMP_FORMAT_DELTA) && !LcDump_DeltaInitialize(ctx)) { goto fail; }
+    if((pReq->tpFormat == LC_DUMP_FORMAT_DEDUP) && !LcDump_DedupInitialize(ctx)) { goto fail; }
+    lcprintfv(ctxLC, "DUMP: dumping 0x%llx bytes in %i ranges to '%s'.\n", ctx->pProgress->cbTotal, ctx->cRange, pReq->szFileName);
+    // 2: dump memory:
+    if(!LcDump_Pipeline(ctx)) { goto fail; }
+    if(ctx->Delta.fEnabled && !LcDump_DeltaFinish(ctx)) { goto fail; }
+    if(ctx->Dedup.fEnabled && !LcDump_DedupFinish(ctx)) { goto fail; }
+    // 3: extend file to full size (trailing unreadable memory is sparse):
+    if(_fseeki64(ctx->hFile, 0, SEEK_END)) { goto fail; }
+    if((QWORD)_ftelli64(ctx->hFile) < ctx->cbFile) {
+        if(_fseeki64(ctx->hFile, ctx->cbFile - 1, SEEK_SET) || (1 != fwrite("", 1, 1, ctx->hFile))) { goto fail; }
+    }
+    LcDump_JournalClose(ctx, TRUE);
+    if(!(dwFlags & LC_DUMP_FLAG_NO_MEMMAP_FILE)) {
+        LcDump_WriteMemMap(ctx);
+    }
+    lcprintfv(ctxLC, "DUMP: completed: 0x%llx bytes written, 0x%llx bytes unreadable.\n", ctx->pProgress->cbWritten, ctx->pProgress->cbFail);
+    ctx->pProgress->fCompleted = TRUE;
+    fResult = TRUE;
+fail:
+    LcDump_Close(ctx);
+    return fResult;
+}
@@ -23,9 +23,14 @@ typedef struct tdLC_MAIN_CONTEXT {
 LC_MAIN_CONTEXT g_ctx = { 0 };
 
 _Success_(return) BOOL Device3380_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO ppLcCreateErrorInfo);
+_Success_(return) BOOL DeviceCache_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO ppLcCreateErrorInfo);
 _Success_(return) BOOL DeviceFile_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO ppLcCreateErrorInfo);
 _Success_(return) BOOL DeviceFPGA_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO ppLcCreateErrorInfo);
+_Success_(return) BOOL DeviceKcore_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO ppLcCreateErrorInfo);
+_Success_(return) BOOL DeviceQemu_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO ppLcCreateErrorInfo);
 _Success_(return) BOOL DevicePMEM_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO ppLcCreateErrorInfo);
+_Success_(return) BOOL DeviceRecord_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO ppLcCreateErrorInfo);
+_Success_(return) BOOL DeviceReplay_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO ppLcCreateErrorInfo);
 _Success_(return) BOOL DeviceVMM_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO ppLcCreateErrorInfo);
 _Success_(return) BOOL DeviceVMWare_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO ppLcCreateErrorInfo);
 _Success_(return) BOOL DeviceTMD_Open(_Inout_ PLC_CONTEXT ctxLC, _Out_opt_ PPLC_CONFIG_ERRORINFO ppLcCreateErrorInfo);
@@ -243,6 +248,18 @@ VOID LcCreate_FetchDevice(_Inout_ PLC_CONTEXT ctx)
     DWORD cch, cszDevice = 0;
     LPSTR szDeviceSpecial = NULL;
     // 1: check against built-in devices:
+    if(0 == _strnicmp("cache://", ctx->Config.szDevice, 8)) {
+        // cache wrapper device - inner device may be remote.
+        strncpy_s(ctx->Config.szDeviceName, sizeof(ctx->Config.szDeviceName), "cache", _TRUNCATE);
+        ctx->pfnCreate = DeviceCache_Open;
+        return;
+    }
+    if(0 == _strnicmp("record://", ctx->Config.szDevice, 9)) {
+        // record wrapper device - inner device may be remote.
+        strncpy_s(ctx->Config.szDeviceName, sizeof(ctx->Config.szDeviceName), "record", _TRUNCATE);
+        ctx->pfnCreate = DeviceRecord_Open;
+        return;
+    }
     if(0 == _strnicmp("rpc://", ctx->Config.szRemote, 6)) {
         strncpy_s(ctx->Config.szDeviceName, sizeof(ctx->Config.szDeviceName), "rpc", _TRUNCATE);
         ctx->pfnCreate = LeechRpc_Open;
@@ -259,6 +276,11 @@ VOID LcCreate_FetchDevice(_Inout_ PLC_CONTEXT ctx)
         ctx->pfnCreate = DeviceFile_Open;
         return;
     }
+    if((0 == _strnicmp("union://", ctx->Config.szDevice, 8)) || (0 == _strnicmp("multifile://", ctx->Config.szDevice, 12))) {
+        strncpy_s(ctx->Config.szDeviceName, sizeof(ctx->Config.szDeviceName), "union", _TRUNCATE);
+        ctx->pfnCreate = DeviceFile_Open;
+        return;
+    }
     if((0 == _strnicmp("fpga", ctx->Config.szDevice, 4)) || (0 == _strnicmp("rawudp://", ctx->Config.szDevice, 9))) {
         strncpy_s(ctx->Config.szDeviceName, sizeof(ctx->Config.szDeviceName), "fpga", _TRUNCATE);
         ctx->pfnCreate = DeviceFPGA_Open;
@@ -279,6 +301,21 @@ VOID LcCreate_FetchDevice(_Inout_ PLC_CONTEXT ctx)
         ctx->pfnCreate = DevicePMEM_Open;
         return;
     }
+    if((0 == _stricmp("qemu", ctx->Config.szDevice)) || (0 == _strnicmp("qemu://", ctx->Config.szDevice, 7))) {
+        strncpy_s(ctx->Config.szDeviceName, sizeof(ctx->Config.szDeviceName), "qemu", _TRUNCATE);
+        ctx->pfnCreate = DeviceQemu_Open;
+        return;
+    }
+    if((0 == _stricmp("kcore", ctx->Config.szDevice)) || (0 == _strnicmp("kcore://", ctx->Config.szDevice, 8))) {
+        strncpy_s(ctx->Config.szDeviceName, sizeof(ctx->Config.szDeviceName), "kcore", _TRUNCATE);
+        ctx->pfnCreate = DeviceKcore_Open;
+        return;
+    }
+    if(0 == _strnicmp("replay://", ctx->Config.szDevice, 9)) {
+        strncpy_s(ctx->Config.szDeviceName, sizeof(ctx->Config.szDeviceName), "replay", _TRUNCATE);
+        ctx->pfnCreate = DeviceReplay_Open;
+        return;
+    }
     if(0 == _strnicmp("vmm://", ctx->Config.szDevice, 6)) {
         strncpy_s(ctx->Config.szDeviceName, sizeof(ctx->Config.szDeviceName), "vmm", _TRUNCATE);
         ctx->pfnCreate = DeviceVMM_Open;
@@ -477,6 +514,74 @@ EXPORTED_FUNCTION HANDLE LcCreate(_Inout_ PLC_CONFIG pLcCreateConfig)
     return LcCreateEx(pLcCreateConfig, NULL);
 }
 
+/*
+* Open the inner device of a wrapper device such as cache:// or record://.
+* The inner device string is the wrapper device string without its prefix and
+* without the wrapper specific parameters. The remote configuration is passed
+* on to the inner device. The memory map of the inner device is mirrored 1:1
+* into the wrapper device since the inner device performs any remapping.
+* -- ctxLC = the wrapper device.
+* -- cszParameter
+* -- pszParameter = names of the wrapper specific parameters.
+* -- pLcConfigInner = receives the configuration of the inner device.
+* -- ppLcCreateErrorInfo
+* -- return = handle to the inner device, NULL on failure.
+*/
+_Success_(return != NULL)
+HANDLE LcCreate_WrapperInnerDevice(_Inout_ PLC_CONTEXT ctxLC, _In_ DWORD cszParameter, _In_reads_(cszParameter) LPSTR *pszParameter, _Out_ PLC_CONFIG pLcConfigInner, _Out_opt_ PPLC_CONFIG_ERRORINFO ppLcCreateErrorInfo)
+{
+    HANDLE hLC;
+    BOOL fWrapperParameter;
+    DWORD i, cch, cbMemMap = 0;
+    QWORD paMax = 0;
+    LPSTR sz;
+    PLC_MEMMAP_ENTRY pMemMap = NULL;
+    ZeroMemory(pLcConfigInner, sizeof(LC_CONFIG));
+    pLcConfigInner->dwVersion = LC_CONFIG_VERSION;
+    pLcConfigInner->dwPrintfVerbosity = ctxLC->Config.dwPrintfVerbosity;
+    pLcConfigInner->pfn_printf_opt = ctxLC->Config.pfn_printf_opt;
+    pLcConfigInner->paMax = ctxLC->Config.paMax;
+    strncpy_s(pLcConfigInner->szRemote, _countof(pLcConfigInner->szRemote), ctxLC->Config.szRemote, _TRUNCATE);
+    // 1: inner device string - remove prefix and wrapper parameters:
+    if(!(sz = strstr(ctxLC->Config.szDevice, "://"))) { return NULL; }
+    sz += 3;
+    while(*sz) {
+        cch = (DWORD)strcspn(sz, ",;");
+        for(i = 0, fWrapperParameter = FALSE; i < cszParameter; i++) {
+            if(!_strnicmp(sz, pszParameter[i], strlen(pszParameter[i])) && (sz[strlen(pszParameter[i])] == '=')) {
+                fWrapperParameter = TRUE;
+            }
+        }
+        if(!fWrapperParameter) {
+            if(pLcConfigInner->szDevice[0]) {
+                strncat_s(pLcConfigInner->szDevice, _countof(pLcConfigInner->szDevice), ",", _TRUNCATE);
+            }
+            strncat_s(pLcConfigInner->szDevice, _countof(pLcConfigInner->szDevice), sz, cch);
+        }
+        sz += cch;
+        if(*sz) { sz++; }
+    }
+    if(!pLcConfigInner->szDevice[0]) {
+        lcprintf(ctxLC, "DEVICE: %s: FAIL: no inner device specified.\n", ctxLC->Config.szDeviceName);
+        return NULL;
+    }
+    // 2: open inner device:
+    if(!(hLC = LcCreateEx(pLcConfigInner, ppLcCreateErrorInfo))) {
+        lcprintf(ctxLC, "DEVICE: %s: FAIL: unable to open inner device '%s'.\n", ctxLC->Config.szDeviceName, pLcConfigInner->szDevice);
+        return NULL;
+    }
+    // 3: mirror inner memory map:
+    if(LcCommand(hLC, LC_CMD_MEMMAP_GET_STRUCT, 0, NULL, (PBYTE*)&pMemMap, &cbMemMap) && cbMemMap) {
+        for(i = 0; i < cbMemMap / sizeof(LC_MEMMAP_ENTRY); i++) {
+            LcMemMap_AddRange(ctxLC, pMemMap[i].pa, pMemMap[i].cb, pMemMap[i].pa);
+        }
+    } else if(LcGetOption(hLC, LC_OPT_CORE_ADDR_MAX, &paMax) && paMax) {
+        LcMemMap_AddRange(ctxLC, 0, (paMax + 0xfff) & ~0xfff, 0);
+    }
+    LcMemFree(pMemMap);
+    return hLC;
+}
+
 
 
 //-----------------------------------------------------------------------------
@@ -732,6 +837,12 @@ VOID LcReadContigious_Close(_In_ PLC_CONTEXT ctxLC)
 {
     DWORD i;
     PLC_READ_CONTIGIOUS_CONTEXT ctxRC;
+    // idle threads have their finish event set - reset it so that it is only
+    // signalled once the thread has exited its loop.
+    for(i = 0; i < ctxLC->ReadContigious.cThread; i++) {
+        if(!ctxLC->RC.ctx[i] || !ctxLC->RC.ctx[i]->hEventFinish) { break; }
+        ResetEvent(ctxLC->RC.ctx[i]->hEventFinish);
+    }
     ctxLC->RC.fActive = FALSE;
     for(i = 0; i < ctxLC->ReadContigious.cThread; i++) {
         if(!ctxLC->RC.ctx[i] || !ctxLC->RC.ctx[i]->hEventWakeup) { break; }
@@ -1207,6 +1318,12 @@ EXPORTED_FUNCTION BOOL LcCommand(_In_ HANDLE hLC, _In_ QWORD fCommand, _In_ DWOR
     QWORD tmStart = LcCallStart();
     BOOL fResult;
     if(!ctxLC || ctxLC->version != LC_CONTEXT_VERSION) { return FALSE; }
+    if(fCommand == LC_CMD_DUMP_TO_FILE) {
+        // dump to local file - long running; must not hold the lock.
+        fResult = LcDump_ToFile(ctxLC, cbDataIn, pbDataIn);
+        LcCallEnd(ctxLC, LC_STATISTICS_ID_COMMAND, tmStart);
+        return fResult;
+    }
     LcLockAcquire(ctxLC);
     fResult = ctxLC->Config.fRemote ?
         ctxLC->pfnCommand(ctxLC, fCommand, cbDataIn, pbDataIn, ppbDataOut, pcbDataOut) :
@@ -419,6 +419,12 @@ BOOL LcCommand(
 #define LC_OPT_FPGA_CFGSPACE_XILINX                 0x0300008600000000  // RW - [lo-dword: register address in bytes] [bytes: 0-3: data, 4-7: byte_enable(if wr/set); top bit = cfg_mgmt_wr_rw1c_as_rw]
 #define LC_OPT_FPGA_TLP_READ_CB_WITHINFO            0x0300009000000000  // RW - 1/0 call TLP read callback with additional string info in szInfo
 #define LC_OPT_FPGA_TLP_READ_CB_FILTERCPL           0x0300009100000000  // RW - 1/0 call TLP read callback with memory read completions from read calls filtered
+#define LC_OPT_FPGA_UDP_LATENCY                     0x0300009200000000  // R  - RawUDP: average request to first response latency in nS (requires udptimestamp=1).
+#define LC_OPT_FPGA_UDP_LATENCY_MAX                 0x0300009300000000  // R  - RawUDP: max request to first response latency in nS (requires udptimestamp=1).
+
+#define LC_OPT_CACHE_STATISTICS_HIT                 0x0400000100000000  // R - cache:// page reads served from cache file.
+#define LC_OPT_CACHE_STATISTICS_MISS                0x0400000200000000  // R - cache:// page reads forwarded to inner device.
+#define LC_OPT_CACHE_STATISTICS_PAGES               0x0400000300000000  // R - cache:// pages present in cache file.
 
 #define LC_CMD_FPGA_PCIECFGSPACE                    0x0000010300000000  // R
 #define LC_CMD_FPGA_CFGREGPCIE                      0x0000010400000000  // RW - [lo-dword: register address]
@@ -443,14 +449,18 @@ BOOL LcCommand(
 #define LC_CMD_FPGA_BAR_FUNCTION_CALLBACK           0x2000012200000000  // W - set/unset BAR callback function (pbDataIn == PLC_BAR_CALLBACK). [not remote].
 #define LC_CMD_FPGA_BAR_FUNCTION_CALLBACK_RD        0x2000012300000000  // R - get BAR callback function. [not remote].
 #define LC_CMD_FPGA_BAR_INFO                        0x0000012400000000  // R - get BAR info (pbDataOut == LC_BAR_INFO[6]).
+#define LC_CMD_FPGA_AUTOTUNE                        0x0000012500000000  // RW - tune performance profile against target (pbDataIn == LC_FPGA_AUTOTUNE, optional) (pbDataOut == LC_FPGA_AUTOTUNE).
 
 #define LC_CMD_FILE_DUMPHEADER_GET                  0x0000020100000000  // R
+#define LC_CMD_FILE_OVERLAY_SAVE                    0x0000020200000000  // W  - save copy-on-write overlay (cow=1 / overlay=<file>) to file (pbDataIn == LPSTR file name, NULL = overlay file).
+#define LC_CMD_FILE_OVERLAY_DISCARD                 0x0000020300000000  // W  - discard all pages of the copy-on-write overlay.
 
 #define LC_CMD_STATISTICS_GET                       0x4000010000000000  // R
 #define LC_CMD_MEMMAP_GET                           0x4000020000000000  // R  - MEMMAP as LPSTR
 #define LC_CMD_MEMMAP_SET                           0x4000030000000000  // W  - MEMMAP as LPSTR
 #define LC_CMD_MEMMAP_GET_STRUCT                    0x4000040000000000  // R  - MEMMAP as LC_MEMMAP_ENTRY[]
 #define LC_CMD_MEMMAP_SET_STRUCT                    0x4000050000000000  // W  - MEMMAP as LC_MEMMAP_ENTRY[]
+#define LC_CMD_DUMP_TO_FILE                         0x4000060000000000  // W  - dump memory to file (pbDataIn == LC_DUMP_TO_FILE). [not remote].
 
 #define LC_CMD_AGENT_EXEC_PYTHON                    0x8000000100000000  // RW - [lo-dword: optional timeout in ms]
 #define LC_CMD_AGENT_EXIT_PROCESS                   0x8000000200000000  //    - [lo-dword: process exit code]
@@ -525,6 +535,55 @@ typedef struct tdLC_MEMMAP_ENTRY {
     QWORD paRemap;
 } LC_MEMMAP_ENTRY, *PLC_MEMMAP_ENTRY;
 
+#define LC_DUMP_TO_FILE_VERSION         0xdd010002
+#define LC_DUMP_FORMAT_RAW              0   // raw file; file offset == physical address.
+#define LC_DUMP_FORMAT_ELF              1   // ELF64 core dump; one PT_LOAD segment per memory map range.
+#define LC_DUMP_FORMAT_CRASHDUMP        2   // Microsoft 64-bit full crash dump (max 0x80 memory map ranges).
+#define LC_DUMP_FORMAT_DELTA            3   // delta snapshot; only pages changed since szBaseFileName are stored.
+#define LC_DUMP_FORMAT_DEDUP            4   // deduplicated snapshot; unique pages are stored once in page store szBaseFileName.
+#define LC_DUMP_FLAG_NO_MEMMAP_FILE     0x00000001  // do not write the <file>.memmap sidecar file.
+#define LC_DUMP_FLAG_NO_JOURNAL         0x00000002  // do not write the <file>.lcjournal resume journal.
+#define LC_DUMP_FLAG_RESUME             0x00000004  // resume an interrupted dump from its <file>.lcjournal.
+
+/*
+* Progress counters of an ongoing LC_CMD_DUMP_TO_FILE. The counters are
+* updated by the dump writer and may be polled by another thread. The dump is
+* aborted if fAbort is set by the caller.
+*/
+typedef struct tdLC_DUMP_PROGRESS {
+    QWORD cbTotal;          // total number of bytes to dump.
+    QWORD cbRead;           // bytes processed (read successfully or failed).
+    QWORD cbFail;           // bytes which failed to read (sparse in output).
+    QWORD cbWritten;        // bytes written to output file.
+    BOOL fCompleted;
+    BOOL fAbort;
+} LC_DUMP_PROGRESS, *PLC_DUMP_PROGRESS;
+
+/*
+* Dump physical memory to file. Used with LC_CMD_DUMP_TO_FILE.
+* The memory map (if any) is honored; otherwise memory is dumped up to the max
+* address of the device. Unreadable memory is left as holes in the output.
+* Delta snapshots (LC_DUMP_FORMAT_DELTA) store the pages which differ from the
+* base snapshot szBaseFileName - a raw/crash/elf dump or another delta file.
+* If no base snapshot is given all readable pages are stored. Delta snapshots
+* are opened by the file device together with their chain of base snapshots.
+* Deduplicated snapshots (LC_DUMP_FORMAT_DEDUP) store a page map referring to
+* the pages of the page store szBaseFileName (default: <szFileName>.lcstore)
+* which may be shared between many snapshots. Pages not already in the store
+* are appended to it. A page store must not be written by concurrent dumps.
+*/
+typedef struct tdLC_DUMP_TO_FILE {
+    DWORD dwVersion;        // LC_DUMP_TO_FILE_VERSION
+    DWORD tpFormat;         // LC_DUMP_FORMAT_*
+    DWORD dwFlags;          // LC_DUMP_FLAG_*
+    DWORD _Reserved;
+    QWORD paMin;            // min physical address to dump.
+    QWORD paMax;            // max physical address to dump (0 = no limit).
+    PLC_DUMP_PROGRESS pProgress;    // optional progress counters.
+    CHAR szFileName[MAX_PATH];
+    CHAR szBaseFileName[MAX_PATH];  // LC_DUMP_FORMAT_DELTA: base snapshot (optional). LC_DUMP_FORMAT_DEDUP: page store (optional).
+} LC_DUMP_TO_FILE, *PLC_DUMP_TO_FILE;
+
 typedef enum tdLC_ARCH_TP {
     LC_ARCH_NA      = 0,
     LC_ARCH_X86     = 1,
@@ -610,6 +669,44 @@ typedef VOID(*PLC_BAR_FUNCTION_CALLBACK)(_Inout_ PLC_BAR_REQUEST pBarRequest);
 #define LC_BAR_FUNCTION_CALLBACK_ZEROBAR        (PLC_BAR_FUNCTION_CALLBACK)(-1)
 
 
+
+//-----------------------------------------------------------------------------
+// FPGA PERFORMANCE PROFILE AUTOTUNE SUPPORT:
+//-----------------------------------------------------------------------------
+
+#define LC_FPGA_AUTOTUNE_VERSION        0xfa7e0001
+#define LC_FPGA_AUTOTUNE_FLAG_NOSAVE    0x00000001      // do not persist the best profile to the profile store.
+
+/*
+* Autotune request/result used with command LC_CMD_FPGA_AUTOTUNE. Read-only
+* test reads are made from the physical address range [paBase, cPages). Pages
+* unreadable with the initial profile are excluded from the error rate.
+* The best profile found is applied and persisted keyed by FPGA ID, device ID
+* and PCIe link gen/width. It's loaded on open with device parameter autotune.
+*/
+typedef struct tdLC_FPGA_AUTOTUNE {
+    DWORD dwVersion;            // LC_FPGA_AUTOTUNE_VERSION
+    DWORD dwFlags;              // LC_FPGA_AUTOTUNE_FLAG_*
+    QWORD paBase;               // test range physical base address (0 = default 0x01000000).
+    DWORD cPages;               // test range size in 4kB pages (0 = default 0x1000).
+    DWORD cCandidates;          // [out] number of profiles measured.
+    DWORD dwThroughputInitial;  // [out] initial profile throughput in kB/s.
+    DWORD dwThroughput;         // [out] best profile throughput in kB/s.
+    DWORD dwErrorPPM;           // [out] best profile failed page reads per million.
+    DWORD dwLatencyUs;          // [out] best profile single page read latency in uS.
+    DWORD dwMaxSizeRx;          // [out] best profile - LC_OPT_FPGA_MAX_SIZE_RX
+    DWORD dwMaxSizeTx;          // [out] best profile - LC_OPT_FPGA_MAX_SIZE_TX
+    DWORD dwDelayRead;          // [out] best profile - LC_OPT_FPGA_DELAY_READ
+    DWORD dwDelayWrite;         // [out] best profile - LC_OPT_FPGA_DELAY_WRITE
+    DWORD dwRetryOnError;       // [out] best profile - LC_OPT_FPGA_RETRY_ON_ERROR
+    DWORD fTiny;                // [out] best profile - LC_OPT_FPGA_ALGO_TINY
+    DWORD dwAsyncMaxReadSize;   // [out] best profile - async read size.
+    DWORD dwAsyncDelay1;        // [out] best profile - async delay #1 in uS.
+    DWORD dwAsyncDelay2;        // [out] best profile - async delay #2 in uS.
+    DWORD _Reserved;
+} LC_FPGA_AUTOTUNE, *PLC_FPGA_AUTOTUNE;
+
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -10,6 +10,143 @@
 #include "leechcore.h"
 #include "leechcore_device.h"
 
+/*
+* ELF core dump headers. Used by the file device (ELF core dumps such as
+* VirtualBox .core dump files) and by the kcore device (/proc/kcore).
+*/
+#define ELF_EI_MAGIC            0x464c457f
+#define ELF_EI_CLASSDATA_32     0x0101
+#define ELF_EI_CLASSDATA_64     0x0102
+#define ELF_ET_CORE             0x04
+#define ELF_ET_VERSION          0x01
+#define ELF_PHDR_OFFSET_32      0x34
+#define ELF_PHDR_OFFSET_64      0x40
+#define ELF_PT_LOAD             0x00000001
+
+typedef struct tdElf32_Phdr {
+    DWORD p_type;
+    DWORD p_offset;
+    DWORD p_vaddr;
+    DWORD p_paddr;
+    DWORD p_filesz;
+    DWORD p_memsz;
+    DWORD p_flags;
+    DWORD p_align;
+} Elf32_Phdr, *PElf32_Phdr;
+
+typedef struct tdElf64_Phdr {
+    DWORD p_type;
+    DWORD p_flags;
+    QWORD p_offset;
+    QWORD p_vaddr;
+    QWORD p_paddr;
+    QWORD p_filesz;
+    QWORD p_memsz;
+    QWORD p_align;
+} Elf64_Phdr, *PElf64_Phdr;
+
+typedef struct tdElf32_Ehdr {
+    unsigned char e_ident[16];
+    WORD e_type;
+    WORD e_machine;
+    DWORD e_version;
+    DWORD e_entry;
+    DWORD e_phoff;
+    DWORD e_shoff;
+    DWORD e_flags;
+    WORD e_ehsize;
+    WORD e_phentsize;
+    WORD e_phnum;
+    WORD e_shentsize;
+    WORD e_shnum;
+    WORD e_shstrndx;
+    Elf32_Phdr Phdr[];
+} Elf32_Ehdr, *PElf32_Ehdr;
+
+typedef struct tdElf64_Ehdr {
+    unsigned char e_ident[16];
+    WORD e_type;
+    WORD e_machine;
+    DWORD e_version;
+    QWORD e_entry;
+    QWORD e_phoff;
+    QWORD e_shoff;
+    DWORD e_flags;
+    WORD e_ehsize;
+    WORD e_phentsize;
+    WORD e_phnum;
+    WORD e_shentsize;
+    WORD e_shnum;
+    WORD e_shstrndx;
+    Elf64_Phdr Phdr[];
+} Elf64_Ehdr, *PElf64_Ehdr;
+
+#define LC_DELTA_MAGIC                  0x544c444c      // 'LDLT'
+#define LC_DELTA_VERSION                1
+#define LC_DELTA_PAGE_DATA_OFFSET       0x1000
+
+/*
+* Header of a delta snapshot file (LC_DUMP_FORMAT_DELTA). A delta snapshot
+* stores only the pages which differ from its parent snapshot. The stored
+* pages follow the header in ascending pfn order. The stored page bitmap and
+* the page hash table (one QWORD per pfn, zero if the page was not present or
+* unreadable) are located after the page data.
+*/
+typedef struct tdLC_DELTA_HEADER {
+    DWORD dwMagic;
+    DWORD dwVersion;
+    QWORD cPfn;                     // number of pfns covered by bitmap and hash table
+    QWORD cPageStored;
+    QWORD oPageData;                // file offset of stored pages
+    QWORD oBitmap;                  // file offset of stored page bitmap (cPfn rounded up to 512 bits)
+    QWORD oHash;                    // file offset of page hash table
+    DWORD tpArch;                   // LC_ARCH_TP
+    DWORD _Reserved;
+    CHAR szParent[MAX_PATH];        // parent snapshot file name (empty = no parent)
+} LC_DELTA_HEADER, *PLC_DELTA_HEADER;
+
+#define LC_DEDUP_MAGIC                  0x4d44444c      // 'LDDM'
+#define LC_DEDUP_STORE_MAGIC            0x5344444c      // 'LDDS'
+#define LC_DEDUP_VERSION                1
+#define LC_DEDUP_MAP_OFFSET             0x1000
+#define LC_DEDUP_PAGE_NONE              0xffffffff      // page map: page not present or unreadable
+#define LC_DEDUP_PAGE_ZERO              0xfffffffe      // page map: all-zero page (not stored)
+#define LC_DEDUP_PAGE_MAX               0xfffffff0
+#define LC_DEDUP_STORE_GROUP_PAGES      0x200
+#define LC_DEDUP_STORE_GROUP_SIZE       ((1 + LC_DEDUP_STORE_GROUP_PAGES) << 12)
+#define LC_DEDUP_STORE_HASH_OFFSET(id)  (0x1000 + ((QWORD)(id) >> 9) * LC_DEDUP_STORE_GROUP_SIZE)
+#define LC_DEDUP_STORE_PAGE_OFFSET(id)  (LC_DEDUP_STORE_HASH_OFFSET(id) + 0x1000 + (((QWORD)(id) & 0x1ff) << 12))
+
+/*
+* Header of a deduplicating page store. Each unique page is stored once and is
+* identified by its page id. Pages are stored in groups of 512 pages, each
+* group is preceded by a 4kB block holding the hashes of its pages. The store
+* grows by appending pages - cPage is updated last once new pages are synced.
+*/
+typedef struct tdLC_DEDUP_STORE_HEADER {
+    DWORD dwMagic;
+    DWORD dwVersion;
+    QWORD qwStoreId;                // random store id - recorded in snapshots using the store
+    QWORD cPage;                    // number of stored pages
+} LC_DEDUP_STORE_HEADER, *PLC_DEDUP_STORE_HEADER;
+
+/*
+* Header of a deduplicated snapshot file (LC_DUMP_FORMAT_DEDUP). The snapshot
+* holds a page map (one DWORD page id per pfn, or LC_DEDUP_PAGE_NONE/ZERO)
+* which refers to the pages of a page store shared between snapshots.
+*/
+typedef struct tdLC_DEDUP_HEADER {
+    DWORD dwMagic;
+    DWORD dwVersion;
+    QWORD cPfn;                     // number of pfns covered by page map
+    QWORD oMap;                     // file offset of page map
+    QWORD qwStoreId;
+    QWORD cPageStore;               // number of pages in store when snapshot was completed
+    DWORD tpArch;                   // LC_ARCH_TP
+    DWORD _Reserved;
+    CHAR szStore[MAX_PATH];         // page store file name
+} LC_DEDUP_HEADER, *PLC_DEDUP_HEADER;
+
 /*
 * Translate each individual MEM. The qwA field will be overwritten with the
 * translated value - or on error -1.
@@ -62,4 +199,31 @@ BOOL LcMemMap_SetRangesFromStruct(_In_ PLC_CONTEXT ctxLC, _In_ PLC_MEMMAP_ENTRY
 _Success_(return)
 BOOL LcMemMap_SetRangesFromText(_In_ PLC_CONTEXT ctxLC, _In_ PBYTE pb, _In_ DWORD cb);
 
+/*
+* Open the inner device of a wrapper device such as cache:// or record://.
+* The inner device string is the wrapper device string without its prefix and
+* without the wrapper specific parameters. The memory map of the inner device
+* is mirrored 1:1 into the wrapper device.
+* CALLER LcClose: return
+* -- ctxLC = the wrapper device.
+* -- cszParameter
+* -- pszParameter = names of the wrapper specific parameters.
+* -- pLcConfigInner = receives the configuration of the inner device.
+* -- ppLcCreateErrorInfo
+* -- return = handle to the inner device, NULL on failure.
+*/
+_Success_(return != NULL)
+HANDLE LcCreate_WrapperInnerDevice(_Inout_ PLC_CONTEXT ctxLC, _In_ DWORD cszParameter, _In_reads_(cszParameter) LPSTR *pszParameter, _Out_ PLC_CONFIG pLcConfigInner, _Out_opt_ PPLC_CONFIG_ERRORINFO ppLcCreateErrorInfo);
+
+/*
+* Dump the physical memory of a device to file - LC_CMD_DUMP_TO_FILE.
+* The dump is done in the calling thread without holding the LeechCore lock.
+* -- ctxLC
+* -- cbDataIn
+* -- pbDataIn = PLC_DUMP_TO_FILE
+* -- return
+*/
+_Success_(return)
+BOOL LcDump_ToFile(_In_ PLC_CONTEXT ctxLC, _In_ DWORD cbDataIn, _In_reads_opt_(cbDataIn) PBYTE pbDataIn);
+
 #endif /* __LEECHCORE_INTERNAL_H__ */
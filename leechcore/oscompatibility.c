@@ -406,40 +406,51 @@ HANDLE CreateEvent(_In_opt_ PVOID lpEventAttributes, _In_ BOOL bManualReset, _In
     return pi;
 }
 
-// function is limited and not thread-safe, but use case in leechcore is single-threaded
+// function is limited (no timeout support). Waiting on a manual-reset event
+// does not reset it, waiting on an auto-reset event consumes the signal.
 DWORD WaitForSingleObject(_In_ HANDLE hHandle, _In_ DWORD dwMilliseconds)
 {
     PHANDLE_INTERNAL hi = (PHANDLE_INTERNAL)hHandle;
     uint64_t v;
+    struct pollfd fds[1];
+    if(hi->fEventManualReset) {
+        fds[0].fd = hi->handle;
+        fds[0].events = POLLIN;
+        while((poll(fds, 1, -1) <= 0) || !(fds[0].revents & POLLIN));
+        return WAIT_OBJECT_0;
+    }
     read(hi->handle, &v, sizeof(v));
-    return 0;
+    return WAIT_OBJECT_0;
 }
 
-// function is limited and not thread-safe, but use case in leechcore is single-threaded
+// function is limited (no timeout support), see WaitForSingleObject.
 DWORD WaitForMultipleObjects(_In_ DWORD nCount, HANDLE *lpHandles, _In_ BOOL bWaitAll, _In_ DWORD dwMilliseconds)
 {
     struct pollfd fds[MAXIMUM_WAIT_OBJECTS];
     DWORD i;
     uint64_t v;
+    if(!nCount || (nCount > MAXIMUM_WAIT_OBJECTS)) { return WAIT_FAILED; }
     if(bWaitAll) {
         for(i = 0; i < nCount; i++) {
             WaitForSingleObject(lpHandles[i], dwMilliseconds);
         }
-        return -1;
+        return WAIT_OBJECT_0;
     }
     for(i = 0; i < nCount; i++) {
         fds[i].fd = ((PHANDLE_INTERNAL)lpHandles[i])->handle;
         fds[i].events = POLLIN;
     }
-    if(poll(fds, 1, -1) > 0) {
+    if(poll(fds, nCount, -1) > 0) {
         for(i = 0; i < nCount; i++) {
-            if((fds[0].revents & POLLIN)) {
-                read(fds[i].fd, &v, sizeof(v));
-                return i;
+            if(fds[i].revents & POLLIN) {
+                if(!((PHANDLE_INTERNAL)lpHandles[i])->fEventManualReset) {
+                    read(fds[i].fd, &v, sizeof(v));
+                }
+                return WAIT_OBJECT_0 + i;
             }
         }
     }
-    return -1;
+    return WAIT_FAILED;
 }
 
 #endif /* LINUX */
@@ -14,6 +14,7 @@
 #include <winusb.h>
 #include <setupapi.h>
 #include <conio.h>
+#include <sys/stat.h>
 
 #define SOCK_NONBLOCK                       0
 
@@ -31,7 +32,9 @@ VOID usleep(_In_ DWORD us);
 #include <dirent.h>
 #include <dlfcn.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -41,6 +44,7 @@ VOID usleep(_In_ DWORD us);
 #include <sys/eventfd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
@@ -91,6 +95,7 @@ typedef int(*_CoreCrtNonSecureSearchSortCompareFunction)(void const *, void cons
 #define SOCKET_ERROR	                    -1
 #define WSAEWOULDBLOCK                      10035L
 #define WAIT_OBJECT_0                       (0x00000000UL)
+#define WAIT_FAILED                         (0xFFFFFFFFUL)
 #define INFINITE                            (0xFFFFFFFFUL)
 #define MAXIMUM_WAIT_OBJECTS                64
 
@@ -155,10 +160,15 @@ typedef int(*_CoreCrtNonSecureSearchSortCompareFunction)(void const *, void cons
 #define _fseeki64(f, o, w)                  (fseeko64(f, o, w))
 #define _chsize_s(fd, cb)                   (ftruncate64(fd, cb))
 #define _fileno(f)                          (fileno(f))
+#define _stat64                             stat64
+#define _fstat64(fd, s)                     (fstat64(fd, s))
 #define InterlockedAdd64(p, v)              (__sync_add_and_fetch_8(p, v))
 #define InterlockedIncrement64(p)           (__sync_add_and_fetch_8(p, 1))
 #define InterlockedIncrement(p)             (__sync_add_and_fetch_4(p, 1))
 #define InterlockedDecrement(p)             (__sync_sub_and_fetch_4(p, 1))
+#define InterlockedCompareExchange(p, x, c)    (__sync_val_compare_and_swap_4(p, c, x))
+#define InterlockedCompareExchange64(p, x, c)  (__sync_val_compare_and_swap_8(p, c, x))
+#define MemoryBarrier()                     (__sync_synchronize())
 #define GetCurrentProcess()					((HANDLE)-1)
 #define closesocket(s)                      close(s)
 
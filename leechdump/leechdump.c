@@ -0,0 +1,189 @@
+// leechdump.c : command line utility to dump the physical memory of any
+//               LeechCore device to file using LC_CMD_DUMP_TO_FILE.
+//
+// Usage: leechdump -device <device> [-remote <remote>] -out <file>
+//                  [-format raw|elf|crash|delta|dedup] [-base <file>]
+//                  [-min <addr>] [-max <addr>] [-memmap <file>]
+//                  [-nomemmapfile] [-nojournal] [-resume] [-v]
+//
+// (c) Ulf Frisk, 2020-2023
+// Author: Ulf Frisk, pcileech@frizk.net
+//
+#ifdef _WIN32
+#include <Windows.h>
+#include <stdio.h>
+#endif /* _WIN32 */
+#ifdef LINUX
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#define _stricmp(s1, s2)        (strcasecmp(s1, s2))
+#define Sleep(dwMs)             (usleep(1000 * (dwMs)))
+#define TRUE                    1
+#define FALSE                   0
+#endif /* LINUX */
+#include "leechcore.h"
+
+typedef struct tdLEECHDUMP_CONTEXT {
+    HANDLE hLC;
+    LC_DUMP_TO_FILE Req;
+    LC_DUMP_PROGRESS Progress;
+    BOOL fResult;
+    BOOL fFinished;
+} LEECHDUMP_CONTEXT, *PLEECHDUMP_CONTEXT;
+
+VOID LeechDump_Usage()
+{
+    printf(
+        "Usage: leechdump -device <device> [-remote <remote>] -out <file>            \n" \
+        "                 [-format raw|elf|crash|delta|dedup] [-base <file>]         \n" \
+        "                 [-min <addr>] [-max <addr>] [-memmap <file>]               \n" \
+        "                 [-nomemmapfile] [-nojournal] [-resume] [-v]                \n" \
+        "  -format: output file format (default: raw).                               \n" \
+        "  -base: delta format: base snapshot; only changed pages are stored.        \n" \
+        "         dedup format: page store shared between snapshots                  \n" \
+        "         (default: <file>.lcstore).                                         \n" \
+        "  -min/-max: physical address range to dump (hex).                          \n" \
+        "  -memmap: memory map file to use instead of the device memory map.         \n" \
+        "  -nomemmapfile: do not write the <file>.memmap sidecar file.               \n" \
+        "  -nojournal: do not write the <file>.lcjournal resume journal.             \n" \
+        "  -resume: resume an interrupted dump from its <file>.lcjournal.            \n");
+}
+
+/*
+* Dump thread: run the (blocking) dump command.
+* -- ctx
+*/
+#ifdef _WIN32
+DWORD WINAPI LeechDump_ThreadProc(_In_ PLEECHDUMP_CONTEXT ctx)
+#else
+PVOID LeechDump_ThreadProc(_In_ PLEECHDUMP_CONTEXT ctx)
+#endif /* _WIN32 */
+{
+    ctx->fResult = LcCommand(ctx->hLC, LC_CMD_DUMP_TO_FILE, sizeof(LC_DUMP_TO_FILE), (PBYTE)&ctx->Req, NULL, NULL);
+    ctx->fFinished = TRUE;
+    return 0;
+}
+
+/*
+* Load a memory map text file and set it on the device.
+* -- hLC
+* -- szFileName
+* -- return
+*/
+BOOL LeechDump_MemMapLoad(_In_ HANDLE hLC, _In_ LPSTR szFileName)
+{
+    BOOL fResult = FALSE;
+    FILE *hFile = NULL;
+    PBYTE pb = NULL;
+    DWORD cb;
+    if(!(hFile = fopen(szFileName, "rb"))) { return FALSE; }
+    if(!(pb = malloc(0x01000000))) { goto fail; }
+    cb = (DWORD)fread(pb, 1, 0x01000000 - 1, hFile);
+    fResult = cb && LcCommand(hLC, LC_CMD_MEMMAP_SET, cb, pb, NULL, NULL);
+fail:
+    free(pb);
+    fclose(hFile);
+    return fResult;
+}
+
+int main(_In_ int argc, _In_ char* argv[])
+{
+    int i;
+    LC_CONFIG LcConfig = { 0 };
+    PLEECHDUMP_CONTEXT ctx;
+    LPSTR szMemMap = NULL;
+    QWORD cbLast = 0;
+#ifdef LINUX
+    pthread_t hThread;
+#endif /* LINUX */
+    if(!(ctx = calloc(1, sizeof(LEECHDUMP_CONTEXT)))) { return 1; }
+    LcConfig.dwVersion = LC_CONFIG_VERSION;
+    ctx->Req.dwVersion = LC_DUMP_TO_FILE_VERSION;
+    ctx->Req.tpFormat = LC_DUMP_FORMAT_RAW;
+    ctx->Req.pProgress = &ctx->Progress;
+    for(i = 1; i < argc; i++) {
+        if(!_stricmp(argv[i], "-v")) {
+            LcConfig.dwPrintfVerbosity = LC_CONFIG_PRINTF_ENABLED | LC_CONFIG_PRINTF_V;
+        } else if(!_stricmp(argv[i], "-nomemmapfile")) {
+            ctx->Req.dwFlags |= LC_DUMP_FLAG_NO_MEMMAP_FILE;
+        } else if(!_stricmp(argv[i], "-nojournal")) {
+            ctx->Req.dwFlags |= LC_DUMP_FLAG_NO_JOURNAL;
+        } else if(!_stricmp(argv[i], "-resume")) {
+            ctx->Req.dwFlags |= LC_DUMP_FLAG_RESUME;
+        } else if(i + 1 >= argc) {
+            LeechDump_Usage();
+            return 1;
+        } else if(!_stricmp(argv[i], "-device")) {
+            strncpy(LcConfig.szDevice, argv[++i], sizeof(LcConfig.szDevice) - 1);
+        } else if(!_stricmp(argv[i], "-remote")) {
+            strncpy(LcConfig.szRemote, argv[++i], sizeof(LcConfig.szRemote) - 1);
+        } else if(!_stricmp(argv[i], "-out")) {
+            strncpy(ctx->Req.szFileName, argv[++i], sizeof(ctx->Req.szFileName) - 1);
+        } else if(!_stricmp(argv[i], "-min")) {
+            ctx->Req.paMin = strtoull(argv[++i], NULL, 16);
+        } else if(!_stricmp(argv[i], "-max")) {
+            ctx->Req.paMax = strtoull(argv[++i], NULL, 16);
+        } else if(!_stricmp(argv[i], "-base")) {
+            strncpy(ctx->Req.szBaseFileName, argv[++i], sizeof(ctx->Req.szBaseFileName) - 1);
+        } else if(!_stricmp(argv[i], "-memmap")) {
+            szMemMap = argv[++i];
+        } else if(!_stricmp(argv[i], "-format")) {
+            i++;
+            if(!_stricmp(argv[i], "raw")) {
+                ctx->Req.tpFormat = LC_DUMP_FORMAT_RAW;
+            } else if(!_stricmp(argv[i], "elf")) {
+                ctx->Req.tpFormat = LC_DUMP_FORMAT_ELF;
+            } else if(!_stricmp(argv[i], "crash")) {
+                ctx->Req.tpFormat = LC_DUMP_FORMAT_CRASHDUMP;
+            } else if(!_stricmp(argv[i], "delta")) {
+                ctx->Req.tpFormat = LC_DUMP_FORMAT_DELTA;
+            } else if(!_stricmp(argv[i], "dedup")) {
+                ctx->Req.tpFormat = LC_DUMP_FORMAT_DEDUP;
+            } else {
+                LeechDump_Usage();
+                return 1;
+            }
+        } else {
+            LeechDump_Usage();
+            return 1;
+        }
+    }
+    if(!LcConfig.szDevice[0] || !ctx->Req.szFileName[0]) {
+        LeechDump_Usage();
+        return 1;
+    }
+    if(!(ctx->hLC = LcCreate(&LcConfig))) {
+        printf("leechdump: failed to open device '%s'.\n", LcConfig.szDevice);
+        return 1;
+    }
+    if(szMemMap && !LeechDump_MemMapLoad(ctx->hLC, szMemMap)) {
+        printf("leechdump: failed to load memory map '%s'.\n", szMemMap);
+        LcClose(ctx->hLC);
+        return 1;
+    }
+    // run dump in separate thread and report progress:
+#ifdef _WIN32
+    CloseHandle(CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)LeechDump_ThreadProc, ctx, 0, NULL));
+#else
+    pthread_create(&hThread, NULL, (PVOID(*)(PVOID))LeechDump_ThreadProc, ctx);
+#endif /* _WIN32 */
+    while(!ctx->fFinished) {
+        Sleep(500);
+        if(ctx->Progress.cbTotal && (ctx->Progress.cbRead != cbLast)) {
+            cbLast = ctx->Progress.cbRead;
+            printf("\r  %3lli%%  %lli / %lli MB  (unreadable: %lli MB)   ",
+                (cbLast * 100) / ctx->Progress.cbTotal, cbLast >> 20, ctx->Progress.cbTotal >> 20, ctx->Progress.cbFail >> 20);
+            fflush(stdout);
+        }
+    }
+#ifdef LINUX
+    pthread_join(hThread, NULL);
+#endif /* LINUX */
+    printf("\nleechdump: %s: 0x%llx bytes written to '%s'.\n", ctx->fResult ? "completed" : "FAILED", ctx->Progress.cbWritten, ctx->Req.szFileName);
+    LcClose(ctx->hLC);
+    return ctx->fResult ? 0 : 1;
+}